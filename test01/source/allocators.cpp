@@ -0,0 +1,100 @@
+#include "allocators.h"
+#include <algorithm>
+
+// Blocks are aligned for any fundamental type; larger alignments are handled
+// by padding inside the block.
+static const size_t BLOCK_ALIGNMENT = alignof(std::max_align_t);
+
+LinearArena::LinearArena(size_t initialCapacity, MemoryTag tag)
+	: tag(tag), current(0), offset(0), usedBefore(0), peak(0)
+{
+	blocks.push_back(NewBlock(std::max<size_t>(initialCapacity, 256)));
+}
+
+LinearArena::~LinearArena()
+{
+	for (Block &block : blocks)
+		FreeBlock(block);
+}
+
+LinearArena::Block LinearArena::NewBlock(size_t size)
+{
+	// Routed through operator new so MemoryTracker sees the arena's tag.
+	MemoryTagScope tagScope(tag);
+	Block block;
+	block.data = (uint8_t *)::operator new(size, std::align_val_t(BLOCK_ALIGNMENT));
+	block.size = size;
+	return block;
+}
+
+void LinearArena::FreeBlock(Block &block)
+{
+	::operator delete(block.data, std::align_val_t(BLOCK_ALIGNMENT));
+	block.data = nullptr;
+}
+
+void *LinearArena::AllocateSlow(size_t size, size_t alignment)
+{
+	// Blocks past the current one are left over from before a rewind; take
+	// the first that fits before growing.
+	size_t needed = size + alignment;
+	usedBefore += offset;
+	for (uint32_t next = current + 1; next < blocks.size(); next++)
+	{
+		if (blocks[next].size >= needed)
+		{
+			current = next;
+			offset = 0;
+			return Allocate(size, alignment);
+		}
+	}
+
+	// Doubling keeps the number of blocks logarithmic in the high-water mark.
+	blocks.push_back(NewBlock(std::max(needed, blocks.back().size * 2)));
+	current = (uint32_t)blocks.size() - 1;
+	offset = 0;
+	return Allocate(size, alignment);
+}
+
+void LinearArena::Rewind(const Marker &marker)
+{
+	if (marker.block == 0 && marker.offset == 0)
+	{
+		Reset();
+		return;
+	}
+	peak = GetPeak();
+	current = marker.block;
+	offset = marker.offset;
+	usedBefore = marker.usedBefore;
+}
+
+void LinearArena::Reset()
+{
+	peak = GetPeak();
+	if (blocks.size() > 1)
+	{
+		size_t capacity = GetCapacity();
+		for (Block &block : blocks)
+			FreeBlock(block);
+		blocks.clear();
+		blocks.push_back(NewBlock(capacity));
+	}
+	current = 0;
+	offset = 0;
+	usedBefore = 0;
+}
+
+size_t LinearArena::GetCapacity() const
+{
+	size_t capacity = 0;
+	for (const Block &block : blocks)
+		capacity += block.size;
+	return capacity;
+}
+
+LinearArena &GetThreadScratch()
+{
+	static thread_local LinearArena scratch(256 * 1024);
+	return scratch;
+}
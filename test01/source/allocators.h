@@ -0,0 +1,206 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include "memtrack.h"
+
+// Bump allocator over a list of blocks. Allocation is an aligned pointer
+// increment and nothing is freed individually: Rewind drops everything after a
+// marker and Reset drops everything. When the arena has spilled into extra
+// blocks, Reset folds them into one block sized for the high-water mark, so a
+// steady workload settles into a single block and never calls the system
+// allocator. Not thread safe.
+class LinearArena
+{
+public:
+	struct Marker
+	{
+		uint32_t block;
+		size_t offset;
+		size_t usedBefore;
+	};
+
+	explicit LinearArena(size_t initialCapacity = 64 * 1024, MemoryTag tag = MEMTAG_UNTAGGED);
+	~LinearArena();
+
+	LinearArena(const LinearArena &) = delete;
+	LinearArena &operator=(const LinearArena &) = delete;
+
+	void *Allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+	{
+		Block &block = blocks[current];
+		uintptr_t base = (uintptr_t)block.data;
+		uintptr_t aligned = (base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		if (aligned + size <= base + block.size)
+		{
+			offset = aligned + size - base;
+			return (void *)aligned;
+		}
+		return AllocateSlow(size, alignment);
+	}
+
+	// Uninitialized storage for count objects.
+	template <typename T>
+	T *AllocateArray(size_t count)
+	{
+		return (T *)Allocate(count * sizeof(T), alignof(T));
+	}
+
+	// Destructors never run, so this is meant for trivially destructible types.
+	template <typename T, typename... Args>
+	T *New(Args &&...args)
+	{
+		return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	Marker GetMarker() const { return { current, offset, usedBefore }; }
+	void Rewind(const Marker &marker);
+	void Reset();
+
+	// Bytes handed out since the last reset, including alignment padding.
+	size_t GetUsed() const { return usedBefore + offset; }
+	size_t GetPeak() const { return peak > GetUsed() ? peak : GetUsed(); }
+	size_t GetCapacity() const;
+	uint32_t GetBlockCount() const { return (uint32_t)blocks.size(); }
+
+private:
+	struct Block
+	{
+		uint8_t *data;
+		size_t size;
+	};
+
+	void *AllocateSlow(size_t size, size_t alignment);
+	Block NewBlock(size_t size);
+	void FreeBlock(Block &block);
+
+	MemoryTag tag;
+	std::vector<Block> blocks;
+	uint32_t current;
+	size_t offset;
+	size_t usedBefore;	// bytes used in blocks before current
+	size_t peak;
+};
+
+// Per-thread stack of scratch memory for temporaries inside a function.
+// Scopes nest; everything allocated inside a scope is released when it ends.
+LinearArena &GetThreadScratch();
+
+class ScratchScope
+{
+public:
+	ScratchScope() : arena(GetThreadScratch()), marker(arena.GetMarker()) {}
+	~ScratchScope() { arena.Rewind(marker); }
+
+	ScratchScope(const ScratchScope &) = delete;
+	ScratchScope &operator=(const ScratchScope &) = delete;
+
+	LinearArena &GetArena() { return arena; }
+
+	template <typename T>
+	T *AllocateArray(size_t count) { return arena.AllocateArray<T>(count); }
+
+private:
+	LinearArena &arena;
+	LinearArena::Marker marker;
+};
+
+// Fixed-size slots carved out of chunks, with freed slots kept on an intrusive
+// free list. Once warmed up, Create and Destroy never reach the system
+// allocator. Objects still alive when the pool is destroyed are not destructed.
+// Not thread safe.
+template <typename T, size_t SLOTS_PER_CHUNK = 256>
+class ObjectPool
+{
+public:
+	explicit ObjectPool(MemoryTag tag = MEMTAG_UNTAGGED) : tag(tag), freeList(nullptr), liveCount(0) {}
+
+	~ObjectPool()
+	{
+		for (Slot *chunk : chunks)
+			::operator delete(chunk, std::align_val_t(alignof(Slot)));
+	}
+
+	ObjectPool(const ObjectPool &) = delete;
+	ObjectPool &operator=(const ObjectPool &) = delete;
+
+	template <typename... Args>
+	T *Create(Args &&...args)
+	{
+		if (!freeList)
+			AddChunk();
+		Slot *slot = freeList;
+		freeList = slot->next;
+		liveCount++;
+		return new (slot->storage) T(std::forward<Args>(args)...);
+	}
+
+	void Destroy(T *object)
+	{
+		if (!object)
+			return;
+		object->~T();
+		Slot *slot = (Slot *)object;
+		slot->next = freeList;
+		freeList = slot;
+		liveCount--;
+	}
+
+	size_t GetLiveCount() const { return liveCount; }
+	size_t GetCapacity() const { return chunks.size() * SLOTS_PER_CHUNK; }
+
+private:
+	union Slot
+	{
+		Slot *next;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+	void AddChunk()
+	{
+		MemoryTagScope tagScope(tag);
+		Slot *chunk = (Slot *)::operator new(sizeof(Slot) * SLOTS_PER_CHUNK, std::align_val_t(alignof(Slot)));
+		chunks.push_back(chunk);
+		for (size_t i = 0; i < SLOTS_PER_CHUNK; i++)
+			chunk[i].next = i + 1 < SLOTS_PER_CHUNK ? &chunk[i + 1] : freeList;
+		freeList = chunk;
+	}
+
+	MemoryTag tag;
+	std::vector<Slot *> chunks;
+	Slot *freeList;
+	size_t liveCount;
+};
+
+// Standard allocator over a LinearArena, for containers whose contents live no
+// longer than the arena's current frame or scope. deallocate is a no-op, so
+// growth leaves the old storage behind; reserve up front where the size is
+// known.
+template <typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	explicit ArenaAllocator(LinearArena &arena) : arena(&arena) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.GetArena()) {}
+
+	T *allocate(size_t count) { return arena->AllocateArray<T>(count); }
+	void deallocate(T *, size_t) {}
+
+	LinearArena *GetArena() const { return arena; }
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U> &other) const { return arena == other.GetArena(); }
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.GetArena(); }
+
+private:
+	LinearArena *arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
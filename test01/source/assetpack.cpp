@@ -0,0 +1,434 @@
+#include "assetpack.h"
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include "hash.h"
+#include "log.h"
+#include "memtrack.h"
+#include "meshcodec.h"
+#include "profiler.h"
+#include "threadpool.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t PACK_MAGIC = 0x314b5041;	// "APK1"
+static const uint32_t PACK_VERSION = 1;
+static const uint64_t BLOB_ALIGNMENT = 4096;
+
+namespace
+{
+	struct PackHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t assetCount;
+		uint32_t alignment;
+		uint64_t tableOffset;
+		uint64_t namesOffset;
+		uint64_t namesSize;
+		uint64_t fileSize;
+		uint8_t reserved[16];
+	};
+
+	static_assert(sizeof(PackHeader) == 64, "pack header is 64 bytes");
+
+	bool EntryLess(const AssetPackEntry &a, const AssetPackEntry &b)
+	{
+		return a.nameHash < b.nameHash;
+	}
+}
+
+const char *GetAssetCompressionName(AssetCompression compression)
+{
+	switch (compression)
+	{
+	case ASSET_COMPRESSION_NONE: return "none";
+	case ASSET_COMPRESSION_LZ: return "lz";
+	case ASSET_COMPRESSION_MESH: return "mesh";
+	default: return "unknown";
+	}
+}
+
+const char *GetAssetReadModeName(AssetReadMode mode)
+{
+	return mode == ASSET_READ_PREAD ? "pread" : "mapped";
+}
+
+AssetPackWriter::AssetPackWriter()
+	: file(nullptr), position(0), storedBytes(0), assetBytes(0)
+{
+}
+
+AssetPackWriter::~AssetPackWriter()
+{
+	Abort();
+}
+
+bool AssetPackWriter::Open(const std::string &path)
+{
+	Abort();
+	this->path = path;
+	entries.clear();
+	names.clear();
+	storedBytes = 0;
+	assetBytes = 0;
+	file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		LOG_ERROR(LOG_CATEGORY_ASSETS, "Could not create asset pack %s", path);
+		return false;
+	}
+	// The header goes in last, once the table offset is known.
+	PackHeader header = {};
+	position = 0;
+	return WriteAll(&header, sizeof(header));
+}
+
+bool AssetPackWriter::Add(const std::string &name, const void *data, size_t size, AssetCompression compression)
+{
+	if (compression == ASSET_COMPRESSION_LZ)
+	{
+		scratch.clear();
+		LzCompress((const uint8_t *)data, size, scratch);
+		if (scratch.size() < size)
+			return AddStored(name, scratch.data(), scratch.size(), size, ASSET_COMPRESSION_LZ);
+	}
+	return AddStored(name, data, size, size, ASSET_COMPRESSION_NONE);
+}
+
+bool AssetPackWriter::AddMeshStream(const std::string &name, const void *data, size_t count, size_t stride, size_t laneSize)
+{
+	size_t size = count * stride;
+	scratch.clear();
+	EncodeMeshStream(data, count, stride, laneSize, scratch);
+	if (scratch.size() < size)
+		return AddStored(name, scratch.data(), scratch.size(), size, ASSET_COMPRESSION_MESH);
+	return AddStored(name, data, size, size, ASSET_COMPRESSION_NONE);
+}
+
+bool AssetPackWriter::AddStored(const std::string &name, const void *stored, size_t storedSize, size_t size, AssetCompression compression)
+{
+	if (!file || name.size() > 0xffff)
+		return false;
+	static const uint8_t zeros[BLOB_ALIGNMENT] = {};
+	uint64_t padding = (BLOB_ALIGNMENT - position % BLOB_ALIGNMENT) % BLOB_ALIGNMENT;
+	if (!WriteAll(zeros, (size_t)padding))
+		return false;
+
+	AssetPackEntry entry = {};
+	entry.nameHash = HashBytes(name.data(), name.size());
+	entry.offset = position;
+	entry.storedSize = storedSize;
+	entry.size = size;
+	entry.nameOffset = (uint32_t)names.size();
+	entry.nameLength = (uint16_t)name.size();
+	entry.compression = (uint8_t)compression;
+	if (!WriteAll(stored, storedSize))
+		return false;
+	entries.push_back(entry);
+	names += name;
+	storedBytes += storedSize;
+	assetBytes += size;
+	return true;
+}
+
+bool AssetPackWriter::Finish()
+{
+	if (!file)
+		return false;
+	std::stable_sort(entries.begin(), entries.end(), EntryLess);
+	for (size_t i = 1; i < entries.size(); i++)
+	{
+		const AssetPackEntry &a = entries[i - 1], &b = entries[i];
+		if (a.nameHash == b.nameHash && a.nameLength == b.nameLength &&
+			names.compare(a.nameOffset, a.nameLength, names, b.nameOffset, b.nameLength) == 0)
+		{
+			LOG_ERROR(LOG_CATEGORY_ASSETS, "Asset %s added to %s twice", names.substr(a.nameOffset, a.nameLength), path);
+			Abort();
+			return false;
+		}
+	}
+
+	PackHeader header = {};
+	header.magic = PACK_MAGIC;
+	header.version = PACK_VERSION;
+	header.assetCount = (uint32_t)entries.size();
+	header.alignment = (uint32_t)BLOB_ALIGNMENT;
+	static const uint8_t zeros[8] = {};
+	if (!WriteAll(zeros, (size_t)((8 - position % 8) % 8)))
+		return false;
+	header.tableOffset = position;
+	if (!WriteAll(entries.data(), entries.size() * sizeof(AssetPackEntry)))
+		return false;
+	header.namesOffset = position;
+	header.namesSize = names.size();
+	if (!WriteAll(names.data(), names.size()))
+		return false;
+	header.fileSize = position;
+
+	bool ok = fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = fclose(file) == 0 && ok;
+	file = nullptr;
+	if (!ok)
+		LOG_ERROR(LOG_CATEGORY_ASSETS, "Could not finish asset pack %s", path);
+	return ok;
+}
+
+bool AssetPackWriter::WriteAll(const void *data, size_t size)
+{
+	if (size && fwrite(data, 1, size, file) != size)
+	{
+		LOG_ERROR(LOG_CATEGORY_ASSETS, "Could not write to asset pack %s", path);
+		Abort();
+		return false;
+	}
+	position += size;
+	return true;
+}
+
+// Drops a half written pack rather than leave one with an empty header.
+void AssetPackWriter::Abort()
+{
+	if (!file)
+		return;
+	fclose(file);
+	file = nullptr;
+	remove(path.c_str());
+}
+
+AssetPack::AssetPack()
+	:
+#ifdef _WIN32
+	file(INVALID_HANDLE_VALUE), mapping(nullptr),
+#else
+	fd(-1),
+#endif
+	mapped(nullptr), mappedSize(0), entries(nullptr), names(nullptr), assetCount(0)
+{
+}
+
+AssetPack::~AssetPack()
+{
+	Close();
+}
+
+bool AssetPack::Open(const std::string &path)
+{
+	PROFILE_FUNCTION();
+	Close();
+#ifdef _WIN32
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	LARGE_INTEGER fileSize = {};
+	if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(PackHeader))
+	{
+		LOG_ERROR(LOG_CATEGORY_ASSETS, "Could not open asset pack %s", path);
+		Close();
+		return false;
+	}
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	mapped = mapping ? (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	mappedSize = (size_t)fileSize.QuadPart;
+#else
+	fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat status;
+	if (fd < 0 || fstat(fd, &status) != 0 || status.st_size < (off_t)sizeof(PackHeader))
+	{
+		LOG_ERROR(LOG_CATEGORY_ASSETS, "Could not open asset pack %s", path);
+		Close();
+		return false;
+	}
+	void *address = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	mapped = address != MAP_FAILED ? (const uint8_t *)address : nullptr;
+	mappedSize = (size_t)status.st_size;
+#endif
+	if (!mapped)
+	{
+		LOG_ERROR(LOG_CATEGORY_ASSETS, "Could not map asset pack %s", path);
+		Close();
+		return false;
+	}
+
+	PackHeader header;
+	memcpy(&header, mapped, sizeof(header));
+	uint64_t tableSize = (uint64_t)header.assetCount * sizeof(AssetPackEntry);
+	bool valid = header.magic == PACK_MAGIC && header.version == PACK_VERSION && header.fileSize == mappedSize &&
+		header.tableOffset % 8 == 0 && header.tableOffset >= sizeof(PackHeader) && header.tableOffset <= mappedSize &&
+		tableSize <= mappedSize - header.tableOffset && header.namesOffset >= header.tableOffset + tableSize &&
+		header.namesOffset <= mappedSize && header.namesSize <= mappedSize - header.namesOffset;
+	if (valid)
+	{
+		entries = (const AssetPackEntry *)(mapped + header.tableOffset);
+		names = (const char *)(mapped + header.namesOffset);
+		for (uint32_t i = 0; i < header.assetCount && valid; i++)
+		{
+			const AssetPackEntry &entry = entries[i];
+			valid = entry.offset >= sizeof(PackHeader) && entry.offset <= header.tableOffset &&
+				entry.storedSize <= header.tableOffset - entry.offset &&
+				(uint64_t)entry.nameOffset + entry.nameLength <= header.namesSize &&
+				entry.compression < ASSET_COMPRESSION_COUNT &&
+				(entry.compression != ASSET_COMPRESSION_NONE || entry.storedSize == entry.size) &&
+				(i == 0 || entries[i - 1].nameHash <= entry.nameHash);
+		}
+	}
+	if (!valid)
+	{
+		LOG_ERROR(LOG_CATEGORY_ASSETS, "%s is not a valid asset pack", path);
+		Close();
+		return false;
+	}
+	assetCount = header.assetCount;
+	LOG_DEBUG(LOG_CATEGORY_ASSETS, "Opened asset pack %s: %u assets, %.1f MB", path, assetCount, mappedSize / 1048576.0);
+	return true;
+}
+
+void AssetPack::Close()
+{
+#ifdef _WIN32
+	if (mapped)
+		UnmapViewOfFile(mapped);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (mapped)
+		munmap((void *)mapped, mappedSize);
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+#endif
+	mapped = nullptr;
+	mappedSize = 0;
+	entries = nullptr;
+	names = nullptr;
+	assetCount = 0;
+}
+
+std::string AssetPack::GetName(uint32_t index) const
+{
+	return std::string(names + entries[index].nameOffset, entries[index].nameLength);
+}
+
+uint32_t AssetPack::Find(const std::string &name) const
+{
+	AssetPackEntry key = {};
+	key.nameHash = HashBytes(name.data(), name.size());
+	const AssetPackEntry *end = entries + assetCount;
+	for (const AssetPackEntry *entry = std::lower_bound(entries, end, key, EntryLess);
+		entry != end && entry->nameHash == key.nameHash; entry++)
+	{
+		if (entry->nameLength == name.size() && memcmp(names + entry->nameOffset, name.data(), name.size()) == 0)
+			return (uint32_t)(entry - entries);
+	}
+	return INVALID_ASSET;
+}
+
+bool AssetPack::ReadStored(const AssetPackEntry &entry, uint8_t *destination) const
+{
+	return ReadFileAt(GetFile(), entry.offset, destination, (size_t)entry.storedSize);
+}
+
+bool AssetPack::DecodeAsset(const AssetPackEntry &entry, const uint8_t *stored, std::vector<uint8_t> &out)
+{
+	MEMORY_TAG(MEMTAG_ASSETS);
+	size_t size = (size_t)entry.size;
+	switch (entry.compression)
+	{
+	case ASSET_COMPRESSION_NONE:
+		out.assign(stored, stored + size);
+		return true;
+	case ASSET_COMPRESSION_LZ:
+	{
+		out.resize(size + LZ_DECOMPRESS_SLACK);
+		bool ok = LzDecompress(stored, (size_t)entry.storedSize, out.data(), size);
+		out.resize(size);
+		return ok;
+	}
+	case ASSET_COMPRESSION_MESH:
+		out.resize(size);
+		return DecodeMeshStream(stored, (size_t)entry.storedSize, out.data(), size);
+	default:
+		return false;
+	}
+}
+
+bool AssetPack::Load(uint32_t index, std::vector<uint8_t> &out, AssetReadMode mode) const
+{
+	std::vector<uint8_t> scratch;
+	return LoadWith(index, out, mode, scratch);
+}
+
+bool AssetPack::LoadWith(uint32_t index, std::vector<uint8_t> &out, AssetReadMode mode, std::vector<uint8_t> &scratch) const
+{
+	if (index >= assetCount)
+		return false;
+	const AssetPackEntry &entry = entries[index];
+	if (mode == ASSET_READ_MAPPED)
+		return DecodeAsset(entry, mapped + entry.offset, out);
+	if (entry.compression == ASSET_COMPRESSION_NONE)
+	{
+		MEMORY_TAG(MEMTAG_ASSETS);
+		out.resize((size_t)entry.size);
+		return ReadStored(entry, out.data());
+	}
+	scratch.resize((size_t)entry.storedSize);
+	return ReadStored(entry, scratch.data()) && DecodeAsset(entry, scratch.data(), out);
+}
+
+size_t AssetPack::LoadBatch(const uint32_t *indices, size_t count, std::vector<uint8_t> *outputs, AssetReadMode mode,
+	ThreadPool *pool) const
+{
+	PROFILE_FUNCTION();
+#ifndef _WIN32
+	if (mode == ASSET_READ_MAPPED && count > 0)
+	{
+		// Start readahead for the whole span up front, rather than take a
+		// synchronous fault every few pages.
+		uint64_t begin = ~0ull, end = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (indices[i] >= assetCount)
+				continue;
+			begin = std::min(begin, entries[indices[i]].offset);
+			end = std::max(end, entries[indices[i]].offset + entries[indices[i]].storedSize);
+		}
+		if (begin < end)
+		{
+			begin &= ~(BLOB_ALIGNMENT - 1);
+			madvise((void *)(mapped + begin), (size_t)(end - begin), MADV_WILLNEED);
+		}
+	}
+#endif
+
+	if (!pool || pool->GetWorkerCount() == 0 || count < 2)
+	{
+		std::vector<uint8_t> scratch;
+		size_t failed = 0;
+		for (size_t i = 0; i < count; i++)
+			failed += !LoadWith(indices[i], outputs[i], mode, scratch);
+		return failed;
+	}
+
+	size_t taskCount = std::min<size_t>(pool->GetWorkerCount(), count);
+	std::atomic<size_t> failed(0);
+	pool->Run((unsigned)taskCount, [&](unsigned t)
+	{
+		std::vector<uint8_t> scratch;
+		size_t taskFailed = 0;
+		for (size_t i = t; i < count; i += taskCount)
+			taskFailed += !LoadWith(indices[i], outputs[i], mode, scratch);
+		failed.fetch_add(taskFailed);
+	});
+	return failed.load();
+}
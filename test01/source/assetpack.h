@@ -0,0 +1,160 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "fileio.h"
+
+class ThreadPool;
+
+enum AssetCompression
+{
+	ASSET_COMPRESSION_NONE,
+	ASSET_COMPRESSION_LZ,	// LzCompress over the whole asset
+	ASSET_COMPRESSION_MESH,	// an EncodeMeshStream stream
+	ASSET_COMPRESSION_COUNT
+};
+
+const char *GetAssetCompressionName(AssetCompression compression);
+
+// One table of contents entry. The table is sorted by nameHash, so lookups
+// are a binary search over the mapped file with no parsing at open.
+struct AssetPackEntry
+{
+	uint64_t nameHash;	// HashBytes of the name
+	uint64_t offset;
+	uint64_t storedSize;
+	uint64_t size;	// after decompression
+	uint32_t nameOffset;	// into the name table
+	uint16_t nameLength;
+	uint8_t compression;	// AssetCompression
+	uint8_t reserved;
+};
+
+static_assert(sizeof(AssetPackEntry) == 40, "AssetPackEntry is part of the file format");
+
+// Many assets in one file, so loading them costs one open and a few large
+// reads instead of a file system round trip per asset.
+//
+// Layout (little endian):
+//   header  64 bytes: magic "APK1", version, asset count, blob alignment,
+//           table offset, name table offset and size, file size
+//   blobs   each starting on a 4 KB boundary
+//   table   AssetPackEntry per asset, sorted by name hash
+//   names   the asset names back to back, not terminated
+//
+// Names are written once and never parsed again; they only settle hash
+// collisions and are there for tools.
+class AssetPackWriter
+{
+public:
+	AssetPackWriter();
+	~AssetPackWriter();
+
+	AssetPackWriter(const AssetPackWriter &) = delete;
+	AssetPackWriter &operator=(const AssetPackWriter &) = delete;
+
+	bool Open(const std::string &path);
+
+	// Assets that do not get smaller are stored uncompressed, whatever was
+	// asked for. ASSET_COMPRESSION_MESH needs AddMeshStream.
+	bool Add(const std::string &name, const void *data, size_t size, AssetCompression compression);
+	bool AddMeshStream(const std::string &name, const void *data, size_t count, size_t stride, size_t laneSize);
+
+	// Writes the table and closes the file. Fails on duplicate names.
+	bool Finish();
+
+	size_t GetAssetCount() const { return entries.size(); }
+	uint64_t GetStoredBytes() const { return storedBytes; }
+	uint64_t GetAssetBytes() const { return assetBytes; }
+
+private:
+	bool AddStored(const std::string &name, const void *stored, size_t storedSize, size_t size, AssetCompression compression);
+	bool WriteAll(const void *data, size_t size);
+	void Abort();
+
+	FILE *file;
+	std::string path;
+	uint64_t position;
+	std::vector<AssetPackEntry> entries;
+	std::string names;
+	std::vector<uint8_t> scratch;
+	uint64_t storedBytes;
+	uint64_t assetBytes;
+};
+
+enum AssetReadMode
+{
+	ASSET_READ_MAPPED,	// copy or decode straight out of the mapping
+	ASSET_READ_PREAD,	// positional reads into a private buffer first
+};
+
+const char *GetAssetReadModeName(AssetReadMode mode);
+
+// A pack opened read-only and mapped whole. Every method is const and safe to
+// call from several threads at once.
+class AssetPack
+{
+public:
+	static const uint32_t INVALID_ASSET = ~0u;
+
+	AssetPack();
+	~AssetPack();
+
+	AssetPack(const AssetPack &) = delete;
+	AssetPack &operator=(const AssetPack &) = delete;
+
+	// Validates the header and every table entry, so later reads only need
+	// to check the blobs themselves.
+	bool Open(const std::string &path);
+	void Close();
+
+	bool IsOpen() const { return mapped != nullptr; }
+	uint32_t GetAssetCount() const { return assetCount; }
+	const AssetPackEntry &GetEntry(uint32_t index) const { return entries[index]; }
+	std::string GetName(uint32_t index) const;
+	uint64_t GetFileSize() const { return mappedSize; }
+
+	uint32_t Find(const std::string &name) const;
+
+	// The stored bytes, in place; for uncompressed assets that is the asset.
+	const uint8_t *GetMappedData(uint32_t index) const { return mapped + entries[index].offset; }
+
+	// Fails on a read error or a blob that does not decode to its size.
+	bool Load(uint32_t index, std::vector<uint8_t> &out, AssetReadMode mode = ASSET_READ_MAPPED) const;
+
+	// outputs[i] receives asset indices[i]. With a pool the assets are spread
+	// across its workers through ThreadPool::Run. Returns how many failed.
+	size_t LoadBatch(const uint32_t *indices, size_t count, std::vector<uint8_t> *outputs, AssetReadMode mode,
+		ThreadPool *pool = nullptr) const;
+
+	// Reads the stored bytes with ReadFileAt. destination needs
+	// entry.storedSize bytes.
+	bool ReadStored(const AssetPackEntry &entry, uint8_t *destination) const;
+
+	// Decodes stored bytes, wherever they came from, into out.
+	static bool DecodeAsset(const AssetPackEntry &entry, const uint8_t *stored, std::vector<uint8_t> &out);
+
+	// For queueing reads of entries on an IoQueue.
+#ifdef _WIN32
+	IoFile GetFile() const { return file; }
+#else
+	IoFile GetFile() const { return fd; }
+#endif
+
+private:
+	bool LoadWith(uint32_t index, std::vector<uint8_t> &out, AssetReadMode mode, std::vector<uint8_t> &scratch) const;
+
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#else
+	int fd;
+#endif
+	const uint8_t *mapped;
+	size_t mappedSize;
+	const AssetPackEntry *entries;
+	const char *names;
+	uint32_t assetCount;
+};
@@ -0,0 +1,175 @@
+#include <memory>
+#include <random>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "allocators.h"
+#include "benchmark.h"
+#include "threadpool.h"
+
+// Each thread runs a stream of "frames": a burst of mixed-size transient
+// allocations that are touched and then all released at the end of the frame.
+// This is the churn the frame arenas replace, measured with every thread busy
+// so the system allocator's locking and cache traffic show up.
+static const uint32_t ALLOCATIONS_PER_FRAME = 4096;
+static const uint32_t FRAMES_PER_THREAD = 16;
+
+static std::vector<uint32_t> MakeSizes(uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::vector<uint32_t> sizes(ALLOCATIONS_PER_FRAME);
+	for (uint32_t &size : sizes)
+		size = 16 + rng() % 496;
+	return sizes;
+}
+
+template <typename Frame>
+static void RunThreads(BenchmarkState &state, uint32_t threads, uint32_t itemsPerFrame, Frame frame)
+{
+	std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads) : nullptr);
+	std::vector<std::vector<uint32_t>> sizes;
+	for (uint32_t i = 0; i < threads; i++)
+		sizes.push_back(MakeSizes(100 + i));
+
+	state.SetItemsProcessed((uint64_t)threads * FRAMES_PER_THREAD * itemsPerFrame);
+	state.Measure([&]
+	{
+		auto run = [&](uint32_t thread)
+		{
+			for (uint32_t f = 0; f < FRAMES_PER_THREAD; f++)
+				frame(sizes[thread]);
+		};
+		if (!pool)
+		{
+			run(0);
+			return;
+		}
+		for (uint32_t i = 0; i < threads; i++)
+			pool->Submit([&, i] { run(i); });
+		pool->WaitIdle();
+	});
+	state.AddMetric("threads", threads);
+}
+
+static void BenchmarkSystemFrames(BenchmarkState &state, uint32_t threads)
+{
+	RunThreads(state, threads, ALLOCATIONS_PER_FRAME, [](const std::vector<uint32_t> &sizes)
+	{
+		static thread_local std::vector<void *> pointers(ALLOCATIONS_PER_FRAME);
+		for (size_t i = 0; i < sizes.size(); i++)
+		{
+			pointers[i] = malloc(sizes[i]);
+			memset(pointers[i], (int)i, 16);
+		}
+		for (size_t i = 0; i < sizes.size(); i++)
+			free(pointers[i]);
+	});
+}
+
+static void BenchmarkArenaFrames(BenchmarkState &state, uint32_t threads)
+{
+	RunThreads(state, threads, ALLOCATIONS_PER_FRAME, [](const std::vector<uint32_t> &sizes)
+	{
+		static thread_local LinearArena arena(1024 * 1024);
+		for (size_t i = 0; i < sizes.size(); i++)
+		{
+			void *pointer = arena.Allocate(sizes[i]);
+			memset(pointer, (int)i, 16);
+			DoNotOptimize(pointer);
+		}
+		arena.Reset();
+	});
+}
+
+// Nested scratch scopes, as helper functions inside a frame would use them.
+static void BenchmarkScratchFrames(BenchmarkState &state, uint32_t threads)
+{
+	RunThreads(state, threads, ALLOCATIONS_PER_FRAME, [](const std::vector<uint32_t> &sizes)
+	{
+		for (size_t i = 0; i < sizes.size(); i += 8)
+		{
+			ScratchScope scope;
+			for (size_t j = i; j < i + 8 && j < sizes.size(); j++)
+			{
+				uint8_t *pointer = scope.AllocateArray<uint8_t>(sizes[j]);
+				memset(pointer, (int)j, 16);
+				DoNotOptimize(pointer);
+			}
+		}
+	});
+}
+
+struct PooledObject
+{
+	float transform[16];
+	uint64_t id;
+	PooledObject *next;
+};
+
+// Objects created and destroyed in interleaved order, so the free list does
+// not simply hand back the same slot.
+static void BenchmarkObjects(BenchmarkState &state, uint32_t threads, bool pooled)
+{
+	RunThreads(state, threads, ALLOCATIONS_PER_FRAME, [pooled](const std::vector<uint32_t> &sizes)
+	{
+		static thread_local ObjectPool<PooledObject> pool;
+		static thread_local std::vector<PooledObject *> live(ALLOCATIONS_PER_FRAME);
+		for (size_t i = 0; i < sizes.size(); i++)
+		{
+			live[i] = pooled ? pool.Create() : new PooledObject();
+			live[i]->id = sizes[i];
+		}
+		for (size_t i = 0; i < sizes.size(); i += 2)
+			pooled ? pool.Destroy(live[i]) : delete live[i];
+		for (size_t i = 1; i < sizes.size(); i += 2)
+			pooled ? pool.Destroy(live[i]) : delete live[i];
+	});
+}
+
+// Per-frame lists built with push_back, std::vector against ArenaVector.
+// Items are lists.
+static void BenchmarkVectors(BenchmarkState &state, uint32_t threads, bool arenaBacked)
+{
+	RunThreads(state, threads, ALLOCATIONS_PER_FRAME / 64, [arenaBacked](const std::vector<uint32_t> &sizes)
+	{
+		static thread_local LinearArena arena(1024 * 1024);
+		uint64_t sum = 0;
+		for (size_t i = 0; i < sizes.size(); i += 64)
+		{
+			if (arenaBacked)
+			{
+				ArenaVector<uint32_t> list{ ArenaAllocator<uint32_t>(arena) };
+				for (uint32_t j = 0; j < sizes[i] / 4; j++)
+					list.push_back(j);
+				sum += list.size();
+			}
+			else
+			{
+				std::vector<uint32_t> list;
+				for (uint32_t j = 0; j < sizes[i] / 4; j++)
+					list.push_back(j);
+				sum += list.size();
+			}
+		}
+		arena.Reset();
+		DoNotOptimize(sum);
+	});
+}
+
+#define ALLOCATOR_BENCHMARKS(name, body) \
+	BENCHMARK(allocator_##name##_t1, "allocator") { body(state, 1); } \
+	BENCHMARK(allocator_##name##_t4, "allocator") { body(state, 4); } \
+	BENCHMARK(allocator_##name##_t8, "allocator") { body(state, 8); }
+
+static void SystemObjects(BenchmarkState &state, uint32_t threads) { BenchmarkObjects(state, threads, false); }
+static void PoolObjects(BenchmarkState &state, uint32_t threads) { BenchmarkObjects(state, threads, true); }
+static void StdVectors(BenchmarkState &state, uint32_t threads) { BenchmarkVectors(state, threads, false); }
+static void ArenaVectors(BenchmarkState &state, uint32_t threads) { BenchmarkVectors(state, threads, true); }
+
+ALLOCATOR_BENCHMARKS(frame_system, BenchmarkSystemFrames)
+ALLOCATOR_BENCHMARKS(frame_arena, BenchmarkArenaFrames)
+ALLOCATOR_BENCHMARKS(frame_scratch, BenchmarkScratchFrames)
+ALLOCATOR_BENCHMARKS(objects_new, SystemObjects)
+ALLOCATOR_BENCHMARKS(objects_pool, PoolObjects)
+ALLOCATOR_BENCHMARKS(vector_std, StdVectors)
+ALLOCATOR_BENCHMARKS(vector_arena, ArenaVectors)
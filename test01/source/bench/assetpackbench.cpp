@@ -0,0 +1,257 @@
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "assetpack.h"
+#include "benchmark.h"
+#include "hash.h"
+#include "mesh.h"
+#include "threadpool.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t ASSET_COUNT = 10000;
+
+// The same assets twice: one file each, and packed. Meshes go in as mesh
+// streams, the rest as LZ, so the pack also reads less.
+struct AssetBenchData
+{
+	std::string packPath;
+	std::vector<std::string> loosePaths;
+	std::vector<uint64_t> hashes;
+	std::vector<uint32_t> packIndices;	// pack index of asset i
+	uint64_t assetBytes = 0;
+	uint64_t storedBytes = 0;
+	bool ok = false;
+};
+
+static std::vector<uint8_t> GenerateAsset(uint32_t id, std::mt19937 &rng, bool &isMesh)
+{
+	std::vector<uint8_t> data;
+	isMesh = id % 3 == 0;
+	if (isMesh)
+	{
+		uint32_t rings = 4 + rng() % 20;
+		Mesh mesh = GenerateSphere(rings, rings * 2, 1.0f);
+		data.resize(mesh.vertices.size() * sizeof(Vertex));
+		memcpy(data.data(), mesh.vertices.data(), data.size());
+	}
+	else if (id % 3 == 1)
+	{
+		// A noisy gradient, standing in for a small texture.
+		uint32_t side = 32 << (rng() % 3);
+		data.resize(side * side);
+		for (uint32_t y = 0; y < side; y++)
+			for (uint32_t x = 0; x < side; x++)
+				data[y * side + x] = (uint8_t)(x + y * 2 + rng() % 8);
+	}
+	else
+	{
+		uint32_t lines = 16 + rng() % 200;
+		std::string text;
+		for (uint32_t i = 0; i < lines; i++)
+			text += "{ \"entity\": " + std::to_string(rng() % 5000) + ", \"material\": \"mat_" + std::to_string(rng() % 40) + "\" }\n";
+		data.assign(text.begin(), text.end());
+	}
+	return data;
+}
+
+static void EvictFile(const std::string &path)
+{
+#ifndef _WIN32
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+#else
+	(void)path;
+#endif
+}
+
+static const AssetBenchData &GetAssetBenchData()
+{
+	static AssetBenchData data = []
+	{
+		AssetBenchData result;
+		std::filesystem::path directory = std::filesystem::temp_directory_path() / "vulkan01_assetbench";
+		std::filesystem::remove_all(directory);
+		std::filesystem::create_directories(directory / "loose");
+		result.packPath = (directory / "assets.pack").string();
+
+		std::mt19937 rng(47);
+		AssetPackWriter writer;
+		if (!writer.Open(result.packPath))
+			return result;
+		for (uint32_t id = 0; id < ASSET_COUNT; id++)
+		{
+			bool isMesh = false;
+			std::vector<uint8_t> asset = GenerateAsset(id, rng, isMesh);
+			std::string name = "assets/" + std::to_string(id);
+			std::string loosePath = (directory / "loose" / std::to_string(id)).string();
+			bool added = isMesh ? writer.AddMeshStream(name, asset.data(), asset.size() / sizeof(Vertex), sizeof(Vertex), 4)
+				: writer.Add(name, asset.data(), asset.size(), ASSET_COMPRESSION_LZ);
+			FILE *file = fopen(loosePath.c_str(), "wb");
+			bool written = file && fwrite(asset.data(), 1, asset.size(), file) == asset.size();
+			if (file)
+				fclose(file);
+			if (!added || !written)
+				return result;
+			result.loosePaths.push_back(loosePath);
+			result.hashes.push_back(HashBytes(asset.data(), asset.size()));
+		}
+		result.assetBytes = writer.GetAssetBytes();
+		result.storedBytes = writer.GetStoredBytes();
+		if (!writer.Finish())
+			return result;
+
+		AssetPack pack;
+		if (!pack.Open(result.packPath))
+			return result;
+		for (uint32_t id = 0; id < ASSET_COUNT; id++)
+			result.packIndices.push_back(pack.Find("assets/" + std::to_string(id)));
+
+		// Pages written back before the benchmarks try to drop them.
+#ifndef _WIN32
+		sync();
+#endif
+		result.ok = true;
+		return result;
+	}();
+	return data;
+}
+
+static bool CheckAssets(const AssetBenchData &data, const std::vector<std::vector<uint8_t>> &assets)
+{
+	for (uint32_t id = 0; id < ASSET_COUNT; id++)
+	{
+		if (HashBytes(assets[id].data(), assets[id].size()) != data.hashes[id])
+			return false;
+	}
+	return true;
+}
+
+static void BenchmarkLoose(BenchmarkState &state, bool cold)
+{
+	const AssetBenchData &data = GetAssetBenchData();
+	if (!data.ok)
+	{
+		state.Fail("could not write the test assets");
+		return;
+	}
+	std::vector<std::vector<uint8_t>> assets(ASSET_COUNT);
+	bool ok = true;
+	state.SetItemsProcessed(ASSET_COUNT);
+	state.SetBytesProcessed(data.assetBytes);
+	state.Measure([&]
+	{
+		for (uint32_t id = 0; id < ASSET_COUNT; id++)
+		{
+			FILE *file = fopen(data.loosePaths[id].c_str(), "rb");
+			if (!file)
+			{
+				ok = false;
+				continue;
+			}
+			fseek(file, 0, SEEK_END);
+			long size = ftell(file);
+			fseek(file, 0, SEEK_SET);
+			assets[id].resize((size_t)size);
+			ok = fread(assets[id].data(), 1, assets[id].size(), file) == assets[id].size() && ok;
+			fclose(file);
+		}
+	}, [&]
+	{
+		if (cold)
+		{
+			for (const std::string &path : data.loosePaths)
+				EvictFile(path);
+		}
+	});
+	if (!ok || !CheckAssets(data, assets))
+		state.Fail("loose files did not read back");
+}
+
+// Cold runs include opening the pack, since that is part of what a cold
+// start pays; warm runs keep it open.
+static void BenchmarkPack(BenchmarkState &state, AssetReadMode mode, uint32_t threads, bool cold)
+{
+	const AssetBenchData &data = GetAssetBenchData();
+	if (!data.ok)
+	{
+		state.Fail("could not write the test assets");
+		return;
+	}
+	std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads) : nullptr);
+	std::vector<std::vector<uint8_t>> assets(ASSET_COUNT);
+	AssetPack pack;
+	if (!cold && !pack.Open(data.packPath))
+	{
+		state.Fail("could not open the pack");
+		return;
+	}
+	size_t failed = 0;
+	state.SetItemsProcessed(ASSET_COUNT);
+	state.SetBytesProcessed(data.assetBytes);
+	state.Measure([&]
+	{
+		if (cold && !pack.Open(data.packPath))
+		{
+			failed = ASSET_COUNT;
+			return;
+		}
+		failed += pack.LoadBatch(data.packIndices.data(), ASSET_COUNT, assets.data(), mode, pool.get());
+	}, [&]
+	{
+		if (cold)
+		{
+			pack.Close();
+			EvictFile(data.packPath);
+		}
+	});
+	state.AddMetric("threads", threads);
+	state.AddMetric("pack_mb", data.storedBytes / 1048576.0);
+	state.AddMetric("asset_mb", data.assetBytes / 1048576.0);
+	if (failed || !CheckAssets(data, assets))
+		state.Fail("pack did not read back");
+}
+
+BENCHMARK(assetpack_loose_cold, "assetpack") { BenchmarkLoose(state, true); }
+BENCHMARK(assetpack_loose_warm, "assetpack") { BenchmarkLoose(state, false); }
+BENCHMARK(assetpack_mapped_cold, "assetpack") { BenchmarkPack(state, ASSET_READ_MAPPED, 1, true); }
+BENCHMARK(assetpack_mapped_warm, "assetpack") { BenchmarkPack(state, ASSET_READ_MAPPED, 1, false); }
+BENCHMARK(assetpack_pread_cold, "assetpack") { BenchmarkPack(state, ASSET_READ_PREAD, 1, true); }
+BENCHMARK(assetpack_pread_warm, "assetpack") { BenchmarkPack(state, ASSET_READ_PREAD, 1, false); }
+BENCHMARK(assetpack_pread_cold_t4, "assetpack") { BenchmarkPack(state, ASSET_READ_PREAD, 4, true); }
+BENCHMARK(assetpack_pread_warm_t4, "assetpack") { BenchmarkPack(state, ASSET_READ_PREAD, 4, false); }
+
+BENCHMARK(assetpack_find, "assetpack")
+{
+	const AssetBenchData &data = GetAssetBenchData();
+	AssetPack pack;
+	if (!data.ok || !pack.Open(data.packPath))
+	{
+		state.Fail("could not open the pack");
+		return;
+	}
+	std::vector<std::string> names;
+	for (uint32_t id = 0; id < ASSET_COUNT; id++)
+		names.push_back("assets/" + std::to_string(id));
+	uint32_t missing = 0;
+	state.SetItemsProcessed(ASSET_COUNT);
+	state.Measure([&]
+	{
+		missing = 0;
+		for (const std::string &name : names)
+			missing += pack.Find(name) == AssetPack::INVALID_ASSET;
+		missing += pack.Find("assets/missing") != AssetPack::INVALID_ASSET;
+	});
+	if (missing)
+		state.Fail("lookup failed");
+}
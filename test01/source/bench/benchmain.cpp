@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "perfcounters.h"
+
+static void PrintUsage()
+{
+	std::cout << "Usage: Vulkan01Bench [--list] [--filter text] [--category name] [--warmup n] [--reps n]" << std::endl;
+	std::cout << "                     [--json file] [--commit id]" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+	std::string filter, category, jsonPath;
+	std::string commit = getenv("GIT_COMMIT") ? getenv("GIT_COMMIT") : "";
+	uint32_t warmup = 3;
+	uint32_t repetitions = 15;
+	bool list = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--list")
+			list = true;
+		else if (arg == "--filter" && i + 1 < argc)
+			filter = argv[++i];
+		else if (arg == "--category" && i + 1 < argc)
+			category = argv[++i];
+		else if (arg == "--warmup" && i + 1 < argc)
+			warmup = (uint32_t)atoi(argv[++i]);
+		else if (arg == "--reps" && i + 1 < argc)
+			repetitions = (uint32_t)std::max(1, atoi(argv[++i]));
+		else if (arg == "--json" && i + 1 < argc)
+			jsonPath = argv[++i];
+		else if (arg == "--commit" && i + 1 < argc)
+			commit = argv[++i];
+		else
+		{
+			PrintUsage();
+			return arg == "--help" ? 0 : 1;
+		}
+	}
+
+	std::vector<BenchmarkResult> results;
+	bool passed = true;
+	for (const BenchmarkInfo &info : GetBenchmarkRegistry())
+	{
+		if (!filter.empty() && std::string(info.name).find(filter) == std::string::npos)
+			continue;
+		if (!category.empty() && category != info.category)
+			continue;
+		if (list)
+		{
+			std::cout << info.category << "\t" << info.name << std::endl;
+			continue;
+		}
+
+		results.push_back(RunBenchmark(info, warmup, repetitions));
+		PrintBenchmarkResult(results.back());
+		passed &= results.back().passed;
+	}
+
+	if (!list)
+		PerfCounters::LogSummary();
+
+	if (!jsonPath.empty())
+	{
+		std::ofstream file(jsonPath, std::ios::binary);
+		file << BenchmarkResultsToJson(results, commit);
+		if (!file)
+		{
+			std::cout << "Could not write " << jsonPath << std::endl;
+			return 1;
+		}
+	}
+	return passed ? 0 : 1;
+}
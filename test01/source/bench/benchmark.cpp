@@ -0,0 +1,250 @@
+#include "benchmark.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <math.h>
+#include <sstream>
+#include <thread>
+#include <time.h>
+#include "perfcounters.h"
+#include "timer.h"
+
+std::vector<BenchmarkInfo> &GetBenchmarkRegistry()
+{
+	static std::vector<BenchmarkInfo> registry;
+	return registry;
+}
+
+BenchmarkState::BenchmarkState(BenchmarkResult &result, uint32_t warmup, uint32_t repetitions)
+	: result(result), warmup(warmup), repetitions(repetitions)
+{
+}
+
+void BenchmarkState::Fail(const std::string &reason)
+{
+	result.passed = false;
+	result.failure = reason;
+}
+
+void BenchmarkState::Measure(const std::function<void()> &body)
+{
+	Measure(body, std::function<void()>());
+}
+
+void BenchmarkState::Measure(const std::function<void()> &body, const std::function<void()> &setup)
+{
+	for (uint32_t i = 0; i < warmup; i++)
+	{
+		if (setup)
+			setup();
+		body();
+	}
+
+	// The counter reads sit outside the timed region.
+	PerfCounterGroup *counters = PerfCounters::ThreadGroup();
+	PerfCounterValues total;
+	result.samplesNs.clear();
+	for (uint32_t i = 0; i < repetitions; i++)
+	{
+		if (setup)
+			setup();
+		PerfCounterValues before, after;
+		if (counters)
+			counters->Read(before);
+		uint64_t start = NowNs();
+		body();
+		uint64_t end = NowNs();
+		if (counters)
+		{
+			counters->Read(after);
+			total += after - before;
+		}
+		result.samplesNs.push_back((double)(end - start));
+	}
+
+	result.warmup = warmup;
+	result.repetitions = repetitions;
+	if (counters && repetitions > 0 && total.IsValid(PERF_CYCLES))
+	{
+		result.cycles = (double)total.values[PERF_CYCLES] / repetitions;
+		result.ipc = total.GetIpc();
+		result.cacheMissRate = total.GetCacheMissRate();
+		result.branchMissRate = total.GetBranchMissRate();
+	}
+}
+
+static void ComputeStatistics(BenchmarkResult &result)
+{
+	if (result.samplesNs.empty())
+		return;
+
+	std::vector<double> sorted = result.samplesNs;
+	std::sort(sorted.begin(), sorted.end());
+	size_t count = sorted.size();
+	result.minNs = sorted.front();
+	result.medianNs = count % 2 ? sorted[count / 2] : 0.5 * (sorted[count / 2 - 1] + sorted[count / 2]);
+
+	// Nearest-rank percentile.
+	size_t rank = (size_t)ceil(0.99 * count);
+	result.p99Ns = sorted[std::min(count, std::max<size_t>(rank, 1)) - 1];
+
+	double sum = 0.0;
+	for (double sample : sorted)
+		sum += sample;
+	result.meanNs = sum / count;
+
+	double variance = 0.0;
+	for (double sample : sorted)
+		variance += (sample - result.meanNs) * (sample - result.meanNs);
+	result.stddevNs = count > 1 ? sqrt(variance / (count - 1)) : 0.0;
+}
+
+BenchmarkResult RunBenchmark(const BenchmarkInfo &info, uint32_t warmup, uint32_t repetitions)
+{
+	BenchmarkResult result;
+	result.name = info.name;
+	result.category = info.category;
+
+	BenchmarkState state(result, warmup, repetitions);
+	info.function(state);
+	if (result.samplesNs.empty() && result.passed)
+		state.Fail("benchmark did not call Measure()");
+	ComputeStatistics(result);
+	return result;
+}
+
+static std::string FormatNs(double ns)
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(2);
+	if (ns >= 1e9)
+		out << ns / 1e9 << " s";
+	else if (ns >= 1e6)
+		out << ns / 1e6 << " ms";
+	else if (ns >= 1e3)
+		out << ns / 1e3 << " us";
+	else
+		out << ns << " ns";
+	return out.str();
+}
+
+void PrintBenchmarkResult(const BenchmarkResult &result)
+{
+	std::ostringstream out;
+	out << std::left << std::setw(28) << result.name << " median " << std::setw(12) << FormatNs(result.medianNs)
+		<< " p99 " << std::setw(12) << FormatNs(result.p99Ns) << " min " << std::setw(12) << FormatNs(result.minNs);
+	if (result.cycles >= 0.0)
+		out << " cycles " << (uint64_t)result.cycles;
+	if (result.ipc >= 0.0)
+		out << " IPC " << std::fixed << std::setprecision(2) << result.ipc;
+	if (result.cacheMissRate >= 0.0)
+		out << " cache miss " << std::fixed << std::setprecision(2) << result.cacheMissRate * 100.0 << "%";
+	if (result.branchMissRate >= 0.0)
+		out << " branch miss " << std::fixed << std::setprecision(2) << result.branchMissRate * 100.0 << "%";
+	if (result.itemsPerRepetition && result.medianNs > 0.0)
+		out << " | " << std::setprecision(3) << result.itemsPerRepetition / result.medianNs * 1e3 << " M items/s";
+	if (result.bytesPerRepetition && result.medianNs > 0.0)
+		out << " | " << std::setprecision(3) << result.bytesPerRepetition / result.medianNs << " GB/s";
+	out << std::endl;
+	for (const auto &metric : result.metrics)
+		out << "    " << metric.first << ": " << metric.second << std::endl;
+	if (!result.passed)
+		out << "    FAILED: " << result.failure << std::endl;
+	std::cout << out.str();
+}
+
+static void AppendJsonString(std::ostringstream &out, const std::string &text)
+{
+	static const char hexDigits[] = "0123456789abcdef";
+	out << '"';
+	for (char c : text)
+	{
+		if ((unsigned char)c < 0x20)
+		{
+			out << "\\u00" << hexDigits[c >> 4] << hexDigits[c & 15];
+			continue;
+		}
+		if (c == '"' || c == '\\')
+			out << '\\';
+		out << c;
+	}
+	out << '"';
+}
+
+// JSON has no NaN or infinity, so those become null.
+static void AppendJsonNumber(std::ostringstream &out, double value)
+{
+	if (isfinite(value))
+		out << value;
+	else
+		out << "null";
+}
+
+std::string BenchmarkResultsToJson(const std::vector<BenchmarkResult> &results, const std::string &commit)
+{
+	std::ostringstream out;
+	out << std::setprecision(10);
+	out << "{\"commit\":";
+	AppendJsonString(out, commit);
+	out << ",\"timestamp\":" << (uint64_t)time(nullptr) << ",\"hardwareThreads\":" << std::thread::hardware_concurrency() << ",\"benchmarks\":[";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchmarkResult &r = results[i];
+		out << (i ? "," : "") << "{\"name\":";
+		AppendJsonString(out, r.name);
+		out << ",\"category\":";
+		AppendJsonString(out, r.category);
+		out << ",\"warmup\":" << r.warmup << ",\"repetitions\":" << r.repetitions;
+		out << ",\"minNs\":";
+		AppendJsonNumber(out, r.minNs);
+		out << ",\"medianNs\":";
+		AppendJsonNumber(out, r.medianNs);
+		out << ",\"meanNs\":";
+		AppendJsonNumber(out, r.meanNs);
+		out << ",\"p99Ns\":";
+		AppendJsonNumber(out, r.p99Ns);
+		out << ",\"stddevNs\":";
+		AppendJsonNumber(out, r.stddevNs);
+		// Counters are negative when unavailable, which also leaves out NaN.
+		if (r.cycles >= 0.0)
+		{
+			out << ",\"cycles\":";
+			AppendJsonNumber(out, r.cycles);
+		}
+		if (r.ipc >= 0.0)
+		{
+			out << ",\"ipc\":";
+			AppendJsonNumber(out, r.ipc);
+		}
+		if (r.cacheMissRate >= 0.0)
+		{
+			out << ",\"cacheMissRate\":";
+			AppendJsonNumber(out, r.cacheMissRate);
+		}
+		if (r.branchMissRate >= 0.0)
+		{
+			out << ",\"branchMissRate\":";
+			AppendJsonNumber(out, r.branchMissRate);
+		}
+		out << ",\"itemsPerRepetition\":" << r.itemsPerRepetition << ",\"bytesPerRepetition\":" << r.bytesPerRepetition;
+		out << ",\"metrics\":{";
+		bool first = true;
+		for (const auto &metric : r.metrics)
+		{
+			out << (first ? "" : ",");
+			AppendJsonString(out, metric.first);
+			out << ":";
+			AppendJsonNumber(out, metric.second);
+			first = false;
+		}
+		out << "},\"passed\":" << (r.passed ? "true" : "false");
+		if (!r.passed)
+		{
+			out << ",\"failure\":";
+			AppendJsonString(out, r.failure);
+		}
+		out << "}";
+	}
+	out << "]}";
+	return out.str();
+}
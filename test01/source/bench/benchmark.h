@@ -0,0 +1,103 @@
+#pragma once
+#include <functional>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct BenchmarkResult
+{
+	std::string name;
+	std::string category;
+	uint32_t warmup = 0;
+	uint32_t repetitions = 0;
+	std::vector<double> samplesNs;
+	double minNs = 0.0;
+	double medianNs = 0.0;
+	double meanNs = 0.0;
+	double p99Ns = 0.0;
+	double stddevNs = 0.0;
+
+	// Per repetition from perf counters; negative when unavailable.
+	double cycles = -1.0;
+	double ipc = -1.0;
+	double cacheMissRate = -1.0;
+	double branchMissRate = -1.0;
+
+	uint64_t itemsPerRepetition = 0;
+	uint64_t bytesPerRepetition = 0;
+	std::map<std::string, double> metrics;
+	bool passed = true;
+	std::string failure;
+};
+
+// Handed to each benchmark. Setup runs once in the benchmark body; the code
+// passed to Measure() is then run for the warmup and timed repetitions, each
+// repetition timed on its own so medians and tails can be computed.
+class BenchmarkState
+{
+public:
+	BenchmarkState(BenchmarkResult &result, uint32_t warmup, uint32_t repetitions);
+
+	void Measure(const std::function<void()> &body);
+
+	// As above, with untimed setup run before every warmup and timed
+	// repetition, for benchmarks whose state must be reset between runs.
+	void Measure(const std::function<void()> &body, const std::function<void()> &setup);
+
+	void SetItemsProcessed(uint64_t items) { result.itemsPerRepetition = items; }
+	void SetBytesProcessed(uint64_t bytes) { result.bytesPerRepetition = bytes; }
+	void AddMetric(const std::string &name, double value) { result.metrics[name] = value; }
+
+	// Marks the run as failed; results are still reported.
+	void Fail(const std::string &reason);
+
+	uint32_t GetRepetitions() const { return repetitions; }
+
+private:
+	BenchmarkResult &result;
+	uint32_t warmup;
+	uint32_t repetitions;
+};
+
+typedef void (*BenchmarkFunction)(BenchmarkState &state);
+
+struct BenchmarkInfo
+{
+	const char *name;
+	const char *category;
+	BenchmarkFunction function;
+};
+
+std::vector<BenchmarkInfo> &GetBenchmarkRegistry();
+
+struct BenchmarkRegistrar
+{
+	BenchmarkRegistrar(const char *name, const char *category, BenchmarkFunction function)
+	{
+		GetBenchmarkRegistry().push_back({ name, category, function });
+	}
+};
+
+// Defines and registers a benchmark:
+//     BENCHMARK(culling_spheres, "micro") { ...setup...; state.Measure([&] { ... }); }
+#define BENCHMARK(name, category) \
+	static void Benchmark_##name(BenchmarkState &state); \
+	static BenchmarkRegistrar benchmarkRegistrar_##name(#name, category, Benchmark_##name); \
+	static void Benchmark_##name(BenchmarkState &state)
+
+BenchmarkResult RunBenchmark(const BenchmarkInfo &info, uint32_t warmup, uint32_t repetitions);
+void PrintBenchmarkResult(const BenchmarkResult &result);
+std::string BenchmarkResultsToJson(const std::vector<BenchmarkResult> &results, const std::string &commit);
+
+// Keeps a value alive so the optimizer cannot remove the work producing it.
+template <typename T>
+inline void DoNotOptimize(const T &value)
+{
+#if defined(__GNUC__)
+	asm volatile("" : : "g"(&value) : "memory");
+#else
+	static volatile const void *sink;
+	sink = &value;
+#endif
+}
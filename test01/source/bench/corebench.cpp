@@ -0,0 +1,155 @@
+#include <math.h>
+#include <random>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "benchmark.h"
+#include "culling.h"
+#include "mesh.h"
+#include "softraster.h"
+
+// Small, short-lived allocations of mixed sizes through the system allocator;
+// the baseline any custom allocator has to beat.
+BENCHMARK(allocator_system_mixed, "micro")
+{
+	const uint32_t allocationCount = 1 << 16;
+	std::mt19937 rng(42);
+	std::vector<uint32_t> sizes(allocationCount);
+	for (uint32_t &size : sizes)
+		size = 16 + rng() % 496;
+	std::vector<void *> pointers(allocationCount);
+
+	state.SetItemsProcessed(allocationCount);
+	state.Measure([&]
+	{
+		for (uint32_t i = 0; i < allocationCount; i++)
+			pointers[i] = malloc(sizes[i]);
+		// Free every other block first to fragment the heap a little.
+		for (uint32_t i = 0; i < allocationCount; i += 2)
+			free(pointers[i]);
+		for (uint32_t i = 1; i < allocationCount; i += 2)
+			free(pointers[i]);
+	});
+}
+
+BENCHMARK(culling_spheres, "micro")
+{
+	const uint32_t sphereCount = 1 << 17;
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> radius(0.5f, 8.0f);
+	std::vector<BoundingSphere> spheres(sphereCount);
+	for (BoundingSphere &sphere : spheres)
+	{
+		sphere.center = Vec3(position(rng), position(rng) * 0.1f, position(rng));
+		sphere.radius = radius(rng);
+	}
+	std::vector<uint32_t> visible(sphereCount);
+
+	Mat4 viewProjection = Mat4::Perspective(1.0f, 16.0f / 9.0f, 0.1f, 400.0f) * Mat4::LookAt(Vec3(0, 10, 0), Vec3(0, 0, 100), Vec3(0, 1, 0));
+	Frustum frustum = Frustum::FromMatrix(viewProjection);
+
+	size_t visibleCount = 0;
+	state.SetItemsProcessed(sphereCount);
+	state.Measure([&]
+	{
+		visibleCount = CullSpheres(frustum, spheres.data(), spheres.size(), visible.data());
+		DoNotOptimize(visibleCount);
+	});
+	state.AddMetric("visible_fraction", (double)visibleCount / sphereCount);
+	if (visibleCount == 0 || visibleCount == sphereCount)
+		state.Fail("frustum rejected everything or nothing");
+}
+
+BENCHMARK(raster_depth_spheres, "macro")
+{
+	const uint32_t width = 1280;
+	const uint32_t height = 720;
+	Mesh sphere = GenerateSphere(48, 96, 1.0f);
+	DepthRasterizer rasterizer(width, height);
+	Mat4 viewProjection = Mat4::Perspective(1.0f, (float)width / height, 0.1f, 100.0f) * Mat4::LookAt(Vec3(0, 0, -12), Vec3(0, 0, 0), Vec3(0, 1, 0));
+
+	const int grid = 5;
+	state.SetItemsProcessed((uint64_t)grid * grid * sphere.GetTriangleCount());
+	state.Measure([&]
+	{
+		rasterizer.Clear();
+		rasterizer.ResetStats();
+		for (int y = 0; y < grid; y++)
+		{
+			for (int x = 0; x < grid; x++)
+			{
+				Mat4 mvp = viewProjection * Mat4::Translation(Vec3((x - grid / 2) * 2.5f, (y - grid / 2) * 2.5f, 0.0f));
+				rasterizer.DrawIndexed(sphere.vertices[0].position, sizeof(Vertex), sphere.indices.data(), sphere.indices.size(), mvp);
+			}
+		}
+	});
+
+	const SoftRasterStats &stats = rasterizer.GetStats();
+	state.AddMetric("triangles_culled", (double)stats.trianglesCulled);
+	state.AddMetric("pixels_written", (double)stats.pixelsWritten);
+	state.AddMetric("vertex_cache_hit_rate", (double)stats.vertexCacheHits / (stats.vertexCacheHits + stats.vertexTransforms));
+	if (stats.pixelsWritten == 0)
+		state.Fail("nothing was rasterized");
+
+	// The middle sphere sits on the view axis, so the centre pixel must hold
+	// its near side, 11 units away, and not its far side at 13.
+	float nearDepth = 100.0f * (11.0f - 0.1f) / (11.0f * (100.0f - 0.1f));
+	float centreDepth = rasterizer.GetDepth()[(height / 2) * width + width / 2];
+	state.AddMetric("centre_depth", centreDepth);
+	if (fabsf(centreDepth - nearDepth) > 1e-4f)
+		state.Fail("the centre pixel does not hold the sphere's near side");
+}
+
+// Copies per-frame data into a persistently mapped staging ring the way an
+// upload path would: 256-byte aligned sub-allocations that wrap around.
+BENCHMARK(upload_staging_ring, "micro")
+{
+	const size_t ringSize = 32 << 20;
+	const size_t alignment = 256;
+	const uint32_t uploadCount = 4096;
+	std::mt19937 rng(3);
+	std::vector<size_t> uploadSizes(uploadCount);
+	size_t totalBytes = 0;
+	for (size_t &size : uploadSizes)
+	{
+		size = 64 + rng() % (16 << 10);
+		totalBytes += size;
+	}
+	std::vector<uint8_t> source(64 + (16 << 10));
+	for (size_t i = 0; i < source.size(); i++)
+		source[i] = (uint8_t)i;
+
+	uint8_t *ring = (uint8_t *)aligned_alloc(alignment, ringSize);
+	size_t head = 0;
+	state.SetBytesProcessed(totalBytes);
+	state.Measure([&]
+	{
+		for (size_t size : uploadSizes)
+		{
+			if (head + size > ringSize)
+				head = 0;
+			memcpy(ring + head, source.data(), size);
+			head = (head + size + alignment - 1) & ~(alignment - 1);
+		}
+		DoNotOptimize(ring[head % ringSize]);
+	});
+	free(ring);
+}
+
+BENCHMARK(parse_obj, "macro")
+{
+	std::string text = WriteObj(GenerateSphere(128, 256, 1.0f));
+	Mesh mesh;
+	bool parsed = true;
+	state.SetBytesProcessed(text.size());
+	state.Measure([&]
+	{
+		mesh = Mesh();
+		parsed &= ParseObj(text.data(), text.size(), mesh);
+	});
+	state.AddMetric("triangles", (double)mesh.GetTriangleCount());
+	state.AddMetric("vertices", (double)mesh.vertices.size());
+	if (!parsed || mesh.GetTriangleCount() == 0)
+		state.Fail("OBJ parse failed");
+}
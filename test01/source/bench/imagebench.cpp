@@ -0,0 +1,579 @@
+#include <condition_variable>
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "benchmark.h"
+#include "deflate.h"
+#include "imageencode.h"
+#include "threadpool.h"
+
+static const uint32_t IMAGE_WIDTH = 1920;
+static const uint32_t IMAGE_HEIGHT = 1080;
+
+// Something shaped like a render: smooth gradients, flat-shaded discs with
+// hard edges, a little per-pixel noise for dithering and texture detail.
+static const std::vector<uint8_t> &GetTestImage()
+{
+	static std::vector<uint8_t> image;
+	if (!image.empty())
+		return image;
+
+	image.resize((size_t)IMAGE_WIDTH * IMAGE_HEIGHT * 4);
+	std::mt19937 rng(11);
+	struct Disc
+	{
+		float x, y, radius;
+		uint8_t r, g, b;
+	};
+	std::vector<Disc> discs;
+	for (int i = 0; i < 40; i++)
+		discs.push_back({ (float)(rng() % IMAGE_WIDTH), (float)(rng() % IMAGE_HEIGHT), 20.0f + rng() % 150, (uint8_t)rng(), (uint8_t)rng(), (uint8_t)rng() });
+
+	for (uint32_t y = 0; y < IMAGE_HEIGHT; y++)
+	{
+		for (uint32_t x = 0; x < IMAGE_WIDTH; x++)
+		{
+			uint8_t *pixel = &image[((size_t)y * IMAGE_WIDTH + x) * 4];
+			float shade = 0.5f + 0.5f * sinf(x * 0.003f) * cosf(y * 0.004f);
+			pixel[0] = (uint8_t)(40 + 60 * shade);
+			pixel[1] = (uint8_t)(60 + 80 * shade);
+			pixel[2] = (uint8_t)(90 + 120 * (float)y / IMAGE_HEIGHT);
+			pixel[3] = 255;
+			for (const Disc &disc : discs)
+			{
+				float dx = x - disc.x, dy = y - disc.y;
+				float d2 = dx * dx + dy * dy;
+				if (d2 < disc.radius * disc.radius)
+				{
+					float light = 1.0f - 0.6f * sqrtf(d2) / disc.radius;
+					pixel[0] = (uint8_t)(disc.r * light);
+					pixel[1] = (uint8_t)(disc.g * light);
+					pixel[2] = (uint8_t)(disc.b * light);
+				}
+			}
+			if (rng() % 8 == 0)
+				pixel[rng() % 3] ^= 1;
+		}
+	}
+	return image;
+}
+
+static const uint64_t IMAGE_BYTES = (uint64_t)IMAGE_WIDTH * IMAGE_HEIGHT * 4;
+
+static uint32_t ReadBigEndian32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// Just enough inflate (RFC 1951) to read the PNG encoder's output back, after
+// zlib's puff: slow and simple, with bounds checks instead of speed.
+class Inflater
+{
+public:
+	Inflater(const uint8_t *data, size_t size) : data(data), size(size), position(0), bitBuffer(0), bitCount(0), overrun(false) {}
+
+	bool Inflate(std::vector<uint8_t> &out)
+	{
+		bool last = false;
+		while (!last)
+		{
+			last = Bits(1) != 0;
+			uint32_t type = Bits(2);
+			bool ok = type == 0 ? Stored(out) : type == 1 ? Fixed(out) : type == 2 ? Dynamic(out) : false;
+			if (!ok || overrun)
+				return false;
+		}
+		return true;
+	}
+
+	// Bytes consumed, rounded up to a whole byte.
+	size_t GetPosition() const { return position; }
+
+private:
+	struct Huffman
+	{
+		uint16_t counts[16];
+		uint16_t symbols[288];
+	};
+
+	uint32_t Bits(int count)
+	{
+		while (bitCount < count)
+		{
+			if (position == size)
+			{
+				overrun = true;
+				return 0;
+			}
+			bitBuffer |= (uint32_t)data[position++] << bitCount;
+			bitCount += 8;
+		}
+		uint32_t value = bitBuffer & ((1u << count) - 1);
+		bitBuffer >>= count;
+		bitCount -= count;
+		return value;
+	}
+
+	static bool Build(Huffman &huffman, const uint8_t *lengths, int count)
+	{
+		memset(huffman.counts, 0, sizeof(huffman.counts));
+		for (int i = 0; i < count; i++)
+			huffman.counts[lengths[i]]++;
+		int left = 1;
+		for (int length = 1; length < 16; length++)
+		{
+			left = (left << 1) - huffman.counts[length];
+			if (left < 0)
+				return false;
+		}
+		uint16_t offsets[16];
+		offsets[1] = 0;
+		for (int length = 1; length < 15; length++)
+			offsets[length + 1] = offsets[length] + huffman.counts[length];
+		for (int i = 0; i < count; i++)
+		{
+			if (lengths[i])
+				huffman.symbols[offsets[lengths[i]]++] = (uint16_t)i;
+		}
+		return true;
+	}
+
+	int Decode(const Huffman &huffman)
+	{
+		int code = 0, first = 0, index = 0;
+		for (int length = 1; length < 16; length++)
+		{
+			code |= (int)Bits(1);
+			int count = huffman.counts[length];
+			if (code - first < count)
+				return huffman.symbols[index + code - first];
+			index += count;
+			first = (first + count) << 1;
+			code <<= 1;
+		}
+		return -1;
+	}
+
+	bool Stored(std::vector<uint8_t> &out)
+	{
+		bitBuffer = 0;
+		bitCount = 0;
+		if (size - position < 4)
+			return false;
+		uint32_t length = data[position] | data[position + 1] << 8;
+		uint32_t complement = data[position + 2] | data[position + 3] << 8;
+		position += 4;
+		if (length != (~complement & 0xffff) || size - position < length)
+			return false;
+		out.insert(out.end(), data + position, data + position + length);
+		position += length;
+		return true;
+	}
+
+	bool Codes(std::vector<uint8_t> &out, const Huffman &lengthCodes, const Huffman &distanceCodes)
+	{
+		static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+			67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+			1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const uint8_t distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+			12, 12, 13, 13 };
+		for (;;)
+		{
+			int symbol = Decode(lengthCodes);
+			if (symbol < 0 || overrun)
+				return false;
+			if (symbol < 256)
+				out.push_back((uint8_t)symbol);
+			else if (symbol == 256)
+				return true;
+			else
+			{
+				symbol -= 257;
+				if (symbol >= 29)
+					return false;
+				uint32_t length = lengthBase[symbol] + Bits(lengthExtra[symbol]);
+				int distanceSymbol = Decode(distanceCodes);
+				if (distanceSymbol < 0 || distanceSymbol >= 30)
+					return false;
+				size_t distance = distanceBase[distanceSymbol] + Bits(distanceExtra[distanceSymbol]);
+				if (distance > out.size())
+					return false;
+				for (uint32_t i = 0; i < length; i++)
+					out.push_back(out[out.size() - distance]);
+			}
+		}
+	}
+
+	bool Fixed(std::vector<uint8_t> &out)
+	{
+		uint8_t lengths[320];
+		int i = 0;
+		for (; i < 144; i++)
+			lengths[i] = 8;
+		for (; i < 256; i++)
+			lengths[i] = 9;
+		for (; i < 280; i++)
+			lengths[i] = 7;
+		for (; i < 288; i++)
+			lengths[i] = 8;
+		for (; i < 318; i++)
+			lengths[i] = 5;
+		Huffman lengthCodes, distanceCodes;
+		Build(lengthCodes, lengths, 288);
+		Build(distanceCodes, lengths + 288, 30);
+		return Codes(out, lengthCodes, distanceCodes);
+	}
+
+	bool Dynamic(std::vector<uint8_t> &out)
+	{
+		static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+		int lengthCount = (int)Bits(5) + 257;
+		int distanceCount = (int)Bits(5) + 1;
+		int codeCount = (int)Bits(4) + 4;
+		if (lengthCount > 286 || distanceCount > 30)
+			return false;
+		uint8_t lengths[320] = {};
+		for (int i = 0; i < codeCount; i++)
+			lengths[order[i]] = (uint8_t)Bits(3);
+		Huffman codeCodes;
+		if (!Build(codeCodes, lengths, 19))
+			return false;
+
+		int index = 0;
+		while (index < lengthCount + distanceCount)
+		{
+			int symbol = Decode(codeCodes);
+			if (symbol < 0 || overrun)
+				return false;
+			if (symbol < 16)
+			{
+				lengths[index++] = (uint8_t)symbol;
+				continue;
+			}
+			uint8_t repeated = 0;
+			int repeat;
+			if (symbol == 16)
+			{
+				if (index == 0)
+					return false;
+				repeated = lengths[index - 1];
+				repeat = 3 + (int)Bits(2);
+			}
+			else
+				repeat = symbol == 17 ? 3 + (int)Bits(3) : 11 + (int)Bits(7);
+			if (index + repeat > lengthCount + distanceCount)
+				return false;
+			while (repeat--)
+				lengths[index++] = repeated;
+		}
+
+		Huffman lengthCodes, distanceCodes;
+		// Incomplete codes are allowed, so only over-subscription fails.
+		if (!Build(lengthCodes, lengths, lengthCount) || !Build(distanceCodes, lengths + lengthCount, distanceCount))
+			return false;
+		return Codes(out, lengthCodes, distanceCodes);
+	}
+
+	const uint8_t *data;
+	size_t size;
+	size_t position;
+	uint32_t bitBuffer;
+	int bitCount;
+	bool overrun;
+};
+
+static bool DecodePng(const std::vector<uint8_t> &png, uint32_t width, uint32_t height, std::vector<uint8_t> &rgba)
+{
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	if (png.size() < 8 || memcmp(png.data(), signature, 8) != 0)
+		return false;
+	std::vector<uint8_t> zlib;
+	bool sawHeader = false, sawEnd = false;
+	for (size_t p = 8; !sawEnd;)
+	{
+		if (png.size() - p < 12)
+			return false;
+		uint32_t length = ReadBigEndian32(&png[p]);
+		if (png.size() - p - 12 < length || Crc32(&png[p + 4], length + 4) != ReadBigEndian32(&png[p + 8 + length]))
+			return false;
+		const uint8_t *chunk = &png[p + 8];
+		if (memcmp(&png[p + 4], "IHDR", 4) == 0)
+		{
+			if (length != 13 || ReadBigEndian32(chunk) != width || ReadBigEndian32(chunk + 4) != height || chunk[8] != 8 || chunk[9] != 6)
+				return false;
+			sawHeader = true;
+		}
+		else if (memcmp(&png[p + 4], "IDAT", 4) == 0)
+			zlib.insert(zlib.end(), chunk, chunk + length);
+		else if (memcmp(&png[p + 4], "IEND", 4) == 0)
+			sawEnd = true;
+		p += 12 + length;
+	}
+	if (!sawHeader || zlib.size() < 6 || ((zlib[0] << 8) | zlib[1]) % 31 != 0 || (zlib[0] & 0x0f) != 8)
+		return false;
+
+	std::vector<uint8_t> filtered;
+	Inflater inflater(zlib.data() + 2, zlib.size() - 2);
+	size_t stride = (size_t)width * 4;
+	if (!inflater.Inflate(filtered) || filtered.size() != (stride + 1) * height || zlib.size() - 2 - inflater.GetPosition() != 4 ||
+		Adler32(filtered.data(), filtered.size()) != ReadBigEndian32(&zlib[zlib.size() - 4]))
+		return false;
+
+	rgba.resize(stride * height);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint8_t *source = &filtered[y * (stride + 1)];
+		uint8_t *row = &rgba[y * stride];
+		const uint8_t *above = y > 0 ? row - stride : nullptr;
+		for (size_t i = 0; i < stride; i++)
+		{
+			int a = i >= 4 ? row[i - 4] : 0;
+			int b = above ? above[i] : 0;
+			int c = above && i >= 4 ? above[i - 4] : 0;
+			int predicted;
+			switch (source[0])
+			{
+			case 0: predicted = 0; break;
+			case 1: predicted = a; break;
+			case 2: predicted = b; break;
+			case 3: predicted = (a + b) >> 1; break;
+			case 4:
+			{
+				int estimate = a + b - c;
+				int pa = abs(estimate - a), pb = abs(estimate - b), pc = abs(estimate - c);
+				predicted = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+				break;
+			}
+			default: return false;
+			}
+			row[i] = (uint8_t)(source[1 + i] + predicted);
+		}
+	}
+	return true;
+}
+
+static bool DecodeQoi(const std::vector<uint8_t> &qoi, uint32_t width, uint32_t height, std::vector<uint8_t> &rgba)
+{
+	static const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	if (qoi.size() < 22 || memcmp(qoi.data(), "qoif", 4) != 0 || ReadBigEndian32(&qoi[4]) != width || ReadBigEndian32(&qoi[8]) != height ||
+		qoi[12] != 4 || memcmp(&qoi[qoi.size() - 8], end, 8) != 0)
+		return false;
+
+	uint8_t index[64][4] = {};
+	uint8_t pixel[4] = { 0, 0, 0, 255 };
+	size_t pixelCount = (size_t)width * height, p = 14, last = qoi.size() - 8;
+	rgba.resize(pixelCount * 4);
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		if (p >= last)
+			return false;
+		uint8_t op = qoi[p++];
+		int run = 0;
+		if (op == 0xfe || op == 0xff)
+		{
+			int channels = op == 0xff ? 4 : 3;
+			if (last - p < (size_t)channels)
+				return false;
+			memcpy(pixel, &qoi[p], channels);
+			p += channels;
+		}
+		else if ((op & 0xc0) == 0x00)
+			memcpy(pixel, index[op], 4);
+		else if ((op & 0xc0) == 0x40)
+		{
+			pixel[0] += ((op >> 4) & 3) - 2;
+			pixel[1] += ((op >> 2) & 3) - 2;
+			pixel[2] += (op & 3) - 2;
+		}
+		else if ((op & 0xc0) == 0x80)
+		{
+			if (p >= last)
+				return false;
+			int dg = (op & 0x3f) - 32;
+			uint8_t second = qoi[p++];
+			pixel[0] += dg + (second >> 4) - 8;
+			pixel[1] += dg;
+			pixel[2] += dg + (second & 0x0f) - 8;
+		}
+		else
+			run = op & 0x3f;
+		if (i + run >= pixelCount)
+			return false;
+		for (int r = 0; r <= run; r++)
+			memcpy(&rgba[(i + r) * 4], pixel, 4);
+		i += run;
+		memcpy(index[(pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) & 63], pixel, 4);
+	}
+	return p == last;
+}
+
+// The header ends where the offset table says the first scanline is, and the
+// blocks fill the rest of the file exactly.
+static bool CheckExr(const std::vector<uint8_t> &exr, uint32_t width, uint32_t height)
+{
+	uint32_t magic, version;
+	if (exr.size() < 8)
+		return false;
+	memcpy(&magic, &exr[0], 4);
+	memcpy(&version, &exr[4], 4);
+	if (magic != 20000630 || version != 2)
+		return false;
+	size_t p = 8;
+	while (p < exr.size() && exr[p] != 0)
+	{
+		const void *nameEnd = memchr(&exr[p], 0, exr.size() - p);
+		if (!nameEnd)
+			return false;
+		p = (const uint8_t *)nameEnd - exr.data() + 1;
+		const void *typeEnd = memchr(&exr[p], 0, exr.size() - p);
+		if (!typeEnd)
+			return false;
+		p = (const uint8_t *)typeEnd - exr.data() + 1;
+		uint32_t attributeSize;
+		if (exr.size() - p < 4)
+			return false;
+		memcpy(&attributeSize, &exr[p], 4);
+		p += 4 + attributeSize;
+	}
+	p++;
+
+	uint64_t blockSize = 8 + (uint64_t)width * 4 * sizeof(uint16_t);
+	if (exr.size() < p + (uint64_t)height * 8 || exr.size() - p - (uint64_t)height * 8 != height * blockSize)
+		return false;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		uint64_t offset;
+		int32_t line;
+		uint32_t byteCount;
+		memcpy(&offset, &exr[p + y * 8], 8);
+		if (offset != p + (uint64_t)height * 8 + y * blockSize)
+			return false;
+		memcpy(&line, &exr[offset], 4);
+		memcpy(&byteCount, &exr[offset + 4], 4);
+		if (line != (int32_t)y || byteCount != blockSize - 8)
+			return false;
+	}
+	return true;
+}
+
+// Decodes what can be decoded and compares it with the source; EXR gets a
+// structural check only, since its pixels are converted.
+static bool CheckEncoded(ImageFormat format, const std::vector<uint8_t> &encoded, const std::vector<uint8_t> &image)
+{
+	std::vector<uint8_t> decoded;
+	switch (format)
+	{
+	case IMAGE_FORMAT_PPM:
+	{
+		char header[64];
+		size_t headerSize = (size_t)snprintf(header, sizeof(header), "P6\n%u %u\n255\n", IMAGE_WIDTH, IMAGE_HEIGHT);
+		if (encoded.size() != headerSize + (size_t)IMAGE_WIDTH * IMAGE_HEIGHT * 3 || memcmp(encoded.data(), header, headerSize) != 0)
+			return false;
+		for (size_t i = 0; i < (size_t)IMAGE_WIDTH * IMAGE_HEIGHT; i++)
+		{
+			if (memcmp(&encoded[headerSize + i * 3], &image[i * 4], 3) != 0)
+				return false;
+		}
+		return true;
+	}
+	case IMAGE_FORMAT_PNG:
+		return DecodePng(encoded, IMAGE_WIDTH, IMAGE_HEIGHT, decoded) && decoded == image;
+	case IMAGE_FORMAT_QOI:
+		return DecodeQoi(encoded, IMAGE_WIDTH, IMAGE_HEIGHT, decoded) && decoded == image;
+	case IMAGE_FORMAT_EXR:
+		return CheckExr(encoded, IMAGE_WIDTH, IMAGE_HEIGHT);
+	}
+	return false;
+}
+
+// One frame per thread, the way the capture writers use the encoders.
+static void BenchmarkFrames(BenchmarkState &state, ImageFormat format, uint32_t threads)
+{
+	const std::vector<uint8_t> &image = GetTestImage();
+	std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads) : nullptr);
+	std::vector<std::vector<uint8_t>> outputs(threads);
+
+	state.SetBytesProcessed(IMAGE_BYTES * threads);
+	state.Measure([&]
+	{
+		for (std::vector<uint8_t> &output : outputs)
+			output.clear();
+		if (!pool)
+		{
+			EncodeImage(format, image.data(), IMAGE_WIDTH, IMAGE_HEIGHT, outputs[0]);
+			return;
+		}
+		for (uint32_t i = 0; i < threads; i++)
+			pool->Submit([&, i] { EncodeImage(format, image.data(), IMAGE_WIDTH, IMAGE_HEIGHT, outputs[i]); });
+		pool->WaitIdle();
+	});
+	state.AddMetric("threads", threads);
+	state.AddMetric("compression_ratio", (double)IMAGE_BYTES / outputs[0].size());
+	for (const std::vector<uint8_t> &output : outputs)
+	{
+		if (!CheckEncoded(format, output, image))
+		{
+			state.Fail("the encoded image does not decode to the source");
+			break;
+		}
+	}
+}
+
+// A single PNG split into strips deflated in parallel.
+static void BenchmarkPngStrips(BenchmarkState &state, uint32_t threads)
+{
+	const std::vector<uint8_t> &image = GetTestImage();
+	ThreadPool pool(threads);
+	std::vector<uint8_t> output;
+	state.SetBytesProcessed(IMAGE_BYTES);
+	state.Measure([&]
+	{
+		output.clear();
+		EncodePng(image.data(), IMAGE_WIDTH, IMAGE_HEIGHT, output, &pool);
+	});
+	state.AddMetric("threads", threads);
+	state.AddMetric("compression_ratio", (double)IMAGE_BYTES / output.size());
+	if (!CheckEncoded(IMAGE_FORMAT_PNG, output, image))
+		state.Fail("the strips do not decode to the source");
+}
+
+// Empty images have no PNG form, so nothing is appended, with or without
+// strips.
+static void BenchmarkPngEmpty(BenchmarkState &state)
+{
+	const std::vector<uint8_t> &image = GetTestImage();
+	ThreadPool pool(2);
+	std::vector<uint8_t> output;
+	state.Measure([&]
+	{
+		output.clear();
+		EncodePng(image.data(), IMAGE_WIDTH, 0, output);
+		EncodePng(image.data(), IMAGE_WIDTH, 0, output, &pool);
+		EncodePng(image.data(), IMAGE_WIDTH, 0, output, &pool, 4);
+		EncodePng(image.data(), 0, IMAGE_HEIGHT, output, &pool);
+	});
+	if (!output.empty())
+		state.Fail("an empty image produced output");
+}
+
+#define IMAGE_FORMAT_BENCHMARKS(name, format) \
+	BENCHMARK(image_##name##_t1, "image") { BenchmarkFrames(state, format, 1); } \
+	BENCHMARK(image_##name##_frames_t4, "image") { BenchmarkFrames(state, format, 4); } \
+	BENCHMARK(image_##name##_frames_t8, "image") { BenchmarkFrames(state, format, 8); }
+
+IMAGE_FORMAT_BENCHMARKS(ppm, IMAGE_FORMAT_PPM)
+IMAGE_FORMAT_BENCHMARKS(png, IMAGE_FORMAT_PNG)
+IMAGE_FORMAT_BENCHMARKS(qoi, IMAGE_FORMAT_QOI)
+IMAGE_FORMAT_BENCHMARKS(exr, IMAGE_FORMAT_EXR)
+
+BENCHMARK(image_png_strips_t2, "image") { BenchmarkPngStrips(state, 2); }
+BENCHMARK(image_png_strips_t4, "image") { BenchmarkPngStrips(state, 4); }
+BENCHMARK(image_png_strips_t8, "image") { BenchmarkPngStrips(state, 8); }
+BENCHMARK(image_png_empty, "image") { BenchmarkPngEmpty(state); }
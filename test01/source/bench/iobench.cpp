@@ -0,0 +1,172 @@
+#include <filesystem>
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "fileio.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const uint64_t IO_FILE_SIZE = 256ull << 20;
+static const uint32_t RANDOM_READ_SIZE = 4096;
+static const uint32_t RANDOM_READ_COUNT = 4096;
+static const uint32_t SEQUENTIAL_READ_SIZE = 128 * 1024;
+
+static const std::string &GetIoBenchFile()
+{
+	static std::string path = []
+	{
+		std::filesystem::path directory = std::filesystem::temp_directory_path() / "vulkan01_iobench";
+		std::filesystem::create_directories(directory);
+		std::string result = (directory / "data.bin").string();
+		std::error_code error;
+		if (std::filesystem::file_size(result, error) == IO_FILE_SIZE)
+			return result;
+		FILE *file = fopen(result.c_str(), "wb");
+		if (!file)
+			return std::string();
+		std::mt19937 rng(48);
+		std::vector<uint32_t> block(1 << 18);
+		bool ok = true;
+		for (uint64_t written = 0; written < IO_FILE_SIZE && ok; written += block.size() * sizeof(uint32_t))
+		{
+			for (uint32_t &word : block)
+				word = rng();
+			ok = fwrite(block.data(), sizeof(uint32_t), block.size(), file) == block.size();
+		}
+		ok = fclose(file) == 0 && ok;
+		return ok ? result : std::string();
+	}();
+	return path;
+}
+
+// Unbuffered where the platform allows, so reads reach the device instead of
+// the page cache; otherwise the cache is dropped before every run.
+struct IoBenchFile
+{
+	IoFile file;
+	bool direct;
+	bool open;
+
+	explicit IoBenchFile(const std::string &path)
+		: direct(true)
+	{
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+		open = file != INVALID_HANDLE_VALUE;
+#else
+		file = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+		if (file < 0)
+		{
+			direct = false;
+			file = ::open(path.c_str(), O_RDONLY);
+		}
+		open = file >= 0;
+#endif
+	}
+
+	~IoBenchFile()
+	{
+		if (!open)
+			return;
+#ifdef _WIN32
+		CloseHandle(file);
+#else
+		close(file);
+#endif
+	}
+
+	void DropCache()
+	{
+#ifndef _WIN32
+		if (!direct)
+			posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+	}
+};
+
+// Keeps depth reads in flight, one registered buffer each, until every offset
+// has been read.
+static void BenchmarkReads(BenchmarkState &state, IoBackend backend, uint32_t depth, bool sequential)
+{
+	const std::string &path = GetIoBenchFile();
+	IoBenchFile file(path);
+	uint32_t readSize = sequential ? SEQUENTIAL_READ_SIZE : RANDOM_READ_SIZE;
+	IoQueue queue;
+	if (path.empty() || !file.open || !queue.Init(backend, depth, depth, readSize))
+	{
+		state.Fail("could not set up the read");
+		return;
+	}
+
+	std::vector<uint64_t> offsets;
+	if (sequential)
+	{
+		for (uint64_t offset = 0; offset < IO_FILE_SIZE; offset += readSize)
+			offsets.push_back(offset);
+	}
+	else
+	{
+		std::mt19937_64 rng(depth);
+		for (uint32_t i = 0; i < RANDOM_READ_COUNT; i++)
+			offsets.push_back(rng() % (IO_FILE_SIZE / readSize) * readSize);
+	}
+
+	std::vector<uint32_t> freeBuffers;
+	std::vector<IoCompletion> completions(depth);
+	uint64_t failed = 0;
+	state.SetItemsProcessed(offsets.size());
+	state.SetBytesProcessed(offsets.size() * readSize);
+	state.Measure([&]
+	{
+		freeBuffers.clear();
+		for (uint32_t i = 0; i < depth; i++)
+			freeBuffers.push_back(i);
+		size_t next = 0, done = 0;
+		while (done < offsets.size())
+		{
+			while (next < offsets.size() && !freeBuffers.empty())
+			{
+				uint32_t buffer = freeBuffers.back();
+				freeBuffers.pop_back();
+				queue.ReadFixed(file.file, offsets[next++], readSize, buffer, buffer);
+			}
+			queue.Submit();
+			size_t count = queue.Reap(completions.data(), completions.size(), 1);
+			for (size_t i = 0; i < count; i++)
+			{
+				failed += completions[i].result != (int64_t)readSize;
+				freeBuffers.push_back((uint32_t)completions[i].userData);
+			}
+			done += count;
+		}
+	}, [&]
+	{
+		file.DropCache();
+	});
+	state.AddMetric("queue_depth", depth);
+	state.AddMetric("uring", queue.GetBackend() == IO_BACKEND_URING);
+	state.AddMetric("registered_buffers", queue.HasRegisteredBuffers());
+	state.AddMetric("direct", file.direct);
+	if (failed)
+		state.Fail("short or failed reads");
+}
+
+#define IO_BENCHMARKS(depth) \
+	BENCHMARK(io_random4k_uring_qd##depth, "io") { BenchmarkReads(state, IO_BACKEND_URING, depth, false); } \
+	BENCHMARK(io_random4k_threads_qd##depth, "io") { BenchmarkReads(state, IO_BACKEND_THREADS, depth, false); } \
+	BENCHMARK(io_seq128k_uring_qd##depth, "io") { BenchmarkReads(state, IO_BACKEND_URING, depth, true); } \
+	BENCHMARK(io_seq128k_threads_qd##depth, "io") { BenchmarkReads(state, IO_BACKEND_THREADS, depth, true); }
+
+IO_BENCHMARKS(1)
+IO_BENCHMARKS(4)
+IO_BENCHMARKS(16)
+IO_BENCHMARKS(64)
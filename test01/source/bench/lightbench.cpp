@@ -0,0 +1,190 @@
+#include <math.h>
+#include <memory>
+#include <vector>
+#include "benchmark.h"
+#include "lightclusters.h"
+#include "threadpool.h"
+
+static const uint32_t LIGHT_VIEW_WIDTH = 1280;
+static const uint32_t LIGHT_VIEW_HEIGHT = 720;
+static const float LIGHT_FOV = 1.0f;
+static const float LIGHT_NEAR = 0.1f;
+static const float LIGHT_FAR = 200.0f;
+
+// Surface points for shading: a ground plane seen from a raised camera, one
+// point per 4x4 pixel block, as a G-buffer would hold them.
+struct LightSample
+{
+	float pixelX;
+	float pixelY;
+	float viewDepth;
+	Vec3 position;
+};
+
+struct LightScene
+{
+	Mat4 view;
+	std::vector<PointLight> lights;
+	std::vector<LightSample> samples;
+};
+
+static const LightScene &GetLightScene(uint32_t lightCount)
+{
+	static std::vector<std::unique_ptr<LightScene>> scenes;
+	for (const std::unique_ptr<LightScene> &scene : scenes)
+	{
+		if (scene->lights.size() == lightCount)
+			return *scene;
+	}
+
+	LightScene *scene = new LightScene;
+	scenes.emplace_back(scene);
+	Vec3 eye(0.0f, 12.0f, 70.0f), target(0.0f, 0.0f, 0.0f);
+	scene->view = Mat4::LookAt(eye, target, Vec3(0, 1, 0));
+	GenerateLights(scene->lights, lightCount, Vec3(-100.0f, 0.5f, -120.0f), Vec3(100.0f, 6.0f, 70.0f), 2.0f, 6.0f, 50);
+
+	// Rays through pixel centres, in the same basis LookAt builds.
+	Vec3 forward = Normalize(target - eye);
+	Vec3 side = Normalize(Cross(forward, Vec3(0, 1, 0)));
+	Vec3 up = Cross(side, forward);
+	float tanY = tanf(LIGHT_FOV * 0.5f), tanX = tanY * LIGHT_VIEW_WIDTH / LIGHT_VIEW_HEIGHT;
+	for (uint32_t y = 2; y < LIGHT_VIEW_HEIGHT; y += 4)
+	{
+		for (uint32_t x = 2; x < LIGHT_VIEW_WIDTH; x += 4)
+		{
+			float u = ((x + 0.5f) / LIGHT_VIEW_WIDTH * 2.0f - 1.0f) * tanX;
+			float v = -((y + 0.5f) / LIGHT_VIEW_HEIGHT * 2.0f - 1.0f) * tanY;
+			Vec3 ray = forward + side * u + up * v;
+			if (ray.y >= 0.0f)
+				continue;
+			float t = -eye.y / ray.y;
+			if (t > LIGHT_FAR)
+				continue;
+			LightSample sample;
+			sample.pixelX = x + 0.5f;
+			sample.pixelY = y + 0.5f;
+			sample.viewDepth = t;	// forward has unit length, so t is the view depth
+			sample.position = eye + ray * t;
+			scene->samples.push_back(sample);
+		}
+	}
+	return *scene;
+}
+
+static LightClusters *CreateClusters(bool narrowRows = true)
+{
+	LightClusterConfig config;
+	config.narrowRows = narrowRows;
+	LightClusters *clusters = new LightClusters(config);
+	clusters->SetProjection(LIGHT_FOV, LIGHT_VIEW_WIDTH, LIGHT_VIEW_HEIGHT, LIGHT_NEAR, LIGHT_FAR);
+	return clusters;
+}
+
+enum BinPath
+{
+	BIN_SCALAR,
+	BIN_SIMD,
+	BIN_POOL,
+};
+
+static void BenchmarkBin(BenchmarkState &state, uint32_t lightCount, BinPath path)
+{
+	const LightScene &scene = GetLightScene(lightCount);
+	std::unique_ptr<LightClusters> clusters(CreateClusters());
+	std::unique_ptr<ThreadPool> pool(path == BIN_POOL ? new ThreadPool(4) : nullptr);
+	state.SetItemsProcessed(lightCount);
+	state.Measure([&]
+	{
+		clusters->Bin(scene.lights.data(), lightCount, scene.view, pool.get(), path != BIN_SCALAR);
+	});
+	state.AddMetric("lights_per_cluster", clusters->GetAverageLightsPerCluster());
+	state.AddMetric("max_cluster_lights", clusters->GetMaxClusterLights());
+	state.AddMetric("dropped", clusters->GetDroppedLights());
+	state.AddMetric("rows_tested", (double)clusters->GetTestedRows());
+
+	// Every path must produce the same lists as scalar binning that tests
+	// every row, while testing fewer rows.
+	std::unique_ptr<LightClusters> reference(CreateClusters(false));
+	reference->Bin(scene.lights.data(), lightCount, scene.view, nullptr, false);
+	state.AddMetric("rows_tested_unnarrowed", (double)reference->GetTestedRows());
+	if (reference->GetClusterRanges() != clusters->GetClusterRanges() || reference->GetLightIndices() != clusters->GetLightIndices())
+		state.Fail("cluster lists differ from the scalar binning");
+	if (clusters->GetTestedRows() >= reference->GetTestedRows())
+		state.Fail("narrowing did not cut the tile rows tested");
+}
+
+// Shading every sample with all lights, the loop clustering replaces.
+static void BenchmarkShadeNaive(BenchmarkState &state, uint32_t lightCount)
+{
+	const LightScene &scene = GetLightScene(lightCount);
+	Vec3 normal(0, 1, 0), sum;
+	state.SetItemsProcessed(scene.samples.size());
+	state.Measure([&]
+	{
+		for (const LightSample &sample : scene.samples)
+			sum = sum + ShadeAllLights(scene.lights.data(), lightCount, sample.position, normal);
+		DoNotOptimize(sum);
+	});
+	state.AddMetric("lights_per_sample", lightCount);
+}
+
+// Binning and then shading each sample with its cluster's list. The result
+// has to match the naive loop exactly: lists keep index order, so the same
+// lights are summed in the same order.
+static void BenchmarkShadeClustered(BenchmarkState &state, uint32_t lightCount)
+{
+	const LightScene &scene = GetLightScene(lightCount);
+	std::unique_ptr<LightClusters> clusters(CreateClusters());
+	Vec3 normal(0, 1, 0), sum;
+	uint64_t lightsVisited = 0;
+	state.SetItemsProcessed(scene.samples.size());
+	state.Measure([&]
+	{
+		clusters->Bin(scene.lights.data(), lightCount, scene.view);
+		const std::vector<uint32_t> &ranges = clusters->GetClusterRanges();
+		const uint32_t *indices = clusters->GetLightIndices().data();
+		lightsVisited = 0;
+		for (const LightSample &sample : scene.samples)
+		{
+			uint32_t cluster = clusters->FindCluster(sample.pixelX, sample.pixelY, sample.viewDepth);
+			if (cluster == LightClusters::NO_CLUSTER)
+				continue;
+			uint32_t count = ranges[cluster * 2 + 1];
+			sum = sum + ShadeLights(scene.lights.data(), indices + ranges[cluster * 2], count, sample.position, normal);
+			lightsVisited += count;
+		}
+		DoNotOptimize(sum);
+	});
+	state.AddMetric("bin_ms", clusters->GetBinNs() / 1000000.0);
+	state.AddMetric("lights_per_cluster", clusters->GetAverageLightsPerCluster());
+	state.AddMetric("lights_per_sample", (double)lightsVisited / scene.samples.size());
+	if (clusters->GetDroppedLights())
+		state.Fail("lights dropped over the cluster limit");
+
+	uint32_t mismatches = 0;
+	const std::vector<uint32_t> &ranges = clusters->GetClusterRanges();
+	for (const LightSample &sample : scene.samples)
+	{
+		uint32_t cluster = clusters->FindCluster(sample.pixelX, sample.pixelY, sample.viewDepth);
+		if (cluster == LightClusters::NO_CLUSTER)
+			continue;
+		Vec3 clustered = ShadeLights(scene.lights.data(), clusters->GetLightIndices().data() + ranges[cluster * 2], ranges[cluster * 2 + 1],
+			sample.position, normal);
+		Vec3 naive = ShadeAllLights(scene.lights.data(), lightCount, sample.position, normal);
+		mismatches += clustered.x != naive.x || clustered.y != naive.y || clustered.z != naive.z;
+	}
+	state.AddMetric("mismatches", mismatches);
+	if (mismatches)
+		state.Fail("clustered shading differs from shading every light");
+}
+
+#define LIGHT_BENCHMARKS(count) \
+	BENCHMARK(lights_bin_##count##_scalar, "lights") { BenchmarkBin(state, count, BIN_SCALAR); } \
+	BENCHMARK(lights_bin_##count##_simd, "lights") { BenchmarkBin(state, count, BIN_SIMD); } \
+	BENCHMARK(lights_bin_##count##_t4, "lights") { BenchmarkBin(state, count, BIN_POOL); } \
+	BENCHMARK(lights_shade_naive_##count, "lights") { BenchmarkShadeNaive(state, count); } \
+	BENCHMARK(lights_shade_clustered_##count, "lights") { BenchmarkShadeClustered(state, count); }
+
+LIGHT_BENCHMARKS(256)
+LIGHT_BENCHMARKS(1024)
+LIGHT_BENCHMARKS(4096)
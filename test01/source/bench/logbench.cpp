@@ -0,0 +1,99 @@
+#include <fstream>
+#include <stdio.h>
+#include "benchmark.h"
+#include "log.h"
+
+// Cost of a log call on the calling thread. Each repetition issues a burst of
+// calls into a ring the setup step has just drained, so the numbers cover the
+// record capture only; formatting happens on the writer thread, whose output
+// goes to /dev/null.
+static const uint32_t CALLS_PER_REPETITION = 256;
+
+struct NullLogOutput
+{
+	NullLogOutput() { Log::SetOutputFile("/dev/null"); }
+	~NullLogOutput() { Log::SetOutputFile(""); }
+};
+
+template <typename Body>
+static void BenchmarkLogCalls(BenchmarkState &state, Body body)
+{
+	NullLogOutput output;
+	uint64_t droppedBefore = Log::GetDroppedCount();
+	state.SetItemsProcessed(CALLS_PER_REPETITION);
+	state.Measure([&]
+	{
+		for (uint32_t i = 0; i < CALLS_PER_REPETITION; i++)
+			body(i);
+	}, []
+	{
+		Log::Flush();
+	});
+	if (Log::GetDroppedCount() != droppedBefore)
+		state.Fail("records were dropped");
+}
+
+BENCHMARK(log_ints, "log")
+{
+	BenchmarkLogCalls(state, [](uint32_t i)
+	{
+		LOG_INFO(LOG_CATEGORY_FRAME, "frame %u: %d draws, %.3f ms", i, 42, 1.25);
+	});
+}
+
+BENCHMARK(log_string, "log")
+{
+	const std::string name = "shaders/basic.frag.spv";
+	BenchmarkLogCalls(state, [&](uint32_t i)
+	{
+		LOG_INFO(LOG_CATEGORY_PIPELINES, "loaded %s (%u bytes)", name, i);
+	});
+}
+
+// Filtered by level: the check every disabled call site pays.
+BENCHMARK(log_disabled, "log")
+{
+	BenchmarkLogCalls(state, [](uint32_t i)
+	{
+		LOG_DEBUG(LOG_CATEGORY_FRAME, "frame %u", i);
+	});
+}
+
+// Almost every call is suppressed after the first few in the window.
+BENCHMARK(log_rate_limited, "log")
+{
+	BenchmarkLogCalls(state, [](uint32_t i)
+	{
+		LOG_RATE_LIMITED(LOG_LEVEL_WARNING, LOG_CATEGORY_FRAME, 10, "late frame %u", i);
+	});
+}
+
+// The synchronous path the logger replaced: format on the calling thread and
+// write through a stream flushed at every line, as std::endl did.
+BENCHMARK(log_sync_stream, "log")
+{
+	std::ofstream out("/dev/null");
+	state.SetItemsProcessed(CALLS_PER_REPETITION);
+	state.Measure([&]
+	{
+		for (uint32_t i = 0; i < CALLS_PER_REPETITION; i++)
+			out << "frame " << i << ": " << 42 << " draws, " << 1.25 << " ms" << std::endl;
+	});
+}
+
+BENCHMARK(log_sync_snprintf, "log")
+{
+	FILE *out = fopen("/dev/null", "w");
+	state.SetItemsProcessed(CALLS_PER_REPETITION);
+	state.Measure([&]
+	{
+		char line[256];
+		for (uint32_t i = 0; i < CALLS_PER_REPETITION; i++)
+		{
+			int length = snprintf(line, sizeof(line), "frame %u: %d draws, %.3f ms\n", i, 42, 1.25);
+			fwrite(line, 1, (size_t)length, out);
+			fflush(out);
+		}
+	});
+	fclose(out);
+}
@@ -0,0 +1,177 @@
+#include <memory>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "mesh.h"
+#include "meshcodec.h"
+#include "meshoptimize.h"
+#include "threadpool.h"
+#include "vertexformat.h"
+
+struct CodecAsset
+{
+	std::vector<uint8_t> raw;
+	size_t count;
+	size_t stride;
+	size_t laneSize;
+};
+
+// A sphere laid out as the importer leaves it: vertex cache and fetch
+// optimized, so neighbouring vertices are close together.
+static const Mesh &GetCodecMesh()
+{
+	static Mesh mesh = []
+	{
+		Mesh result = GenerateSphere(384, 768, 3.0f);
+		OptimizeMesh(result);
+		return result;
+	}();
+	return mesh;
+}
+
+static CodecAsset MakeAsset(const void *data, size_t count, size_t stride, size_t laneSize)
+{
+	CodecAsset asset;
+	asset.raw.resize(count * stride);
+	memcpy(asset.raw.data(), data, asset.raw.size());
+	asset.count = count;
+	asset.stride = stride;
+	asset.laneSize = laneSize;
+	return asset;
+}
+
+static const CodecAsset &GetFloatVertices()
+{
+	static CodecAsset asset = MakeAsset(GetCodecMesh().vertices.data(), GetCodecMesh().vertices.size(), sizeof(Vertex), 4);
+	return asset;
+}
+
+static const CodecAsset &GetPackedVertices()
+{
+	static CodecAsset asset = []
+	{
+		const Mesh &mesh = GetCodecMesh();
+		std::vector<PackedVertex> packed(mesh.vertices.size());
+		PackVertices(packed.data(), mesh.vertices.data(), mesh.vertices.size(), ComputeQuantizationBox(mesh.vertices.data(), mesh.vertices.size()));
+		return MakeAsset(packed.data(), packed.size(), sizeof(PackedVertex), 2);
+	}();
+	return asset;
+}
+
+static const CodecAsset &GetIndices()
+{
+	static CodecAsset asset = MakeAsset(GetCodecMesh().indices.data(), GetCodecMesh().indices.size(), sizeof(uint32_t), 4);
+	return asset;
+}
+
+enum DecodePath
+{
+	DECODE_REFERENCE,
+	DECODE_SIMD,
+	DECODE_POOL,
+};
+
+static void BenchmarkDecode(BenchmarkState &state, const CodecAsset &asset, DecodePath path)
+{
+	std::vector<uint8_t> encoded;
+	EncodeMeshStream(asset.raw.data(), asset.count, asset.stride, asset.laneSize, encoded);
+	std::vector<uint8_t> decoded(asset.raw.size());
+	std::unique_ptr<ThreadPool> pool(path == DECODE_POOL ? new ThreadPool(4) : nullptr);
+	bool ok = true;
+
+	state.SetBytesProcessed(asset.raw.size());
+	state.Measure([&]
+	{
+		if (path == DECODE_REFERENCE)
+			ok = DecodeMeshStreamReference(encoded.data(), encoded.size(), decoded.data(), decoded.size()) && ok;
+		else
+			ok = DecodeMeshStream(encoded.data(), encoded.size(), decoded.data(), decoded.size(), pool.get()) && ok;
+		DoNotOptimize(decoded.data());
+	});
+	state.AddMetric("raw_bytes", (double)asset.raw.size());
+	state.AddMetric("encoded_bytes", (double)encoded.size());
+	state.AddMetric("compression_ratio", (double)asset.raw.size() / encoded.size());
+	if (!ok || decoded != asset.raw)
+		state.Fail("decoded stream differs from the input");
+}
+
+#define MESH_CODEC_BENCHMARKS(name, asset) \
+	BENCHMARK(meshcodec_##name##_reference, "meshcodec") { BenchmarkDecode(state, asset(), DECODE_REFERENCE); } \
+	BENCHMARK(meshcodec_##name##_simd, "meshcodec") { BenchmarkDecode(state, asset(), DECODE_SIMD); } \
+	BENCHMARK(meshcodec_##name##_t4, "meshcodec") { BenchmarkDecode(state, asset(), DECODE_POOL); }
+
+MESH_CODEC_BENCHMARKS(float_vertices, GetFloatVertices)
+MESH_CODEC_BENCHMARKS(packed_vertices, GetPackedVertices)
+MESH_CODEC_BENCHMARKS(indices, GetIndices)
+
+BENCHMARK(meshcodec_encode, "meshcodec")
+{
+	const CodecAsset &asset = GetFloatVertices();
+	std::vector<uint8_t> encoded;
+	state.SetBytesProcessed(asset.raw.size());
+	state.Measure([&]
+	{
+		encoded.clear();
+		EncodeMeshStream(asset.raw.data(), asset.count, asset.stride, asset.laneSize, encoded);
+		DoNotOptimize(encoded.data());
+	});
+}
+
+// The LZ stage straight on the raw bytes, to show what the filter adds.
+BENCHMARK(meshcodec_lz_only, "meshcodec")
+{
+	double rawBytes = 0.0, encodedBytes = 0.0;
+	const CodecAsset *assets[] = { &GetFloatVertices(), &GetPackedVertices(), &GetIndices() };
+	const char *names[] = { "float_vertices", "packed_vertices", "indices" };
+	std::vector<std::vector<uint8_t>> compressed(3);
+	for (int a = 0; a < 3; a++)
+	{
+		LzCompress(assets[a]->raw.data(), assets[a]->raw.size(), compressed[a]);
+		rawBytes += assets[a]->raw.size();
+		encodedBytes += compressed[a].size();
+		state.AddMetric(std::string(names[a]) + "_ratio", (double)assets[a]->raw.size() / compressed[a].size());
+	}
+
+	std::vector<uint8_t> decoded(GetFloatVertices().raw.size() + LZ_DECOMPRESS_SLACK);
+	bool ok = true;
+	state.SetBytesProcessed((uint64_t)rawBytes);
+	state.Measure([&]
+	{
+		for (int a = 0; a < 3; a++)
+			ok = LzDecompress(compressed[a].data(), compressed[a].size(), decoded.data(), assets[a]->raw.size()) && ok;
+		DoNotOptimize(decoded.data());
+	});
+	state.AddMetric("compression_ratio", rawBytes / encodedBytes);
+	if (!ok)
+		state.Fail("LZ round trip failed");
+}
+
+// Truncated and corrupted streams must be rejected rather than read past.
+BENCHMARK(meshcodec_reject_corrupt, "meshcodec")
+{
+	const CodecAsset &asset = GetIndices();
+	std::vector<uint8_t> encoded;
+	EncodeMeshStream(asset.raw.data(), asset.count, asset.stride, asset.laneSize, encoded);
+	std::vector<uint8_t> decoded(asset.raw.size());
+	uint32_t accepted = 0, trials = 0;
+	state.Measure([&]
+	{
+		accepted = 0;
+		trials = 0;
+		for (size_t cut = 0; cut < encoded.size(); cut += encoded.size() / 64 + 1, trials++)
+			accepted += DecodeMeshStream(encoded.data(), cut, decoded.data(), decoded.size());
+	});
+	std::vector<uint8_t> corrupt = encoded;
+	uint32_t corruptDecodes = 0;
+	for (size_t at = 20; at < corrupt.size(); at += corrupt.size() / 256 + 1)
+	{
+		corrupt[at] ^= 0x5a;
+		corruptDecodes += DecodeMeshStream(corrupt.data(), corrupt.size(), decoded.data(), decoded.size());
+		corrupt[at] ^= 0x5a;
+	}
+	state.AddMetric("truncations", trials);
+	state.AddMetric("corrupt_decodes_accepted", corruptDecodes);
+	if (accepted != 0)
+		state.Fail("truncated stream accepted");
+}
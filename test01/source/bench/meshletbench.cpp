@@ -0,0 +1,95 @@
+#include <math.h>
+#include <vector>
+#include "benchmark.h"
+#include "culling.h"
+#include "mesh.h"
+#include "meshlet.h"
+
+// A grid of dense spheres merged into one mesh, like the app's meshlet scene.
+static Mesh GenerateSphereGrid(int gridSize, uint32_t rings, uint32_t segments)
+{
+	Mesh sphere = GenerateSphere(rings, segments, 0.8f);
+	Mesh grid;
+	for (int y = 0; y < gridSize; y++)
+	{
+		for (int x = 0; x < gridSize; x++)
+		{
+			uint32_t base = (uint32_t)grid.vertices.size();
+			for (Vertex vertex : sphere.vertices)
+			{
+				vertex.position[0] += (x - gridSize / 2 + 0.5f) * 2.0f;
+				vertex.position[1] += (y - gridSize / 2 + 0.5f) * 2.0f;
+				grid.vertices.push_back(vertex);
+			}
+			for (uint32_t index : sphere.indices)
+				grid.indices.push_back(base + index);
+		}
+	}
+	return grid;
+}
+
+BENCHMARK(meshlet_build, "meshlet")
+{
+	Mesh mesh = GenerateSphere(128, 256, 1.0f);
+	MeshletMesh meshlets;
+
+	state.SetItemsProcessed(mesh.GetTriangleCount());
+	state.Measure([&]
+	{
+		BuildMeshlets(mesh, meshlets);
+		DoNotOptimize(meshlets.meshlets.data());
+	});
+
+	MeshletStats stats = GetMeshletStats(meshlets, mesh.vertices.size());
+	state.AddMetric("meshlets", (double)stats.meshletCount);
+	state.AddMetric("avg_vertices", stats.averageVertices);
+	state.AddMetric("avg_triangles", stats.averageTriangles);
+	state.AddMetric("acmr", stats.acmr);
+	state.AddMetric("atvr", stats.atvr);
+	if (stats.triangleCount != mesh.GetTriangleCount())
+		state.Fail("meshlets lost triangles");
+}
+
+// Culls the app's scene from a camera orbiting it, cycling through the
+// orbit across iterations, and compares the triangles left to draw with the
+// whole mesh.
+BENCHMARK(meshlet_cull_orbit, "meshlet")
+{
+	Mesh mesh = GenerateSphereGrid(6, 96, 192);
+	MeshletMesh meshlets;
+	BuildMeshlets(mesh, meshlets);
+	const size_t count = meshlets.meshlets.size();
+	std::vector<uint32_t> visible(count);
+
+	const int cameraCount = 64;
+	std::vector<Frustum> frustums;
+	std::vector<Vec3> eyes;
+	Mat4 projection = Mat4::Perspective(1.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+	for (int i = 0; i < cameraCount; i++)
+	{
+		float angle = i * 6.2831853f / cameraCount;
+		Vec3 eye(sinf(angle) * 10.0f, 3.0f, cosf(angle) * 10.0f);
+		eyes.push_back(eye);
+		frustums.push_back(Frustum::FromMatrix(projection * Mat4::LookAt(eye, Vec3(0, 0, 0), Vec3(0, 1, 0))));
+	}
+
+	MeshletCullStats stats = {};
+	uint64_t visibleTriangles = 0;
+	int camera = 0;
+	state.SetItemsProcessed(count);
+	state.Measure([&]
+	{
+		size_t visibleCount = CullMeshlets(frustums[camera], eyes[camera], meshlets.bounds.data(), count, visible.data(), &stats);
+		for (size_t i = 0; i < visibleCount; i++)
+			visibleTriangles += meshlets.meshlets[visible[i]].triangleCount;
+		camera = (camera + 1) % cameraCount;
+	});
+
+	double tested = (double)stats.tested;
+	state.AddMetric("meshlets", (double)count);
+	state.AddMetric("frustum_culled", stats.frustumCulled / tested);
+	state.AddMetric("cone_culled", stats.coneCulled / tested);
+	state.AddMetric("triangles_drawn", visibleTriangles / (tested / count) / mesh.GetTriangleCount());
+	if (stats.coneCulled == 0)
+		state.Fail("no clusters were backface culled");
+}
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <vector>
+#include "benchmark.h"
+#include "mesh.h"
+#include "meshoptimize.h"
+#include "softraster.h"
+#include "timer.h"
+
+// A 3x3x3 lattice of overlapping spheres merged into one mesh, so parts hide
+// each other from every side, with triangles and vertices shuffled the way an
+// exporter that knows nothing about caches might leave them.
+static Mesh GenerateScrambledMesh()
+{
+	Mesh sphere = GenerateSphere(32, 64, 0.5f);
+	Mesh mesh;
+	for (int z = -1; z <= 1; z++)
+	{
+		for (int y = -1; y <= 1; y++)
+		{
+			for (int x = -1; x <= 1; x++)
+			{
+				uint32_t base = (uint32_t)mesh.vertices.size();
+				for (Vertex vertex : sphere.vertices)
+				{
+					vertex.position[0] += x * 0.7f;
+					vertex.position[1] += y * 0.7f;
+					vertex.position[2] += z * 0.7f;
+					mesh.vertices.push_back(vertex);
+				}
+				for (uint32_t index : sphere.indices)
+					mesh.indices.push_back(base + index);
+			}
+		}
+	}
+
+	std::mt19937 rng(43);
+	size_t triangleCount = mesh.GetTriangleCount();
+	std::vector<uint32_t> order(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+		order[t] = (uint32_t)t;
+	std::shuffle(order.begin(), order.end(), rng);
+	std::vector<uint32_t> remap(mesh.vertices.size());
+	for (size_t v = 0; v < remap.size(); v++)
+		remap[v] = (uint32_t)v;
+	std::shuffle(remap.begin(), remap.end(), rng);
+
+	Mesh scrambled;
+	scrambled.vertices.resize(mesh.vertices.size());
+	for (size_t v = 0; v < remap.size(); v++)
+		scrambled.vertices[remap[v]] = mesh.vertices[v];
+	for (uint32_t t : order)
+	{
+		for (int k = 0; k < 3; k++)
+			scrambled.indices.push_back(remap[mesh.indices[t * 3 + k]]);
+	}
+	return scrambled;
+}
+
+// Depth writes per covered pixel, averaged over views from all around.
+static double MeasureOverdraw(const Mesh &mesh, const uint32_t *indices)
+{
+	const uint32_t size = 256;
+	DepthRasterizer rasterizer(size, size);
+	Mat4 projection = Mat4::Perspective(0.8f, 1.0f, 0.1f, 20.0f);
+	uint64_t written = 0, covered = 0;
+	for (int view = 0; view < 12; view++)
+	{
+		float angle = view * 6.2831853f / 12;
+		Vec3 eye(sinf(angle) * 4.0f, (view % 3 - 1) * 2.0f, cosf(angle) * 4.0f);
+		rasterizer.Clear();
+		rasterizer.ResetStats();
+		rasterizer.DrawIndexed(mesh.vertices[0].position, sizeof(Vertex), indices, mesh.indices.size(),
+			projection * Mat4::LookAt(eye, Vec3(0, 0, 0), Vec3(0, 1, 0)));
+		written += rasterizer.GetStats().pixelsWritten;
+		const float *depth = rasterizer.GetDepth();
+		for (uint32_t i = 0; i < size * size; i++)
+			covered += depth[i] < 1.0f;
+	}
+	return covered ? (double)written / covered : 0.0;
+}
+
+BENCHMARK(meshopt_vertex_cache, "meshopt")
+{
+	Mesh mesh = GenerateScrambledMesh();
+	std::vector<uint32_t> optimized(mesh.indices.size());
+
+	state.SetItemsProcessed(mesh.GetTriangleCount());
+	state.Measure([&]
+	{
+		OptimizeVertexCache(optimized.data(), mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+		DoNotOptimize(optimized.data());
+	});
+
+	VertexCacheStats before = AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+	VertexCacheStats after = AnalyzeVertexCache(optimized.data(), optimized.size(), mesh.vertices.size());
+	state.AddMetric("acmr_before", before.acmr);
+	state.AddMetric("acmr_after", after.acmr);
+	state.AddMetric("atvr_before", before.atvr);
+	state.AddMetric("atvr_after", after.atvr);
+	if (after.acmr >= before.acmr)
+		state.Fail("cache order did not improve");
+}
+
+BENCHMARK(meshopt_overdraw, "meshopt")
+{
+	Mesh mesh = GenerateScrambledMesh();
+	std::vector<uint32_t> cacheOrder(mesh.indices.size());
+	OptimizeVertexCache(cacheOrder.data(), mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+	std::vector<uint32_t> optimized(mesh.indices.size());
+
+	state.SetItemsProcessed(mesh.GetTriangleCount());
+	state.Measure([&]
+	{
+		OptimizeOverdraw(optimized.data(), cacheOrder.data(), cacheOrder.size(), mesh.vertices[0].position, sizeof(Vertex),
+			mesh.vertices.size());
+		DoNotOptimize(optimized.data());
+	});
+
+	double overdrawCache = MeasureOverdraw(mesh, cacheOrder.data());
+	double overdrawAfter = MeasureOverdraw(mesh, optimized.data());
+	state.AddMetric("overdraw_before", MeasureOverdraw(mesh, mesh.indices.data()));
+	state.AddMetric("overdraw_cache_order", overdrawCache);
+	state.AddMetric("overdraw_after", overdrawAfter);
+	state.AddMetric("acmr_cache_order", AnalyzeVertexCache(cacheOrder.data(), cacheOrder.size(), mesh.vertices.size()).acmr);
+	state.AddMetric("acmr_after", AnalyzeVertexCache(optimized.data(), optimized.size(), mesh.vertices.size()).acmr);
+	if (overdrawAfter >= overdrawCache)
+		state.Fail("cluster order did not reduce overdraw");
+}
+
+BENCHMARK(meshopt_vertex_fetch, "meshopt")
+{
+	Mesh source = GenerateScrambledMesh();
+	std::vector<uint32_t> cacheOrder(source.indices.size());
+	OptimizeVertexCache(cacheOrder.data(), source.indices.data(), source.indices.size(), source.vertices.size());
+	source.indices = cacheOrder;
+	Mesh mesh;
+
+	state.SetItemsProcessed(source.vertices.size());
+	state.Measure([&]
+	{
+		OptimizeVertexFetch(mesh);
+		DoNotOptimize(mesh.vertices.data());
+	}, [&]
+	{
+		mesh = source;
+	});
+
+	VertexFetchStats before = AnalyzeVertexFetch(source.indices.data(), source.indices.size(), source.vertices.size(), sizeof(Vertex));
+	VertexFetchStats after = AnalyzeVertexFetch(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), sizeof(Vertex));
+	state.AddMetric("overfetch_before", before.overfetch);
+	state.AddMetric("overfetch_after", after.overfetch);
+	if (after.overfetch >= before.overfetch)
+		state.Fail("fetch order did not improve");
+}
+
+// The CPU rasterizer's own vertex cache, before and after the full pass.
+BENCHMARK(meshopt_raster, "meshopt")
+{
+	Mesh scrambled = GenerateScrambledMesh();
+	Mesh optimized = scrambled;
+	OptimizeMesh(optimized);
+	DepthRasterizer rasterizer(1280, 720);
+	Mat4 viewProjection = Mat4::Perspective(1.0f, 1280.0f / 720.0f, 0.1f, 20.0f) * Mat4::LookAt(Vec3(0, 1, -3), Vec3(0, 0, 0), Vec3(0, 1, 0));
+
+	auto draw = [&](const Mesh &mesh)
+	{
+		rasterizer.Clear();
+		rasterizer.ResetStats();
+		rasterizer.DrawIndexed(mesh.vertices[0].position, sizeof(Vertex), mesh.indices.data(), mesh.indices.size(), viewProjection);
+		const SoftRasterStats &stats = rasterizer.GetStats();
+		return (double)stats.vertexCacheHits / (stats.vertexCacheHits + stats.vertexTransforms);
+	};
+
+	uint64_t start = NowNs();
+	double hitRateBefore = 0.0;
+	const int scrambledRuns = 5;
+	for (int i = 0; i < scrambledRuns; i++)
+		hitRateBefore = draw(scrambled);
+	double scrambledMs = ElapsedMs(start, NowNs()) / scrambledRuns;
+
+	double hitRateAfter = 0.0;
+	state.SetItemsProcessed(optimized.GetTriangleCount());
+	state.Measure([&]
+	{
+		hitRateAfter = draw(optimized);
+	});
+	state.AddMetric("cache_hit_rate_before", hitRateBefore);
+	state.AddMetric("cache_hit_rate_after", hitRateAfter);
+	state.AddMetric("scrambled_ms", scrambledMs);
+}
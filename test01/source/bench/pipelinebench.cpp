@@ -0,0 +1,143 @@
+#include <atomic>
+#include <random>
+#include <string.h>
+#include <vector>
+#include "benchmark.h"
+#include "pipelinestatecache.h"
+#include "threadpool.h"
+
+static GraphicsPipelineState MakeBenchmarkState(uint32_t index)
+{
+	// Fake handles: the cache never dereferences them.
+	GraphicsPipelineState state;
+	state.stages.resize(2);
+	state.stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	state.stages[0].module = (VkShaderModule)(uintptr_t)(0x1000 + (index % 16) * 16);
+	state.stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	state.stages[1].module = (VkShaderModule)(uintptr_t)(0x2000 + (index % 32) * 16);
+	for (ShaderStageState &stage : state.stages)
+	{
+		stage.specializationEntries.push_back({ 0, 0, sizeof(uint32_t) });
+		stage.specializationData.resize(sizeof(uint32_t));
+		memcpy(stage.specializationData.data(), &index, sizeof(uint32_t));
+	}
+	state.vertexBindings.push_back({ 0, 6 * sizeof(float), VK_VERTEX_INPUT_RATE_VERTEX });
+	state.vertexAttributes.push_back({ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 });
+	state.vertexAttributes.push_back({ 1, 0, VK_FORMAT_R32G32B32_SFLOAT, 3 * sizeof(float) });
+	state.cullMode = index % 3 == 0 ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+	state.depthTest = index % 2 ? VK_TRUE : VK_FALSE;
+	state.depthWrite = state.depthTest;
+	state.blendAttachments.push_back(index % 4 == 0 ? AlphaBlendAttachment() : OpaqueBlendAttachment());
+	state.layout = (VkPipelineLayout)(uintptr_t)0x3000;
+	state.colorFormats.push_back(index % 5 == 0 ? VK_FORMAT_B8G8R8A8_UNORM : VK_FORMAT_R8G8B8A8_UNORM);
+	state.depthFormat = VK_FORMAT_D32_SFLOAT;
+	return state;
+}
+
+static const uint32_t PSO_UNIQUE_STATES = 4096;
+
+static std::vector<GraphicsPipelineState> MakeRequests()
+{
+	// Independent copies in random order, as a material system building its
+	// state on the fly would produce.
+	std::mt19937 rng(1234);
+	std::vector<GraphicsPipelineState> requests;
+	for (uint32_t i = 0; i < PSO_UNIQUE_STATES; i++)
+		requests.push_back(MakeBenchmarkState(rng() % PSO_UNIQUE_STATES));
+	return requests;
+}
+
+BENCHMARK(pso_hash, "micro")
+{
+	std::vector<GraphicsPipelineState> requests = MakeRequests();
+	state.SetItemsProcessed(requests.size());
+	state.Measure([&]
+	{
+		uint64_t hash = 0;
+		for (const GraphicsPipelineState &request : requests)
+			hash += HashPipelineState(request);
+		DoNotOptimize(hash);
+	});
+}
+
+BENCHMARK(pso_cache_lookup, "micro")
+{
+	uint64_t nextPipeline = 1;
+	PipelineStateCache cache(
+		[&nextPipeline](const GraphicsPipelineState &, VkPipeline *pipeline)
+		{
+			*pipeline = (VkPipeline)(uintptr_t)(nextPipeline++);
+			return VK_SUCCESS;
+		},
+		[](VkPipeline) {});
+	for (uint32_t i = 0; i < PSO_UNIQUE_STATES; i++)
+		cache.GetPipeline(MakeBenchmarkState(i));
+
+	std::vector<GraphicsPipelineState> requests = MakeRequests();
+	state.SetItemsProcessed(requests.size());
+	state.Measure([&]
+	{
+		uintptr_t sum = 0;
+		for (const GraphicsPipelineState &request : requests)
+			sum += (uintptr_t)cache.GetPipeline(request);
+		DoNotOptimize(sum);
+	});
+
+	state.AddMetric("collisions", (double)cache.GetCollisionCount());
+	// Every lookup after the initial fill must have been a hit.
+	if (cache.GetPipelineCount() != PSO_UNIQUE_STATES || cache.GetHitCount() != cache.GetLookupCount() - PSO_UNIQUE_STATES)
+		state.Fail("lookups created new pipelines");
+}
+
+// Compiler workers and the render thread filling one cache at once: every
+// state must end up with exactly one stored pipeline, and every duplicate a
+// race produced must have been destroyed.
+BENCHMARK(pso_cache_concurrent, "micro")
+{
+	const uint32_t threads = 4;
+	std::vector<GraphicsPipelineState> requests = MakeRequests();
+	std::atomic<uint64_t> created(0), destroyed(0);
+	uint64_t stored = 0;
+	ThreadPool pool(threads);
+	state.SetItemsProcessed((uint64_t)requests.size() * threads);
+	state.Measure([&]
+	{
+		created = 0;
+		destroyed = 0;
+		PipelineStateCache cache(
+			[&created](const GraphicsPipelineState &, VkPipeline *pipeline)
+			{
+				*pipeline = (VkPipeline)(uintptr_t)(++created);
+				return VK_SUCCESS;
+			},
+			[&destroyed](VkPipeline) { destroyed++; });
+		for (uint32_t t = 0; t < threads; t++)
+		{
+			pool.Submit([&cache, &requests, t]
+			{
+				for (size_t i = 0; i < requests.size(); i++)
+					cache.GetPipeline(requests[(i + t * 997) % requests.size()]);
+			});
+		}
+		pool.WaitIdle();
+		stored = cache.GetPipelineCount();
+		for (size_t i = 0; i < requests.size(); i++)
+		{
+			if (cache.Find(requests[i]) == VK_NULL_HANDLE)
+				stored = 0;
+		}
+	});
+
+	state.AddMetric("duplicates_destroyed", (double)(created - stored));
+	PipelineStateCache reference(
+		[](const GraphicsPipelineState &, VkPipeline *pipeline)
+		{
+			*pipeline = (VkPipeline)(uintptr_t)1;
+			return VK_SUCCESS;
+		},
+		[](VkPipeline) {});
+	for (const GraphicsPipelineState &request : requests)
+		reference.GetPipeline(request);
+	if (stored != reference.GetPipelineCount() || destroyed != created)
+		state.Fail("concurrent lookups lost or leaked pipelines");
+}
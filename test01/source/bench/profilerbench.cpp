@@ -0,0 +1,59 @@
+#include "benchmark.h"
+#include "profiler.h"
+
+static const uint32_t PROFILER_SCOPES = 1 << 16;
+
+BENCHMARK(profiler_counter_read, "micro")
+{
+	// Two of these bound the cost of a scope from below. On virtual machines
+	// the counter is often trapped and this floor alone can be tens of ns.
+	state.SetItemsProcessed(PROFILER_SCOPES);
+	state.Measure([&]
+	{
+		uint64_t sum = 0;
+		for (uint32_t i = 0; i < PROFILER_SCOPES; i++)
+			sum += ProfilerTicks();
+		DoNotOptimize(sum);
+	});
+}
+
+BENCHMARK(profiler_scope_flat, "micro")
+{
+	{
+		PROFILE_SCOPE("warmup");
+	}
+	Profiler::TicksToNs(ProfilerTicks());
+
+	uint64_t eventsBefore = Profiler::GetEventCount();
+	state.SetItemsProcessed(PROFILER_SCOPES);
+	state.Measure([&]
+	{
+		for (uint32_t i = 0; i < PROFILER_SCOPES; i++)
+		{
+			PROFILE_SCOPE("bench_flat");
+		}
+	});
+	if (Profiler::GetEventCount() - eventsBefore < (uint64_t)PROFILER_SCOPES * state.GetRepetitions())
+		state.Fail("scopes were dropped");
+}
+
+BENCHMARK(profiler_scope_nested, "micro")
+{
+	state.SetItemsProcessed(PROFILER_SCOPES);
+	state.Measure([&]
+	{
+		for (uint32_t i = 0; i < PROFILER_SCOPES / 4; i++)
+		{
+			PROFILE_SCOPE("bench_outer");
+			{
+				PROFILE_SCOPE("bench_middle");
+				{
+					PROFILE_SCOPE("bench_inner");
+					{
+						PROFILE_SCOPE("bench_leaf");
+					}
+				}
+			}
+		}
+	});
+}
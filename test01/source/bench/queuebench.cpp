@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "benchmark.h"
+#include "concurrentqueue.h"
+#include "timer.h"
+
+// Producers push a fixed number of small messages through a queue to a set of
+// consumers that drain it. Every 64th message carries its send time, so the
+// consumers also sample end-to-end latency. Both sides spin with a yield when
+// the queue is full or empty, as a busy job system would.
+static const uint32_t MESSAGE_COUNT = 1 << 18;
+static const uint32_t LATENCY_SAMPLE_INTERVAL = 64;
+static const size_t QUEUE_CAPACITY = 1024;
+
+struct Message
+{
+	uint64_t sendNs;
+	uint64_t value;
+};
+
+// The baseline: a deque behind a mutex, the shape ThreadPool used to have.
+class MutexQueue
+{
+public:
+	explicit MutexQueue(size_t capacity) : capacity(capacity) {}
+
+	bool TryPush(const Message &message)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (messages.size() >= capacity)
+			return false;
+		messages.push_back(message);
+		return true;
+	}
+
+	bool TryPop(Message &message)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (messages.empty())
+			return false;
+		message = messages.front();
+		messages.pop_front();
+		return true;
+	}
+
+private:
+	size_t capacity;
+	std::mutex mutex;
+	std::deque<Message> messages;
+};
+
+template <typename Queue>
+static void BenchmarkQueue(BenchmarkState &state, uint32_t producers, uint32_t consumers)
+{
+	std::vector<std::vector<uint64_t>> latencies(consumers);
+	uint64_t checksum = 0;
+
+	state.SetItemsProcessed(MESSAGE_COUNT);
+	state.Measure([&]
+	{
+		Queue queue(QUEUE_CAPACITY);
+		std::atomic<uint32_t> consumed(0);
+		std::atomic<uint64_t> sum(0);
+		for (std::vector<uint64_t> &samples : latencies)
+			samples.clear();
+
+		std::vector<std::thread> threads;
+		for (uint32_t p = 0; p < producers; p++)
+		{
+			threads.emplace_back([&, p]
+			{
+				uint32_t begin = MESSAGE_COUNT * p / producers;
+				uint32_t end = MESSAGE_COUNT * (p + 1) / producers;
+				for (uint32_t i = begin; i < end; i++)
+				{
+					Message message = { i % LATENCY_SAMPLE_INTERVAL == 0 ? NowNs() : 0, i };
+					while (!queue.TryPush(message))
+						std::this_thread::yield();
+				}
+			});
+		}
+		for (uint32_t c = 0; c < consumers; c++)
+		{
+			threads.emplace_back([&, c]
+			{
+				uint64_t localSum = 0;
+				Message message;
+				while (consumed.load(std::memory_order_relaxed) < MESSAGE_COUNT)
+				{
+					if (!queue.TryPop(message))
+					{
+						std::this_thread::yield();
+						continue;
+					}
+					if (message.sendNs)
+						latencies[c].push_back(NowNs() - message.sendNs);
+					localSum += message.value;
+					consumed.fetch_add(1, std::memory_order_relaxed);
+				}
+				sum.fetch_add(localSum);
+			});
+		}
+		for (std::thread &thread : threads)
+			thread.join();
+		checksum = sum.load();
+	});
+
+	if (checksum != (uint64_t)MESSAGE_COUNT * (MESSAGE_COUNT - 1) / 2)
+		state.Fail("messages were lost or duplicated");
+
+	std::vector<uint64_t> samples;
+	for (const std::vector<uint64_t> &consumerSamples : latencies)
+		samples.insert(samples.end(), consumerSamples.begin(), consumerSamples.end());
+	std::sort(samples.begin(), samples.end());
+	state.AddMetric("producers", producers);
+	state.AddMetric("consumers", consumers);
+	if (!samples.empty())
+	{
+		state.AddMetric("latency_p50_ns", (double)samples[samples.size() / 2]);
+		state.AddMetric("latency_p99_ns", (double)samples[samples.size() * 99 / 100]);
+	}
+}
+
+typedef MpmcQueue<Message> MessageMpmcQueue;
+typedef SpscQueue<Message> MessageSpscQueue;
+
+#define QUEUE_BENCHMARKS(producers, consumers) \
+	BENCHMARK(queue_mutex_p##producers##c##consumers, "queue") { BenchmarkQueue<MutexQueue>(state, producers, consumers); } \
+	BENCHMARK(queue_mpmc_p##producers##c##consumers, "queue") { BenchmarkQueue<MessageMpmcQueue>(state, producers, consumers); }
+
+BENCHMARK(queue_spsc_p1c1, "queue") { BenchmarkQueue<MessageSpscQueue>(state, 1, 1); }
+QUEUE_BENCHMARKS(1, 1)
+QUEUE_BENCHMARKS(1, 4)
+QUEUE_BENCHMARKS(4, 1)
+QUEUE_BENCHMARKS(2, 2)
+QUEUE_BENCHMARKS(4, 4)
+QUEUE_BENCHMARKS(8, 8)
+QUEUE_BENCHMARKS(16, 16)
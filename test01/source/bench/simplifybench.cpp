@@ -0,0 +1,106 @@
+#include <math.h>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "culling.h"
+#include "mesh.h"
+#include "objectfield.h"
+#include "simplify.h"
+
+// A sphere with ridges, so that simplification has curvature to trade off
+// rather than a uniform surface.
+static Mesh GenerateBumpySphere(uint32_t rings, uint32_t segments)
+{
+	Mesh mesh = GenerateSphere(rings, segments, 1.0f);
+	for (Vertex &vertex : mesh.vertices)
+	{
+		float u = vertex.uv[0] * 6.2831853f, v = vertex.uv[1] * 3.14159265f;
+		float radius = 1.0f + 0.08f * sinf(u * 6.0f) * sinf(v * 5.0f);
+		for (int k = 0; k < 3; k++)
+			vertex.position[k] = vertex.normal[k] * radius;
+	}
+	return mesh;
+}
+
+BENCHMARK(simplify_mesh, "simplify")
+{
+	Mesh mesh = GenerateBumpySphere(256, 512);
+	std::vector<uint32_t> simplified(mesh.indices.size());
+	size_t count = 0;
+	float error = 0.0f;
+
+	state.SetItemsProcessed(mesh.GetTriangleCount());
+	state.Measure([&]
+	{
+		count = SimplifyMesh(simplified.data(), mesh, mesh.indices.size() / 8, 0.05f, &error);
+		DoNotOptimize(simplified.data());
+	});
+	state.AddMetric("input_tris", (double)mesh.GetTriangleCount());
+	state.AddMetric("output_tris", (double)(count / 3));
+	state.AddMetric("relative_error", error);
+	if (count == 0 || count > mesh.indices.size() / 6)
+		state.Fail("target not reached");
+}
+
+BENCHMARK(simplify_lod_chain, "simplify")
+{
+	Mesh mesh = GenerateBumpySphere(128, 256);
+	LodChain chain;
+
+	state.SetItemsProcessed(mesh.GetTriangleCount());
+	state.Measure([&]
+	{
+		BuildLodChain(mesh, chain);
+		DoNotOptimize(chain.indices.data());
+	});
+	for (size_t lod = 0; lod < chain.lods.size(); lod++)
+	{
+		state.AddMetric("lod" + std::to_string(lod) + "_tris", chain.lods[lod].indexCount / 3);
+		state.AddMetric("lod" + std::to_string(lod) + "_error", chain.lods[lod].error);
+	}
+	if (chain.lods.size() < 4)
+		state.Fail("LOD chain too short");
+}
+
+// The --objects scene's orbit, with the same culling and LOD selection as the
+// CPU submission path: triangles per frame at full detail and within one
+// pixel of error.
+BENCHMARK(lod_field_triangles, "simplify")
+{
+	const uint32_t objectCount = 100000;
+	const uint32_t width = 1280, height = 720;
+	const float fovY = 1.0f;
+	const int frames = 64;
+	ObjectField field;
+	GenerateObjectField(field, objectCount, true);
+	std::vector<uint32_t> visible(objectCount), lods(objectCount);
+	float projectionScale = GetLodProjectionScale(fovY, height);
+
+	auto run = [&](float pixelError)
+	{
+		uint64_t triangles = 0;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			float angle = frame * 6.2831853f / frames;
+			Vec3 eye(sinf(angle) * 10.0f, 3.0f, cosf(angle) * 10.0f);
+			Mat4 viewProjection = Mat4::Perspective(fovY, (float)width / height, 0.1f, 100.0f) * Mat4::LookAt(eye, Vec3(0, 0, 0), Vec3(0, 1, 0));
+			size_t count = CullSpheres(Frustum::FromMatrix(viewProjection), field.bounds.data(), objectCount, visible.data());
+			triangles += SelectObjectLods(field, visible.data(), count, eye, projectionScale, pixelError, lods.data());
+		}
+		return (double)triangles / frames;
+	};
+
+	double fullDetail = run(0.0f);
+	double withLods = 0.0;
+	state.SetItemsProcessed((uint64_t)objectCount * frames);
+	state.Measure([&]
+	{
+		withLods = run(1.0f);
+	});
+	state.AddMetric("tris_per_frame_full", fullDetail);
+	state.AddMetric("tris_per_frame_lod", withLods);
+	state.AddMetric("reduction", fullDetail / withLods);
+	state.AddMetric("lod_levels", (double)field.lods.size());
+	if (withLods >= fullDetail)
+		state.Fail("LOD selection did not reduce triangles");
+}
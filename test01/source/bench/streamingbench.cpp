@@ -0,0 +1,167 @@
+#include <filesystem>
+#include <math.h>
+#include <memory>
+#include <string>
+#include "assetpack.h"
+#include "benchmark.h"
+#include "fileio.h"
+#include "simplify.h"
+#include "streaming.h"
+
+static const float FLIGHT_FOV = 1.0f;
+static const uint32_t FLIGHT_HEIGHT = 720;
+
+// A figure of eight over the world, low enough to fly past resources, always
+// looking a little ahead along the path.
+static void GetFlightCamera(uint32_t step, uint32_t stepCount, float extent, Vec3 &eye, Frustum &frustum)
+{
+	auto position = [&](float t)
+	{
+		return Vec3(0.4f * extent * sinf(t), 12.0f + 6.0f * sinf(3.0f * t), 0.4f * extent * sinf(2.0f * t));
+	};
+	float t = 6.2831853f * step / stepCount;
+	eye = position(t);
+	Vec3 ahead = position(t + 0.02f);
+	Vec3 target(ahead.x, ahead.y - 4.0f, ahead.z);
+	Mat4 viewProjection = Mat4::Perspective(FLIGHT_FOV, 16.0f / 9.0f, 0.1f, 2000.0f) * Mat4::LookAt(eye, target, Vec3(0, 1, 0));
+	frustum = Frustum::FromMatrix(viewProjection);
+}
+
+static void Fly(StreamingManager &manager, uint32_t stepCount, float extent)
+{
+	float projectionScale = GetLodProjectionScale(FLIGHT_FOV, FLIGHT_HEIGHT);
+	for (uint32_t step = 0; step < stepCount; step++)
+	{
+		Vec3 eye;
+		Frustum frustum;
+		GetFlightCamera(step, stepCount, extent, eye, frustum);
+		manager.Update(eye, frustum, projectionScale);
+	}
+	manager.Flush();
+}
+
+static void AddStreamingMetrics(BenchmarkState &state, const StreamingManager &manager)
+{
+	const StreamingStats &stats = manager.GetStats();
+	state.AddMetric("hit_rate", stats.GetHitRate());
+	state.AddMetric("missing_levels_per_update", (double)stats.missingLevels / stats.updates);
+	state.AddMetric("budget_mb", manager.GetConfig().memoryBudget / 1048576.0);
+	state.AddMetric("peak_resident_mb", stats.peakResidentBytes / 1048576.0);
+	state.AddMetric("loaded_mb", stats.bytesLoaded / 1048576.0);
+	state.AddMetric("loads", (double)stats.loadsCompleted);
+	state.AddMetric("evictions", (double)stats.evictions);
+	state.AddMetric("thrash_evictions", (double)stats.thrashEvictions);
+	state.AddMetric("over_budget_updates", (double)stats.overBudgetUpdates);
+}
+
+static bool SameStats(const StreamingStats &a, const StreamingStats &b)
+{
+	return a.residentBytes == b.residentBytes && a.peakResidentBytes == b.peakResidentBytes && a.loadsIssued == b.loadsIssued &&
+		a.loadsCompleted == b.loadsCompleted && a.evictions == b.evictions && a.thrashEvictions == b.thrashEvictions &&
+		a.satisfiedResources == b.satisfiedResources && a.missingLevels == b.missingLevels;
+}
+
+// 20000 resources, about 7 GB at full detail, under a 24 MB budget of which
+// the pinned coarsest levels take 17 MB, so most loads have to evict. Loads are
+// simulated, so every repetition must end with the same stats.
+static void BenchmarkScriptedFlight(BenchmarkState &state, float hysteresis)
+{
+	const uint32_t resourceCount = 20000, stepCount = 1500;
+	const float extent = 1000.0f;
+	static StreamingWorld world;
+	if (world.bounds.empty())
+		GenerateStreamingWorld(world, resourceCount, extent, 4, 49);
+
+	StreamingConfig config;
+	config.memoryBudget = 24ull << 20;
+	config.hysteresis = hysteresis;
+	config.maxLoadsInFlight = 256;
+	config.simulatedBandwidth = 32ull << 20;
+	std::unique_ptr<StreamingManager> manager;
+	StreamingStats first;
+	bool haveFirst = false, deterministic = true;
+	state.SetItemsProcessed(stepCount);
+	state.Measure([&]
+	{
+		Fly(*manager, stepCount, extent);
+		if (haveFirst)
+			deterministic = deterministic && SameStats(first, manager->GetStats());
+		first = manager->GetStats();
+		haveFirst = true;
+	}, [&]
+	{
+		manager.reset(new StreamingManager(config));
+		AddStreamingWorld(*manager, world);
+	});
+	state.AddMetric("world_mb", world.totalBytes / 1048576.0);
+	AddStreamingMetrics(state, *manager);
+	if (!deterministic)
+		state.Fail("repetitions of the same flight ended with different stats");
+	if (manager->GetStats().peakResidentBytes > config.memoryBudget)
+		state.Fail("resident bytes went over the budget");
+}
+
+BENCHMARK(streaming_scripted_flight, "streaming") { BenchmarkScriptedFlight(state, 2.0f); }
+BENCHMARK(streaming_scripted_flight_no_hysteresis, "streaming") { BenchmarkScriptedFlight(state, 1.0f); }
+
+// The same flight over a smaller world that is really in a pack, read through
+// an IoQueue and decoded, with a budget a quarter of the world.
+static void BenchmarkPackFlight(BenchmarkState &state, IoBackend backend)
+{
+	const uint32_t resourceCount = 2000, stepCount = 600;
+	const float extent = 300.0f;
+	static StreamingWorld world;
+	static bool written = false;
+	if (world.bounds.empty())
+	{
+		GenerateStreamingWorld(world, resourceCount, extent, 2, 49);
+		std::filesystem::path directory = std::filesystem::temp_directory_path() / "vulkan01_streamingbench";
+		std::filesystem::create_directories(directory);
+		written = WriteStreamingWorldPack(world, (directory / "world.pack").string());
+	}
+	AssetPack pack;
+	IoQueue queue;
+	std::string path = (std::filesystem::temp_directory_path() / "vulkan01_streamingbench" / "world.pack").string();
+	if (!written || !pack.Open(path) || !queue.Init(backend, 32))
+	{
+		state.Fail("could not set up the pack");
+		return;
+	}
+
+	StreamingConfig config;
+	config.memoryBudget = world.totalBytes / 4;
+	std::unique_ptr<StreamingManager> manager;
+	state.SetItemsProcessed(stepCount);
+	state.Measure([&]
+	{
+		Fly(*manager, stepCount, extent);
+	}, [&]
+	{
+		manager.reset(new StreamingManager(config));
+		manager->SetSource(&pack, &queue);
+		AddStreamingWorld(*manager, world);
+	});
+	state.AddMetric("world_mb", world.totalBytes / 1048576.0);
+	state.AddMetric("uring", queue.GetBackend() == IO_BACKEND_URING);
+	AddStreamingMetrics(state, *manager);
+	if (manager->GetStats().loadsFailed)
+		state.Fail("failed loads");
+
+	// Whatever is resident must be what the pack holds for that level.
+	std::vector<uint8_t> expected;
+	for (uint32_t i = 0; i < manager->GetResourceCount(); i++)
+	{
+		uint32_t level = manager->GetResidentLevel(i);
+		if (level == manager->GetLevelCount(i))
+			continue;
+		const std::vector<uint8_t> &data = manager->GetLevelData(i, level);
+		if (!pack.Load(world.levels[world.firstLevel[i] + level].asset, expected) || data != expected)
+		{
+			state.Fail("resident data does not match the pack");
+			break;
+		}
+	}
+}
+
+BENCHMARK(streaming_pack_flight_uring, "streaming") { BenchmarkPackFlight(state, IO_BACKEND_URING); }
+BENCHMARK(streaming_pack_flight_threads, "streaming") { BenchmarkPackFlight(state, IO_BACKEND_THREADS); }
@@ -0,0 +1,92 @@
+#include <math.h>
+#include <vector>
+#include "benchmark.h"
+#include "mesh.h"
+#include "meshoptimize.h"
+#include "softraster.h"
+#include "timer.h"
+#include "vertexformat.h"
+
+BENCHMARK(vertex_pack, "vertexformat")
+{
+	Mesh mesh = GenerateSphere(256, 512, 3.0f);
+	for (Vertex &vertex : mesh.vertices)
+		vertex.position[0] += 10.0f;
+	QuantizationBox box = ComputeQuantizationBox(mesh.vertices.data(), mesh.vertices.size());
+	std::vector<PackedVertex> packed(mesh.vertices.size());
+
+	state.SetItemsProcessed(mesh.vertices.size());
+	state.SetBytesProcessed(mesh.vertices.size() * sizeof(Vertex));
+	state.Measure([&]
+	{
+		PackVertices(packed.data(), mesh.vertices.data(), mesh.vertices.size(), box);
+		DoNotOptimize(packed.data());
+	});
+
+	std::vector<Vertex> unpacked(mesh.vertices.size());
+	UnpackVertices(unpacked.data(), packed.data(), packed.size(), box);
+	double positionError = 0.0, normalError = 0.0, uvError = 0.0;
+	for (size_t v = 0; v < mesh.vertices.size(); v++)
+	{
+		const Vertex &a = mesh.vertices[v], &b = unpacked[v];
+		double cosine = 0.0;
+		for (int k = 0; k < 3; k++)
+		{
+			positionError = std::max(positionError, (double)fabsf(a.position[k] - b.position[k]));
+			cosine += a.normal[k] * b.normal[k];
+		}
+		normalError = std::max(normalError, acos(std::min(cosine, 1.0)) * 57.29578);
+		for (int k = 0; k < 2; k++)
+			uvError = std::max(uvError, (double)fabsf(a.uv[k] - b.uv[k]));
+	}
+	state.AddMetric("bytes_per_vertex_float", sizeof(Vertex));
+	state.AddMetric("bytes_per_vertex_packed", sizeof(PackedVertex));
+	state.AddMetric("position_error_max", positionError);
+	state.AddMetric("position_error_relative", positionError / box.scale);
+	state.AddMetric("normal_error_deg", normalError);
+	state.AddMetric("uv_error_max", uvError);
+	if (positionError / box.scale > 1.0 / 32767 || normalError > 0.05)
+		state.Fail("quantization error above format precision");
+}
+
+// The CPU rasterizer fed both formats from the same cache-optimized mesh.
+// Fetch traffic comes from AnalyzeVertexFetch over the post-transform misses.
+BENCHMARK(vertex_raster_packed, "vertexformat")
+{
+	Mesh mesh = GenerateSphere(256, 512, 1.0f);
+	OptimizeMesh(mesh);
+	QuantizationBox box = ComputeQuantizationBox(mesh.vertices.data(), mesh.vertices.size());
+	std::vector<PackedVertex> packed(mesh.vertices.size());
+	PackVertices(packed.data(), mesh.vertices.data(), mesh.vertices.size(), box);
+
+	DepthRasterizer rasterizer(1280, 720);
+	Mat4 viewProjection = Mat4::Perspective(1.0f, 1280.0f / 720.0f, 0.1f, 20.0f) * Mat4::LookAt(Vec3(0, 0.5f, -2.5f), Vec3(0, 0, 0), Vec3(0, 1, 0));
+
+	const int floatRuns = 5;
+	uint64_t start = NowNs();
+	for (int i = 0; i < floatRuns; i++)
+	{
+		rasterizer.Clear();
+		rasterizer.DrawIndexed(mesh.vertices[0].position, sizeof(Vertex), mesh.indices.data(), mesh.indices.size(), viewProjection);
+	}
+	double floatMs = ElapsedMs(start, NowNs()) / floatRuns;
+	std::vector<float> floatDepth(rasterizer.GetDepth(), rasterizer.GetDepth() + 1280 * 720);
+
+	state.SetItemsProcessed(mesh.GetTriangleCount());
+	state.Measure([&]
+	{
+		rasterizer.Clear();
+		rasterizer.DrawIndexedQuantized(packed[0].position, sizeof(PackedVertex), mesh.indices.data(), mesh.indices.size(), box, viewProjection);
+	});
+
+	size_t differing = 0;
+	for (size_t i = 0; i < floatDepth.size(); i++)
+		differing += fabsf(floatDepth[i] - rasterizer.GetDepth()[i]) > 1e-4f;
+	VertexFetchStats floatFetch = AnalyzeVertexFetch(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), sizeof(Vertex));
+	VertexFetchStats packedFetch = AnalyzeVertexFetch(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size(), sizeof(PackedVertex));
+	state.AddMetric("float_ms", floatMs);
+	state.AddMetric("fetch_kb_float", floatFetch.bytesFetched / 1024.0);
+	state.AddMetric("fetch_kb_packed", packedFetch.bytesFetched / 1024.0);
+	state.AddMetric("fetch_saved", 1.0 - (double)packedFetch.bytesFetched / floatFetch.bytesFetched);
+	state.AddMetric("depth_pixels_differing", (double)differing);
+}
@@ -0,0 +1,103 @@
+#include <memory>
+#include <random>
+#include <string.h>
+#include <vector>
+#include "benchmark.h"
+#include "threadpool.h"
+#include "yuvconvert.h"
+
+static const uint32_t VIDEO_WIDTH = 3840;
+static const uint32_t VIDEO_HEIGHT = 2160;
+static const uint64_t FRAME_BYTES = (uint64_t)VIDEO_WIDTH * VIDEO_HEIGHT * 4;
+
+// Conversion cost does not depend on content, but the noise keeps the
+// reference comparison honest about rounding.
+static const std::vector<uint8_t> &GetTestFrame()
+{
+	static std::vector<uint8_t> frame;
+	if (!frame.empty())
+		return frame;
+
+	frame.resize(FRAME_BYTES);
+	std::mt19937 rng(37);
+	for (uint32_t y = 0; y < VIDEO_HEIGHT; y++)
+	{
+		for (uint32_t x = 0; x < VIDEO_WIDTH; x++)
+		{
+			uint8_t *pixel = &frame[((size_t)y * VIDEO_WIDTH + x) * 4];
+			pixel[0] = (uint8_t)(x * 255 / VIDEO_WIDTH);
+			pixel[1] = (uint8_t)(y * 255 / VIDEO_HEIGHT);
+			pixel[2] = (uint8_t)rng();
+			pixel[3] = 255;
+		}
+	}
+	return frame;
+}
+
+static bool MatchesReference(BenchmarkState &state, const std::vector<uint8_t> &yuv)
+{
+	std::vector<uint8_t> reference(yuv.size());
+	ConvertRgbaToYuv420Reference(GetTestFrame().data(), VIDEO_WIDTH, VIDEO_HEIGHT, reference.data());
+	if (memcmp(reference.data(), yuv.data(), yuv.size()) != 0)
+	{
+		state.Fail(std::string(GetYuvConvertKernelName()) + " output differs from the reference conversion");
+		return false;
+	}
+	return true;
+}
+
+// Frames converted concurrently, one per thread, as the capture writers do.
+// Items are frames, so items/s against 60 is the 4K60 budget.
+static void BenchmarkFrames(BenchmarkState &state, uint32_t threads, bool reference)
+{
+	const std::vector<uint8_t> &frame = GetTestFrame();
+	size_t frameSize = GetYuv420Layout(VIDEO_WIDTH, VIDEO_HEIGHT).GetFrameSize();
+	std::vector<std::vector<uint8_t>> outputs(threads, std::vector<uint8_t>(frameSize));
+	std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads) : nullptr);
+
+	auto convert = [&](uint32_t i)
+	{
+		if (reference)
+			ConvertRgbaToYuv420Reference(frame.data(), VIDEO_WIDTH, VIDEO_HEIGHT, outputs[i].data());
+		else
+			ConvertRgbaToYuv420(frame.data(), VIDEO_WIDTH, VIDEO_HEIGHT, outputs[i].data());
+	};
+
+	state.SetItemsProcessed(threads);
+	state.SetBytesProcessed(FRAME_BYTES * threads);
+	state.Measure([&]
+	{
+		if (!pool)
+		{
+			convert(0);
+			return;
+		}
+		for (uint32_t i = 0; i < threads; i++)
+			pool->Submit([&, i] { convert(i); });
+		pool->WaitIdle();
+	});
+	state.AddMetric("threads", threads);
+	if (!reference)
+		MatchesReference(state, outputs[0]);
+}
+
+// One frame split into row bands, for when latency matters more than
+// throughput.
+static void BenchmarkBands(BenchmarkState &state, uint32_t threads)
+{
+	const std::vector<uint8_t> &frame = GetTestFrame();
+	std::vector<uint8_t> yuv(GetYuv420Layout(VIDEO_WIDTH, VIDEO_HEIGHT).GetFrameSize());
+	ThreadPool pool(threads);
+
+	state.SetItemsProcessed(1);
+	state.SetBytesProcessed(FRAME_BYTES);
+	state.Measure([&] { ConvertRgbaToYuv420(frame.data(), VIDEO_WIDTH, VIDEO_HEIGHT, yuv.data(), &pool); });
+	state.AddMetric("threads", threads);
+	MatchesReference(state, yuv);
+}
+
+BENCHMARK(yuv420_4k_reference_t1, "video") { BenchmarkFrames(state, 1, true); }
+BENCHMARK(yuv420_4k_t1, "video") { BenchmarkFrames(state, 1, false); }
+BENCHMARK(yuv420_4k_frames_t4, "video") { BenchmarkFrames(state, 4, false); }
+BENCHMARK(yuv420_4k_frames_t8, "video") { BenchmarkFrames(state, 8, false); }
+BENCHMARK(yuv420_4k_bands_t8, "video") { BenchmarkBands(state, 8); }
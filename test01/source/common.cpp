@@ -1,18 +1,693 @@
 #include "common.h"
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "assetpack.h"
+#include "fileio.h"
+#include "framecapture.h"
+#include "frameloop.h"
+#include "log.h"
+#include "memtrack.h"
+#include "perfcounters.h"
+#include "profiler.h"
+#include "scenerenderer.h"
+#include "streaming.h"
+#include "vulkanhelpers.h"
 
+static const char *SHADER_DIR = "shaders/";
 
+// The --stream-world world: a square around the scene camera, at the smaller
+// level sizes the pack benchmark uses.
+static const float STREAMING_WORLD_EXTENT = 60.0f;
+static const uint32_t STREAMING_WORLD_DETAIL = 2;
+static const uint32_t STREAMING_WORLD_SEED = 49;
 
 Common::Common()
+	: instance(VK_NULL_HANDLE), physicalDevice(VK_NULL_HANDLE), deviceProperties(), device(VK_NULL_HANDLE),
+	queueFamilyIndex(0), queue(VK_NULL_HANDLE), commandPool(VK_NULL_HANDLE), pipelineCache(VK_NULL_HANDLE),
+	enabledFeatures(), enabledFeatures12(), lodPixelError(1.0f), basicPipelineLayout(VK_NULL_HANDLE), basicProgram(0), basicProgramReady(false)
 {
 }
 
 
 Common::~Common()
 {
+	Cleanup();
 }
 
+bool Common::Init()
+{
+	PROFILE_FUNCTION();
+	MEMORY_TAG(MEMTAG_VULKAN);
+	if (!CreateInstance() || !SelectPhysicalDevice() || !CreateDevice())
+		return false;
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = queueFamilyIndex;
+	if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+		return false;
+
+	gpuProfiler.reset(new GpuProfiler(device, physicalDevice, queueFamilyIndex, MAX_FRAMES_IN_FLIGHT));
+	gpuProfiler->Calibrate(queue, commandPool, IsDeviceExtensionEnabled(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME));
+
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache);
+
+	MEMORY_TAG(MEMTAG_PIPELINES);
+	pipelineStates.reset(new PipelineStateCache(device, pipelineCache));
+	pipelineCompiler.reset(new PipelineCompiler(*pipelineStates));
+	permutations.reset(new ShaderPermutationManager(device, *pipelineStates));
+	permutations->SetAsyncCompiler(pipelineCompiler.get());
+
+	if (!CreateBasicProgram())
+		LOG_WARNING(LOG_CATEGORY_PIPELINES, "Basic shaders not found in %s, basic pipelines disabled", SHADER_DIR);
+	return true;
+}
+
+void Common::Cleanup()
+{
+	if (device != VK_NULL_HANDLE)
+	{
+		vkDeviceWaitIdle(device);
+		permutations.reset();
+		pipelineCompiler.reset();
+		pipelineStates.reset();
+		gpuProfiler.reset();
+		if (commandPool != VK_NULL_HANDLE)
+			vkDestroyCommandPool(device, commandPool, nullptr);
+		commandPool = VK_NULL_HANDLE;
+		if (basicPipelineLayout != VK_NULL_HANDLE)
+			vkDestroyPipelineLayout(device, basicPipelineLayout, nullptr);
+		if (pipelineCache != VK_NULL_HANDLE)
+			vkDestroyPipelineCache(device, pipelineCache, nullptr);
+		vkDestroyDevice(device, nullptr);
+		basicPipelineLayout = VK_NULL_HANDLE;
+		pipelineCache = VK_NULL_HANDLE;
+		device = VK_NULL_HANDLE;
+	}
+	if (instance != VK_NULL_HANDLE)
+	{
+		vkDestroyInstance(instance, nullptr);
+		instance = VK_NULL_HANDLE;
+	}
+}
+
+bool Common::CreateInstance()
+{
+	PROFILE_FUNCTION();
+	VkApplicationInfo appInfo = {};
+	appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	appInfo.pApplicationName = "Vulkan01";
+	appInfo.pEngineName = "Vulkan01";
+	appInfo.apiVersion = VK_API_VERSION_1_3;
+
+	VkInstanceCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	info.pApplicationInfo = &appInfo;
+
+	VkResult result = vkCreateInstance(&info, nullptr, &instance);
+	if (result != VK_SUCCESS)
+	{
+		LOG_ERROR(LOG_CATEGORY_VULKAN, "vkCreateInstance failed: %s", VkResultToString(result));
+		return false;
+	}
+	return true;
+}
+
+bool Common::SelectPhysicalDevice()
+{
+	PROFILE_FUNCTION();
+	uint32_t count = 0;
+	vkEnumeratePhysicalDevices(instance, &count, nullptr);
+	std::vector<VkPhysicalDevice> devices(count);
+	vkEnumeratePhysicalDevices(instance, &count, devices.data());
+
+	// Prefer a discrete GPU, but accept anything with Vulkan 1.3 and a
+	// graphics queue so software implementations such as lavapipe work too.
+	int bestScore = -1;
+	for (VkPhysicalDevice candidate : devices)
+	{
+		VkPhysicalDeviceProperties props;
+		vkGetPhysicalDeviceProperties(candidate, &props);
+		if (VK_API_VERSION_MINOR(props.apiVersion) < 3 && VK_API_VERSION_MAJOR(props.apiVersion) == 1)
+			continue;
+
+		uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> families(familyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, families.data());
+
+		for (uint32_t i = 0; i < familyCount; i++)
+		{
+			if (!(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) || !(families[i].queueFlags & VK_QUEUE_COMPUTE_BIT))
+				continue;
+
+			int score = props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ? 3
+				: props.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ? 2 : 1;
+			if (score > bestScore)
+			{
+				bestScore = score;
+				physicalDevice = candidate;
+				deviceProperties = props;
+				queueFamilyIndex = i;
+			}
+			break;
+		}
+	}
+
+	if (physicalDevice == VK_NULL_HANDLE)
+	{
+		LOG_ERROR(LOG_CATEGORY_VULKAN, "No Vulkan 1.3 device with a graphics queue found");
+		return false;
+	}
+	LOG_INFO(LOG_CATEGORY_VULKAN, "Using %s", deviceProperties.deviceName);
+	return true;
+}
+
+bool Common::CreateDevice()
+{
+	PROFILE_FUNCTION();
+	VkPhysicalDeviceVulkan12Features supported12 = {};
+	supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceVulkan13Features supported13 = {};
+	supported13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	supported13.pNext = &supported12;
+	VkPhysicalDeviceFeatures2 supported = {};
+	supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supported.pNext = &supported13;
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+	if (!supported13.dynamicRendering || !supported13.synchronization2)
+	{
+		LOG_ERROR(LOG_CATEGORY_VULKAN, "Device lacks dynamicRendering or synchronization2");
+		return false;
+	}
+
+	VkPhysicalDeviceVulkan12Features features12 = {};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceVulkan13Features features13 = {};
+	features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	features13.pNext = &features12;
+	features13.dynamicRendering = VK_TRUE;
+	features13.synchronization2 = VK_TRUE;
+	VkPhysicalDeviceFeatures2 features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &features13;
+
+	// Optional core features, used when present.
+	features.features.multiDrawIndirect = supported.features.multiDrawIndirect;
+	features.features.drawIndirectFirstInstance = supported.features.drawIndirectFirstInstance;
+	features12.drawIndirectCount = supported12.drawIndirectCount;
+	enabledFeatures = features.features;
+	enabledFeatures12 = features12;
+	enabledFeatures12.pNext = nullptr;
+
+	// Optional extensions: enabled when present, features degrade without them.
+	const char *optionalExtensions[] = {
+		VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME,
+		VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+	};
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> available(extensionCount);
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, available.data());
+	std::vector<const char *> extensions;
+	for (const char *name : optionalExtensions)
+	{
+		for (const VkExtensionProperties &extension : available)
+		{
+			if (strcmp(extension.extensionName, name) == 0)
+			{
+				extensions.push_back(name);
+				enabledDeviceExtensions.push_back(name);
+				break;
+			}
+		}
+	}
+
+	float priority = 1.0f;
+	VkDeviceQueueCreateInfo queueInfo = {};
+	queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queueInfo.queueFamilyIndex = queueFamilyIndex;
+	queueInfo.queueCount = 1;
+	queueInfo.pQueuePriorities = &priority;
+
+	VkDeviceCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	info.pNext = &features;
+	info.queueCreateInfoCount = 1;
+	info.pQueueCreateInfos = &queueInfo;
+	info.enabledExtensionCount = (uint32_t)extensions.size();
+	info.ppEnabledExtensionNames = extensions.data();
+
+	VkResult result = vkCreateDevice(physicalDevice, &info, nullptr, &device);
+	if (result != VK_SUCCESS)
+	{
+		LOG_ERROR(LOG_CATEGORY_VULKAN, "vkCreateDevice failed: %s", VkResultToString(result));
+		return false;
+	}
+	vkGetDeviceQueue(device, queueFamilyIndex, 0, &queue);
+	MemoryTracker::QueryDeviceBudget(physicalDevice, IsDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME));
+	return true;
+}
+
+bool Common::CreateBasicProgram()
+{
+	PROFILE_FUNCTION();
+	std::vector<uint32_t> vertexCode, fragmentCode;
+	if (!LoadSpirvFile(GetShaderPath("basic.vert.spv"), vertexCode) ||
+		!LoadSpirvFile(GetShaderPath("basic.frag.spv"), fragmentCode))
+		return false;
+
+	VkPushConstantRange pushRange = {};
+	pushRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	pushRange.size = sizeof(BasicPushConstants);
+
+	VkPipelineLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushRange;
+	if (vkCreatePipelineLayout(device, &layoutInfo, nullptr, &basicPipelineLayout) != VK_SUCCESS)
+		return false;
+
+	GraphicsPipelineState state;
+	state.stages.resize(2);
+	state.stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	state.stages[0].module = permutations->LoadModule(vertexCode);
+	state.stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	state.stages[1].module = permutations->LoadModule(fragmentCode);
+	if (state.stages[0].module == VK_NULL_HANDLE || state.stages[1].module == VK_NULL_HANDLE)
+		return false;
+	state.vertexBindings.push_back({ 0, 6 * sizeof(float), VK_VERTEX_INPUT_RATE_VERTEX });
+	state.vertexAttributes.push_back({ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 });
+	state.vertexAttributes.push_back({ 1, 0, VK_FORMAT_R32G32B32_SFLOAT, 3 * sizeof(float) });
+	state.blendAttachments.push_back(OpaqueBlendAttachment());
+	state.layout = basicPipelineLayout;
+	state.colorFormats.push_back(VK_FORMAT_R8G8B8A8_UNORM);
+
+	std::vector<ShaderFeature> features = {
+		{ "VERTEX_COLOR", 0 },
+		{ "FOG", 1 },
+		{ "GAMMA", 2 },
+		{ "UBER", 3 },
+	};
+	basicProgram = permutations->RegisterProgram("basic", state, features);
+	basicProgramReady = permutations->SetFallbackPermutation(basicProgram, BASIC_UBER);
+	return basicProgramReady;
+}
+
+std::string Common::GetShaderPath(const char *name)
+{
+	return std::string(SHADER_DIR) + name;
+}
+
+bool Common::IsDeviceExtensionEnabled(const char *name) const
+{
+	for (const std::string &extension : enabledDeviceExtensions)
+	{
+		if (extension == name)
+			return true;
+	}
+	return false;
+}
+
+VkPipeline Common::GetPipeline(const GraphicsPipelineState &state)
+{
+	return pipelineStates->GetPipeline(state);
+}
+
+VkPipeline Common::GetBasicPipeline(uint64_t features)
+{
+	if (!basicProgramReady)
+		return VK_NULL_HANDLE;
+	return permutations->GetPipeline(basicProgram, features);
+}
+
+void Common::LogPermutationStats()
+{
+	if (!permutations)
+		return;
+
+	LOG_INFO(LOG_CATEGORY_PIPELINES, "Shader modules: %u unique of %u requested", permutations->GetUniqueModuleCount(), permutations->GetModuleRequestCount());
+	LOG_INFO(LOG_CATEGORY_PIPELINES, "Pipelines: %u", permutations->GetPipelineCount());
+	for (const PermutationStats &stats : permutations->GetPermutationStats())
+		LOG_INFO(LOG_CATEGORY_PIPELINES, "  %s [%s] %g ms, queued %g ms", stats.program, stats.features, stats.createMs, stats.queueMs);
+}
+
+void Common::LogPipelineCompilerStats()
+{
+	if (!pipelineCompiler)
+		return;
+
+	LOG_INFO(LOG_CATEGORY_PIPELINES, "Pipeline compiler: %u workers, %u compiled, %u failed",
+		pipelineCompiler->GetWorkerCount(), pipelineCompiler->GetCompiledCount(), pipelineCompiler->GetFailedCount());
+	LOG_INFO(LOG_CATEGORY_PIPELINES, "Hitches: %u of %u frames drew with a fallback pipeline (%u draws)",
+		pipelineCompiler->GetHitchFrames(), pipelineCompiler->GetFrameCount(), pipelineCompiler->GetFallbackDraws());
+	std::ostringstream latency;
+	latency << "Readiness latency:";
+	for (int i = 0; i < PipelineCompiler::LATENCY_BUCKETS; i++)
+	{
+		uint64_t count = pipelineCompiler->GetLatencyBucket(i);
+		if (count)
+			latency << " " << PipelineCompiler::GetLatencyBucketLabel(i) << ":" << count;
+	}
+	LOG_INFO(LOG_CATEGORY_PIPELINES, "%s", latency.str());
+}
+
+void Common::LogPipelineStateCacheStats()
+{
+	if (!pipelineStates)
+		return;
+
+	LOG_INFO(LOG_CATEGORY_PIPELINES, "Pipeline state cache: %u pipelines, %u of %u lookups deduplicated, %u hash collisions",
+		pipelineStates->GetPipelineCount(), pipelineStates->GetHitCount(), pipelineStates->GetLookupCount(), pipelineStates->GetCollisionCount());
+}
+
+void Common::LogGpuTimings()
+{
+	if (!gpuProfiler || !gpuProfiler->IsSupported())
+		return;
+
+	LOG_INFO(LOG_CATEGORY_PROFILER, "GPU zones (%u frames resolved, %u late):", gpuProfiler->GetResolvedFrames(), gpuProfiler->GetLateFrames());
+	for (const GpuZoneResult &zone : gpuProfiler->GetLastResults())
+		LOG_INFO(LOG_CATEGORY_PROFILER, "  %s%s %g ms", std::string(zone.depth * 2, ' '), zone.name, zone.GetMs());
+}
+
+
+struct AppOptions
+{
+	std::string tracePath;
+	std::string memoryDumpPath;
+	std::string perfDumpPath;
+	int memorySummaryInterval = 0;
+	int frameCount = 300;
+	uint32_t framesInFlight = 2;
+	FramePacing pacing = FRAME_PACING_THROUGHPUT;
+	bool frameLog = false;
+	uint32_t width = 1280;
+	uint32_t height = 720;
+	std::string capturePrefix;
+	ImageFormat captureFormat = IMAGE_FORMAT_PPM;
+	uint32_t captureThreads = 0;
+	uint32_t captureBuffers = 0;
+	std::string streamPath;
+	VideoStreamFormat streamFormat = VIDEO_STREAM_Y4M;
+	uint32_t streamFrameRate = 60;
+	bool meshlets = false;
+	MeshletCulling meshletCulling = MESHLET_CULLING_NONE;
+	uint32_t objectCount = 0;
+	bool gpuDriven = false;
+	float lodPixelError = 1.0f;
+	VertexFormat vertexFormat = VERTEX_FORMAT_PACKED;
+	uint32_t lightCount = 0;
+	LightBinning lightBinning = LIGHT_BINNING_CPU;
+	uint32_t streamingResources = 0;
+	uint32_t streamingBudgetMB = 64;
+	IoBackend ioBackend = IO_BACKEND_URING;
+	uint32_t ioDepth = 32;
+};
+
+// Removed when it goes out of scope, whichever way RunApplication returns.
+// Declared before whatever has it open, so that is closed first.
+struct TemporaryFile
+{
+	std::string path;
+
+	~TemporaryFile()
+	{
+		std::error_code error;
+		if (!path.empty())
+			std::filesystem::remove(path, error);
+	}
+};
+
+static int RunApplication(const AppOptions &options)
+{
+	Common common;
+	if (!common.Init())
+		return 1;
+	common.lodPixelError = options.lodPixelError;
+
+	SceneRenderer scene(common, options.width, options.height);
+	FrameLoop frameLoop(common, options.framesInFlight, options.pacing);
+	if (options.objectCount)
+		scene.EnableObjects(options.objectCount, options.gpuDriven ? INSTANCE_SUBMISSION_GPU : INSTANCE_SUBMISSION_CPU, options.vertexFormat);
+	else if (options.meshlets)
+		scene.EnableMeshlets(options.meshletCulling);
+	if (options.lightCount)
+		scene.EnableLights(options.lightCount, options.lightBinning);
+	if (!scene.Init() || !frameLoop.Init())
+		return 1;
+
+	std::unique_ptr<FrameCapture> capture;
+	if (!options.capturePrefix.empty() || !options.streamPath.empty())
+	{
+		capture.reset(new FrameCapture(common, frameLoop, options.capturePrefix, options.captureFormat, options.captureThreads));
+		uint32_t bufferCount = options.captureBuffers ? options.captureBuffers
+			: frameLoop.GetFramesInFlight() + (options.captureThreads ? options.captureThreads : ThreadPool::DefaultWorkerCount()) + 1;
+		if (!capture->Init(options.width, options.height, bufferCount))
+			return 1;
+		if (!options.streamPath.empty() && !capture->OpenStream(options.streamPath, options.streamFormat, options.streamFrameRate))
+			return 1;
+	}
+
+	// A synthetic world streamed from a pack around the scene camera. Nothing
+	// draws it yet; it runs so the streaming stats reflect real reads.
+	TemporaryFile streamingPackFile;
+	AssetPack streamingPack;
+	IoQueue streamingQueue;
+	StreamingConfig streamingConfig;
+	streamingConfig.memoryBudget = (uint64_t)options.streamingBudgetMB << 20;
+	streamingConfig.pixelError = options.lodPixelError;
+	streamingConfig.maxLoadsInFlight = options.ioDepth;
+	StreamingManager streaming(streamingConfig);
+	if (options.streamingResources)
+	{
+		StreamingWorld world;
+		GenerateStreamingWorld(world, options.streamingResources, STREAMING_WORLD_EXTENT, STREAMING_WORLD_DETAIL, STREAMING_WORLD_SEED);
+		std::string &packPath = streamingPackFile.path;
+		packPath = (std::filesystem::temp_directory_path() / ("vulkan01_streaming_" + std::to_string(std::random_device()()) + ".pack")).string();
+		if (!WriteStreamingWorldPack(world, packPath) || !streamingPack.Open(packPath) || !streamingQueue.Init(options.ioBackend, options.ioDepth))
+		{
+			LOG_ERROR(LOG_CATEGORY_ASSETS, "Could not set up streaming from %s", packPath);
+			return 1;
+		}
+		streaming.SetSource(&streamingPack, &streamingQueue);
+		AddStreamingWorld(streaming, world);
+		LOG_INFO(LOG_CATEGORY_ASSETS, "Streaming %u resources, %.1f MB in total, through %s", options.streamingResources,
+			world.totalBytes / 1048576.0, GetIoBackendName(streamingQueue.GetBackend()));
+	}
+
+	// The first frames draw with the uber fallback while the specialized
+	// pipelines compile.
+	for (int frame = 0; frame < options.frameCount; frame++)
+	{
+		PROFILE_SCOPE("Frame");
+		FrameContext context;
+		if (!frameLoop.BeginFrame(context))
+			return 1;
+		common.pipelineCompiler->BeginFrame();
+		if (options.streamingResources)
+		{
+			SceneCamera camera = scene.GetCamera(context.frameIndex);
+			streaming.Update(camera.eye, Frustum::FromMatrix(camera.viewProjection), camera.projectionScale);
+		}
+		{
+			PROFILE_COUNTERS("Record");
+			scene.Record(context.cmd, context.frameIndex, *context.arena);
+			if (capture)
+				capture->Capture(context.cmd, scene.GetColorTarget(), context.frameIndex);
+		}
+		if (!frameLoop.EndFrame(context))
+			return 1;
+
+		MemoryTracker::QueryDeviceBudget(common.physicalDevice, common.IsDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME));
+		MemoryTracker::EndFrame();
+		if (options.memorySummaryInterval > 0 && (frame + 1) % options.memorySummaryInterval == 0)
+			MemoryTracker::LogSummary();
+	}
+	frameLoop.WaitIdle();
+	if (capture)
+		capture->Flush();
+	streaming.Flush();
+
+	frameLoop.LogSummary(options.frameLog);
+	scene.LogSummary();
+	if (capture)
+		capture->LogSummary();
+	if (options.streamingResources)
+		streaming.LogSummary();
+	common.LogPermutationStats();
+	common.LogPipelineCompilerStats();
+	common.LogPipelineStateCacheStats();
+	common.LogGpuTimings();
+	MemoryTracker::LogSummary();
+	PerfCounters::LogSummary();
+	return 0;
+}
 
 int main(int argc, char **argv)
 {
-	cout << "Hello World";
-}
\ No newline at end of file
+	AppOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--trace" && i + 1 < argc)
+			options.tracePath = argv[++i];
+		else if (arg == "--mem-dump" && i + 1 < argc)
+			options.memoryDumpPath = argv[++i];
+		else if (arg == "--perf-dump" && i + 1 < argc)
+			options.perfDumpPath = argv[++i];
+		else if (arg == "--mem-summary" && i + 1 < argc)
+			options.memorySummaryInterval = atoi(argv[++i]);
+		else if (arg == "--frames" && i + 1 < argc)
+			options.frameCount = atoi(argv[++i]);
+		else if (arg == "--frames-in-flight" && i + 1 < argc)
+			options.framesInFlight = (uint32_t)atoi(argv[++i]);
+		else if (arg == "--pacing" && i + 1 < argc)
+			options.pacing = std::string(argv[++i]) == "latency" ? FRAME_PACING_LATENCY : FRAME_PACING_THROUGHPUT;
+		else if (arg == "--frame-log")
+			options.frameLog = true;
+		else if (arg == "--resolution" && i + 1 < argc)
+		{
+			std::string resolution = argv[++i];
+			if (resolution == "1080p")
+			{
+				options.width = 1920;
+				options.height = 1080;
+			}
+			else if (resolution == "4k")
+			{
+				options.width = 3840;
+				options.height = 2160;
+			}
+			else if (sscanf(resolution.c_str(), "%ux%u", &options.width, &options.height) != 2 || !options.width || !options.height)
+			{
+				LOG_ERROR(LOG_CATEGORY_GENERAL, "Bad resolution %s, expected WIDTHxHEIGHT, 1080p or 4k", resolution);
+				return 1;
+			}
+		}
+		else if (arg == "--capture" && i + 1 < argc)
+			options.capturePrefix = argv[++i];
+		else if (arg == "--capture-format" && i + 1 < argc)
+		{
+			if (!ParseImageFormat(argv[++i], options.captureFormat))
+			{
+				LOG_ERROR(LOG_CATEGORY_GENERAL, "Unknown capture format %s, expected ppm, png, qoi or exr", argv[i]);
+				return 1;
+			}
+		}
+		else if (arg == "--capture-threads" && i + 1 < argc)
+			options.captureThreads = (uint32_t)atoi(argv[++i]);
+		else if (arg == "--capture-buffers" && i + 1 < argc)
+			options.captureBuffers = (uint32_t)atoi(argv[++i]);
+		else if (arg == "--stream" && i + 1 < argc)
+			options.streamPath = argv[++i];
+		else if (arg == "--stream-format" && i + 1 < argc)
+		{
+			if (!ParseVideoStreamFormat(argv[++i], options.streamFormat))
+			{
+				LOG_ERROR(LOG_CATEGORY_GENERAL, "Unknown stream format %s, expected y4m or yuv", argv[i]);
+				return 1;
+			}
+		}
+		else if (arg == "--stream-fps" && i + 1 < argc)
+			options.streamFrameRate = (uint32_t)std::max(1, atoi(argv[++i]));
+		else if (arg == "--meshlets" && i + 1 < argc)
+		{
+			options.meshlets = true;
+			if (!ParseMeshletCulling(argv[++i], options.meshletCulling))
+			{
+				LOG_ERROR(LOG_CATEGORY_GENERAL, "Unknown meshlet culling %s, expected none, cpu or gpu", argv[i]);
+				return 1;
+			}
+		}
+		else if (arg == "--objects" && i + 1 < argc)
+			options.objectCount = (uint32_t)std::max(0, atoi(argv[++i]));
+		else if (arg == "--gpu-driven")
+			options.gpuDriven = true;
+		else if (arg == "--lod-error" && i + 1 < argc)
+			options.lodPixelError = std::max(0.0f, (float)atof(argv[++i]));
+		else if (arg == "--vertex-format" && i + 1 < argc)
+		{
+			if (!ParseVertexFormat(argv[++i], options.vertexFormat))
+			{
+				LOG_ERROR(LOG_CATEGORY_GENERAL, "Unknown vertex format %s, expected float or packed", argv[i]);
+				return 1;
+			}
+		}
+		else if (arg == "--lights" && i + 1 < argc)
+			options.lightCount = (uint32_t)std::max(0, atoi(argv[++i]));
+		else if (arg == "--light-binning" && i + 1 < argc)
+		{
+			if (!ParseLightBinning(argv[++i], options.lightBinning))
+			{
+				LOG_ERROR(LOG_CATEGORY_GENERAL, "Unknown light binning %s, expected cpu or gpu", argv[i]);
+				return 1;
+			}
+		}
+		else if (arg == "--stream-world" && i + 1 < argc)
+			options.streamingResources = (uint32_t)std::max(0, atoi(argv[++i]));
+		else if (arg == "--stream-budget" && i + 1 < argc)
+			options.streamingBudgetMB = (uint32_t)std::max(1, atoi(argv[++i]));
+		else if (arg == "--io-backend" && i + 1 < argc)
+		{
+			if (!ParseIoBackend(argv[++i], options.ioBackend))
+			{
+				LOG_ERROR(LOG_CATEGORY_GENERAL, "Unknown I/O backend %s, expected uring or threads", argv[i]);
+				return 1;
+			}
+		}
+		else if (arg == "--io-depth" && i + 1 < argc)
+			options.ioDepth = (uint32_t)std::max(1, atoi(argv[++i]));
+		else if (arg == "--log-level" && i + 1 < argc)
+		{
+			// Either a level for everything or category=level.
+			std::string setting = argv[++i];
+			size_t separator = setting.find('=');
+			LogCategory category = LOG_CATEGORY_GENERAL;
+			LogLevel level = LOG_LEVEL_INFO;
+			if (separator == std::string::npos ? !ParseLogLevel(setting, level)
+				: !ParseLogCategory(setting.substr(0, separator), category) || !ParseLogLevel(setting.substr(separator + 1), level))
+			{
+				LOG_ERROR(LOG_CATEGORY_GENERAL, "Bad log level %s, expected LEVEL or CATEGORY=LEVEL", setting);
+				return 1;
+			}
+			if (separator == std::string::npos)
+				Log::SetLevel(level);
+			else
+				Log::SetCategoryLevel(category, level);
+		}
+		else if (arg == "--log-file" && i + 1 < argc)
+		{
+			if (!Log::SetOutputFile(argv[++i]))
+			{
+				LOG_ERROR(LOG_CATEGORY_GENERAL, "Could not open log file %s", argv[i]);
+				return 1;
+			}
+		}
+	}
+
+	int exitCode = RunApplication(options);
+	if (!options.tracePath.empty())
+	{
+		if (Profiler::WriteChromeTrace(options.tracePath))
+			LOG_INFO(LOG_CATEGORY_PROFILER, "Wrote %u profiler events to %s", Profiler::GetEventCount(), options.tracePath);
+		else
+			LOG_ERROR(LOG_CATEGORY_PROFILER, "Could not write trace to %s", options.tracePath);
+	}
+	if (!options.memoryDumpPath.empty() && !MemoryTracker::WriteJson(options.memoryDumpPath))
+		LOG_ERROR(LOG_CATEGORY_MEMORY, "Could not write memory dump to %s", options.memoryDumpPath);
+	if (!options.perfDumpPath.empty() && !PerfCounters::WriteJson(options.perfDumpPath))
+		LOG_ERROR(LOG_CATEGORY_PROFILER, "Could not write hardware counters to %s", options.perfDumpPath);
+	Log::Shutdown();
+	return exitCode;
+}
+
@@ -1,12 +1,81 @@
 #pragma once
-#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "gpuprofiler.h"
+#include "pipelinecompiler.h"
+#include "pipelinestatecache.h"
+#include "shaderpermutation.h"
 
-using namespace std;
+enum BasicFeature
+{
+	BASIC_VERTEX_COLOR = 1 << 0,
+	BASIC_FOG = 1 << 1,
+	BASIC_GAMMA = 1 << 2,
+	BASIC_UBER = 1 << 3,
+};
+
+struct BasicPushConstants
+{
+	float mvp[16];
+	float fogColor[4];
+	uint32_t features;
+};
 
 class Common
 {
 public:
+	// Upper bound for FrameLoop; the GPU profiler keeps this many query slices.
+	static const uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+
 	Common();
 	virtual ~Common();
-};
 
+	bool Init();
+	void Cleanup();
+
+	// Returns the pipeline for an arbitrary state, creating it only if no
+	// identical state has been requested before.
+	VkPipeline GetPipeline(const GraphicsPipelineState &state);
+	VkPipeline GetBasicPipeline(uint64_t features);
+	VkPipelineLayout GetBasicPipelineLayout() const { return basicPipelineLayout; }
+	void LogPermutationStats();
+	void LogPipelineCompilerStats();
+	void LogPipelineStateCacheStats();
+	void LogGpuTimings();
+
+	bool IsDeviceExtensionEnabled(const char *name) const;
+
+	// Where the compiled SPIR-V for a shader source file lives.
+	static std::string GetShaderPath(const char *name);
+
+	VkInstance instance;
+	VkPhysicalDevice physicalDevice;
+	VkPhysicalDeviceProperties deviceProperties;
+	VkDevice device;
+	uint32_t queueFamilyIndex;
+	VkQueue queue;
+	VkCommandPool commandPool;
+	VkPipelineCache pipelineCache;
+	std::vector<std::string> enabledDeviceExtensions;
+	VkPhysicalDeviceFeatures enabledFeatures;
+	VkPhysicalDeviceVulkan12Features enabledFeatures12;
+	std::unique_ptr<PipelineStateCache> pipelineStates;
+	std::unique_ptr<PipelineCompiler> pipelineCompiler;
+	std::unique_ptr<ShaderPermutationManager> permutations;
+	std::unique_ptr<GpuProfiler> gpuProfiler;
+	// Screen-space error in pixels that LOD selection (SelectLod) may
+	// introduce; 0 always draws full detail.
+	float lodPixelError;
+
+private:
+	bool CreateInstance();
+	bool SelectPhysicalDevice();
+	bool CreateDevice();
+	bool CreateBasicProgram();
+
+	VkPipelineLayout basicPipelineLayout;
+	uint32_t basicProgram;
+	bool basicProgramReady;
+};
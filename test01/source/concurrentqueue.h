@@ -0,0 +1,223 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+// Keeps the producer and consumer indices on separate cache lines so the two
+// sides do not invalidate each other's line on every operation.
+static const size_t QUEUE_CACHE_LINE = 64;
+
+static inline size_t RoundUpQueueCapacity(size_t capacity)
+{
+	size_t rounded = 2;
+	while (rounded < capacity)
+		rounded <<= 1;
+	return rounded;
+}
+
+// Bounded multi-producer multi-consumer ring (Dmitry Vyukov's design). Every
+// cell carries a sequence number that says whether it is ready to be written
+// or read for a given lap of the ring, so a push or pop is one CAS on the
+// shared position plus a release store on the cell; no locks and no
+// allocation after construction. Capacity is rounded up to a power of two.
+// Push and pop fail rather than block when the ring is full or empty.
+template <typename T>
+class MpmcQueue
+{
+public:
+	explicit MpmcQueue(size_t capacity)
+		: mask(RoundUpQueueCapacity(capacity) - 1), cells(new Cell[mask + 1]), enqueuePosition(0), dequeuePosition(0)
+	{
+		for (size_t i = 0; i <= mask; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	MpmcQueue(const MpmcQueue &) = delete;
+	MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+	// value is only moved from when the push succeeds.
+	bool TryPush(T &&value)
+	{
+		Cell *cell = AcquireCell(enqueuePosition, 0);
+		if (!cell)
+			return false;
+		cell->value = std::move(value);
+		cell->sequence.store(cell->claimed + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool TryPush(const T &value)
+	{
+		T copy(value);
+		return TryPush(std::move(copy));
+	}
+
+	bool TryPop(T &value)
+	{
+		Cell *cell = AcquireCell(dequeuePosition, 1);
+		if (!cell)
+			return false;
+		value = std::move(cell->value);
+		cell->value = T();
+		cell->sequence.store(cell->claimed + mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Exact only when no push or pop is in progress.
+	size_t ApproximateSize() const
+	{
+		size_t dequeued = dequeuePosition.load(std::memory_order_relaxed);
+		size_t enqueued = enqueuePosition.load(std::memory_order_relaxed);
+		return enqueued - dequeued;
+	}
+
+	bool IsEmpty() const { return ApproximateSize() == 0; }
+	size_t GetCapacity() const { return mask + 1; }
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		size_t claimed;	// position the owning thread claimed, private to it
+		T value;
+	};
+
+	// A cell at position p is free for writing when its sequence equals p and
+	// full for reading when it equals p + 1, hence the offset.
+	Cell *AcquireCell(std::atomic<size_t> &position, size_t offset)
+	{
+		size_t claimed = position.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell *cell = &cells[claimed & mask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			intptr_t difference = (intptr_t)sequence - (intptr_t)(claimed + offset);
+			if (difference == 0)
+			{
+				if (position.compare_exchange_weak(claimed, claimed + 1, std::memory_order_relaxed))
+				{
+					cell->claimed = claimed;
+					return cell;
+				}
+			}
+			else if (difference < 0)
+			{
+				return nullptr;
+			}
+			else
+			{
+				claimed = position.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	const size_t mask;
+	std::unique_ptr<Cell[]> cells;
+	alignas(QUEUE_CACHE_LINE) std::atomic<size_t> enqueuePosition;
+	alignas(QUEUE_CACHE_LINE) std::atomic<size_t> dequeuePosition;
+};
+
+// Bounded single-producer single-consumer ring. Each side keeps a private copy
+// of the other side's index and only re-reads the shared one when the copy
+// says the ring is full (or empty), so in steady state a push or pop touches
+// no cache line the other thread is writing.
+//
+// Besides TryPush/TryPop, slots can be written and read in place: the
+// producer fills the slot returned by BeginPush and publishes it with
+// EndPush; the consumer reads Front and releases it with Pop.
+template <typename T>
+class SpscQueue
+{
+public:
+	explicit SpscQueue(size_t capacity)
+		: mask(RoundUpQueueCapacity(capacity) - 1), slots(new T[mask + 1]), head(0), cachedTail(0), tail(0), cachedHead(0)
+	{
+	}
+
+	SpscQueue(const SpscQueue &) = delete;
+	SpscQueue &operator=(const SpscQueue &) = delete;
+
+	// Producer side. Returns null when full.
+	T *BeginPush()
+	{
+		size_t position = tail.load(std::memory_order_relaxed);
+		if (position - cachedHead > mask)
+		{
+			cachedHead = head.load(std::memory_order_acquire);
+			if (position - cachedHead > mask)
+				return nullptr;
+		}
+		return &slots[position & mask];
+	}
+
+	void EndPush() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+	bool TryPush(T &&value)
+	{
+		T *slot = BeginPush();
+		if (!slot)
+			return false;
+		*slot = std::move(value);
+		EndPush();
+		return true;
+	}
+
+	bool TryPush(const T &value)
+	{
+		T *slot = BeginPush();
+		if (!slot)
+			return false;
+		*slot = value;
+		EndPush();
+		return true;
+	}
+
+	// Consumer side. Returns null when empty.
+	T *Front()
+	{
+		size_t position = head.load(std::memory_order_relaxed);
+		if (position == cachedTail)
+		{
+			cachedTail = tail.load(std::memory_order_acquire);
+			if (position == cachedTail)
+				return nullptr;
+		}
+		return &slots[position & mask];
+	}
+
+	void Pop() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+	bool TryPop(T &value)
+	{
+		T *slot = Front();
+		if (!slot)
+			return false;
+		value = std::move(*slot);
+		Pop();
+		return true;
+	}
+
+	size_t ApproximateSize() const
+	{
+		size_t popped = head.load(std::memory_order_relaxed);
+		size_t pushed = tail.load(std::memory_order_relaxed);
+		return pushed - popped;
+	}
+
+	bool IsEmpty() const { return ApproximateSize() == 0; }
+	size_t GetCapacity() const { return mask + 1; }
+
+private:
+	const size_t mask;
+	std::unique_ptr<T[]> slots;
+
+	// Written by the consumer.
+	alignas(QUEUE_CACHE_LINE) std::atomic<size_t> head;
+	size_t cachedTail;
+
+	// Written by the producer.
+	alignas(QUEUE_CACHE_LINE) std::atomic<size_t> tail;
+	size_t cachedHead;
+};
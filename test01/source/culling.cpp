@@ -0,0 +1,67 @@
+#include "culling.h"
+#include "perfcounters.h"
+
+static Plane MakePlane(float a, float b, float c, float d)
+{
+	float length = sqrtf(a * a + b * b + c * c);
+	Plane plane;
+	plane.normal = Vec3(a / length, b / length, c / length);
+	plane.d = d / length;
+	return plane;
+}
+
+Frustum Frustum::FromMatrix(const Mat4 &vp)
+{
+	// Gribb/Hartmann extraction; near uses row 2 alone because clip depth
+	// starts at 0 rather than -w.
+	Frustum frustum;
+	for (int i = 0; i < 3; i++)
+	{
+		frustum.planes[i * 2 + 0] = MakePlane(vp.Row(3, 0) + vp.Row(i, 0), vp.Row(3, 1) + vp.Row(i, 1), vp.Row(3, 2) + vp.Row(i, 2), vp.Row(3, 3) + vp.Row(i, 3));
+		frustum.planes[i * 2 + 1] = MakePlane(vp.Row(3, 0) - vp.Row(i, 0), vp.Row(3, 1) - vp.Row(i, 1), vp.Row(3, 2) - vp.Row(i, 2), vp.Row(3, 3) - vp.Row(i, 3));
+	}
+	frustum.planes[4] = MakePlane(vp.Row(2, 0), vp.Row(2, 1), vp.Row(2, 2), vp.Row(2, 3));
+	return frustum;
+}
+
+bool Frustum::TestSphere(const Vec3 &center, float radius) const
+{
+	for (const Plane &plane : planes)
+	{
+		if (Dot(plane.normal, center) + plane.d < -radius)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::TestAabb(const Vec3 &minimum, const Vec3 &maximum) const
+{
+	for (const Plane &plane : planes)
+	{
+		// Corner furthest along the plane normal.
+		Vec3 corner(plane.normal.x >= 0.0f ? maximum.x : minimum.x,
+			plane.normal.y >= 0.0f ? maximum.y : minimum.y,
+			plane.normal.z >= 0.0f ? maximum.z : minimum.z);
+		if (Dot(plane.normal, corner) + plane.d < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+size_t CullSpheres(const Frustum &frustum, const BoundingSphere *spheres, size_t count, uint32_t *visible)
+{
+	PROFILE_COUNTERS("Culling");
+	size_t visibleCount = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		const BoundingSphere &sphere = spheres[i];
+		bool inside = true;
+		for (const Plane &plane : frustum.planes)
+			inside &= Dot(plane.normal, sphere.center) + plane.d >= -sphere.radius;
+
+		// Branch-free append: always write, only advance when visible.
+		visible[visibleCount] = (uint32_t)i;
+		visibleCount += inside ? 1 : 0;
+	}
+	return visibleCount;
+}
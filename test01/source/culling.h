@@ -0,0 +1,33 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "mathutil.h"
+
+struct BoundingSphere
+{
+	Vec3 center;
+	float radius;
+};
+
+// Plane with a unit normal pointing into the frustum: dot(normal, p) + d >= 0
+// for points inside.
+struct Plane
+{
+	Vec3 normal;
+	float d;
+};
+
+struct Frustum
+{
+	Plane planes[6];
+
+	// Extracts the planes of a Vulkan (depth 0..1) view-projection matrix.
+	static Frustum FromMatrix(const Mat4 &viewProjection);
+
+	bool TestSphere(const Vec3 &center, float radius) const;
+	bool TestAabb(const Vec3 &minimum, const Vec3 &maximum) const;
+};
+
+// Writes the indices of the spheres that intersect the frustum and returns how
+// many there were.
+size_t CullSpheres(const Frustum &frustum, const BoundingSphere *spheres, size_t count, uint32_t *visible);
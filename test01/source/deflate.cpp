@@ -0,0 +1,534 @@
+#include "deflate.h"
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+	const int WINDOW_SIZE = 1 << 15;
+	const int WINDOW_MASK = WINDOW_SIZE - 1;
+	const int HASH_BITS = 15;
+	const int MIN_MATCH = 3;
+	const int MAX_MATCH = 258;
+	const size_t TOKENS_PER_BLOCK = 1 << 16;
+
+	const int LITLEN_CODES = 286;
+	const int DISTANCE_CODES = 30;
+	const int CODELENGTH_CODES = 19;
+
+	const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+		4097, 6145, 8193, 12289, 16385, 24577 };
+	const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	const uint8_t CODELENGTH_ORDER[CODELENGTH_CODES] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	// A literal when distance is 0, otherwise a match.
+	struct Token
+	{
+		uint16_t value;
+		uint16_t distance;
+	};
+
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(std::vector<uint8_t> &out) : out(out), bits(0), count(0) {}
+
+		void Write(uint32_t value, int bitCount)
+		{
+			bits |= (uint64_t)value << count;
+			count += bitCount;
+			while (count >= 8)
+			{
+				out.push_back((uint8_t)bits);
+				bits >>= 8;
+				count -= 8;
+			}
+		}
+
+		void AlignToByte()
+		{
+			if (count > 0)
+				Write(0, 8 - count);
+		}
+
+	private:
+		std::vector<uint8_t> &out;
+		uint64_t bits;
+		int count;
+	};
+
+	int LengthCode(int length)
+	{
+		int code = 0;
+		while (code < 28 && LENGTH_BASE[code + 1] <= length)
+			code++;
+		return code;
+	}
+
+	int DistanceCode(int distance)
+	{
+		int code = 0;
+		while (code < 29 && DISTANCE_BASE[code + 1] <= distance)
+			code++;
+		return code;
+	}
+
+	struct CodeTables
+	{
+		uint8_t lengthCode[MAX_MATCH + 1];
+		uint8_t distanceCodeLow[512];
+		uint8_t distanceCodeHigh[256];
+
+		CodeTables()
+		{
+			for (int length = MIN_MATCH; length <= MAX_MATCH; length++)
+				lengthCode[length] = (uint8_t)LengthCode(length);
+			for (int distance = 1; distance <= 512; distance++)
+				distanceCodeLow[distance - 1] = (uint8_t)DistanceCode(distance);
+			for (int i = 0; i < 256; i++)
+				distanceCodeHigh[i] = (uint8_t)DistanceCode((i << 7) + 1);
+		}
+
+		int Distance(int distance) const
+		{
+			return distance <= 512 ? distanceCodeLow[distance - 1] : distanceCodeHigh[(distance - 1) >> 7];
+		}
+	};
+
+	const CodeTables &Tables()
+	{
+		static const CodeTables tables;
+		return tables;
+	}
+
+	// Huffman code lengths limited to maxBits. Frequencies are halved until
+	// the tree fits, which costs a little ratio in rare skewed blocks but
+	// keeps the builder simple.
+	void BuildLengths(const uint32_t *frequencies, int count, int maxBits, uint8_t *lengths)
+	{
+		std::vector<uint32_t> freq(frequencies, frequencies + count);
+		memset(lengths, 0, count);
+		for (;;)
+		{
+			struct Node
+			{
+				uint64_t weight;
+				int left, right;
+			};
+			std::vector<Node> nodes;
+			std::vector<std::pair<uint64_t, int>> heap;
+			for (int i = 0; i < count; i++)
+			{
+				if (freq[i])
+				{
+					heap.push_back({ freq[i], (int)nodes.size() });
+					nodes.push_back({ freq[i], -1, i });
+				}
+			}
+			if (heap.empty())
+				return;
+			if (heap.size() == 1)
+			{
+				lengths[nodes[0].right] = 1;
+				return;
+			}
+
+			auto greater = [](const std::pair<uint64_t, int> &a, const std::pair<uint64_t, int> &b) { return a.first > b.first; };
+			std::make_heap(heap.begin(), heap.end(), greater);
+			while (heap.size() > 1)
+			{
+				std::pop_heap(heap.begin(), heap.end(), greater);
+				std::pair<uint64_t, int> a = heap.back();
+				heap.pop_back();
+				std::pop_heap(heap.begin(), heap.end(), greater);
+				std::pair<uint64_t, int> b = heap.back();
+				heap.pop_back();
+				nodes.push_back({ a.first + b.first, a.second, b.second });
+				heap.push_back({ a.first + b.first, (int)nodes.size() - 1 });
+				std::push_heap(heap.begin(), heap.end(), greater);
+			}
+
+			// Leaves have left == -1 and the symbol in right.
+			std::vector<int> depth(nodes.size(), 0);
+			int maxDepth = 0;
+			for (int i = (int)nodes.size() - 1; i >= 0; i--)
+			{
+				if (nodes[i].left < 0)
+				{
+					lengths[nodes[i].right] = (uint8_t)depth[i];
+					maxDepth = std::max(maxDepth, depth[i]);
+					continue;
+				}
+				depth[nodes[i].left] = depth[i] + 1;
+				depth[nodes[i].right] = depth[i] + 1;
+			}
+			if (maxDepth <= maxBits)
+				return;
+
+			for (uint32_t &f : freq)
+			{
+				if (f)
+					f = (f >> 1) | 1;
+			}
+			memset(lengths, 0, count);
+		}
+	}
+
+	// Canonical codes, bit-reversed because deflate sends Huffman codes most
+	// significant bit first through an LSB-first bit stream.
+	void BuildCodes(const uint8_t *lengths, int count, uint16_t *codes)
+	{
+		int lengthCounts[16] = {};
+		for (int i = 0; i < count; i++)
+			lengthCounts[lengths[i]]++;
+		lengthCounts[0] = 0;
+
+		int nextCode[16] = {};
+		int code = 0;
+		for (int bits = 1; bits < 16; bits++)
+		{
+			code = (code + lengthCounts[bits - 1]) << 1;
+			nextCode[bits] = code;
+		}
+		for (int i = 0; i < count; i++)
+		{
+			int length = lengths[i];
+			if (!length)
+			{
+				codes[i] = 0;
+				continue;
+			}
+			int value = nextCode[length]++;
+			int reversed = 0;
+			for (int bit = 0; bit < length; bit++)
+				reversed |= ((value >> bit) & 1) << (length - 1 - bit);
+			codes[i] = (uint16_t)reversed;
+		}
+	}
+
+	void WriteBlock(BitWriter &writer, const Token *tokens, size_t tokenCount, bool final)
+	{
+		const CodeTables &tables = Tables();
+		uint32_t litlenFreq[LITLEN_CODES] = {};
+		uint32_t distanceFreq[DISTANCE_CODES] = {};
+		for (size_t i = 0; i < tokenCount; i++)
+		{
+			if (tokens[i].distance == 0)
+				litlenFreq[tokens[i].value]++;
+			else
+			{
+				litlenFreq[257 + tables.lengthCode[tokens[i].value]]++;
+				distanceFreq[tables.Distance(tokens[i].distance)]++;
+			}
+		}
+		litlenFreq[256] = 1;
+
+		// Keep both trees complete; some decoders reject single-code trees.
+		if (std::count_if(litlenFreq, litlenFreq + LITLEN_CODES, [](uint32_t f) { return f != 0; }) < 2)
+			litlenFreq[0]++;
+		int usedDistances = (int)std::count_if(distanceFreq, distanceFreq + DISTANCE_CODES, [](uint32_t f) { return f != 0; });
+		if (usedDistances < 2)
+		{
+			distanceFreq[0] += distanceFreq[0] ? 0 : 1;
+			distanceFreq[1] += distanceFreq[1] ? 0 : 1;
+		}
+
+		uint8_t litlenLengths[LITLEN_CODES];
+		uint8_t distanceLengths[DISTANCE_CODES];
+		BuildLengths(litlenFreq, LITLEN_CODES, 15, litlenLengths);
+		BuildLengths(distanceFreq, DISTANCE_CODES, 15, distanceLengths);
+
+		int litlenCount = LITLEN_CODES;
+		while (litlenCount > 257 && litlenLengths[litlenCount - 1] == 0)
+			litlenCount--;
+		int distanceCount = DISTANCE_CODES;
+		while (distanceCount > 1 && distanceLengths[distanceCount - 1] == 0)
+			distanceCount--;
+
+		// Both length arrays are sent as one run-length coded sequence.
+		uint8_t lengths[LITLEN_CODES + DISTANCE_CODES];
+		memcpy(lengths, litlenLengths, litlenCount);
+		memcpy(lengths + litlenCount, distanceLengths, distanceCount);
+		int total = litlenCount + distanceCount;
+
+		std::vector<std::pair<uint8_t, uint8_t>> runs;
+		uint32_t codelengthFreq[CODELENGTH_CODES] = {};
+		for (int i = 0; i < total;)
+		{
+			uint8_t value = lengths[i];
+			int run = 1;
+			while (i + run < total && lengths[i + run] == value)
+				run++;
+			int remaining = run;
+			if (value == 0)
+			{
+				while (remaining >= 11)
+				{
+					int n = std::min(remaining, 138);
+					runs.push_back({ 18, (uint8_t)(n - 11) });
+					remaining -= n;
+				}
+				if (remaining >= 3)
+				{
+					runs.push_back({ 17, (uint8_t)(remaining - 3) });
+					remaining = 0;
+				}
+			}
+			else if (remaining >= 4)
+			{
+				runs.push_back({ value, 0 });
+				remaining--;
+				while (remaining >= 3)
+				{
+					int n = std::min(remaining, 6);
+					runs.push_back({ 16, (uint8_t)(n - 3) });
+					remaining -= n;
+				}
+			}
+			while (remaining-- > 0)
+				runs.push_back({ value, 0 });
+			i += run;
+		}
+		for (const auto &run : runs)
+			codelengthFreq[run.first]++;
+
+		uint8_t codelengthLengths[CODELENGTH_CODES];
+		uint16_t codelengthCodes[CODELENGTH_CODES];
+		BuildLengths(codelengthFreq, CODELENGTH_CODES, 7, codelengthLengths);
+		BuildCodes(codelengthLengths, CODELENGTH_CODES, codelengthCodes);
+		int codelengthCount = CODELENGTH_CODES;
+		while (codelengthCount > 4 && codelengthLengths[CODELENGTH_ORDER[codelengthCount - 1]] == 0)
+			codelengthCount--;
+
+		writer.Write(final ? 1 : 0, 1);
+		writer.Write(2, 2);
+		writer.Write(litlenCount - 257, 5);
+		writer.Write(distanceCount - 1, 5);
+		writer.Write(codelengthCount - 4, 4);
+		for (int i = 0; i < codelengthCount; i++)
+			writer.Write(codelengthLengths[CODELENGTH_ORDER[i]], 3);
+		for (const auto &run : runs)
+		{
+			writer.Write(codelengthCodes[run.first], codelengthLengths[run.first]);
+			if (run.first == 16)
+				writer.Write(run.second, 2);
+			else if (run.first == 17)
+				writer.Write(run.second, 3);
+			else if (run.first == 18)
+				writer.Write(run.second, 7);
+		}
+
+		uint16_t litlenCodes[LITLEN_CODES];
+		uint16_t distanceCodes[DISTANCE_CODES];
+		BuildCodes(litlenLengths, LITLEN_CODES, litlenCodes);
+		BuildCodes(distanceLengths, DISTANCE_CODES, distanceCodes);
+		for (size_t i = 0; i < tokenCount; i++)
+		{
+			const Token &token = tokens[i];
+			if (token.distance == 0)
+			{
+				writer.Write(litlenCodes[token.value], litlenLengths[token.value]);
+				continue;
+			}
+			int lengthCode = tables.lengthCode[token.value];
+			writer.Write(litlenCodes[257 + lengthCode], litlenLengths[257 + lengthCode]);
+			writer.Write(token.value - LENGTH_BASE[lengthCode], LENGTH_EXTRA[lengthCode]);
+			int distanceCode = tables.Distance(token.distance);
+			writer.Write(distanceCodes[distanceCode], distanceLengths[distanceCode]);
+			writer.Write(token.distance - DISTANCE_BASE[distanceCode], DISTANCE_EXTRA[distanceCode]);
+		}
+		writer.Write(litlenCodes[256], litlenLengths[256]);
+	}
+
+	inline int MatchLength(const uint8_t *a, const uint8_t *b, int maxLength)
+	{
+		int length = 0;
+#if defined(__GNUC__)
+		// Eight bytes at a time; the first differing byte is found from the
+		// lowest set bit of the XOR (little endian).
+		while (length + 8 <= maxLength)
+		{
+			uint64_t x, y;
+			memcpy(&x, a + length, 8);
+			memcpy(&y, b + length, 8);
+			uint64_t difference = x ^ y;
+			if (difference)
+				return length + (__builtin_ctzll(difference) >> 3);
+			length += 8;
+		}
+#endif
+		while (length < maxLength && a[length] == b[length])
+			length++;
+		return length;
+	}
+
+	inline uint32_t Hash3(const uint8_t *p)
+	{
+		uint32_t value = p[0] | (p[1] << 8) | (p[2] << 16);
+		return (value * 2654435761u) >> (32 - HASH_BITS);
+	}
+}
+
+void DeflateRaw(const uint8_t *data, size_t size, bool final, int level, std::vector<uint8_t> &out)
+{
+	BitWriter writer(out);
+	int maxChain = level <= 1 ? 4 : level <= 3 ? 8 : level <= 6 ? 32 : 128;
+	int niceLength = level <= 3 ? 32 : level <= 6 ? 128 : MAX_MATCH;
+
+	std::vector<int32_t> head(1 << HASH_BITS, -1);
+	std::vector<int32_t> previous(WINDOW_SIZE, -1);
+	std::vector<Token> tokens;
+	tokens.reserve(TOKENS_PER_BLOCK);
+
+	// Match positions are stored as int32, so pieces must stay under 2 GB.
+	size_t position = 0;
+	bool finished = false;
+	while (position < size)
+	{
+		int bestLength = 0;
+		int bestDistance = 0;
+		if (position + MIN_MATCH <= size)
+		{
+			uint32_t hash = Hash3(data + position);
+			int32_t candidate = head[hash];
+			int maxLength = (int)std::min<size_t>(MAX_MATCH, size - position);
+			for (int chain = 0; candidate >= 0 && chain < maxChain; chain++)
+			{
+				int distance = (int)(position - (size_t)candidate);
+				if (distance > WINDOW_SIZE - 1)
+					break;
+				const uint8_t *a = data + candidate;
+				const uint8_t *b = data + position;
+				if (bestLength >= maxLength)
+					break;
+				if (a[bestLength] == b[bestLength])
+				{
+					int length = MatchLength(a, b, maxLength);
+					if (length > bestLength)
+					{
+						bestLength = length;
+						bestDistance = distance;
+						if (length >= niceLength)
+							break;
+					}
+				}
+				int32_t next = previous[candidate & WINDOW_MASK];
+				if (next >= candidate)
+					break;
+				candidate = next;
+			}
+			previous[position & WINDOW_MASK] = head[hash];
+			head[hash] = (int32_t)position;
+		}
+
+		if (bestLength >= MIN_MATCH)
+		{
+			tokens.push_back({ (uint16_t)bestLength, (uint16_t)bestDistance });
+			// Insert the skipped positions so later matches can find them;
+			// long runs only insert their tail to bound the cost.
+			size_t end = position + bestLength;
+			size_t insert = bestLength > 32 ? end - 8 : position + 1;
+			for (; insert < end && insert + MIN_MATCH <= size; insert++)
+			{
+				uint32_t hash = Hash3(data + insert);
+				previous[insert & WINDOW_MASK] = head[hash];
+				head[hash] = (int32_t)insert;
+			}
+			position = end;
+		}
+		else
+		{
+			tokens.push_back({ data[position], 0 });
+			position++;
+		}
+
+		if (tokens.size() == TOKENS_PER_BLOCK)
+		{
+			finished = final && position == size;
+			WriteBlock(writer, tokens.data(), tokens.size(), finished);
+			tokens.clear();
+		}
+	}
+	if (!tokens.empty() || (final && !finished))
+		WriteBlock(writer, tokens.data(), tokens.size(), final);
+
+	if (!final)
+	{
+		// Sync flush: empty stored block, then byte alignment.
+		writer.Write(0, 1);
+		writer.Write(0, 2);
+		writer.AlignToByte();
+		out.push_back(0x00);
+		out.push_back(0x00);
+		out.push_back(0xff);
+		out.push_back(0xff);
+	}
+	else
+		writer.AlignToByte();
+}
+
+uint32_t Adler32(const uint8_t *data, size_t size, uint32_t adler)
+{
+	const uint32_t BASE = 65521;
+	uint32_t a = adler & 0xffff;
+	uint32_t b = adler >> 16;
+	while (size > 0)
+	{
+		// 5552 bytes is the most that can be summed before b overflows.
+		size_t chunk = std::min<size_t>(size, 5552);
+		size -= chunk;
+		for (size_t i = 0; i < chunk; i++)
+		{
+			a += data[i];
+			b += a;
+		}
+		data += chunk;
+		a %= BASE;
+		b %= BASE;
+	}
+	return a | (b << 16);
+}
+
+uint32_t Adler32Combine(uint32_t adler1, uint32_t adler2, size_t length2)
+{
+	const uint32_t BASE = 65521;
+	uint32_t remainder = (uint32_t)(length2 % BASE);
+	uint32_t sum1 = adler1 & 0xffff;
+	uint32_t sum2 = (uint32_t)(((uint64_t)remainder * sum1) % BASE);
+	sum1 += (adler2 & 0xffff) + BASE - 1;
+	sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + BASE - remainder;
+	if (sum1 >= BASE)
+		sum1 -= BASE;
+	if (sum1 >= BASE)
+		sum1 -= BASE;
+	if (sum2 >= (BASE << 1))
+		sum2 -= (BASE << 1);
+	if (sum2 >= BASE)
+		sum2 -= BASE;
+	return sum1 | (sum2 << 16);
+}
+
+uint32_t Crc32(const uint8_t *data, size_t size, uint32_t crc)
+{
+	static const struct CrcTable
+	{
+		uint32_t entries[256];
+
+		CrcTable()
+		{
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				uint32_t c = i;
+				for (int k = 0; k < 8; k++)
+					c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				entries[i] = c;
+			}
+		}
+	} table;
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Compresses data as raw deflate blocks (RFC 1951) with LZ77 matching and
+// dynamic Huffman codes, appending to out. When final is false the output ends
+// with an empty stored block (a sync flush), leaving it byte aligned so that
+// independently compressed pieces can be concatenated into one stream; only the
+// last piece is final. Matches never reach outside data, so pieces compress in
+// parallel. level 1..9 trades speed for ratio through the match search depth.
+void DeflateRaw(const uint8_t *data, size_t size, bool final, int level, std::vector<uint8_t> &out);
+
+uint32_t Adler32(const uint8_t *data, size_t size, uint32_t adler = 1);
+
+// Adler-32 of the concatenation of two pieces, given each piece's checksum and
+// the second piece's length.
+uint32_t Adler32Combine(uint32_t adler1, uint32_t adler2, size_t length2);
+
+uint32_t Crc32(const uint8_t *data, size_t size, uint32_t crc = 0);
@@ -0,0 +1,413 @@
+#include "fileio.h"
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include "log.h"
+#include "profiler.h"
+#include "threadpool.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if IO_URING_ENABLED
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+// Plenty of threads to keep a device busy; beyond this, blocking reads only
+// add context switches.
+static const uint32_t MAX_IO_THREADS = 64;
+
+namespace
+{
+	int64_t ReadAtOnce(IoFile file, uint64_t offset, void *destination, size_t size)
+	{
+#ifdef _WIN32
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		DWORD read = 0;
+		if (!ReadFile(file, destination, (DWORD)std::min<size_t>(size, 1u << 30), &read, &overlapped))
+			return GetLastError() == ERROR_HANDLE_EOF ? 0 : -EIO;
+		return read;
+#else
+		for (;;)
+		{
+			ssize_t read = pread(file, destination, size, (off_t)offset);
+			if (read >= 0)
+				return read;
+			if (errno != EINTR)
+				return -errno;
+		}
+#endif
+	}
+
+	uint8_t *AllocateBuffers(size_t size)
+	{
+#ifdef _WIN32
+		return (uint8_t *)VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+		void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return address != MAP_FAILED ? (uint8_t *)address : nullptr;
+#endif
+	}
+
+	void FreeBuffers(uint8_t *buffers, size_t size)
+	{
+#ifdef _WIN32
+		(void)size;
+		VirtualFree(buffers, 0, MEM_RELEASE);
+#else
+		munmap(buffers, size);
+#endif
+	}
+
+#if IO_URING_ENABLED
+	int IoUringSetup(unsigned entries, io_uring_params *params)
+	{
+		return (int)syscall(__NR_io_uring_setup, entries, params);
+	}
+
+	int IoUringEnter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+	{
+		return (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0);
+	}
+
+	int IoUringRegister(int ringFd, unsigned opcode, const void *arg, unsigned count)
+	{
+		return (int)syscall(__NR_io_uring_register, ringFd, opcode, arg, count);
+	}
+
+	void *MapRing(int ringFd, size_t size, uint64_t offset)
+	{
+		void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, (off_t)offset);
+		return address != MAP_FAILED ? address : nullptr;
+	}
+#endif
+}
+
+bool ReadFileAt(IoFile file, uint64_t offset, void *destination, size_t size)
+{
+	uint8_t *bytes = (uint8_t *)destination;
+	while (size > 0)
+	{
+		int64_t read = ReadAtOnce(file, offset, bytes, size);
+		if (read <= 0)
+			return false;
+		bytes += read;
+		offset += (uint64_t)read;
+		size -= (size_t)read;
+	}
+	return true;
+}
+
+const char *GetIoBackendName(IoBackend backend)
+{
+	return backend == IO_BACKEND_URING ? "uring" : "threads";
+}
+
+bool ParseIoBackend(const std::string &name, IoBackend &backend)
+{
+	if (name == "uring")
+		backend = IO_BACKEND_URING;
+	else if (name == "threads")
+		backend = IO_BACKEND_THREADS;
+	else
+		return false;
+	return true;
+}
+
+IoQueue::IoQueue()
+	:
+#if IO_URING_ENABLED
+	ringFd(-1), sqRing(nullptr), sqRingSize(0), cqRing(nullptr), cqRingSize(0), sqes(nullptr), sqesSize(0),
+	sqHead(nullptr), sqTail(nullptr), sqMask(nullptr), sqArray(nullptr), cqHead(nullptr), cqTail(nullptr),
+	cqMask(nullptr), cqes(nullptr), unsubmitted(0),
+#endif
+	backend(IO_BACKEND_THREADS), depth(0), pending(0), buffers(nullptr), bufferCount(0), bufferSize(0),
+	buffersRegistered(false)
+{
+}
+
+IoQueue::~IoQueue()
+{
+	Shutdown();
+}
+
+bool IoQueue::Init(IoBackend backend, uint32_t depth, uint32_t bufferCount, size_t bufferSize)
+{
+	Shutdown();
+	if (depth == 0)
+		return false;
+	this->depth = depth;
+	if (bufferCount && bufferSize)
+	{
+		// Whole pages, so every buffer is page aligned.
+		bufferSize = (bufferSize + 4095) & ~(size_t)4095;
+		buffers = AllocateBuffers(bufferCount * bufferSize);
+		if (!buffers)
+		{
+			LOG_ERROR(LOG_CATEGORY_ASSETS, "Could not allocate %u I/O buffers of %u bytes", bufferCount, bufferSize);
+			return false;
+		}
+		this->bufferCount = bufferCount;
+		this->bufferSize = bufferSize;
+	}
+
+	this->backend = IO_BACKEND_THREADS;
+#if IO_URING_ENABLED
+	if (backend == IO_BACKEND_URING)
+	{
+		if (InitRing())
+			this->backend = IO_BACKEND_URING;
+		else
+			LOG_WARNING(LOG_CATEGORY_ASSETS, "io_uring unavailable (%s), using I/O threads", strerror(errno));
+	}
+#else
+	if (backend == IO_BACKEND_URING)
+		LOG_WARNING(LOG_CATEGORY_ASSETS, "io_uring is Linux only, using I/O threads");
+#endif
+	if (this->backend == IO_BACKEND_THREADS)
+		pool.reset(new ThreadPool(std::min(depth, MAX_IO_THREADS)));
+	return true;
+}
+
+void IoQueue::Shutdown()
+{
+	if (pending)
+	{
+		// Buffers must outlive any read still writing into them.
+		std::vector<IoCompletion> drained(pending);
+		while (pending && Reap(drained.data(), drained.size(), 1) > 0)
+			;
+	}
+	pool.reset();
+	queued.clear();
+	completions.clear();
+#if IO_URING_ENABLED
+	ShutdownRing();
+#endif
+	if (buffers)
+		FreeBuffers(buffers, bufferCount * bufferSize);
+	buffers = nullptr;
+	bufferCount = 0;
+	bufferSize = 0;
+	buffersRegistered = false;
+	depth = 0;
+}
+
+bool IoQueue::Read(IoFile file, uint64_t offset, uint32_t size, void *destination, uint64_t userData)
+{
+	return Queue(Request{ file, offset, size, destination, userData }, -1);
+}
+
+bool IoQueue::ReadFixed(IoFile file, uint64_t offset, uint32_t size, uint32_t bufferIndex, uint64_t userData)
+{
+	if (bufferIndex >= bufferCount || size > bufferSize)
+		return false;
+	return Queue(Request{ file, offset, size, GetBuffer(bufferIndex), userData }, (int32_t)bufferIndex);
+}
+
+bool IoQueue::Queue(const Request &request, int32_t bufferIndex)
+{
+	if (pending >= depth)
+		return false;
+#if IO_URING_ENABLED
+	if (backend == IO_BACKEND_URING)
+	{
+		// Only this thread produces, so the tail needs no atomic read; the
+		// kernel moves the head.
+		unsigned tail = *sqTail;
+		unsigned index = tail & *sqMask;
+		io_uring_sqe *sqe = &sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = bufferIndex >= 0 && buffersRegistered ? IORING_OP_READ_FIXED : IORING_OP_READ;
+		sqe->fd = request.file;
+		sqe->off = request.offset;
+		sqe->addr = (uint64_t)(uintptr_t)request.destination;
+		sqe->len = request.size;
+		sqe->buf_index = (uint16_t)std::max(bufferIndex, 0);
+		sqe->user_data = request.userData;
+		sqArray[index] = index;
+		__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+		unsubmitted++;
+		pending++;
+		return true;
+	}
+#else
+	(void)bufferIndex;
+#endif
+	queued.push_back(request);
+	pending++;
+	return true;
+}
+
+uint32_t IoQueue::Submit()
+{
+	PROFILE_FUNCTION();
+#if IO_URING_ENABLED
+	if (backend == IO_BACKEND_URING)
+	{
+		uint32_t submitted = 0;
+		while (unsubmitted > 0)
+		{
+			int result = IoUringEnter(ringFd, unsubmitted, 0, 0);
+			if (result < 0 && errno == EINTR)
+				continue;
+			if (result <= 0)
+			{
+				// The entries stay in the ring and go with the next call.
+				LOG_RATE_LIMITED(LOG_LEVEL_WARNING, LOG_CATEGORY_ASSETS, 1, "io_uring_enter failed: %s", strerror(errno));
+				break;
+			}
+			unsubmitted -= (unsigned)result;
+			submitted += (uint32_t)result;
+		}
+		return submitted;
+	}
+#endif
+	for (const Request &request : queued)
+	{
+		pool->Submit([this, request]
+		{
+			IoCompletion completion;
+			completion.userData = request.userData;
+			completion.result = 0;
+			// Loops like pread would on io_uring's side: short only at the end.
+			uint8_t *bytes = (uint8_t *)request.destination;
+			while (completion.result < request.size)
+			{
+				int64_t read = ReadAtOnce(request.file, request.offset + completion.result, bytes + completion.result,
+					request.size - (size_t)completion.result);
+				if (read <= 0)
+				{
+					if (read < 0)
+						completion.result = read;
+					break;
+				}
+				completion.result += read;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			completions.push_back(completion);
+			completed.notify_one();
+		});
+	}
+	uint32_t submitted = (uint32_t)queued.size();
+	queued.clear();
+	return submitted;
+}
+
+size_t IoQueue::Reap(IoCompletion *completions, size_t maxCompletions, size_t minCompletions)
+{
+	minCompletions = std::min<size_t>({ minCompletions, maxCompletions, pending });
+#if IO_URING_ENABLED
+	if (backend == IO_BACKEND_URING)
+		return ReapRing(completions, maxCompletions, minCompletions);
+#endif
+	if (minCompletions > 0 && !queued.empty())
+		Submit();
+	std::unique_lock<std::mutex> lock(mutex);
+	completed.wait(lock, [&] { return this->completions.size() >= minCompletions; });
+	size_t count = std::min(maxCompletions, this->completions.size());
+	std::copy(this->completions.begin(), this->completions.begin() + count, completions);
+	this->completions.erase(this->completions.begin(), this->completions.begin() + count);
+	pending -= (uint32_t)count;
+	return count;
+}
+
+#if IO_URING_ENABLED
+bool IoQueue::InitRing()
+{
+	io_uring_params params = {};
+	ringFd = IoUringSetup(depth, &params);
+	if (ringFd < 0)
+		return false;
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+	sqRing = MapRing(ringFd, sqRingSize, IORING_OFF_SQ_RING);
+	cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? sqRing : MapRing(ringFd, cqRingSize, IORING_OFF_CQ_RING);
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	sqes = (io_uring_sqe *)MapRing(ringFd, sqesSize, IORING_OFF_SQES);
+	if (!sqRing || !cqRing || !sqes)
+	{
+		ShutdownRing();
+		return false;
+	}
+
+	uint8_t *sq = (uint8_t *)sqRing, *cq = (uint8_t *)cqRing;
+	sqHead = (unsigned *)(sq + params.sq_off.head);
+	sqTail = (unsigned *)(sq + params.sq_off.tail);
+	sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+	sqArray = (unsigned *)(sq + params.sq_off.array);
+	cqHead = (unsigned *)(cq + params.cq_off.head);
+	cqTail = (unsigned *)(cq + params.cq_off.tail);
+	cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+	cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+	if (buffers)
+	{
+		std::vector<iovec> vectors(bufferCount);
+		for (uint32_t i = 0; i < bufferCount; i++)
+			vectors[i] = iovec{ GetBuffer(i), bufferSize };
+		buffersRegistered = IoUringRegister(ringFd, IORING_REGISTER_BUFFERS, vectors.data(), bufferCount) == 0;
+		if (!buffersRegistered)
+			LOG_WARNING(LOG_CATEGORY_ASSETS, "Could not register I/O buffers (%s), reading without", strerror(errno));
+	}
+	LOG_DEBUG(LOG_CATEGORY_ASSETS, "io_uring: %u submission and %u completion entries", params.sq_entries, params.cq_entries);
+	return true;
+}
+
+void IoQueue::ShutdownRing()
+{
+	if (sqes)
+		munmap(sqes, sqesSize);
+	if (cqRing && cqRing != sqRing)
+		munmap(cqRing, cqRingSize);
+	if (sqRing)
+		munmap(sqRing, sqRingSize);
+	// Closing the ring also drops the buffer registration.
+	if (ringFd >= 0)
+		close(ringFd);
+	ringFd = -1;
+	sqRing = cqRing = nullptr;
+	sqes = nullptr;
+	unsubmitted = 0;
+}
+
+size_t IoQueue::ReapRing(IoCompletion *completions, size_t maxCompletions, size_t minCompletions)
+{
+	size_t count = 0;
+	for (;;)
+	{
+		unsigned head = *cqHead;
+		unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail && count < maxCompletions; head++, count++)
+		{
+			const io_uring_cqe &cqe = cqes[head & *cqMask];
+			completions[count].userData = cqe.user_data;
+			completions[count].result = cqe.res;
+		}
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+		if (count >= minCompletions)
+			break;
+		// Anything still unsubmitted goes in with the wait.
+		int result = IoUringEnter(ringFd, unsubmitted, (unsigned)(minCompletions - count), IORING_ENTER_GETEVENTS);
+		if (result > 0)
+			unsubmitted -= (unsigned)result;
+		else if (result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			break;
+	}
+	pending -= (uint32_t)count;
+	return count;
+}
+#endif
@@ -0,0 +1,145 @@
+#pragma once
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#if !defined(IO_URING_ENABLED)
+#if defined(LINUX)
+#define IO_URING_ENABLED 1
+#else
+#define IO_URING_ENABLED 0
+#endif
+#endif
+
+class ThreadPool;
+
+// A file as the platform reads it: a descriptor, or a HANDLE on Windows.
+#ifdef _WIN32
+typedef void *IoFile;
+#else
+typedef int IoFile;
+#endif
+
+// Reads size bytes at offset, retrying short reads; false on an error or end
+// of file. Safe to call from any number of threads on one file.
+bool ReadFileAt(IoFile file, uint64_t offset, void *destination, size_t size);
+
+enum IoBackend
+{
+	IO_BACKEND_URING,	// io_uring, Linux only
+	IO_BACKEND_THREADS,	// blocking positional reads on worker threads
+};
+
+const char *GetIoBackendName(IoBackend backend);
+bool ParseIoBackend(const std::string &name, IoBackend &backend);
+
+struct IoCompletion
+{
+	uint64_t userData;
+	int64_t result;	// bytes read, possibly short at end of file, or -errno
+};
+
+// Asynchronous reads with a bounded number in flight. Reads are only queued
+// until Submit(), which hands the whole batch over at once: one
+// io_uring_enter for any number of reads, where blocking reads would cost a
+// system call and a thread each.
+//
+// With io_uring the queue can own page-aligned buffers registered with the
+// kernel, so ReadFixed() skips pinning and mapping the pages on every read.
+// If registration is refused (RLIMIT_MEMLOCK) the buffers are still there and
+// ReadFixed() falls back to ordinary reads. When io_uring is missing or
+// disabled, Init() falls back to the thread backend.
+//
+// Owned by one thread: queueing, submitting and reaping are not synchronized.
+class IoQueue
+{
+public:
+	IoQueue();
+	~IoQueue();
+
+	IoQueue(const IoQueue &) = delete;
+	IoQueue &operator=(const IoQueue &) = delete;
+
+	// depth is the most reads queued or in flight at once, and the number of
+	// worker threads for the thread backend. bufferCount buffers of
+	// bufferSize bytes are allocated for ReadFixed().
+	bool Init(IoBackend backend, uint32_t depth, uint32_t bufferCount = 0, size_t bufferSize = 0);
+	void Shutdown();
+
+	IoBackend GetBackend() const { return backend; }
+	uint32_t GetDepth() const { return depth; }
+	bool HasRegisteredBuffers() const { return buffersRegistered; }
+
+	uint8_t *GetBuffer(uint32_t index) const { return buffers + index * bufferSize; }
+	uint32_t GetBufferCount() const { return bufferCount; }
+	size_t GetBufferSize() const { return bufferSize; }
+
+	// False when depth reads are already queued or in flight.
+	bool Read(IoFile file, uint64_t offset, uint32_t size, void *destination, uint64_t userData);
+	bool ReadFixed(IoFile file, uint64_t offset, uint32_t size, uint32_t bufferIndex, uint64_t userData);
+
+	// Starts everything queued since the last call; returns how many.
+	uint32_t Submit();
+
+	// Fills completions with up to maxCompletions finished reads, blocking
+	// until at least minCompletions (capped to what is in flight) are there.
+	size_t Reap(IoCompletion *completions, size_t maxCompletions, size_t minCompletions);
+
+	// Queued plus submitted reads not yet reaped.
+	uint32_t GetPending() const { return pending; }
+
+private:
+	struct Request
+	{
+		IoFile file;
+		uint64_t offset;
+		uint32_t size;
+		void *destination;
+		uint64_t userData;
+	};
+
+	bool Queue(const Request &request, int32_t bufferIndex);
+
+#if IO_URING_ENABLED
+	bool InitRing();
+	void ShutdownRing();
+	size_t ReapRing(IoCompletion *completions, size_t maxCompletions, size_t minCompletions);
+
+	int ringFd;
+	void *sqRing;
+	size_t sqRingSize;
+	void *cqRing;
+	size_t cqRingSize;
+	struct io_uring_sqe *sqes;
+	size_t sqesSize;
+	unsigned *sqHead;
+	unsigned *sqTail;
+	unsigned *sqMask;
+	unsigned *sqArray;
+	unsigned *cqHead;
+	unsigned *cqTail;
+	unsigned *cqMask;
+	struct io_uring_cqe *cqes;
+	unsigned unsubmitted;
+#endif
+
+	IoBackend backend;
+	uint32_t depth;
+	uint32_t pending;
+
+	uint8_t *buffers;
+	uint32_t bufferCount;
+	size_t bufferSize;
+	bool buffersRegistered;
+
+	// Thread backend.
+	std::unique_ptr<ThreadPool> pool;
+	std::vector<Request> queued;
+	std::mutex mutex;
+	std::condition_variable completed;
+	std::vector<IoCompletion> completions;
+};
@@ -0,0 +1,235 @@
+#include "framecapture.h"
+#include <iomanip>
+#include <sstream>
+#include "common.h"
+#include "frameloop.h"
+#include "log.h"
+#include "profiler.h"
+#include "timer.h"
+#include "yuvconvert.h"
+
+static const uint32_t BYTES_PER_PIXEL = 4;
+
+FrameCapture::FrameCapture(Common &common, FrameLoop &frameLoop, const std::string &pathPrefix, ImageFormat format,
+	uint32_t writerThreads)
+	: common(common), frameLoop(frameLoop), pathPrefix(pathPrefix), format(format), width(0), height(0),
+	writers(new ThreadPool(writerThreads)), framesCaptured(0), stallCount(0), stallMs(0.0), firstCaptureNs(0),
+	framesWritten(0), bytesWritten(0), encodeNs(0), writeNs(0), writeFailures(0), lastWriteEndNs(0)
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+	frameLoop.WaitIdle();
+	Flush();
+	for (BufferAllocation &buffer : buffers)
+		DestroyBuffer(common.device, buffer);
+}
+
+bool FrameCapture::Init(uint32_t width, uint32_t height, uint32_t bufferCount)
+{
+	this->width = width;
+	this->height = height;
+	if (bufferCount < frameLoop.GetFramesInFlight() + 1)
+		bufferCount = frameLoop.GetFramesInFlight() + 1;
+
+	// Cached memory makes the writers' reads fast; without it every read
+	// goes uncached over the bus.
+	VkDeviceSize size = (VkDeviceSize)width * height * BYTES_PER_PIXEL;
+	buffers.resize(bufferCount);
+	for (uint32_t i = 0; i < bufferCount; i++)
+	{
+		if (!CreateBuffer(common.device, common.physicalDevice, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT, MEMTAG_CAPTURE, buffers[i]))
+		{
+			LOG_ERROR(LOG_CATEGORY_CAPTURE, "Could not create readback buffer %u", i);
+			return false;
+		}
+		freeBuffers.push_back(i);
+	}
+	return true;
+}
+
+bool FrameCapture::OpenStream(const std::string &path, VideoStreamFormat streamFormat, uint32_t frameRate)
+{
+	// Y4M 4:2:0 has no way to express odd sizes to most readers.
+	if (width % 2 || height % 2)
+	{
+		LOG_ERROR(LOG_CATEGORY_CAPTURE, "Video streaming needs an even resolution, got %ux%u", width, height);
+		return false;
+	}
+	stream.reset(new VideoStream());
+	if (!stream->Open(path, streamFormat, width, height, frameRate))
+	{
+		stream.reset();
+		return false;
+	}
+	return true;
+}
+
+uint32_t FrameCapture::AcquireBuffer()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (freeBuffers.empty())
+	{
+		PROFILE_SCOPE("FrameCapture::Stall");
+		uint64_t start = NowNs();
+		bufferFreed.wait(lock, [this] { return !freeBuffers.empty(); });
+		stallMs += ElapsedMs(start, NowNs());
+		stallCount++;
+	}
+	uint32_t buffer = freeBuffers.back();
+	freeBuffers.pop_back();
+	return buffer;
+}
+
+void FrameCapture::ReleaseBuffer(uint32_t buffer)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		freeBuffers.push_back(buffer);
+	}
+	bufferFreed.notify_one();
+}
+
+bool FrameCapture::Capture(VkCommandBuffer cmd, const ImageAllocation &image, uint64_t frameIndex)
+{
+	PROFILE_FUNCTION();
+	if (image.width != width || image.height != height || buffers.empty())
+		return false;
+	uint64_t sequence = framesCaptured++;
+	if (sequence == 0)
+		firstCaptureNs = NowNs();
+
+	uint32_t buffer = AcquireBuffer();
+	VkBufferImageCopy region = {};
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageExtent = { width, height, 1 };
+	vkCmdCopyImageToBuffer(cmd, image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffers[buffer].buffer, 1, &region);
+
+	VkBufferMemoryBarrier2 barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = buffers[buffer].buffer;
+	barrier.size = VK_WHOLE_SIZE;
+	VkDependencyInfo dependency = {};
+	dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency.bufferMemoryBarrierCount = 1;
+	dependency.pBufferMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(cmd, &dependency);
+
+	// Runs once the frame loop has seen this frame's fence signal.
+	frameLoop.DeferRelease([this, buffer, frameIndex, sequence]
+	{
+		if (stream)
+			writers->Submit([this, buffer, sequence] { StreamFrame(buffer, sequence); });
+		else
+			writers->Submit([this, buffer, frameIndex] { WriteFrame(buffer, frameIndex); });
+	});
+	return true;
+}
+
+void FrameCapture::WriteFrame(uint32_t buffer, uint64_t frameIndex)
+{
+	PROFILE_FUNCTION();
+	MEMORY_TAG(MEMTAG_CAPTURE);
+	uint64_t start = NowNs();
+	InvalidateBuffer(common.device, buffers[buffer]);
+
+	// Reused per writer thread so steady-state encoding does not allocate.
+	static thread_local std::vector<uint8_t> encoded;
+	encoded.clear();
+	EncodeImage(format, (const uint8_t *)buffers[buffer].mapped, width, height, encoded);
+	ReleaseBuffer(buffer);
+	uint64_t encodedNs = NowNs();
+
+	std::ostringstream path;
+	path << pathPrefix << "_" << std::setw(6) << std::setfill('0') << frameIndex << "." << GetImageFormatExtension(format);
+	if (WriteFileBytes(path.str(), encoded))
+	{
+		framesWritten.fetch_add(1, std::memory_order_relaxed);
+		bytesWritten.fetch_add(encoded.size(), std::memory_order_relaxed);
+	}
+	else if (writeFailures.fetch_add(1, std::memory_order_relaxed) == 0)
+	{
+		LOG_ERROR(LOG_CATEGORY_CAPTURE, "Could not write %s", path.str());
+	}
+
+	RecordWrite(start, encodedNs, NowNs());
+}
+
+void FrameCapture::StreamFrame(uint32_t buffer, uint64_t sequence)
+{
+	PROFILE_FUNCTION();
+	MEMORY_TAG(MEMTAG_CAPTURE);
+	uint64_t start = NowNs();
+	InvalidateBuffer(common.device, buffers[buffer]);
+
+	static thread_local std::vector<uint8_t> yuv;
+	yuv.resize(GetYuv420Layout(width, height).GetFrameSize());
+	ConvertRgbaToYuv420((const uint8_t *)buffers[buffer].mapped, width, height, yuv.data());
+	ReleaseBuffer(buffer);
+	uint64_t convertedNs = NowNs();
+
+	// Waiting for earlier frames counts as write time.
+	if (stream->WriteFrame(sequence, yuv.data(), yuv.size()))
+	{
+		framesWritten.fetch_add(1, std::memory_order_relaxed);
+		bytesWritten.fetch_add(yuv.size(), std::memory_order_relaxed);
+	}
+	else
+	{
+		writeFailures.fetch_add(1, std::memory_order_relaxed);
+	}
+	RecordWrite(start, convertedNs, NowNs());
+}
+
+void FrameCapture::RecordWrite(uint64_t start, uint64_t encoded, uint64_t end)
+{
+	encodeNs.fetch_add(encoded - start, std::memory_order_relaxed);
+	writeNs.fetch_add(end - encoded, std::memory_order_relaxed);
+	uint64_t previous = lastWriteEndNs.load(std::memory_order_relaxed);
+	while (end > previous && !lastWriteEndNs.compare_exchange_weak(previous, end, std::memory_order_relaxed))
+	{
+	}
+}
+
+void FrameCapture::Flush()
+{
+	writers->WaitIdle();
+}
+
+void FrameCapture::LogSummary() const
+{
+	uint64_t written = framesWritten.load();
+	double totalMs = written ? ElapsedMs(firstCaptureNs, lastWriteEndNs.load()) : 0.0;
+	double megabytes = bytesWritten.load() / (1024.0 * 1024.0);
+	double rawMegabytes = (double)width * height * BYTES_PER_PIXEL * written / (1024.0 * 1024.0);
+
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(2);
+	if (stream)
+		out << "Stream " << stream->GetPath() << " " << width << "x" << height << " " << GetVideoStreamFormatName(stream->GetFormat())
+			<< " (" << GetYuvConvertKernelName() << "): ";
+	else
+		out << "Capture " << width << "x" << height << " " << GetImageFormatExtension(format) << ": ";
+	out << written << " of " << framesCaptured << " frames written";
+	if (writeFailures.load())
+		out << " (" << writeFailures.load() << (stream ? " dropped)" : " failed)");
+	out << ", " << buffers.size() << " readback buffers, " << writers->GetWorkerCount() << " writers" << std::endl;
+	if (totalMs > 0.0)
+	{
+		double encodeMs = (double)encodeNs.load() / 1000000.0;
+		out << "  " << 1000.0 * written / totalMs << (stream ? " frames/s to the reader, " : " frames/s to disk, ") << megabytes * 1000.0 / totalMs << " MB/s written, ratio "
+			<< (megabytes > 0.0 ? rawMegabytes / megabytes : 0.0) << ":1" << std::endl;
+		out << "  per frame per writer: " << (stream ? "convert " : "encode ") << encodeMs / written << " ms (" << rawMegabytes * 1000.0 / encodeMs
+			<< " MB/s), write " << (double)writeNs.load() / 1000000.0 / written << " ms" << std::endl;
+	}
+	out << "  render thread stalled " << stallCount << " times waiting for a buffer (" << stallMs << " ms)" << std::endl;
+	Log::WriteLines(LOG_LEVEL_INFO, LOG_CATEGORY_CAPTURE, out.str());
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "imageencode.h"
+#include "threadpool.h"
+#include "videostream.h"
+#include "vulkanhelpers.h"
+
+class Common;
+class FrameLoop;
+
+// Writes rendered frames to disk as an image sequence, or converts them to YUV
+// and streams them to an external encoder, without stalling the render thread.
+// Each captured frame is copied into one of a ring of host-visible readback
+// buffers. Once the frame's fence has signalled the buffer goes to a pool of
+// writer threads, which encode it and return it to the ring. Streamed frames
+// are converted in parallel but written in capture order. Rendering only
+// blocks when every buffer is still in use, which is counted as a stall.
+class FrameCapture
+{
+public:
+	// Files are named <pathPrefix>_<frame>.<format extension>.
+	FrameCapture(Common &common, FrameLoop &frameLoop, const std::string &pathPrefix, ImageFormat format,
+		uint32_t writerThreads);
+	~FrameCapture();
+
+	// bufferCount is raised to at least frames in flight + 1, the minimum for
+	// a buffer to always come free.
+	bool Init(uint32_t width, uint32_t height, uint32_t bufferCount);
+
+	// Sends frames to a video stream instead of image files. Call after Init.
+	bool OpenStream(const std::string &path, VideoStreamFormat streamFormat, uint32_t frameRate);
+
+	// Records a copy of an image in TRANSFER_SRC_OPTIMAL layout.
+	bool Capture(VkCommandBuffer cmd, const ImageAllocation &image, uint64_t frameIndex);
+
+	// Waits until every submitted frame is on disk. The frame loop must be
+	// idle first so all readbacks have been handed to the writers.
+	void Flush();
+
+	void LogSummary() const;
+
+private:
+	uint32_t AcquireBuffer();
+	void ReleaseBuffer(uint32_t buffer);
+	void WriteFrame(uint32_t buffer, uint64_t frameIndex);
+	void StreamFrame(uint32_t buffer, uint64_t sequence);
+	void RecordWrite(uint64_t start, uint64_t encoded, uint64_t end);
+
+	Common &common;
+	FrameLoop &frameLoop;
+	std::string pathPrefix;
+	ImageFormat format;
+	uint32_t width;
+	uint32_t height;
+	std::vector<BufferAllocation> buffers;
+	std::unique_ptr<ThreadPool> writers;
+	std::unique_ptr<VideoStream> stream;
+
+	std::mutex mutex;
+	std::condition_variable bufferFreed;
+	std::vector<uint32_t> freeBuffers;
+
+	uint64_t framesCaptured;
+	uint64_t stallCount;
+	double stallMs;
+	uint64_t firstCaptureNs;
+	std::atomic<uint64_t> framesWritten;
+	std::atomic<uint64_t> bytesWritten;
+	std::atomic<uint64_t> encodeNs;
+	std::atomic<uint64_t> writeNs;
+	std::atomic<uint64_t> writeFailures;
+	std::atomic<uint64_t> lastWriteEndNs;
+};
@@ -0,0 +1,280 @@
+#include "frameloop.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include "allocators.h"
+#include "common.h"
+#include "log.h"
+#include "profiler.h"
+#include "timer.h"
+#include "vulkanhelpers.h"
+
+static const char *FRAME_ZONE = "Frame";
+static const size_t FRAME_ARENA_CAPACITY = 256 * 1024;
+
+const char *GetFramePacingName(FramePacing pacing)
+{
+	return pacing == FRAME_PACING_LATENCY ? "latency" : "throughput";
+}
+
+FrameLoop::FrameLoop(Common &common, uint32_t framesInFlight, FramePacing pacing)
+	: common(common), pacing(pacing), frameIndex(0), firstBeginNs(0), currentBeginNs(0), lastEndNs(0), lastResolvedFrames(0),
+	lastGpuFrame(UINT64_MAX), lastGpuEndNs(0)
+{
+	if (framesInFlight < 1)
+		framesInFlight = 1;
+	if (framesInFlight > Common::MAX_FRAMES_IN_FLIGHT)
+		framesInFlight = Common::MAX_FRAMES_IN_FLIGHT;
+	slots.resize(framesInFlight);
+}
+
+FrameLoop::~FrameLoop()
+{
+	WaitIdle();
+	for (FrameSlot &slot : slots)
+	{
+		if (slot.fence != VK_NULL_HANDLE)
+			vkDestroyFence(common.device, slot.fence, nullptr);
+		if (slot.commandPool != VK_NULL_HANDLE)
+			vkDestroyCommandPool(common.device, slot.commandPool, nullptr);
+	}
+}
+
+bool FrameLoop::Init()
+{
+	for (FrameSlot &slot : slots)
+	{
+		// A pool per frame so the whole frame's command memory is recycled
+		// with one reset instead of per command buffer.
+		VkCommandPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = common.queueFamilyIndex;
+		if (vkCreateCommandPool(common.device, &poolInfo, nullptr, &slot.commandPool) != VK_SUCCESS)
+			return false;
+
+		VkCommandBufferAllocateInfo allocateInfo = {};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocateInfo.commandPool = slot.commandPool;
+		allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocateInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(common.device, &allocateInfo, &slot.cmd) != VK_SUCCESS)
+			return false;
+
+		VkFenceCreateInfo fenceInfo = {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		if (vkCreateFence(common.device, &fenceInfo, nullptr, &slot.fence) != VK_SUCCESS)
+			return false;
+
+		slot.arena.reset(new LinearArena(FRAME_ARENA_CAPACITY, MEMTAG_RENDERER));
+	}
+	return true;
+}
+
+double FrameLoop::WaitForSlot(FrameSlot &slot)
+{
+	double waitMs = 0.0;
+	if (slot.submitted)
+	{
+		uint64_t start = NowNs();
+		VkResult result = vkWaitForFences(common.device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+		waitMs = ElapsedMs(start, NowNs());
+		if (result != VK_SUCCESS)
+			LOG_ERROR(LOG_CATEGORY_FRAME, "vkWaitForFences failed: %s", VkResultToString(result));
+		slot.submitted = false;
+	}
+
+	for (std::function<void()> &release : slot.releases)
+		release();
+	slot.releases.clear();
+	return waitMs;
+}
+
+bool FrameLoop::BeginFrame(FrameContext &frame)
+{
+	PROFILE_FUNCTION();
+	uint64_t beginNs = NowNs();
+	if (frameIndex == 0)
+		firstBeginNs = beginNs;
+
+	FrameStats frameStats = {};
+	frameStats.frameIndex = frameIndex;
+	frameStats.gpuMs = -1.0;
+	frameStats.gpuIdleMs = -1.0;
+
+	uint32_t slotIndex = (uint32_t)(frameIndex % slots.size());
+	FrameSlot &slot = slots[slotIndex];
+	if (frameIndex > 0)
+	{
+		// If the newest submission is already done the GPU is sitting idle
+		// right now, waiting for this frame.
+		FrameSlot &previous = slots[(frameIndex - 1) % slots.size()];
+		frameStats.gpuStarved = !previous.submitted || vkGetFenceStatus(common.device, previous.fence) == VK_SUCCESS;
+		if (pacing == FRAME_PACING_LATENCY)
+			frameStats.waitMs += WaitForSlot(previous);
+	}
+	frameStats.waitMs += WaitForSlot(slot);
+	slot.arena->Reset();
+
+	vkResetCommandPool(common.device, slot.commandPool, 0);
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	if (vkBeginCommandBuffer(slot.cmd, &beginInfo) != VK_SUCCESS)
+		return false;
+
+	if (common.gpuProfiler)
+	{
+		common.gpuProfiler->BeginFrame(slot.cmd);
+		ResolveGpuTimes();
+		slot.gpuZone = common.gpuProfiler->BeginZone(slot.cmd, FRAME_ZONE);
+	}
+
+	stats.push_back(frameStats);
+	frame.frameIndex = frameIndex;
+	frame.slot = slotIndex;
+	frame.cmd = slot.cmd;
+	frame.arena = slot.arena.get();
+	currentBeginNs = beginNs;
+	return true;
+}
+
+bool FrameLoop::EndFrame(FrameContext &frame)
+{
+	PROFILE_FUNCTION();
+	FrameSlot &slot = slots[frame.slot];
+	if (common.gpuProfiler)
+		common.gpuProfiler->EndZone(slot.cmd, slot.gpuZone);
+	if (vkEndCommandBuffer(slot.cmd) != VK_SUCCESS)
+		return false;
+
+	vkResetFences(common.device, 1, &slot.fence);
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &slot.cmd;
+	VkResult result = vkQueueSubmit(common.queue, 1, &submitInfo, slot.fence);
+	if (result != VK_SUCCESS)
+	{
+		LOG_ERROR(LOG_CATEGORY_FRAME, "vkQueueSubmit failed: %s", VkResultToString(result));
+		return false;
+	}
+	slot.submitted = true;
+
+	lastEndNs = NowNs();
+	stats.back().cpuMs = ElapsedMs(currentBeginNs, lastEndNs);
+	frameIndex++;
+	return true;
+}
+
+void FrameLoop::DeferRelease(std::function<void()> release)
+{
+	slots[frameIndex % slots.size()].releases.push_back(std::move(release));
+}
+
+void FrameLoop::WaitIdle()
+{
+	// Oldest frame first, so releases run in the order they would have
+	// between frames; capture relies on it to hand frames to its writers
+	// in sequence.
+	for (size_t i = 0; i < slots.size(); i++)
+		WaitForSlot(slots[(frameIndex + i) % slots.size()]);
+}
+
+void FrameLoop::ResolveGpuTimes()
+{
+	GpuProfiler &profiler = *common.gpuProfiler;
+	if (!profiler.IsSupported() || profiler.GetResolvedFrames() == lastResolvedFrames)
+		return;
+	lastResolvedFrames = profiler.GetResolvedFrames();
+
+	// The profiler just read back the slice it is about to reuse, written
+	// MAX_FRAMES_IN_FLIGHT frames ago.
+	if (frameIndex < Common::MAX_FRAMES_IN_FLIGHT)
+		return;
+	uint64_t resolvedFrame = frameIndex - Common::MAX_FRAMES_IN_FLIGHT;
+	for (const GpuZoneResult &zone : profiler.GetLastResults())
+	{
+		if (zone.depth != 0 || zone.name != FRAME_ZONE)
+			continue;
+
+		FrameStats &frameStats = stats[resolvedFrame];
+		frameStats.gpuMs = zone.GetMs();
+		if (lastGpuFrame + 1 == resolvedFrame)
+			frameStats.gpuIdleMs = zone.startNs > lastGpuEndNs ? (double)(zone.startNs - lastGpuEndNs) / 1000000.0 : 0.0;
+		lastGpuFrame = resolvedFrame;
+		lastGpuEndNs = zone.endNs;
+		break;
+	}
+}
+
+void FrameLoop::LogSummary(bool perFrame) const
+{
+	if (stats.empty())
+		return;
+
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(3);
+	if (perFrame)
+	{
+		out << "  frame      cpu ms    wait ms     gpu ms    idle ms" << std::endl;
+		for (const FrameStats &frame : stats)
+		{
+			out << "  " << std::setw(5) << frame.frameIndex << std::setw(11) << frame.cpuMs << std::setw(11) << frame.waitMs;
+			if (frame.gpuMs >= 0.0)
+				out << std::setw(11) << frame.gpuMs;
+			else
+				out << std::setw(11) << "-";
+			if (frame.gpuIdleMs >= 0.0)
+				out << std::setw(11) << frame.gpuIdleMs;
+			else
+				out << std::setw(11) << (frame.gpuStarved ? "starved" : "-");
+			out << std::endl;
+		}
+	}
+
+	double cpuMs = 0.0, waitMs = 0.0, gpuMs = 0.0, idleMs = 0.0;
+	uint32_t gpuFrames = 0, idleFrames = 0, starvedFrames = 0;
+	for (const FrameStats &frame : stats)
+	{
+		cpuMs += frame.cpuMs;
+		waitMs += frame.waitMs;
+		starvedFrames += frame.gpuStarved ? 1 : 0;
+		if (frame.gpuMs >= 0.0)
+		{
+			gpuMs += frame.gpuMs;
+			gpuFrames++;
+		}
+		if (frame.gpuIdleMs >= 0.0)
+		{
+			idleMs += frame.gpuIdleMs;
+			idleFrames++;
+		}
+	}
+
+	double count = (double)stats.size();
+	double totalMs = ElapsedMs(firstBeginNs, lastEndNs);
+	out << "Frame loop (" << GetFramePacingName(pacing) << ", " << slots.size() << " in flight): " << stats.size()
+		<< " frames in " << totalMs << " ms, " << std::setprecision(1) << (totalMs > 0.0 ? 1000.0 * count / totalMs : 0.0)
+		<< " fps" << std::setprecision(3) << std::endl;
+	out << "  cpu " << cpuMs / count << " ms/frame, fence wait " << waitMs / count << " ms/frame" << std::endl;
+	if (gpuFrames)
+		out << "  gpu " << gpuMs / gpuFrames << " ms/frame";
+	else
+		out << "  gpu timestamps unavailable";
+	if (idleFrames)
+		out << ", idle between frames " << idleMs / idleFrames << " ms (" << std::setprecision(1)
+			<< 100.0 * idleMs / (idleMs + gpuMs) << "% of gpu time)" << std::setprecision(3);
+	out << ", queue drained before " << starvedFrames << " of " << stats.size() << " frames" << std::endl;
+
+	size_t arenaPeak = 0, arenaCapacity = 0;
+	for (const FrameSlot &slot : slots)
+	{
+		if (!slot.arena)
+			continue;
+		arenaPeak = std::max(arenaPeak, slot.arena->GetPeak());
+		arenaCapacity = std::max(arenaCapacity, slot.arena->GetCapacity());
+	}
+	out << "  frame arena peak " << arenaPeak / 1024.0 << " KB of " << arenaCapacity / 1024 << " KB" << std::endl;
+	Log::WriteLines(LOG_LEVEL_INFO, LOG_CATEGORY_FRAME, out.str());
+}
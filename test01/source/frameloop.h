@@ -0,0 +1,108 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+class Common;
+class LinearArena;
+
+enum FramePacing
+{
+	// One frame in flight: the CPU records while the GPU idles, but input is
+	// at most one frame old when the GPU starts.
+	FRAME_PACING_LATENCY,
+
+	// Up to framesInFlight frames queued so the GPU always has work, at the
+	// cost of that many frames of latency. For batch rendering.
+	FRAME_PACING_THROUGHPUT,
+};
+
+const char *GetFramePacingName(FramePacing pacing);
+
+struct FrameContext
+{
+	uint64_t frameIndex;
+	uint32_t slot;
+	VkCommandBuffer cmd;
+
+	// Transient CPU memory for this frame, reset when the slot comes round
+	// again. Render thread only.
+	LinearArena *arena;
+};
+
+struct FrameStats
+{
+	uint64_t frameIndex;
+	double cpuMs;
+	double waitMs;
+
+	// From GPU timestamps, filled in a few frames later; negative until then
+	// or when timestamps are unsupported.
+	double gpuMs;
+	double gpuIdleMs;
+
+	// The queue had already drained when the CPU came back for this frame.
+	bool gpuStarved;
+};
+
+// Drives submission with a ring of per-frame resource sets (command pool,
+// command buffer, fence, deferred releases, frame arena). BeginFrame blocks on the fence of
+// the set it is about to reuse, which throttles the CPU to the GPU.
+class FrameLoop
+{
+public:
+	FrameLoop(Common &common, uint32_t framesInFlight, FramePacing pacing);
+	~FrameLoop();
+
+	bool Init();
+
+	void SetPacing(FramePacing pacing) { this->pacing = pacing; }
+	FramePacing GetPacing() const { return pacing; }
+	uint32_t GetFramesInFlight() const { return (uint32_t)slots.size(); }
+
+	// Waits for the frame's resources, runs their deferred releases and starts
+	// recording. The command buffer is wrapped in a "Frame" GPU zone.
+	bool BeginFrame(FrameContext &frame);
+	bool EndFrame(FrameContext &frame);
+
+	// Runs after the GPU has finished the frame currently being recorded.
+	void DeferRelease(std::function<void()> release);
+
+	// Fence of the most recently submitted frame that used this slot.
+	VkFence GetFence(uint32_t slot) const { return slots[slot].fence; }
+
+	// Waits for every frame in flight, oldest first, running its releases.
+	void WaitIdle();
+
+	const std::vector<FrameStats> &GetFrameStats() const { return stats; }
+	void LogSummary(bool perFrame) const;
+
+private:
+	struct FrameSlot
+	{
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkCommandBuffer cmd = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		bool submitted = false;
+		uint32_t gpuZone = 0;
+		std::vector<std::function<void()>> releases;
+		std::unique_ptr<LinearArena> arena;
+	};
+
+	double WaitForSlot(FrameSlot &slot);
+	void ResolveGpuTimes();
+
+	Common &common;
+	FramePacing pacing;
+	std::vector<FrameSlot> slots;
+	uint64_t frameIndex;
+	uint64_t firstBeginNs;
+	uint64_t currentBeginNs;
+	uint64_t lastEndNs;
+	uint64_t lastResolvedFrames;
+	uint64_t lastGpuFrame;
+	uint64_t lastGpuEndNs;
+	std::vector<FrameStats> stats;
+};
@@ -0,0 +1,231 @@
+#include "gpuprofiler.h"
+#include "log.h"
+#include "timer.h"
+#include "vulkanhelpers.h"
+
+GpuProfiler::GpuProfiler(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex,
+	uint32_t framesInFlight, uint32_t maxZonesPerFrame)
+	: device(device), physicalDevice(physicalDevice), queryPool(VK_NULL_HANDLE), timestampPeriod(1.0), timestampMask(~0ull),
+	framesInFlight(framesInFlight), queriesPerFrame(maxZonesPerFrame * 2), slots(framesInFlight),
+	currentSlot(0), currentDepth(0), frameIndex(0), anchorTicks(0), anchorNs(0), track(nullptr),
+	resolvedFrames(0), lateFrames(0)
+{
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(physicalDevice, &props);
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+	uint32_t validBits = queueFamilyIndex < familyCount ? families[queueFamilyIndex].timestampValidBits : 0;
+	if (validBits == 0 || props.limits.timestampPeriod <= 0.0f)
+	{
+		LOG_WARNING(LOG_CATEGORY_PROFILER, "GPU timestamps not supported on this queue, GPU profiling disabled");
+		return;
+	}
+	timestampPeriod = props.limits.timestampPeriod;
+	timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	VkQueryPoolCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	info.queryCount = queriesPerFrame * framesInFlight;
+	VkResult result = vkCreateQueryPool(device, &info, nullptr, &queryPool);
+	if (result != VK_SUCCESS)
+	{
+		LOG_ERROR(LOG_CATEGORY_PROFILER, "vkCreateQueryPool failed: %s", VkResultToString(result));
+		queryPool = VK_NULL_HANDLE;
+		return;
+	}
+
+	track = Profiler::CreateTrack("GPU queue");
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	if (queryPool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(device, queryPool, nullptr);
+}
+
+void GpuProfiler::Calibrate(VkQueue queue, VkCommandPool commandPool, bool calibratedTimestamps)
+{
+	if (!IsSupported())
+		return;
+	if (calibratedTimestamps && CalibrateWithExtension())
+		return;
+	CalibrateWithSubmit(queue, commandPool);
+}
+
+bool GpuProfiler::CalibrateWithExtension()
+{
+#ifdef LINUX
+	// steady_clock is CLOCK_MONOTONIC on Linux, so that domain maps directly
+	// onto the CPU profiler's timeline.
+	PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps =
+		(PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(device, "vkGetCalibratedTimestampsEXT");
+	if (!getCalibratedTimestamps)
+		return false;
+
+	VkCalibratedTimestampInfoEXT infos[2] = {};
+	infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+	infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+	infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+	infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+	uint64_t timestamps[2] = {};
+	uint64_t maxDeviation = 0;
+	if (getCalibratedTimestamps(device, 2, infos, timestamps, &maxDeviation) != VK_SUCCESS)
+		return false;
+
+	anchorTicks = timestamps[0] & timestampMask;
+	anchorNs = timestamps[1];
+	return true;
+#else
+	return false;
+#endif
+}
+
+void GpuProfiler::CalibrateWithSubmit(VkQueue queue, VkCommandPool commandPool)
+{
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+	VkCommandBuffer cmd = VK_NULL_HANDLE;
+	if (vkAllocateCommandBuffers(device, &allocInfo, &cmd) != VK_SUCCESS)
+		return;
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(cmd, &beginInfo);
+	vkCmdResetQueryPool(cmd, queryPool, 0, 1);
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, queryPool, 0);
+	vkEndCommandBuffer(cmd);
+
+	VkSubmitInfo submit = {};
+	submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit.commandBufferCount = 1;
+	submit.pCommandBuffers = &cmd;
+
+	// The timestamp lands somewhere between submission and the queue going
+	// idle; the midpoint bounds the error by half the round trip.
+	uint64_t before = NowNs();
+	vkQueueSubmit(queue, 1, &submit, VK_NULL_HANDLE);
+	vkQueueWaitIdle(queue);
+	uint64_t after = NowNs();
+
+	uint64_t ticks = 0;
+	if (vkGetQueryPoolResults(device, queryPool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks),
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) == VK_SUCCESS)
+	{
+		anchorTicks = ticks & timestampMask;
+		anchorNs = before + (after - before) / 2;
+	}
+	vkFreeCommandBuffers(device, commandPool, 1, &cmd);
+}
+
+uint64_t GpuProfiler::ToCpuNs(uint64_t ticks) const
+{
+	// Only the low timestampValidBits count. Measuring forward from the anchor
+	// modulo that width keeps the result monotonic across a counter wrap.
+	uint64_t delta = ((ticks & timestampMask) - anchorTicks) & timestampMask;
+	return anchorNs + (uint64_t)((double)delta * timestampPeriod);
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer cmd)
+{
+	if (!IsSupported())
+		return;
+
+	currentSlot = (uint32_t)(frameIndex % framesInFlight);
+	frameIndex++;
+
+	// This slice was last written framesInFlight frames ago; its fence has been
+	// waited on by now, so the results are normally ready without stalling.
+	if (slots[currentSlot].recorded)
+		Resolve(currentSlot);
+
+	FrameSlot &slot = slots[currentSlot];
+	slot.zones.clear();
+	slot.queryCount = 0;
+	slot.recorded = true;
+	currentDepth = 0;
+	vkCmdResetQueryPool(cmd, queryPool, currentSlot * queriesPerFrame, queriesPerFrame);
+}
+
+uint32_t GpuProfiler::BeginZone(VkCommandBuffer cmd, const char *name)
+{
+	if (!IsSupported())
+		return 0;
+
+	FrameSlot &slot = slots[currentSlot];
+	if (slot.queryCount + 2 > queriesPerFrame)
+		return UINT32_MAX;
+
+	Zone zone;
+	zone.name = name;
+	zone.depth = currentDepth++;
+	zone.beginQuery = currentSlot * queriesPerFrame + slot.queryCount++;
+	zone.endQuery = currentSlot * queriesPerFrame + slot.queryCount++;
+	slot.zones.push_back(zone);
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, queryPool, zone.beginQuery);
+	return (uint32_t)slot.zones.size() - 1;
+}
+
+void GpuProfiler::EndZone(VkCommandBuffer cmd, uint32_t zoneIndex)
+{
+	if (!IsSupported() || zoneIndex == UINT32_MAX)
+		return;
+
+	const Zone &zone = slots[currentSlot].zones[zoneIndex];
+	currentDepth--;
+	vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, queryPool, zone.endQuery);
+}
+
+void GpuProfiler::Resolve(uint32_t slotIndex)
+{
+	FrameSlot &slot = slots[slotIndex];
+	if (slot.queryCount == 0)
+		return;
+
+	// Value/availability pairs; never waits.
+	std::vector<uint64_t> data(slot.queryCount * 2);
+	vkGetQueryPoolResults(device, queryPool, slotIndex * queriesPerFrame, slot.queryCount,
+		data.size() * sizeof(uint64_t), data.data(), 2 * sizeof(uint64_t),
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	std::vector<GpuZoneResult> results;
+	for (const Zone &zone : slot.zones)
+	{
+		uint32_t begin = zone.beginQuery - slotIndex * queriesPerFrame;
+		uint32_t end = zone.endQuery - slotIndex * queriesPerFrame;
+		if (!data[begin * 2 + 1] || !data[end * 2 + 1])
+		{
+			lateFrames++;
+			return;
+		}
+
+		GpuZoneResult result;
+		result.name = zone.name;
+		result.depth = zone.depth;
+		result.startNs = ToCpuNs(data[begin * 2]);
+		result.endNs = ToCpuNs(data[end * 2]);
+		results.push_back(result);
+	}
+
+	// Follow the counter so that a narrow one can wrap any number of times,
+	// as long as frames resolve more often than it wraps.
+	if (!slot.zones.empty())
+	{
+		uint32_t first = slot.zones.front().beginQuery - slotIndex * queriesPerFrame;
+		anchorNs = ToCpuNs(data[first * 2]);
+		anchorTicks = data[first * 2] & timestampMask;
+	}
+
+	for (const GpuZoneResult &result : results)
+		Profiler::Record(track, result.name, result.startNs, result.endNs, result.depth);
+	lastResults.swap(results);
+	resolvedFrames++;
+}
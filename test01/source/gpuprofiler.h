@@ -0,0 +1,111 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "profiler.h"
+
+struct GpuZoneResult
+{
+	const char *name;
+	uint32_t depth;
+	uint64_t startNs;
+	uint64_t endNs;
+
+	double GetMs() const { return (double)(endNs - startNs) / 1000000.0; }
+};
+
+// Timestamp queries around GPU work, read back without stalling. Every frame in
+// flight owns a slice of one query pool; a slice is read back just before it is
+// reused, framesInFlight frames later, when its results are normally already
+// available. Resolved zones are converted to steady_clock nanoseconds and fed to
+// the CPU profiler on a "GPU" track, so both appear on one timeline.
+class GpuProfiler
+{
+public:
+	GpuProfiler(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex,
+		uint32_t framesInFlight = 3, uint32_t maxZonesPerFrame = 128);
+	~GpuProfiler();
+
+	bool IsSupported() const { return queryPool != VK_NULL_HANDLE; }
+
+	// Establishes the GPU to CPU clock offset. Uses VK_EXT_calibrated_timestamps
+	// when the device enabled it, otherwise a one-off timestamp submission.
+	void Calibrate(VkQueue queue, VkCommandPool commandPool, bool calibratedTimestamps);
+
+	// Must be recorded outside any render pass, before the frame's zones.
+	void BeginFrame(VkCommandBuffer cmd);
+
+	uint32_t BeginZone(VkCommandBuffer cmd, const char *name);
+	void EndZone(VkCommandBuffer cmd, uint32_t zone);
+
+	const std::vector<GpuZoneResult> &GetLastResults() const { return lastResults; }
+	uint64_t GetResolvedFrames() const { return resolvedFrames; }
+	uint64_t GetLateFrames() const { return lateFrames; }
+
+private:
+	struct Zone
+	{
+		const char *name;
+		uint32_t depth;
+		uint32_t beginQuery;
+		uint32_t endQuery;
+	};
+
+	struct FrameSlot
+	{
+		std::vector<Zone> zones;
+		uint32_t queryCount = 0;
+		bool recorded = false;
+	};
+
+	void Resolve(uint32_t slotIndex);
+	uint64_t ToCpuNs(uint64_t ticks) const;
+	bool CalibrateWithExtension();
+	void CalibrateWithSubmit(VkQueue queue, VkCommandPool commandPool);
+
+	VkDevice device;
+	VkPhysicalDevice physicalDevice;
+	VkQueryPool queryPool;
+	double timestampPeriod;
+	uint64_t timestampMask;
+	uint32_t framesInFlight;
+	uint32_t queriesPerFrame;
+	std::vector<FrameSlot> slots;
+	uint32_t currentSlot;
+	uint32_t currentDepth;
+	uint64_t frameIndex;
+
+	// A GPU timestamp and the steady_clock time it maps to; moved forward as
+	// frames resolve.
+	uint64_t anchorTicks;
+	uint64_t anchorNs;
+	ProfileThreadBuffer *track;
+
+	std::vector<GpuZoneResult> lastResults;
+	uint64_t resolvedFrames;
+	uint64_t lateFrames;
+};
+
+// Wraps a render pass or dispatch sequence in a GPU zone for its lifetime.
+class GpuZone
+{
+public:
+	GpuZone(GpuProfiler *profiler, VkCommandBuffer cmd, const char *name)
+		: profiler(profiler), cmd(cmd), zone(profiler ? profiler->BeginZone(cmd, name) : 0)
+	{
+	}
+
+	~GpuZone()
+	{
+		if (profiler)
+			profiler->EndZone(cmd, zone);
+	}
+
+private:
+	GpuProfiler *profiler;
+	VkCommandBuffer cmd;
+	uint32_t zone;
+};
+
+#define GPU_PROFILE_ZONE(profiler, cmd, name) GpuZone PROFILE_CONCAT(gpuZone, __LINE__)(profiler, cmd, name)
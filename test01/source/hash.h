@@ -0,0 +1,23 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit FNV-1a. Fast enough for keys and SPIR-V blobs, and stable across runs
+// so hashes can be logged and compared between executions.
+inline uint64_t HashBytes(const void *data, size_t size, uint64_t seed = 14695981039346656037ull)
+{
+	const uint8_t *bytes = (const uint8_t *)data;
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+inline uint64_t HashCombine(uint64_t hash, uint64_t value)
+{
+	hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+	return hash;
+}
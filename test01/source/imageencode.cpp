@@ -0,0 +1,513 @@
+#include "imageencode.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "allocators.h"
+#include "deflate.h"
+#include "threadpool.h"
+
+const char *GetImageFormatExtension(ImageFormat format)
+{
+	switch (format)
+	{
+	case IMAGE_FORMAT_PNG: return "png";
+	case IMAGE_FORMAT_QOI: return "qoi";
+	case IMAGE_FORMAT_EXR: return "exr";
+	default: return "ppm";
+	}
+}
+
+bool ParseImageFormat(const std::string &name, ImageFormat &format)
+{
+	static const ImageFormat formats[] = { IMAGE_FORMAT_PPM, IMAGE_FORMAT_PNG, IMAGE_FORMAT_QOI, IMAGE_FORMAT_EXR };
+	for (ImageFormat candidate : formats)
+	{
+		if (name == GetImageFormatExtension(candidate))
+		{
+			format = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void AppendBigEndian32(std::vector<uint8_t> &out, uint32_t value)
+{
+	out.push_back((uint8_t)(value >> 24));
+	out.push_back((uint8_t)(value >> 16));
+	out.push_back((uint8_t)(value >> 8));
+	out.push_back((uint8_t)value);
+}
+
+template <typename T>
+static void AppendLittleEndian(std::vector<uint8_t> &out, T value)
+{
+	uint8_t bytes[sizeof(T)];
+	memcpy(bytes, &value, sizeof(T));
+	out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void EncodePpm(const uint8_t *rgba, uint32_t width, uint32_t height, std::vector<uint8_t> &out)
+{
+	char header[64];
+	int headerSize = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", width, height);
+	size_t start = out.size();
+	out.resize(start + headerSize + (size_t)width * height * 3);
+	memcpy(out.data() + start, header, headerSize);
+
+	uint8_t *rgb = out.data() + start + headerSize;
+	size_t pixelCount = (size_t)width * height;
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		rgb[i * 3 + 0] = rgba[i * 4 + 0];
+		rgb[i * 3 + 1] = rgba[i * 4 + 1];
+		rgb[i * 3 + 2] = rgba[i * 4 + 2];
+	}
+}
+
+static inline uint8_t Paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	return (uint8_t)(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+// Applies the PNG filter per row that minimizes the sum of absolute signed
+// residuals, the usual heuristic. Each output row starts with its filter type.
+static void FilterRows(const uint8_t *rgba, uint32_t width, uint32_t firstRow, uint32_t rowCount, uint8_t *out)
+{
+	const size_t stride = (size_t)width * 4;
+	ScratchScope scratch;
+	uint8_t *candidates[5];
+	for (uint8_t *&candidate : candidates)
+		candidate = scratch.AllocateArray<uint8_t>(stride);
+
+	uint8_t *zeroRow = scratch.AllocateArray<uint8_t>(stride);
+	memset(zeroRow, 0, stride);
+	for (uint32_t row = firstRow; row < firstRow + rowCount; row++)
+	{
+		const uint8_t *current = rgba + row * stride;
+		const uint8_t *above = row > 0 ? current - stride : zeroRow;
+		uint64_t bestScore = UINT64_MAX;
+		int bestFilter = 0;
+		for (int filter = 0; filter < 5; filter++)
+		{
+			// One loop per filter keeps the predictors branch-free; the first
+			// pixel has no left neighbour and is handled separately.
+			uint8_t *residual = candidates[filter];
+			for (size_t i = 0; i < 4; i++)
+			{
+				int b = above[i];
+				int predicted = filter == 2 || filter == 4 ? b : filter == 3 ? b >> 1 : 0;
+				residual[i] = (uint8_t)(current[i] - predicted);
+			}
+			switch (filter)
+			{
+			case 0:
+				memcpy(residual, current, stride);
+				break;
+			case 1:
+				for (size_t i = 4; i < stride; i++)
+					residual[i] = (uint8_t)(current[i] - current[i - 4]);
+				break;
+			case 2:
+				for (size_t i = 4; i < stride; i++)
+					residual[i] = (uint8_t)(current[i] - above[i]);
+				break;
+			case 3:
+				for (size_t i = 4; i < stride; i++)
+					residual[i] = (uint8_t)(current[i] - ((current[i - 4] + above[i]) >> 1));
+				break;
+			default:
+				for (size_t i = 4; i < stride; i++)
+					residual[i] = (uint8_t)(current[i] - Paeth(current[i - 4], above[i], above[i - 4]));
+				break;
+			}
+
+			uint64_t score = 0;
+			for (size_t i = 0; i < stride; i++)
+				score += (uint64_t)abs((int8_t)residual[i]);
+			if (score < bestScore)
+			{
+				bestScore = score;
+				bestFilter = filter;
+			}
+		}
+
+		uint8_t *destination = out + (size_t)(row - firstRow) * (stride + 1);
+		destination[0] = (uint8_t)bestFilter;
+		memcpy(destination + 1, candidates[bestFilter], stride);
+	}
+}
+
+static void AppendPngChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, size_t size)
+{
+	AppendBigEndian32(out, (uint32_t)size);
+	size_t typeStart = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data, data + size);
+	AppendBigEndian32(out, Crc32(out.data() + typeStart, size + 4));
+}
+
+void EncodePng(const uint8_t *rgba, uint32_t width, uint32_t height, std::vector<uint8_t> &out, ThreadPool *pool,
+	uint32_t stripCount, int level)
+{
+	// PNG has no empty images, and the strip split below needs a row.
+	if (width == 0 || height == 0)
+		return;
+	if (stripCount == 0)
+		stripCount = pool ? pool->GetWorkerCount() : 1;
+	stripCount = std::max(1u, std::min(stripCount, height));
+	uint32_t rowsPerStrip = (height + stripCount - 1) / stripCount;
+	stripCount = (height + rowsPerStrip - 1) / rowsPerStrip;
+
+	struct Strip
+	{
+		std::vector<uint8_t> compressed;
+		uint32_t adler;
+		size_t filteredSize;
+	};
+	std::vector<Strip> strips(stripCount);
+	auto compressStrip = [&](uint32_t index)
+	{
+		uint32_t firstRow = index * rowsPerStrip;
+		uint32_t rowCount = std::min(rowsPerStrip, height - firstRow);
+		size_t filteredSize = (size_t)rowCount * (width * 4 + 1);
+		ScratchScope scratch;
+		uint8_t *filtered = scratch.AllocateArray<uint8_t>(filteredSize);
+		FilterRows(rgba, width, firstRow, rowCount, filtered);
+		Strip &strip = strips[index];
+		strip.adler = Adler32(filtered, filteredSize);
+		strip.filteredSize = filteredSize;
+		DeflateRaw(filtered, filteredSize, index == stripCount - 1, level, strip.compressed);
+	};
+
+	if (pool && stripCount > 1)
+	{
+		pool->Run(stripCount, compressStrip);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < stripCount; i++)
+			compressStrip(i);
+	}
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	out.insert(out.end(), signature, signature + 8);
+
+	std::vector<uint8_t> header;
+	AppendBigEndian32(header, width);
+	AppendBigEndian32(header, height);
+	header.push_back(8);	// bit depth
+	header.push_back(6);	// RGBA
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+	AppendPngChunk(out, "IHDR", header.data(), header.size());
+
+	// zlib wrapper around the concatenated strips: CMF/FLG for a 32K window,
+	// then the combined Adler-32 of all filtered data.
+	std::vector<uint8_t> zlib = { 0x78, 0x01 };
+	uint32_t adler = 1;
+	for (const Strip &strip : strips)
+	{
+		zlib.insert(zlib.end(), strip.compressed.begin(), strip.compressed.end());
+		adler = Adler32Combine(adler, strip.adler, strip.filteredSize);
+	}
+	AppendBigEndian32(zlib, adler);
+	AppendPngChunk(out, "IDAT", zlib.data(), zlib.size());
+	AppendPngChunk(out, "IEND", nullptr, 0);
+}
+
+void EncodeQoi(const uint8_t *rgba, uint32_t width, uint32_t height, std::vector<uint8_t> &out)
+{
+	const uint8_t OP_INDEX = 0x00;
+	const uint8_t OP_DIFF = 0x40;
+	const uint8_t OP_LUMA = 0x80;
+	const uint8_t OP_RUN = 0xc0;
+	const uint8_t OP_RGB = 0xfe;
+	const uint8_t OP_RGBA = 0xff;
+
+	size_t pixelCount = (size_t)width * height;
+	size_t start = out.size();
+	// Worst case is five bytes per pixel plus header and end marker.
+	out.resize(start + 14 + pixelCount * 5 + 8);
+	uint8_t *p = out.data() + start;
+
+	memcpy(p, "qoif", 4);
+	p[4] = (uint8_t)(width >> 24);
+	p[5] = (uint8_t)(width >> 16);
+	p[6] = (uint8_t)(width >> 8);
+	p[7] = (uint8_t)width;
+	p[8] = (uint8_t)(height >> 24);
+	p[9] = (uint8_t)(height >> 16);
+	p[10] = (uint8_t)(height >> 8);
+	p[11] = (uint8_t)height;
+	p[12] = 4;	// channels
+	p[13] = 0;	// sRGB with linear alpha
+	p += 14;
+
+	uint32_t index[64] = {};
+	uint32_t previous = 0xff000000u;	// r=0 g=0 b=0 a=255, little endian
+	int run = 0;
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		uint32_t pixel;
+		memcpy(&pixel, rgba + i * 4, 4);
+		if (pixel == previous)
+		{
+			run++;
+			if (run == 62 || i == pixelCount - 1)
+			{
+				*p++ = (uint8_t)(OP_RUN | (run - 1));
+				run = 0;
+			}
+			continue;
+		}
+		if (run > 0)
+		{
+			*p++ = (uint8_t)(OP_RUN | (run - 1));
+			run = 0;
+		}
+
+		uint8_t r = (uint8_t)pixel, g = (uint8_t)(pixel >> 8), b = (uint8_t)(pixel >> 16), a = (uint8_t)(pixel >> 24);
+		int hash = (r * 3 + g * 5 + b * 7 + a * 11) & 63;
+		if (index[hash] == pixel)
+			*p++ = (uint8_t)(OP_INDEX | hash);
+		else
+		{
+			index[hash] = pixel;
+			if (a == (uint8_t)(previous >> 24))
+			{
+				int8_t dr = (int8_t)(r - (uint8_t)previous);
+				int8_t dg = (int8_t)(g - (uint8_t)(previous >> 8));
+				int8_t db = (int8_t)(b - (uint8_t)(previous >> 16));
+				int8_t drdg = (int8_t)(dr - dg);
+				int8_t dbdg = (int8_t)(db - dg);
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+					*p++ = (uint8_t)(OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+				else if (dg >= -32 && dg <= 31 && drdg >= -8 && drdg <= 7 && dbdg >= -8 && dbdg <= 7)
+				{
+					*p++ = (uint8_t)(OP_LUMA | (dg + 32));
+					*p++ = (uint8_t)(((drdg + 8) << 4) | (dbdg + 8));
+				}
+				else
+				{
+					*p++ = OP_RGB;
+					*p++ = r;
+					*p++ = g;
+					*p++ = b;
+				}
+			}
+			else
+			{
+				*p++ = OP_RGBA;
+				*p++ = r;
+				*p++ = g;
+				*p++ = b;
+				*p++ = a;
+			}
+		}
+		previous = pixel;
+	}
+
+	static const uint8_t endMarker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	memcpy(p, endMarker, 8);
+	p += 8;
+	out.resize(p - out.data());
+}
+
+uint16_t FloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if (((bits >> 23) & 0xff) == 0xff)
+		return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	if (exponent >= 31)
+		return (uint16_t)(sign | 0x7c00);
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+			return (uint16_t)sign;
+		// Subnormal: shift in the implicit bit and round to nearest even.
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1)))
+			half++;
+		return (uint16_t)(sign | half);
+	}
+
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1fff;
+	// A carry out of the mantissa correctly bumps the exponent.
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+		half++;
+	return (uint16_t)half;
+}
+
+float HalfToFloat(uint16_t half)
+{
+	uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+	uint32_t bits;
+	if (exponent == 0)
+	{
+		if (mantissa == 0)
+			bits = sign;
+		else
+		{
+			exponent = 127 - 15 + 1;
+			while (!(mantissa & 0x400))
+			{
+				mantissa <<= 1;
+				exponent--;
+			}
+			bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+		}
+	}
+	else if (exponent == 31)
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	else
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+
+	float value;
+	memcpy(&value, &bits, 4);
+	return value;
+}
+
+static void AppendExrAttribute(std::vector<uint8_t> &out, const char *name, const char *type, const void *data, uint32_t size)
+{
+	out.insert(out.end(), name, name + strlen(name) + 1);
+	out.insert(out.end(), type, type + strlen(type) + 1);
+	AppendLittleEndian(out, size);
+	out.insert(out.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+}
+
+void EncodeExr(const uint16_t *halfRgba, uint32_t width, uint32_t height, std::vector<uint8_t> &out)
+{
+	AppendLittleEndian(out, (uint32_t)20000630);	// magic
+	AppendLittleEndian(out, (uint32_t)2);	// version 2, scanline
+
+	// Channels are stored in alphabetical order: A, B, G, R.
+	static const char channelNames[4] = { 'A', 'B', 'G', 'R' };
+	static const int channelSource[4] = { 3, 2, 1, 0 };
+	std::vector<uint8_t> channels;
+	for (char name : channelNames)
+	{
+		channels.push_back((uint8_t)name);
+		channels.push_back(0);
+		AppendLittleEndian(channels, (int32_t)1);	// HALF
+		AppendLittleEndian(channels, (uint32_t)0);	// pLinear + reserved
+		AppendLittleEndian(channels, (int32_t)1);	// xSampling
+		AppendLittleEndian(channels, (int32_t)1);	// ySampling
+	}
+	channels.push_back(0);
+	AppendExrAttribute(out, "channels", "chlist", channels.data(), (uint32_t)channels.size());
+
+	uint8_t compression = 0;
+	AppendExrAttribute(out, "compression", "compression", &compression, 1);
+	int32_t window[4] = { 0, 0, (int32_t)width - 1, (int32_t)height - 1 };
+	AppendExrAttribute(out, "dataWindow", "box2i", window, sizeof(window));
+	AppendExrAttribute(out, "displayWindow", "box2i", window, sizeof(window));
+	uint8_t lineOrder = 0;
+	AppendExrAttribute(out, "lineOrder", "lineOrder", &lineOrder, 1);
+	float aspect = 1.0f;
+	AppendExrAttribute(out, "pixelAspectRatio", "float", &aspect, 4);
+	float center[2] = { 0.0f, 0.0f };
+	AppendExrAttribute(out, "screenWindowCenter", "v2f", center, sizeof(center));
+	float windowWidth = 1.0f;
+	AppendExrAttribute(out, "screenWindowWidth", "float", &windowWidth, 4);
+	out.push_back(0);
+
+	// Offset table, then one block per scanline: y, byte count, channel rows.
+	uint32_t blockSize = width * 4 * sizeof(uint16_t);
+	uint64_t offset = out.size() + (uint64_t)height * 8;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		AppendLittleEndian(out, offset);
+		offset += 8 + blockSize;
+	}
+
+	size_t start = out.size();
+	out.resize(start + (size_t)height * (8 + blockSize));
+	uint8_t *p = out.data() + start;
+	for (uint32_t y = 0; y < height; y++)
+	{
+		int32_t line = (int32_t)y;
+		memcpy(p, &line, 4);
+		memcpy(p + 4, &blockSize, 4);
+		// The header has no alignment, so the halves go through memcpy.
+		uint8_t *row = p + 8;
+		const uint16_t *source = halfRgba + (size_t)y * width * 4;
+		for (int c = 0; c < 4; c++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+				memcpy(row + (c * width + x) * sizeof(uint16_t), &source[x * 4 + channelSource[c]], sizeof(uint16_t));
+		}
+		p += 8 + blockSize;
+	}
+}
+
+void EncodeExrFromSrgb8(const uint8_t *rgba, uint32_t width, uint32_t height, std::vector<uint8_t> &out)
+{
+	static const struct SrgbTable
+	{
+		uint16_t color[256];
+		uint16_t alpha[256];
+
+		SrgbTable()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				float linear = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+				color[i] = FloatToHalf(linear);
+				alpha[i] = FloatToHalf(c);
+			}
+		}
+	} table;
+
+	size_t valueCount = (size_t)width * height * 4;
+	std::vector<uint16_t> half(valueCount);
+	for (size_t i = 0; i < valueCount; i += 4)
+	{
+		half[i + 0] = table.color[rgba[i + 0]];
+		half[i + 1] = table.color[rgba[i + 1]];
+		half[i + 2] = table.color[rgba[i + 2]];
+		half[i + 3] = table.alpha[rgba[i + 3]];
+	}
+	EncodeExr(half.data(), width, height, out);
+}
+
+void EncodeImage(ImageFormat format, const uint8_t *rgba, uint32_t width, uint32_t height, std::vector<uint8_t> &out,
+	ThreadPool *pool)
+{
+	switch (format)
+	{
+	case IMAGE_FORMAT_PNG: EncodePng(rgba, width, height, out, pool); break;
+	case IMAGE_FORMAT_QOI: EncodeQoi(rgba, width, height, out); break;
+	case IMAGE_FORMAT_EXR: EncodeExrFromSrgb8(rgba, width, height, out); break;
+	default: EncodePpm(rgba, width, height, out); break;
+	}
+}
+
+bool WriteFileBytes(const std::string &path, const std::vector<uint8_t> &data)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+	bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+	return fclose(file) == 0 && written;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+enum ImageFormat
+{
+	IMAGE_FORMAT_PPM,
+	IMAGE_FORMAT_PNG,
+	IMAGE_FORMAT_QOI,
+	IMAGE_FORMAT_EXR,
+};
+
+const char *GetImageFormatExtension(ImageFormat format);
+bool ParseImageFormat(const std::string &name, ImageFormat &format);
+
+// All encoders take tightly packed 8-bit RGBA rows and append to out.
+
+void EncodePpm(const uint8_t *rgba, uint32_t width, uint32_t height, std::vector<uint8_t> &out);
+
+// The image is split into horizontal strips that are filtered and deflated
+// independently, then joined into one zlib stream. With a pool the strips are
+// compressed on its workers through ThreadPool::Run; stripCount 0 picks one
+// strip per worker. Splitting costs a little ratio because matches cannot
+// cross strips. An empty image appends nothing.
+void EncodePng(const uint8_t *rgba, uint32_t width, uint32_t height, std::vector<uint8_t> &out,
+	ThreadPool *pool = nullptr, uint32_t stripCount = 0, int level = 3);
+
+// "Quite OK Image" format: one pass, no entropy coding, several times faster
+// than PNG at a somewhat worse ratio.
+void EncodeQoi(const uint8_t *rgba, uint32_t width, uint32_t height, std::vector<uint8_t> &out);
+
+// Uncompressed scanline OpenEXR with half-float RGBA channels. Takes half
+// pixels directly, or 8-bit sRGB that is linearized on the way.
+void EncodeExr(const uint16_t *halfRgba, uint32_t width, uint32_t height, std::vector<uint8_t> &out);
+void EncodeExrFromSrgb8(const uint8_t *rgba, uint32_t width, uint32_t height, std::vector<uint8_t> &out);
+
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t half);
+
+void EncodeImage(ImageFormat format, const uint8_t *rgba, uint32_t width, uint32_t height, std::vector<uint8_t> &out,
+	ThreadPool *pool = nullptr);
+
+bool WriteFileBytes(const std::string &path, const std::vector<uint8_t> &data);
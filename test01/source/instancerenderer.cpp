@@ -0,0 +1,377 @@
+#include "instancerenderer.h"
+#include <iomanip>
+#include <sstream>
+#include <stddef.h>
+#include <string.h>
+#include "allocators.h"
+#include "common.h"
+#include "lightclusterpass.h"
+#include "log.h"
+#include "mesh.h"
+#include "profiler.h"
+#include "timer.h"
+
+static const uint32_t CULL_GROUP_SIZE = 64;
+static const uint32_t COUNTERS_PER_SLOT = 4;
+
+struct InstanceCullPushConstants
+{
+	float planes[6][4];
+	float eyeLodScale[4];	// w: projection scale over the pixel error, 0 for LOD 0 only
+	uint32_t objectCount;
+	uint32_t counterOffset;
+	uint32_t compact;
+};
+
+const char *GetInstanceSubmissionName(InstanceSubmission submission)
+{
+	switch (submission)
+	{
+	case INSTANCE_SUBMISSION_CPU: return "cpu";
+	case INSTANCE_SUBMISSION_GPU: return "gpu";
+	}
+	return "unknown";
+}
+
+InstanceRenderer::InstanceRenderer(Common &common, InstanceSubmission submission, uint32_t objectCount, VertexFormat vertexFormat)
+	: common(common), submission(submission), objectCount(objectCount), vertexFormat(vertexFormat), compactDraws(false), lights(nullptr),
+	objectSetLayout(VK_NULL_HANDLE), graphicsLayout(VK_NULL_HANDLE), graphicsPipeline(VK_NULL_HANDLE),
+	descriptorPool(VK_NULL_HANDLE), objectSet(VK_NULL_HANDLE), visible(nullptr), visibleLods(nullptr), visibleCount(0), currentSlot(0),
+	cullSetLayout(VK_NULL_HANDLE), cullLayout(VK_NULL_HANDLE), cullPipeline(VK_NULL_HANDLE), cullSet(VK_NULL_HANDLE),
+	counterPending(), frames(0), recordedFrames(0), visibleObjects(0), visibleTriangles(0), drawCalls(0), recordNs(0)
+{
+	static_assert(COUNTER_SLOTS == Common::MAX_FRAMES_IN_FLIGHT, "one counter slot per frame in flight");
+}
+
+InstanceRenderer::~InstanceRenderer()
+{
+	if (common.device == VK_NULL_HANDLE)
+		return;
+	// graphicsPipeline belongs to the pipeline state cache.
+	if (cullPipeline != VK_NULL_HANDLE)
+		vkDestroyPipeline(common.device, cullPipeline, nullptr);
+	if (cullLayout != VK_NULL_HANDLE)
+		vkDestroyPipelineLayout(common.device, cullLayout, nullptr);
+	if (cullSetLayout != VK_NULL_HANDLE)
+		vkDestroyDescriptorSetLayout(common.device, cullSetLayout, nullptr);
+	if (graphicsLayout != VK_NULL_HANDLE)
+		vkDestroyPipelineLayout(common.device, graphicsLayout, nullptr);
+	if (objectSetLayout != VK_NULL_HANDLE)
+		vkDestroyDescriptorSetLayout(common.device, objectSetLayout, nullptr);
+	if (descriptorPool != VK_NULL_HANDLE)
+		vkDestroyDescriptorPool(common.device, descriptorPool, nullptr);
+	DestroyBuffer(common.device, counterBuffer);
+	DestroyBuffer(common.device, drawBuffer);
+	DestroyBuffer(common.device, lodBuffer);
+	DestroyBuffer(common.device, meshBuffer);
+	DestroyBuffer(common.device, objectBuffer);
+	DestroyBuffer(common.device, indexBuffer);
+	DestroyBuffer(common.device, vertexBuffer);
+}
+
+bool InstanceRenderer::Init()
+{
+	PROFILE_FUNCTION();
+	if (submission == INSTANCE_SUBMISSION_GPU)
+	{
+		if (!common.enabledFeatures.drawIndirectFirstInstance)
+		{
+			LOG_ERROR(LOG_CATEGORY_VULKAN, "GPU-driven submission needs drawIndirectFirstInstance");
+			return false;
+		}
+		// Without a GPU-side count every object keeps a draw slot, which
+		// still needs a single multi-draw to save CPU work.
+		compactDraws = common.enabledFeatures12.drawIndirectCount != VK_FALSE;
+		if (!compactDraws && !common.enabledFeatures.multiDrawIndirect)
+			LOG_WARNING(LOG_CATEGORY_VULKAN, "No drawIndirectCount or multiDrawIndirect, recording one indirect draw per object");
+	}
+
+	GenerateObjectField(field, objectCount, common.lodPixelError > 0.0f);
+	const void *vertices = vertexFormat == VERTEX_FORMAT_PACKED ? (const void *)field.packedVertices.data()
+		: (const void *)field.geometry.vertices.data();
+	size_t vertexBytes = field.geometry.vertices.size() * GetVertexFormatSize(vertexFormat);
+	const std::vector<uint32_t> &indices = field.geometry.indices;
+
+	VkDevice device = common.device;
+	VkPhysicalDevice physicalDevice = common.physicalDevice;
+	if (!CreateFilledBuffer(device, physicalDevice, vertices, vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MEMTAG_RENDERER, vertexBuffer) ||
+		!CreateFilledBuffer(device, physicalDevice, indices.data(), indices.size() * sizeof(uint32_t),
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT, MEMTAG_RENDERER, indexBuffer) ||
+		!CreateFilledBuffer(device, physicalDevice, field.objects.data(), field.objects.size() * sizeof(FieldObject),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEMTAG_RENDERER, objectBuffer) ||
+		!CreateFilledBuffer(device, physicalDevice, field.meshes.data(), field.meshes.size() * sizeof(FieldMesh),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEMTAG_RENDERER, meshBuffer) ||
+		!CreateFilledBuffer(device, physicalDevice, field.lods.data(), field.lods.size() * sizeof(MeshLod),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEMTAG_RENDERER, lodBuffer))
+		return false;
+
+	VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7 };
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 2;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS || !CreateGraphicsPipeline())
+		return false;
+	if (submission == INSTANCE_SUBMISSION_CPU)
+		return true;
+
+	if (!CreateFilledBuffer(device, physicalDevice, nullptr, (VkDeviceSize)objectCount * sizeof(VkDrawIndexedIndirectCommand),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MEMTAG_RENDERER, drawBuffer))
+		return false;
+	// Read back on the host, so no device-local preference.
+	if (!CreateBuffer(device, physicalDevice, COUNTER_SLOTS * COUNTERS_PER_SLOT * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT, MEMTAG_RENDERER, counterBuffer))
+		return false;
+	return CreateCullPipeline();
+}
+
+bool InstanceRenderer::CreateGraphicsPipeline()
+{
+	std::vector<uint32_t> vertexCode, fragmentCode;
+	if (!LoadSpirvFile(Common::GetShaderPath("instanced.vert.spv"), vertexCode) ||
+		!LoadSpirvFile(Common::GetShaderPath(lights ? "clustered.frag.spv" : "basic.frag.spv"), fragmentCode))
+	{
+		LOG_ERROR(LOG_CATEGORY_PIPELINES, "Could not load the instanced program");
+		return false;
+	}
+
+	const BufferAllocation *buffers[] = { &objectBuffer, &meshBuffer };
+	if (!CreateStorageSet(common.device, descriptorPool, VK_SHADER_STAGE_VERTEX_BIT, buffers, 2, objectSetLayout, objectSet))
+		return false;
+
+	// basic.frag reads the same push constants as the basic program;
+	// clustered.frag reads the light set instead.
+	VkDescriptorSetLayout setLayouts[] = { objectSetLayout, lights ? lights->GetShadeSetLayout() : VK_NULL_HANDLE };
+	VkPushConstantRange pushRange = { VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(BasicPushConstants) };
+	VkPipelineLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.setLayoutCount = lights ? 2 : 1;
+	layoutInfo.pSetLayouts = setLayouts;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushRange;
+	if (vkCreatePipelineLayout(common.device, &layoutInfo, nullptr, &graphicsLayout) != VK_SUCCESS)
+		return false;
+
+	GraphicsPipelineState state;
+	state.stages.resize(2);
+	state.stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	state.stages[0].module = common.permutations->LoadModule(vertexCode);
+	VkBool32 packed = vertexFormat == VERTEX_FORMAT_PACKED ? VK_TRUE : VK_FALSE;
+	state.stages[0].specializationEntries.push_back({ 0, 0, sizeof(VkBool32) });
+	state.stages[0].specializationData.assign((const uint8_t *)&packed, (const uint8_t *)(&packed + 1));
+	state.stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	state.stages[1].module = common.permutations->LoadModule(fragmentCode);
+	if (!lights)
+	{
+		VkBool32 vertexColor = VK_TRUE;
+		state.stages[1].specializationEntries.push_back({ 0, 0, sizeof(VkBool32) });
+		state.stages[1].specializationData.assign((const uint8_t *)&vertexColor, (const uint8_t *)(&vertexColor + 1));
+	}
+	// UVs are not read, but stay in the stride like any other attribute.
+	if (vertexFormat == VERTEX_FORMAT_PACKED)
+	{
+		state.vertexBindings.push_back({ 0, sizeof(PackedVertex), VK_VERTEX_INPUT_RATE_VERTEX });
+		state.vertexAttributes.push_back({ 0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(PackedVertex, position) });
+		state.vertexAttributes.push_back({ 1, 0, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal) });
+	}
+	else
+	{
+		state.vertexBindings.push_back({ 0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX });
+		state.vertexAttributes.push_back({ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position) });
+		state.vertexAttributes.push_back({ 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal) });
+	}
+	state.blendAttachments.push_back(OpaqueBlendAttachment());
+	state.layout = graphicsLayout;
+	state.colorFormats.push_back(VK_FORMAT_R8G8B8A8_UNORM);
+	graphicsPipeline = common.GetPipeline(state);
+	return graphicsPipeline != VK_NULL_HANDLE;
+}
+
+bool InstanceRenderer::CreateCullPipeline()
+{
+	std::vector<uint32_t> code;
+	if (!LoadSpirvFile(Common::GetShaderPath("instancecull.comp.spv"), code))
+	{
+		LOG_ERROR(LOG_CATEGORY_PIPELINES, "Could not load %s", Common::GetShaderPath("instancecull.comp.spv"));
+		return false;
+	}
+
+	const BufferAllocation *buffers[] = { &objectBuffer, &meshBuffer, &lodBuffer, &drawBuffer, &counterBuffer };
+	if (!CreateStorageSet(common.device, descriptorPool, VK_SHADER_STAGE_COMPUTE_BIT, buffers, 5, cullSetLayout, cullSet))
+		return false;
+
+	VkPushConstantRange pushRange = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(InstanceCullPushConstants) };
+	VkPipelineLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &cullSetLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushRange;
+	if (vkCreatePipelineLayout(common.device, &layoutInfo, nullptr, &cullLayout) != VK_SUCCESS)
+		return false;
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = common.permutations->LoadModule(code);
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = cullLayout;
+	VkResult result = vkCreateComputePipelines(common.device, common.pipelineCache, 1, &pipelineInfo, nullptr, &cullPipeline);
+	if (result != VK_SUCCESS)
+	{
+		LOG_ERROR(LOG_CATEGORY_PIPELINES, "Instance cull pipeline creation failed: %s", VkResultToString(result));
+		return false;
+	}
+	return true;
+}
+
+void InstanceRenderer::ReadGpuCounters(uint32_t slot)
+{
+	// FrameLoop has waited on the fence of the frame that last used the slot.
+	if (!counterPending[slot])
+		return;
+	InvalidateBuffer(common.device, counterBuffer);
+	const uint32_t *counters = (const uint32_t *)counterBuffer.mapped + slot * COUNTERS_PER_SLOT;
+	visibleObjects += objectCount - counters[1];
+	visibleTriangles += counters[2];
+	frames++;
+	counterPending[slot] = false;
+}
+
+void InstanceRenderer::Cull(VkCommandBuffer cmd, uint64_t frameIndex, const Mat4 &viewProjection, const Vec3 &eye, float projectionScale,
+	LinearArena &frameArena)
+{
+	PROFILE_FUNCTION();
+	uint64_t start = NowNs();
+	Frustum frustum = Frustum::FromMatrix(viewProjection);
+	if (submission == INSTANCE_SUBMISSION_CPU)
+	{
+		visible = frameArena.AllocateArray<uint32_t>(objectCount);
+		visibleCount = (uint32_t)CullSpheres(frustum, field.bounds.data(), objectCount, visible);
+		visibleLods = frameArena.AllocateArray<uint32_t>(visibleCount);
+		visibleTriangles += SelectObjectLods(field, visible, visibleCount, eye, projectionScale, common.lodPixelError, visibleLods);
+		visibleObjects += visibleCount;
+		frames++;
+		recordNs += NowNs() - start;
+		return;
+	}
+
+	currentSlot = (uint32_t)(frameIndex % COUNTER_SLOTS);
+	ReadGpuCounters(currentSlot);
+
+	// The previous frame's indirect reads must finish before the commands
+	// are rewritten.
+	CmdBufferBarrier(cmd, drawBuffer.buffer, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, 0, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, 0);
+	vkCmdFillBuffer(cmd, counterBuffer.buffer, currentSlot * COUNTERS_PER_SLOT * sizeof(uint32_t), COUNTERS_PER_SLOT * sizeof(uint32_t), 0);
+	CmdBufferBarrier(cmd, counterBuffer.buffer, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+	InstanceCullPushConstants constants = {};
+	for (int i = 0; i < 6; i++)
+	{
+		constants.planes[i][0] = frustum.planes[i].normal.x;
+		constants.planes[i][1] = frustum.planes[i].normal.y;
+		constants.planes[i][2] = frustum.planes[i].normal.z;
+		constants.planes[i][3] = frustum.planes[i].d;
+	}
+	constants.eyeLodScale[0] = eye.x;
+	constants.eyeLodScale[1] = eye.y;
+	constants.eyeLodScale[2] = eye.z;
+	constants.eyeLodScale[3] = common.lodPixelError > 0.0f ? projectionScale / common.lodPixelError : 0.0f;
+	constants.objectCount = objectCount;
+	constants.counterOffset = currentSlot * COUNTERS_PER_SLOT;
+	constants.compact = compactDraws ? 1 : 0;
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout, 0, 1, &cullSet, 0, nullptr);
+	vkCmdPushConstants(cmd, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(cmd, (objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	CmdBufferBarrier(cmd, drawBuffer.buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+	CmdBufferBarrier(cmd, counterBuffer.buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_HOST_READ_BIT);
+	counterPending[currentSlot] = true;
+	recordNs += NowNs() - start;
+}
+
+void InstanceRenderer::Draw(VkCommandBuffer cmd, const Mat4 &viewProjection)
+{
+	uint64_t start = NowNs();
+	BasicPushConstants constants = {};
+	memcpy(constants.mvp, viewProjection.m, sizeof(constants.mvp));
+	constants.features = BASIC_VERTEX_COLOR;
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsLayout, 0, 1, &objectSet, 0, nullptr);
+	if (lights)
+		lights->BindShadeSet(cmd, graphicsLayout, 1);
+	vkCmdPushConstants(cmd, graphicsLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), &constants);
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer.buffer, &offset);
+	vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+	if (submission == INSTANCE_SUBMISSION_CPU)
+	{
+		for (uint32_t i = 0; i < visibleCount; i++)
+		{
+			const MeshLod &lod = field.lods[visibleLods[i]];
+			vkCmdDrawIndexed(cmd, lod.indexCount, 1, lod.firstIndex, 0, visible[i]);
+		}
+		drawCalls += visibleCount;
+	}
+	else
+	{
+		uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+		if (compactDraws)
+		{
+			vkCmdDrawIndexedIndirectCount(cmd, drawBuffer.buffer, 0, counterBuffer.buffer,
+				currentSlot * COUNTERS_PER_SLOT * sizeof(uint32_t), objectCount, stride);
+			drawCalls++;
+		}
+		else if (common.enabledFeatures.multiDrawIndirect)
+		{
+			vkCmdDrawIndexedIndirect(cmd, drawBuffer.buffer, 0, objectCount, stride);
+			drawCalls++;
+		}
+		else
+		{
+			for (uint32_t i = 0; i < objectCount; i++)
+				vkCmdDrawIndexedIndirect(cmd, drawBuffer.buffer, (VkDeviceSize)i * stride, 1, stride);
+			drawCalls += objectCount;
+		}
+	}
+	recordedFrames++;
+	recordNs += NowNs() - start;
+}
+
+void InstanceRenderer::LogSummary() const
+{
+	if (!recordedFrames)
+		return;
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(1);
+	out << "Objects: " << objectCount << ", " << GetInstanceSubmissionName(submission) << " submission";
+	if (submission == INSTANCE_SUBMISSION_GPU)
+		out << (compactDraws ? " (draw count on the GPU)" : " (fixed draw count)");
+	if (common.lodPixelError > 0.0f)
+		out << ", " << field.lods.size() << " LODs within " << common.lodPixelError << " px";
+	else
+		out << ", full detail";
+	out << std::endl;
+	size_t vertexCount = field.geometry.vertices.size();
+	size_t vertexSize = GetVertexFormatSize(vertexFormat);
+	out << "  " << GetVertexFormatName(vertexFormat) << " vertices: " << vertexSize << " B/vertex, "
+		<< vertexCount * vertexSize / 1024.0 << " KB (" << 100.0 * (1.0 - (double)vertexSize / sizeof(Vertex))
+		<< "% less vertex fetch than float)" << std::endl;
+	if (frames)
+	{
+		out << "  " << (double)visibleObjects / frames / 1000.0 << "k objects and "
+			<< (double)visibleTriangles / frames / 1000.0 << "k triangles drawn per frame" << std::endl;
+	}
+	out << "  " << (double)drawCalls / recordedFrames << " draw calls and " << std::setprecision(3)
+		<< (double)recordNs / recordedFrames / 1000000.0 << " ms CPU culling and recording per frame" << std::endl;
+	Log::WriteLines(LOG_LEVEL_INFO, LOG_CATEGORY_FRAME, out.str());
+}
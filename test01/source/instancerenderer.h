@@ -0,0 +1,113 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "culling.h"
+#include "mathutil.h"
+#include "objectfield.h"
+#include "vertexformat.h"
+#include "vulkanhelpers.h"
+
+class Common;
+class LightClusterPass;
+class LinearArena;
+
+enum InstanceSubmission
+{
+	INSTANCE_SUBMISSION_CPU,	// CPU culling, one vkCmdDrawIndexed per visible object
+	INSTANCE_SUBMISSION_GPU,	// compute culling into indirect draws
+};
+
+const char *GetInstanceSubmissionName(InstanceSubmission submission);
+
+// Draws an ObjectField. Object data lives in a storage buffer read by the
+// vertex shader through gl_InstanceIndex, so a draw needs no per-object CPU
+// state beyond its firstInstance.
+//
+// CPU submission is the baseline: frustum culling and one recorded draw per
+// visible object. GPU submission culls in a compute pass that appends
+// VkDrawIndexedIndirectCommands and draws them with one
+// vkCmdDrawIndexedIndirectCount, so recording cost no longer depends on the
+// object count.
+//
+// Both paths pick each object's LOD by projected error against
+// Common::lodPixelError; with 0 only full detail meshes are built. Vertices
+// are uploaded as float Vertex or PackedVertex, half the size, which
+// instanced.vert decodes.
+//
+// With a LightClusterPass the fragment stage is clustered.frag, shading each
+// object with the point lights of its cluster.
+class InstanceRenderer
+{
+public:
+	InstanceRenderer(Common &common, InstanceSubmission submission, uint32_t objectCount, VertexFormat vertexFormat);
+	~InstanceRenderer();
+
+	// Before Init; lights must outlive the renderer.
+	void SetLights(LightClusterPass *lights) { this->lights = lights; }
+
+	bool Init();
+
+	// Outside of rendering. projectionScale converts object-space errors to
+	// pixels (GetLodProjectionScale).
+	void Cull(VkCommandBuffer cmd, uint64_t frameIndex, const Mat4 &viewProjection, const Vec3 &eye, float projectionScale,
+		LinearArena &frameArena);
+
+	// Inside rendering. Binds its own pipeline.
+	void Draw(VkCommandBuffer cmd, const Mat4 &viewProjection);
+
+	const ObjectField &GetField() const { return field; }
+
+	void LogSummary() const;
+
+private:
+	static const uint32_t COUNTER_SLOTS = 3;
+
+	bool CreateGraphicsPipeline();
+	bool CreateCullPipeline();
+	void ReadGpuCounters(uint32_t slot);
+
+	Common &common;
+	InstanceSubmission submission;
+	uint32_t objectCount;
+	VertexFormat vertexFormat;
+	bool compactDraws;	// vkCmdDrawIndexedIndirectCount is available
+
+	BufferAllocation vertexBuffer;
+	BufferAllocation indexBuffer;
+	BufferAllocation objectBuffer;
+	BufferAllocation meshBuffer;
+	BufferAllocation lodBuffer;
+	ObjectField field;
+	LightClusterPass *lights;
+
+	VkDescriptorSetLayout objectSetLayout;
+	VkPipelineLayout graphicsLayout;
+	VkPipeline graphicsPipeline;
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSet objectSet;
+
+	// CPU path: visible object indices and their LODs for the frame being
+	// recorded.
+	uint32_t *visible;
+	uint32_t *visibleLods;
+	uint32_t visibleCount;
+
+	// GPU path.
+	uint32_t currentSlot;
+	BufferAllocation drawBuffer;
+	BufferAllocation counterBuffer;
+	VkDescriptorSetLayout cullSetLayout;
+	VkPipelineLayout cullLayout;
+	VkPipeline cullPipeline;
+	VkDescriptorSet cullSet;
+	bool counterPending[COUNTER_SLOTS];
+
+	uint64_t frames;	// with cull results; GPU results arrive a few frames late
+	uint64_t recordedFrames;
+	uint64_t visibleObjects;
+	uint64_t visibleTriangles;
+	uint64_t drawCalls;
+	uint64_t recordNs;	// Cull plus Draw
+};
@@ -0,0 +1,277 @@
+#include "lightclusterpass.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+#include "common.h"
+#include "gpuprofiler.h"
+#include "log.h"
+#include "profiler.h"
+#include "threadpool.h"
+#include "timer.h"
+
+static const uint32_t CULL_GROUP_SIZE = 64;
+
+struct LightCullPushConstants
+{
+	float view[16];
+	uint32_t lightCount;
+	uint32_t indexCapacity;
+	uint32_t counterOffset;
+};
+
+LightClusterPass::LightClusterPass(Common &common, uint32_t lightCount, LightBinning binning)
+	: common(common), lightCount(lightCount), binning(binning), indexCapacity(0), descriptorPool(VK_NULL_HANDLE),
+	shadeSetLayout(VK_NULL_HANDLE), shadeSets(), cullSetLayout(VK_NULL_HANDLE), cullSets(), cullLayout(VK_NULL_HANDLE),
+	cullPipeline(VK_NULL_HANDLE), currentSlot(0), counterPending(), frames(0), binnedIndices(0), droppedLights(0),
+	maxClusterLights(0), cpuBinNs(0)
+{
+	static_assert(SLOTS == Common::MAX_FRAMES_IN_FLIGHT, "one slot per frame in flight");
+}
+
+LightClusterPass::~LightClusterPass()
+{
+	if (common.device == VK_NULL_HANDLE)
+		return;
+	if (cullPipeline != VK_NULL_HANDLE)
+		vkDestroyPipeline(common.device, cullPipeline, nullptr);
+	if (cullLayout != VK_NULL_HANDLE)
+		vkDestroyPipelineLayout(common.device, cullLayout, nullptr);
+	if (cullSetLayout != VK_NULL_HANDLE)
+		vkDestroyDescriptorSetLayout(common.device, cullSetLayout, nullptr);
+	if (shadeSetLayout != VK_NULL_HANDLE)
+		vkDestroyDescriptorSetLayout(common.device, shadeSetLayout, nullptr);
+	if (descriptorPool != VK_NULL_HANDLE)
+		vkDestroyDescriptorPool(common.device, descriptorPool, nullptr);
+	DestroyBuffer(common.device, counterBuffer);
+	for (uint32_t slot = 0; slot < SLOTS; slot++)
+	{
+		DestroyBuffer(common.device, indexBuffers[slot]);
+		DestroyBuffer(common.device, rangeBuffers[slot]);
+	}
+	DestroyBuffer(common.device, boundsBuffer);
+	DestroyBuffer(common.device, gridBuffer);
+	DestroyBuffer(common.device, lightBuffer);
+}
+
+bool LightClusterPass::Init(float fovY, uint32_t width, uint32_t height, float nearPlane, float farPlane)
+{
+	PROFILE_FUNCTION();
+	clusters.SetProjection(fovY, width, height, nearPlane, farPlane);
+	uint32_t clusterCount = clusters.GetClusterCount();
+	indexCapacity = clusterCount * INDICES_PER_CLUSTER;
+	lights.assign(lightCount, PointLight());
+	if (binning == LIGHT_BINNING_CPU)
+		pool.reset(new ThreadPool());
+
+	VkDevice device = common.device;
+	VkPhysicalDevice physicalDevice = common.physicalDevice;
+	const ClusterGridInfo &grid = clusters.GetGridInfo();
+	if (!CreateFilledBuffer(device, physicalDevice, nullptr, std::max(lightCount, 1u) * sizeof(PointLight),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEMTAG_RENDERER, lightBuffer) ||
+		!CreateFilledBuffer(device, physicalDevice, &grid, sizeof(grid), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEMTAG_RENDERER, gridBuffer))
+		return false;
+	for (uint32_t slot = 0; slot < SLOTS; slot++)
+	{
+		if (!CreateFilledBuffer(device, physicalDevice, nullptr, (VkDeviceSize)clusterCount * 2 * sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEMTAG_RENDERER, rangeBuffers[slot]) ||
+			!CreateFilledBuffer(device, physicalDevice, nullptr, (VkDeviceSize)indexCapacity * sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEMTAG_RENDERER, indexBuffers[slot]))
+			return false;
+	}
+
+	VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, SLOTS * 9 };
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = SLOTS * 2;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+		return false;
+	for (uint32_t slot = 0; slot < SLOTS; slot++)
+	{
+		const BufferAllocation *buffers[] = { &lightBuffer, &gridBuffer, &rangeBuffers[slot], &indexBuffers[slot] };
+		if (!CreateStorageSet(device, descriptorPool, VK_SHADER_STAGE_FRAGMENT_BIT, buffers, 4, shadeSetLayout, shadeSets[slot]))
+			return false;
+	}
+	if (binning == LIGHT_BINNING_CPU)
+		return true;
+
+	// The boxes LightClusters tests against, so both binnings agree.
+	std::vector<float> bounds(clusterCount * 8, 0.0f);
+	for (uint32_t cluster = 0; cluster < clusterCount; cluster++)
+	{
+		Vec3 minimum, maximum;
+		clusters.GetClusterBounds(cluster, minimum, maximum);
+		memcpy(&bounds[cluster * 8], &minimum, sizeof(Vec3));
+		memcpy(&bounds[cluster * 8 + 4], &maximum, sizeof(Vec3));
+	}
+	if (!CreateFilledBuffer(device, physicalDevice, bounds.data(), bounds.size() * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			MEMTAG_RENDERER, boundsBuffer))
+		return false;
+	// Read back on the host, so no device-local preference.
+	if (!CreateBuffer(device, physicalDevice, SLOTS * COUNTERS_PER_SLOT * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		VK_MEMORY_PROPERTY_HOST_CACHED_BIT, MEMTAG_RENDERER, counterBuffer))
+		return false;
+	return CreateCullPipeline();
+}
+
+bool LightClusterPass::CreateCullPipeline()
+{
+	std::vector<uint32_t> code;
+	if (!LoadSpirvFile(Common::GetShaderPath("lightcull.comp.spv"), code))
+	{
+		LOG_ERROR(LOG_CATEGORY_PIPELINES, "Could not load %s", Common::GetShaderPath("lightcull.comp.spv"));
+		return false;
+	}
+
+	for (uint32_t slot = 0; slot < SLOTS; slot++)
+	{
+		const BufferAllocation *buffers[] = { &lightBuffer, &boundsBuffer, &rangeBuffers[slot], &indexBuffers[slot], &counterBuffer };
+		if (!CreateStorageSet(common.device, descriptorPool, VK_SHADER_STAGE_COMPUTE_BIT, buffers, 5, cullSetLayout, cullSets[slot]))
+			return false;
+	}
+
+	VkPushConstantRange pushRange = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(LightCullPushConstants) };
+	VkPipelineLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &cullSetLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushRange;
+	if (vkCreatePipelineLayout(common.device, &layoutInfo, nullptr, &cullLayout) != VK_SUCCESS)
+		return false;
+
+	// The shared list is sized by the same limit the CPU binning uses.
+	uint32_t maxLights = clusters.GetConfig().maxLightsPerCluster;
+	VkSpecializationMapEntry entry = { 0, 0, sizeof(uint32_t) };
+	VkSpecializationInfo specialization = {};
+	specialization.mapEntryCount = 1;
+	specialization.pMapEntries = &entry;
+	specialization.dataSize = sizeof(maxLights);
+	specialization.pData = &maxLights;
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = common.permutations->LoadModule(code);
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.stage.pSpecializationInfo = &specialization;
+	pipelineInfo.layout = cullLayout;
+	VkResult result = vkCreateComputePipelines(common.device, common.pipelineCache, 1, &pipelineInfo, nullptr, &cullPipeline);
+	if (result != VK_SUCCESS)
+	{
+		LOG_ERROR(LOG_CATEGORY_PIPELINES, "Light cull pipeline creation failed: %s", VkResultToString(result));
+		return false;
+	}
+	return true;
+}
+
+void LightClusterPass::SetLights(const PointLight *lights, uint32_t count)
+{
+	count = std::min(count, lightCount);
+	this->lights.assign(lights, lights + count);
+	memcpy(lightBuffer.mapped, lights, count * sizeof(PointLight));
+}
+
+void LightClusterPass::ReadGpuCounters(uint32_t slot)
+{
+	// FrameLoop has waited on the fence of the frame that last used the slot.
+	if (!counterPending[slot])
+		return;
+	InvalidateBuffer(common.device, counterBuffer);
+	const uint32_t *counters = (const uint32_t *)counterBuffer.mapped + slot * COUNTERS_PER_SLOT;
+	binnedIndices += std::min(counters[0], indexCapacity);
+	droppedLights += counters[1];
+	maxClusterLights = std::max(maxClusterLights, counters[2]);
+	frames++;
+	counterPending[slot] = false;
+}
+
+void LightClusterPass::Update(VkCommandBuffer cmd, uint64_t frameIndex, const Mat4 &view)
+{
+	PROFILE_FUNCTION();
+	currentSlot = (uint32_t)(frameIndex % SLOTS);
+	if (binning == LIGHT_BINNING_CPU)
+	{
+		// The slot's buffers were last read by a frame whose fence has been
+		// waited on, so they can be written in place.
+		clusters.Bin(lights.data(), (uint32_t)lights.size(), view, pool.get());
+		const std::vector<uint32_t> &ranges = clusters.GetClusterRanges();
+		const std::vector<uint32_t> &indices = clusters.GetLightIndices();
+		uint32_t *mappedRanges = (uint32_t *)rangeBuffers[currentSlot].mapped;
+		uint32_t dropped = clusters.GetDroppedLights();
+		for (size_t cluster = 0; cluster < ranges.size() / 2; cluster++)
+		{
+			uint32_t offset = ranges[cluster * 2], count = ranges[cluster * 2 + 1];
+			uint32_t kept = offset < indexCapacity ? std::min(count, indexCapacity - offset) : 0;
+			mappedRanges[cluster * 2] = offset;
+			mappedRanges[cluster * 2 + 1] = kept;
+			dropped += count - kept;
+		}
+		size_t kept = std::min<size_t>(indices.size(), indexCapacity);
+		memcpy(indexBuffers[currentSlot].mapped, indices.data(), kept * sizeof(uint32_t));
+		binnedIndices += kept;
+		droppedLights += dropped;
+		maxClusterLights = std::max(maxClusterLights, clusters.GetMaxClusterLights());
+		cpuBinNs += clusters.GetBinNs();
+		frames++;
+		return;
+	}
+
+	ReadGpuCounters(currentSlot);
+	GPU_PROFILE_ZONE(common.gpuProfiler.get(), cmd, "LightCull");
+	vkCmdFillBuffer(cmd, counterBuffer.buffer, currentSlot * COUNTERS_PER_SLOT * sizeof(uint32_t), COUNTERS_PER_SLOT * sizeof(uint32_t), 0);
+	CmdBufferBarrier(cmd, counterBuffer.buffer, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+	LightCullPushConstants constants = {};
+	memcpy(constants.view, view.m, sizeof(constants.view));
+	constants.lightCount = (uint32_t)lights.size();
+	constants.indexCapacity = indexCapacity;
+	constants.counterOffset = currentSlot * COUNTERS_PER_SLOT;
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout, 0, 1, &cullSets[currentSlot], 0, nullptr);
+	vkCmdPushConstants(cmd, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(cmd, clusters.GetClusterCount(), 1, 1);
+
+	CmdBufferBarrier(cmd, rangeBuffers[currentSlot].buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+	CmdBufferBarrier(cmd, indexBuffers[currentSlot].buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+	CmdBufferBarrier(cmd, counterBuffer.buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+	counterPending[currentSlot] = true;
+}
+
+void LightClusterPass::BindShadeSet(VkCommandBuffer cmd, VkPipelineLayout layout, uint32_t setIndex) const
+{
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, setIndex, 1, &shadeSets[currentSlot], 0, nullptr);
+}
+
+void LightClusterPass::LogSummary() const
+{
+	const LightClusterConfig &config = clusters.GetConfig();
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(2);
+	out << "Lights: " << lightCount << ", " << GetLightBinningName(binning) << " binning into " << config.tilesX << "x"
+		<< config.tilesY << "x" << config.slices << " clusters";
+	if (pool)
+		out << " (" << GetLightBinningKernelName() << ", " << pool->GetWorkerCount() << " workers)";
+	out << std::endl;
+	if (frames)
+	{
+		out << "  " << (double)binnedIndices / frames / clusters.GetClusterCount() << " lights per cluster on average, at most "
+			<< maxClusterLights;
+		if (droppedLights)
+			out << ", " << (double)droppedLights / frames << " dropped per frame";
+		out << std::endl;
+		if (binning == LIGHT_BINNING_CPU)
+			out << "  " << std::setprecision(3) << (double)cpuBinNs / frames / 1000000.0 << " ms binning per frame" << std::endl;
+		else
+			out << "  binning time is the LightCull GPU zone" << std::endl;
+	}
+	Log::WriteLines(LOG_LEVEL_INFO, LOG_CATEGORY_FRAME, out.str());
+}
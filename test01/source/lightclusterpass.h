@@ -0,0 +1,80 @@
+#pragma once
+#include <memory>
+#include <stdint.h>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "lightclusters.h"
+#include "vulkanhelpers.h"
+
+class Common;
+
+// Per-frame clustered light lists on the GPU, for shaders/clustered.frag.
+// With CPU binning LightClusters fills them on a thread pool and they are
+// written straight into the frame slot's host-visible buffers; with GPU
+// binning shaders/lightcull.comp writes them in a compute pass before
+// rendering. Either way the fragment set (GetShadeSetLayout, set 1 of the
+// pipeline) reads the lights, the grid and the slot's lists.
+class LightClusterPass
+{
+public:
+	LightClusterPass(Common &common, uint32_t lightCount, LightBinning binning);
+	~LightClusterPass();
+
+	// The projection the scene renders with.
+	bool Init(float fovY, uint32_t width, uint32_t height, float nearPlane, float farPlane);
+
+	// World space; count must match the constructor's. Before the first
+	// frame, as the buffer is read by every frame in flight.
+	void SetLights(const PointLight *lights, uint32_t count);
+
+	// Outside of rendering, before anything that shades with the lists.
+	void Update(VkCommandBuffer cmd, uint64_t frameIndex, const Mat4 &view);
+
+	uint32_t GetLightCount() const { return lightCount; }
+	VkDescriptorSetLayout GetShadeSetLayout() const { return shadeSetLayout; }
+	void BindShadeSet(VkCommandBuffer cmd, VkPipelineLayout layout, uint32_t setIndex) const;
+
+	void LogSummary() const;
+
+private:
+	static const uint32_t SLOTS = 3;
+	static const uint32_t COUNTERS_PER_SLOT = 4;
+
+	// Index buffers hold this many lights per cluster on average; further
+	// lists are cut and counted as dropped.
+	static const uint32_t INDICES_PER_CLUSTER = 64;
+
+	bool CreateCullPipeline();
+	void ReadGpuCounters(uint32_t slot);
+
+	Common &common;
+	uint32_t lightCount;
+	LightBinning binning;
+	LightClusters clusters;
+	std::unique_ptr<ThreadPool> pool;
+	std::vector<PointLight> lights;
+	uint32_t indexCapacity;
+
+	BufferAllocation lightBuffer;
+	BufferAllocation gridBuffer;
+	BufferAllocation boundsBuffer;
+	BufferAllocation rangeBuffers[SLOTS];
+	BufferAllocation indexBuffers[SLOTS];
+	BufferAllocation counterBuffer;
+
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSetLayout shadeSetLayout;
+	VkDescriptorSet shadeSets[SLOTS];
+	VkDescriptorSetLayout cullSetLayout;
+	VkDescriptorSet cullSets[SLOTS];
+	VkPipelineLayout cullLayout;
+	VkPipeline cullPipeline;
+	uint32_t currentSlot;
+	bool counterPending[SLOTS];
+
+	uint64_t frames;	// with binning results; GPU results arrive a few frames late
+	uint64_t binnedIndices;
+	uint64_t droppedLights;
+	uint32_t maxClusterLights;
+	uint64_t cpuBinNs;
+};
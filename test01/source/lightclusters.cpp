@@ -0,0 +1,450 @@
+#include "lightclusters.h"
+#include <algorithm>
+#include <float.h>
+#include <iomanip>
+#include <math.h>
+#include <random>
+#include <sstream>
+#include <string.h>
+#include "log.h"
+#include "profiler.h"
+#include "threadpool.h"
+#include "timer.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHT_CLUSTERS_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LIGHT_CLUSTERS_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Boxes are built from rounded slopes and depths, so the radius gets a little
+// slack: a light may land in a cluster it only grazes, never miss one.
+static const float RADIUS_SLACK = 1.0002f;
+
+const char *GetLightBinningName(LightBinning binning)
+{
+	switch (binning)
+	{
+	case LIGHT_BINNING_CPU: return "cpu";
+	case LIGHT_BINNING_GPU: return "gpu";
+	}
+	return "unknown";
+}
+
+bool ParseLightBinning(const std::string &name, LightBinning &binning)
+{
+	for (LightBinning candidate : { LIGHT_BINNING_CPU, LIGHT_BINNING_GPU })
+	{
+		if (name == GetLightBinningName(candidate))
+		{
+			binning = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+LightClusters::LightClusters(const LightClusterConfig &config)
+	: config(config), grid(), farPlane(0.0f), paddedTiles(0), binNs(0), maxClusterLights(0), droppedLights(0), testedRows(0), bins(0),
+	totalBinNs(0), totalIndices(0), totalLights(0), totalDropped(0)
+{
+	this->config.tilesX = std::max(this->config.tilesX, 1u);
+	this->config.tilesY = std::max(this->config.tilesY, 1u);
+	this->config.slices = std::max(this->config.slices, 1u);
+	this->config.maxLightsPerCluster = std::max(this->config.maxLightsPerCluster, 1u);
+	sliceLights.resize(this->config.slices);
+	sliceIndices.resize(this->config.slices);
+	sliceDropped.resize(this->config.slices);
+	sliceLargest.resize(this->config.slices);
+	sliceTestedRows.resize(this->config.slices);
+	ranges.assign(GetClusterCount() * 2, 0);
+}
+
+void LightClusters::SetProjection(float fovY, uint32_t width, uint32_t height, float nearPlane, float farPlane)
+{
+	grid.tilesX = config.tilesX;
+	grid.tilesY = config.tilesY;
+	grid.slices = config.slices;
+	grid.maxLightsPerCluster = config.maxLightsPerCluster;
+	grid.tileWidth = (float)((width + config.tilesX - 1) / config.tilesX);
+	grid.tileHeight = (float)((height + config.tilesY - 1) / config.tilesY);
+	grid.nearPlane = nearPlane;
+	grid.sliceScale = config.slices / logf(farPlane / nearPlane);
+	this->farPlane = farPlane;
+
+	uint32_t tiles = config.tilesX * config.tilesY;
+	paddedTiles = (tiles + 3) & ~3u;
+	bounds.resize((size_t)config.slices * 6 * paddedTiles);
+	tileEdges.resize((size_t)config.slices * 2 * (config.tilesX + config.tilesY));
+
+	// Tile edges as view-space slopes: x / depth and y / depth. Pixel rows go
+	// down while view y goes up.
+	float tanY = tanf(fovY * 0.5f);
+	float tanX = tanY * width / height;
+	for (uint32_t slice = 0; slice < config.slices; slice++)
+	{
+		float near = nearPlane * expf(slice / grid.sliceScale);
+		float far = slice + 1 == config.slices ? farPlane : nearPlane * expf((slice + 1) / grid.sliceScale);
+		float *minimum = &bounds[(size_t)slice * 6 * paddedTiles];
+		float *maximum = minimum + 3 * paddedTiles;
+		for (uint32_t tile = 0; tile < paddedTiles; tile++)
+		{
+			if (tile >= tiles)
+			{
+				for (uint32_t axis = 0; axis < 3; axis++)
+				{
+					minimum[axis * paddedTiles + tile] = FLT_MAX;
+					maximum[axis * paddedTiles + tile] = -FLT_MAX;
+				}
+				continue;
+			}
+			uint32_t tx = tile % config.tilesX, ty = tile / config.tilesX;
+			float x0 = std::min(tx * grid.tileWidth, (float)width) / width * 2.0f - 1.0f;
+			float x1 = std::min((tx + 1) * grid.tileWidth, (float)width) / width * 2.0f - 1.0f;
+			float y0 = std::min(ty * grid.tileHeight, (float)height) / height * 2.0f - 1.0f;
+			float y1 = std::min((ty + 1) * grid.tileHeight, (float)height) / height * 2.0f - 1.0f;
+			float left = x0 * tanX, right = x1 * tanX;
+			float bottom = -y1 * tanY, top = -y0 * tanY;
+			minimum[tile] = std::min(left * near, left * far);
+			maximum[tile] = std::max(right * near, right * far);
+			minimum[paddedTiles + tile] = std::min(bottom * near, bottom * far);
+			maximum[paddedTiles + tile] = std::max(top * near, top * far);
+			minimum[2 * paddedTiles + tile] = -far;
+			maximum[2 * paddedTiles + tile] = -near;
+
+			float *columns = &tileEdges[(size_t)slice * 2 * (config.tilesX + config.tilesY)];
+			float *rows = columns + 2 * config.tilesX;
+			columns[tx * 2] = minimum[tile];
+			columns[tx * 2 + 1] = maximum[tile];
+			rows[ty * 2] = minimum[paddedTiles + tile];
+			rows[ty * 2 + 1] = maximum[paddedTiles + tile];
+		}
+	}
+}
+
+uint32_t LightClusters::GetSlice(float viewDepth) const
+{
+	float slice = floorf(logf(viewDepth / grid.nearPlane) * grid.sliceScale);
+	return (uint32_t)std::min(std::max(slice, 0.0f), (float)(config.slices - 1));
+}
+
+uint32_t LightClusters::FindCluster(float pixelX, float pixelY, float viewDepth) const
+{
+	if (viewDepth < grid.nearPlane || viewDepth > farPlane)
+		return NO_CLUSTER;
+	uint32_t tx = std::min((uint32_t)std::max(pixelX / grid.tileWidth, 0.0f), config.tilesX - 1);
+	uint32_t ty = std::min((uint32_t)std::max(pixelY / grid.tileHeight, 0.0f), config.tilesY - 1);
+	return (GetSlice(viewDepth) * config.tilesY + ty) * config.tilesX + tx;
+}
+
+void LightClusters::GetClusterBounds(uint32_t cluster, Vec3 &minimum, Vec3 &maximum) const
+{
+	uint32_t tiles = config.tilesX * config.tilesY;
+	const float *slice = &bounds[(size_t)(cluster / tiles) * 6 * paddedTiles];
+	uint32_t tile = cluster % tiles;
+	minimum = Vec3(slice[tile], slice[paddedTiles + tile], slice[2 * paddedTiles + tile]);
+	maximum = Vec3(slice[3 * paddedTiles + tile], slice[4 * paddedTiles + tile], slice[5 * paddedTiles + tile]);
+}
+
+// Tests one sphere against the four boxes at tile and returns a bit per box
+// it touches.
+static inline uint32_t TestSphereBoxes4(const float *minimum, const float *maximum, size_t stride, size_t tile, const float *sphere)
+{
+#if LIGHT_CLUSTERS_SSE2
+	__m128 zero = _mm_setzero_ps();
+	__m128 distance = zero;
+	for (size_t axis = 0; axis < 3; axis++)
+	{
+		__m128 center = _mm_set1_ps(sphere[axis]);
+		__m128 below = _mm_sub_ps(_mm_loadu_ps(minimum + axis * stride + tile), center);
+		__m128 above = _mm_sub_ps(center, _mm_loadu_ps(maximum + axis * stride + tile));
+		__m128 outside = _mm_add_ps(_mm_max_ps(below, zero), _mm_max_ps(above, zero));
+		distance = _mm_add_ps(distance, _mm_mul_ps(outside, outside));
+	}
+	return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(distance, _mm_set1_ps(sphere[3])));
+#elif LIGHT_CLUSTERS_NEON
+	float32x4_t zero = vdupq_n_f32(0.0f);
+	float32x4_t distance = zero;
+	for (size_t axis = 0; axis < 3; axis++)
+	{
+		float32x4_t center = vdupq_n_f32(sphere[axis]);
+		float32x4_t below = vsubq_f32(vld1q_f32(minimum + axis * stride + tile), center);
+		float32x4_t above = vsubq_f32(center, vld1q_f32(maximum + axis * stride + tile));
+		float32x4_t outside = vaddq_f32(vmaxq_f32(below, zero), vmaxq_f32(above, zero));
+		distance = vmlaq_f32(distance, outside, outside);
+	}
+	static const uint32_t laneBits[4] = { 1, 2, 4, 8 };
+	uint32x4_t bits = vandq_u32(vcleq_f32(distance, vdupq_n_f32(sphere[3])), vld1q_u32(laneBits));
+	uint32x2_t pairs = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+	return vget_lane_u32(vpadd_u32(pairs, pairs), 0);
+#else
+	uint32_t mask = 0;
+	for (size_t lane = 0; lane < 4; lane++)
+	{
+		float distance = 0.0f;
+		for (size_t axis = 0; axis < 3; axis++)
+		{
+			float outside = std::max(minimum[axis * stride + tile + lane] - sphere[axis], 0.0f) +
+				std::max(sphere[axis] - maximum[axis * stride + tile + lane], 0.0f);
+			distance += outside * outside;
+		}
+		mask |= (distance <= sphere[3] ? 1u : 0u) << lane;
+	}
+	return mask;
+#endif
+}
+
+uint32_t LightClusters::BinSlice(uint32_t slice, bool simd, std::vector<uint32_t> &scratch)
+{
+	uint32_t tiles = config.tilesX * config.tilesY;
+	uint32_t capacity = config.maxLightsPerCluster;
+	scratch.resize((size_t)tiles * capacity + paddedTiles);
+	uint32_t *counts = scratch.data();
+	uint32_t *lists = counts + paddedTiles;
+	memset(counts, 0, paddedTiles * sizeof(uint32_t));
+
+	const float *minimum = &bounds[(size_t)slice * 6 * paddedTiles];
+	const float *maximum = minimum + 3 * paddedTiles;
+	uint32_t dropped = 0;
+	uint64_t tested = 0;
+	auto add = [&](uint32_t tile, uint32_t light)
+	{
+		if (counts[tile] < capacity)
+			lists[(size_t)tile * capacity + counts[tile]++] = light;
+		else
+			dropped++;
+	};
+	const float *columns = &tileEdges[(size_t)slice * 2 * (config.tilesX + config.tilesY)];
+	const float *rows = columns + 2 * config.tilesX;
+	for (uint32_t light : sliceLights[slice])
+	{
+		// Squared radius in the fourth component, as the kernel compares.
+		float sphere[4];
+		memcpy(sphere, &viewLights[light * 4], sizeof(sphere));
+		float radius = sphere[3] * RADIUS_SLACK;
+		sphere[3] = sphere[3] * sphere[3] * RADIUS_SLACK;
+
+		// Columns and rows are ordered, so the tiles the light's box overlaps
+		// form a rectangle. Columns go up in view x, rows down in view y.
+		uint32_t x0 = 0, x1 = config.tilesX - 1, y0 = 0, y1 = config.tilesY - 1;
+		while (x0 <= x1 && columns[x0 * 2 + 1] < sphere[0] - radius)
+			x0++;
+		while (x1 > x0 && columns[x1 * 2] > sphere[0] + radius)
+			x1--;
+		if (config.narrowRows)
+		{
+			while (y0 <= y1 && rows[y0 * 2] > sphere[1] + radius)
+				y0++;
+			while (y1 > y0 && rows[y1 * 2 + 1] < sphere[1] - radius)
+				y1--;
+		}
+		if (x0 == config.tilesX || y0 == config.tilesY)
+			continue;
+		tested += y1 - y0 + 1;
+
+		for (uint32_t ty = y0; ty <= y1; ty++)
+		{
+			uint32_t first = ty * config.tilesX + x0, last = ty * config.tilesX + x1;
+			if (simd)
+			{
+				for (uint32_t tile = first & ~3u; tile <= last; tile += 4)
+				{
+					uint32_t lanes = 0xf;
+					if (tile < first)
+						lanes &= 0xf << (first - tile);
+					if (tile + 3 > last)
+						lanes &= 0xf >> (tile + 3 - last);
+					uint32_t mask = TestSphereBoxes4(minimum, maximum, paddedTiles, tile, sphere) & lanes;
+					for (; mask; mask &= mask - 1)
+					{
+						uint32_t lane = 0;
+						while (!(mask & (1u << lane)))
+							lane++;
+						add(tile + lane, light);
+					}
+				}
+			}
+			else
+			{
+				for (uint32_t tile = first; tile <= last; tile++)
+				{
+					float distance = 0.0f;
+					for (uint32_t axis = 0; axis < 3; axis++)
+					{
+						float outside = std::max(minimum[axis * paddedTiles + tile] - sphere[axis], 0.0f) +
+							std::max(sphere[axis] - maximum[axis * paddedTiles + tile], 0.0f);
+						distance += outside * outside;
+					}
+					if (distance <= sphere[3])
+						add(tile, light);
+				}
+			}
+		}
+	}
+
+	std::vector<uint32_t> &out = sliceIndices[slice];
+	out.clear();
+	uint32_t largest = 0;
+	uint32_t *range = &ranges[(size_t)slice * tiles * 2];
+	for (uint32_t tile = 0; tile < tiles; tile++)
+	{
+		range[tile * 2] = (uint32_t)out.size();
+		range[tile * 2 + 1] = counts[tile];
+		out.insert(out.end(), lists + (size_t)tile * capacity, lists + (size_t)tile * capacity + counts[tile]);
+		largest = std::max(largest, counts[tile]);
+	}
+	sliceDropped[slice] = dropped;
+	sliceTestedRows[slice] = tested;
+	return largest;
+}
+
+void LightClusters::Bin(const PointLight *lights, uint32_t count, const Mat4 &view, ThreadPool *pool, bool simd)
+{
+	PROFILE_FUNCTION();
+	uint64_t start = NowNs();
+
+	// Lights go to every slice their depth range overlaps, in index order, so
+	// each cluster's list comes out sorted.
+	viewLights.resize((size_t)count * 4);
+	for (std::vector<uint32_t> &list : sliceLights)
+		list.clear();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Vec4 position = view * Vec4(lights[i].position, 1.0f);
+		float depth = -position.z, radius = lights[i].radius;
+		viewLights[i * 4 + 0] = position.x;
+		viewLights[i * 4 + 1] = position.y;
+		viewLights[i * 4 + 2] = position.z;
+		viewLights[i * 4 + 3] = radius;
+		if (depth + radius < grid.nearPlane || depth - radius > farPlane)
+			continue;
+		uint32_t first = GetSlice(std::max(depth - radius, grid.nearPlane));
+		uint32_t last = GetSlice(std::min(depth + radius, farPlane));
+		for (uint32_t slice = first; slice <= last; slice++)
+			sliceLights[slice].push_back(i);
+	}
+
+	// One scratch buffer per task, kept across calls so binning does not
+	// allocate once the largest task count has been seen.
+	if (!pool || pool->GetWorkerCount() == 0)
+	{
+		if (taskScratch.empty())
+			taskScratch.resize(1);
+		for (uint32_t slice = 0; slice < config.slices; slice++)
+			sliceLargest[slice] = BinSlice(slice, simd, taskScratch[0]);
+	}
+	else
+	{
+		// One task per worker, each taking every workerCount-th slice.
+		uint32_t taskCount = std::min(pool->GetWorkerCount(), config.slices);
+		if (taskScratch.size() < taskCount)
+			taskScratch.resize(taskCount);
+		pool->Run(taskCount, [&](unsigned t)
+		{
+			for (uint32_t slice = t; slice < config.slices; slice += taskCount)
+				sliceLargest[slice] = BinSlice(slice, simd, taskScratch[t]);
+		});
+	}
+
+	// Slice lists are already compact; only their offsets need shifting.
+	uint32_t tiles = config.tilesX * config.tilesY;
+	indices.clear();
+	maxClusterLights = 0;
+	droppedLights = 0;
+	testedRows = 0;
+	for (uint32_t slice = 0; slice < config.slices; slice++)
+	{
+		uint32_t base = (uint32_t)indices.size();
+		uint32_t *range = &ranges[(size_t)slice * tiles * 2];
+		for (uint32_t tile = 0; tile < tiles; tile++)
+			range[tile * 2] += base;
+		indices.insert(indices.end(), sliceIndices[slice].begin(), sliceIndices[slice].end());
+		maxClusterLights = std::max(maxClusterLights, sliceLargest[slice]);
+		droppedLights += sliceDropped[slice];
+		testedRows += sliceTestedRows[slice];
+	}
+
+	binNs = NowNs() - start;
+	bins++;
+	totalBinNs += binNs;
+	totalIndices += indices.size();
+	totalLights += count;
+	totalDropped += droppedLights;
+}
+
+void LightClusters::LogSummary() const
+{
+	if (!bins)
+		return;
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(1);
+	out << "Light clusters: " << config.tilesX << "x" << config.tilesY << "x" << config.slices << ", "
+		<< (double)totalLights / bins << " lights binned in " << std::setprecision(3) << (double)totalBinNs / bins / 1000000.0
+		<< " ms per frame (" << GetLightBinningKernelName() << ")" << std::endl;
+	out << std::setprecision(2) << "  " << (double)totalIndices / bins / GetClusterCount() << " lights per cluster on average";
+	if (totalDropped)
+		out << ", " << (double)totalDropped / bins << " dropped per frame over the " << config.maxLightsPerCluster << " limit";
+	out << std::endl;
+	Log::WriteLines(LOG_LEVEL_INFO, LOG_CATEGORY_FRAME, out.str());
+}
+
+static inline void AddLight(const PointLight &light, const Vec3 &position, const Vec3 &normal, Vec3 &result)
+{
+	Vec3 toLight = light.position - position;
+	float distanceSquared = Dot(toLight, toLight);
+	float radiusSquared = light.radius * light.radius;
+	if (distanceSquared >= radiusSquared)
+		return;
+	float falloff = 1.0f - distanceSquared / radiusSquared;
+	float cosine = Dot(normal, toLight) / sqrtf(std::max(distanceSquared, 1e-8f));
+	if (cosine <= 0.0f)
+		return;
+	result = result + light.color * (light.intensity * falloff * falloff * cosine);
+}
+
+Vec3 ShadeLights(const PointLight *lights, const uint32_t *lightIndices, uint32_t count, const Vec3 &position, const Vec3 &normal)
+{
+	Vec3 result;
+	for (uint32_t i = 0; i < count; i++)
+		AddLight(lights[lightIndices[i]], position, normal, result);
+	return result;
+}
+
+Vec3 ShadeAllLights(const PointLight *lights, uint32_t count, const Vec3 &position, const Vec3 &normal)
+{
+	Vec3 result;
+	for (uint32_t i = 0; i < count; i++)
+		AddLight(lights[i], position, normal, result);
+	return result;
+}
+
+void GenerateLights(std::vector<PointLight> &lights, uint32_t count, const Vec3 &minimum, const Vec3 &maximum, float minRadius,
+	float maxRadius, uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> radius(minRadius, maxRadius);
+	std::uniform_real_distribution<float> color(0.2f, 1.0f);
+	lights.resize(count);
+	for (PointLight &light : lights)
+	{
+		light.position = Vec3(minimum.x + unit(rng) * (maximum.x - minimum.x), minimum.y + unit(rng) * (maximum.y - minimum.y),
+			minimum.z + unit(rng) * (maximum.z - minimum.z));
+		light.radius = radius(rng);
+		light.color = Vec3(color(rng), color(rng), color(rng));
+		light.intensity = 1.0f;
+	}
+}
+
+const char *GetLightBinningKernelName()
+{
+#if LIGHT_CLUSTERS_SSE2
+	return "sse2";
+#elif LIGHT_CLUSTERS_NEON
+	return "neon";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,157 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "mathutil.h"
+
+class ThreadPool;
+
+// Mirrored by the Light struct in shaders/lightcull.comp and
+// shaders/clustered.frag.
+struct PointLight
+{
+	Vec3 position;
+	float radius;	// the light's contribution falls to exactly zero here
+	Vec3 color;
+	float intensity;
+};
+
+static_assert(sizeof(PointLight) == 32, "layout is mirrored by the light shaders");
+
+enum LightBinning
+{
+	LIGHT_BINNING_CPU,	// LightClusters on a thread pool, uploaded every frame
+	LIGHT_BINNING_GPU,	// shaders/lightcull.comp
+};
+
+const char *GetLightBinningName(LightBinning binning);
+bool ParseLightBinning(const std::string &name, LightBinning &binning);
+
+struct LightClusterConfig
+{
+	uint32_t tilesX = 16;
+	uint32_t tilesY = 9;
+	uint32_t slices = 24;	// exponential in view depth
+
+	// A cluster keeps at most this many lights; the rest are dropped and
+	// counted, as the GPU binning has to.
+	uint32_t maxLightsPerCluster = 512;
+
+	// Off, every tile row of a light's slices gets the box test. Only there
+	// to check that narrowing the rows leaves the lists unchanged.
+	bool narrowRows = true;
+};
+
+// What shading needs to find a fragment's cluster. Mirrored by ClusterGrid in
+// shaders/clustered.frag and the push constants of shaders/lightcull.comp.
+struct ClusterGridInfo
+{
+	uint32_t tilesX;
+	uint32_t tilesY;
+	uint32_t slices;
+	uint32_t maxLightsPerCluster;
+	float tileWidth;	// pixels
+	float tileHeight;
+	float nearPlane;
+	float sliceScale;	// slices / log(far / near)
+};
+
+// Light lists for a froxel grid: the view frustum cut into screen tiles and
+// exponential depth slices, each cluster listing the lights whose sphere
+// touches its view-space bounding box. Shading a fragment then only loops over
+// its cluster's lights instead of all of them.
+//
+// Binning first sorts lights into the slices their depth range covers. Within
+// a slice, a light's box narrows it down to a rectangle of tiles, which are
+// then tested four boxes at a time with SSE2 or NEON. Slices are independent,
+// so with a pool they are spread across its workers. The lists are compacted
+// into one index array, slice by slice, with an offset and count per cluster.
+class LightClusters
+{
+public:
+	static const uint32_t NO_CLUSTER = ~0u;
+
+	explicit LightClusters(const LightClusterConfig &config = LightClusterConfig());
+
+	// Matches Mat4::Perspective(fovY, width / height, nearPlane, farPlane).
+	void SetProjection(float fovY, uint32_t width, uint32_t height, float nearPlane, float farPlane);
+
+	// lights are in world space and view takes them to the camera's. With a
+	// pool the slices are binned through ThreadPool::Run.
+	void Bin(const PointLight *lights, uint32_t count, const Mat4 &view, ThreadPool *pool = nullptr, bool simd = true);
+
+	// For a fragment at a pixel position and view depth (distance along the
+	// view direction); NO_CLUSTER outside the depth range.
+	uint32_t FindCluster(float pixelX, float pixelY, float viewDepth) const;
+
+	const LightClusterConfig &GetConfig() const { return config; }
+	const ClusterGridInfo &GetGridInfo() const { return grid; }
+	uint32_t GetClusterCount() const { return config.tilesX * config.tilesY * config.slices; }
+	void GetClusterBounds(uint32_t cluster, Vec3 &minimum, Vec3 &maximum) const;
+
+	// Two words per cluster, the offset into GetLightIndices() and the count.
+	// Clusters go x fastest, then y (tile row 0 is the top), then slice.
+	const std::vector<uint32_t> &GetClusterRanges() const { return ranges; }
+	const std::vector<uint32_t> &GetLightIndices() const { return indices; }
+
+	// The last Bin.
+	uint64_t GetBinNs() const { return binNs; }
+	uint32_t GetMaxClusterLights() const { return maxClusterLights; }
+	uint32_t GetDroppedLights() const { return droppedLights; }
+	uint64_t GetTestedRows() const { return testedRows; }	// tile rows put through the box test
+	double GetAverageLightsPerCluster() const { return (double)indices.size() / GetClusterCount(); }
+
+	// Over every Bin.
+	void LogSummary() const;
+
+private:
+	uint32_t GetSlice(float viewDepth) const;
+	uint32_t BinSlice(uint32_t slice, bool simd, std::vector<uint32_t> &scratch);
+
+	LightClusterConfig config;
+	ClusterGridInfo grid;
+	float farPlane;
+	uint32_t paddedTiles;	// tiles per slice rounded up to the SIMD width
+
+	// Per slice, six arrays of paddedTiles floats: minimum x, y, z, then
+	// maximum x, y, z. Padding boxes are empty and never pass.
+	std::vector<float> bounds;
+
+	// Per slice, the x range of each tile column, then the y range of each
+	// row: what the boxes span, before testing them one by one.
+	std::vector<float> tileEdges;
+
+	std::vector<float> viewLights;	// x, y, z, radius in view space
+	std::vector<std::vector<uint32_t>> sliceLights;
+	std::vector<std::vector<uint32_t>> sliceIndices;	// compacted lists, offsets local to the slice
+	std::vector<uint32_t> sliceDropped;
+	std::vector<uint32_t> sliceLargest;	// longest list in the slice
+	std::vector<uint64_t> sliceTestedRows;
+	std::vector<std::vector<uint32_t>> taskScratch;	// BinSlice working space, one per task
+	std::vector<uint32_t> ranges;
+	std::vector<uint32_t> indices;
+
+	uint64_t binNs;
+	uint32_t maxClusterLights;
+	uint32_t droppedLights;
+	uint64_t testedRows;
+	uint64_t bins;
+	uint64_t totalBinNs;
+	uint64_t totalIndices;
+	uint64_t totalLights;
+	uint64_t totalDropped;
+};
+
+// Diffuse lighting at a surface point from the listed lights, in whatever
+// space the point and lights share. Attenuation reaches zero at the radius,
+// so shading a point's cluster gives the same result as shading every light.
+Vec3 ShadeLights(const PointLight *lights, const uint32_t *lightIndices, uint32_t count, const Vec3 &position, const Vec3 &normal);
+Vec3 ShadeAllLights(const PointLight *lights, uint32_t count, const Vec3 &position, const Vec3 &normal);
+
+// Lights scattered through a box, with radii in [minRadius, maxRadius].
+void GenerateLights(std::vector<PointLight> &lights, uint32_t count, const Vec3 &minimum, const Vec3 &maximum, float minRadius,
+	float maxRadius, uint32_t seed);
+
+// "sse2", "neon" or "scalar".
+const char *GetLightBinningKernelName();
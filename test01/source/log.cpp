@@ -0,0 +1,511 @@
+#include "log.h"
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "concurrentqueue.h"
+#include "memtrack.h"
+
+static_assert(sizeof(LogRecord) == 384, "LogRecord should stay a whole number of cache lines");
+
+namespace
+{
+	// 384 KB per logging thread. Large enough to absorb a burst between two
+	// writer passes without stalling INFO callers.
+	const size_t RING_CAPACITY = 1024;
+	const auto WRITER_INTERVAL = std::chrono::milliseconds(2);
+
+	const char *const LEVEL_NAMES[] = { "trace", "debug", "info", "warning", "error", "off" };
+	const char *const CATEGORY_NAMES[] = { "general", "vulkan", "pipelines", "frame", "capture", "profiler", "memory", "assets" };
+
+	struct ThreadLog
+	{
+		ThreadLog() : ring(RING_CAPACITY), exited(false) {}
+
+		SpscQueue<LogRecord> ring;
+		std::atomic<bool> exited;
+	};
+
+	struct LogState
+	{
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable flushed;
+		std::vector<std::shared_ptr<ThreadLog>> threads;
+		std::thread writer;
+		bool writerStarted = false;
+		bool stopping = false;
+		bool wakeRequested = false;
+		uint64_t flushRequested = 0;
+		uint64_t flushCompleted = 0;
+
+		// Held around writes so the file can be swapped mid-run.
+		std::mutex outputMutex;
+		FILE *output = stdout;
+
+		std::atomic<bool> closed{ false };
+		std::atomic<uint64_t> written{ 0 };
+		std::atomic<uint64_t> dropped{ 0 };
+		uint64_t baseNs = Profiler::TicksToNs(ProfilerTicks());
+
+		// Runs the shutdown on this instance rather than through Log::Shutdown,
+		// which would go back through State() while it is being destroyed.
+		~LogState() { Close(); }
+
+		void Close()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (closed.load(std::memory_order_relaxed))
+					return;
+				closed.store(true, std::memory_order_relaxed);
+				stopping = true;
+				wake.notify_one();
+			}
+			if (writer.joinable())
+				writer.join();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			flushed.notify_all();
+			std::lock_guard<std::mutex> outputLock(outputMutex);
+			if (output != stdout)
+				fclose(output);
+			output = stdout;
+		}
+	};
+
+	LogState &State()
+	{
+		static LogState state;
+		return state;
+	}
+
+	// The raw pointer keeps the hot path to a single TLS load; the holder only
+	// exists to mark the ring when its thread exits, so the writer can drop it
+	// once drained.
+	thread_local ThreadLog *threadLog = nullptr;
+	thread_local bool threadExited = false;
+
+	struct ThreadLogHolder
+	{
+		std::shared_ptr<ThreadLog> log;
+		~ThreadLogHolder()
+		{
+			// Later destructors on this thread must not push into a ring the
+			// writer may already have dropped; their records are discarded.
+			threadLog = nullptr;
+			threadExited = true;
+			if (log)
+				log->exited.store(true, std::memory_order_release);
+		}
+	};
+
+	thread_local ThreadLogHolder threadLogHolder;
+
+	void RunWriter(LogState &state);
+
+	ThreadLog *RegisterThread()
+	{
+		LogState &state = State();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (state.closed.load(std::memory_order_relaxed) || threadExited)
+			return nullptr;
+		{
+			MEMORY_TAG(MEMTAG_LOGGING);
+			threadLogHolder.log = std::make_shared<ThreadLog>();
+		}
+		state.threads.push_back(threadLogHolder.log);
+		if (!state.writerStarted)
+		{
+			state.writerStarted = true;
+			state.writer = std::thread(RunWriter, std::ref(state));
+		}
+		threadLog = threadLogHolder.log.get();
+		return threadLog;
+	}
+
+	void RequestWake(LogState &state)
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		state.wakeRequested = true;
+		state.wake.notify_one();
+	}
+
+	// Writes one argument with the caller's conversion spec, widened to the type
+	// the record stored. spec holds everything from '%' up to the length
+	// modifier, which is replaced here.
+	void AppendArg(std::string &out, std::string &spec, char conversion, const LogRecord &record, int index)
+	{
+		char buffer[128];
+		int length = 0;
+		if (index >= record.argCount)
+		{
+			out += "(missing)";
+			return;
+		}
+		uint8_t type = record.argTypes[index];
+		auto value = record.args[index];
+		switch (conversion)
+		{
+		case 'd':
+		case 'i':
+		case 'c':
+			spec += conversion == 'c' ? "c" : "lld";
+			if (type == LogRecord::ARG_DOUBLE)
+				value.i = (int64_t)value.d;
+			length = conversion == 'c' ? snprintf(buffer, sizeof(buffer), spec.c_str(), (int)value.i) : snprintf(buffer, sizeof(buffer), spec.c_str(), (long long)value.i);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			spec += "ll";
+			spec += conversion;
+			if (type == LogRecord::ARG_DOUBLE)
+				value.u = (uint64_t)value.d;
+			length = snprintf(buffer, sizeof(buffer), spec.c_str(), (unsigned long long)value.u);
+			break;
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			spec += conversion;
+			if (type == LogRecord::ARG_INT)
+				value.d = (double)value.i;
+			else if (type == LogRecord::ARG_UINT)
+				value.d = (double)value.u;
+			length = snprintf(buffer, sizeof(buffer), spec.c_str(), value.d);
+			break;
+		case 'p':
+			spec += 'p';
+			length = snprintf(buffer, sizeof(buffer), spec.c_str(), value.p);
+			break;
+		case 's':
+			if (type != LogRecord::ARG_STRING)
+			{
+				out += "(not a string)";
+				return;
+			}
+			if (spec.size() == 1)
+			{
+				out += record.text + value.u;
+				return;
+			}
+			spec += 's';
+			length = snprintf(buffer, sizeof(buffer), spec.c_str(), record.text + value.u);
+			break;
+		}
+		if (length > 0)
+			out.append(buffer, std::min<size_t>((size_t)length, sizeof(buffer) - 1));
+	}
+
+	void AppendRecord(std::string &out, const LogRecord &record, uint64_t baseNs)
+	{
+		char prefix[64];
+		double seconds = (double)(int64_t)(Profiler::TicksToNs(record.ticks) - baseNs) / 1e9;
+		snprintf(prefix, sizeof(prefix), "[%9.3f] %-7s %s: ", seconds, LEVEL_NAMES[record.level], CATEGORY_NAMES[record.category]);
+		out += prefix;
+		Log::FormatMessage(record, out);
+		out += '\n';
+	}
+
+	// Merges whatever each ring held when the pass started, oldest first. Rings
+	// are already in order per thread, so picking the smallest front each time
+	// orders the batch across threads.
+	size_t DrainRings(std::vector<std::shared_ptr<ThreadLog>> &threads, std::string &out, uint64_t baseNs)
+	{
+		std::vector<size_t> remaining(threads.size());
+		for (size_t i = 0; i < threads.size(); i++)
+			remaining[i] = threads[i]->ring.ApproximateSize();
+
+		size_t count = 0;
+		for (;;)
+		{
+			size_t oldest = threads.size();
+			uint64_t oldestTicks = UINT64_MAX;
+			for (size_t i = 0; i < threads.size(); i++)
+			{
+				if (remaining[i] == 0)
+					continue;
+				LogRecord *record = threads[i]->ring.Front();
+				if (record->ticks < oldestTicks)
+				{
+					oldest = i;
+					oldestTicks = record->ticks;
+				}
+			}
+			if (oldest == threads.size())
+				break;
+			AppendRecord(out, *threads[oldest]->ring.Front(), baseNs);
+			threads[oldest]->ring.Pop();
+			remaining[oldest]--;
+			count++;
+		}
+		return count;
+	}
+
+	void RunWriter(LogState &state)
+	{
+		MEMORY_TAG(MEMTAG_LOGGING);
+		std::vector<std::shared_ptr<ThreadLog>> threads;
+		std::string out;
+		for (;;)
+		{
+			uint64_t flushTarget;
+			bool stopping;
+			{
+				std::unique_lock<std::mutex> lock(state.mutex);
+				state.wake.wait_for(lock, WRITER_INTERVAL, [&]
+				{
+					return state.wakeRequested || state.stopping || state.flushRequested != state.flushCompleted;
+				});
+				state.wakeRequested = false;
+
+				// Rings of exited threads are dropped once there is nothing
+				// left in them.
+				state.threads.erase(std::remove_if(state.threads.begin(), state.threads.end(), [](const std::shared_ptr<ThreadLog> &log)
+				{
+					return log->exited.load(std::memory_order_acquire) && log->ring.IsEmpty();
+				}), state.threads.end());
+				threads = state.threads;
+				flushTarget = state.flushRequested;
+				stopping = state.stopping;
+			}
+
+			out.clear();
+			size_t count = DrainRings(threads, out, state.baseNs);
+			if (count)
+			{
+				std::lock_guard<std::mutex> outputLock(state.outputMutex);
+				fwrite(out.data(), 1, out.size(), state.output);
+				fflush(state.output);
+				state.written.fetch_add(count, std::memory_order_relaxed);
+			}
+
+			std::lock_guard<std::mutex> lock(state.mutex);
+			if (state.flushCompleted < flushTarget)
+			{
+				state.flushCompleted = flushTarget;
+				state.flushed.notify_all();
+			}
+			if (stopping && count == 0)
+				break;
+		}
+	}
+
+	uint64_t TicksPerSecond()
+	{
+		uint64_t ticks = ProfilerTicks();
+		uint64_t elapsedNs = Profiler::TicksToNs(ticks + 1000000000) - Profiler::TicksToNs(ticks);
+		return (uint64_t)(1e9 * 1e9 / (double)std::max<uint64_t>(elapsedNs, 1));
+	}
+}
+
+Log::LevelTable Log::levels;
+
+Log::LevelTable::LevelTable()
+{
+	for (std::atomic<int> &threshold : thresholds)
+		threshold.store(LOG_LEVEL_INFO, std::memory_order_relaxed);
+}
+
+const char *GetLogLevelName(LogLevel level)
+{
+	return level >= LOG_LEVEL_TRACE && level <= LOG_LEVEL_OFF ? LEVEL_NAMES[level] : "unknown";
+}
+
+const char *GetLogCategoryName(LogCategory category)
+{
+	return category >= LOG_CATEGORY_GENERAL && category < LOG_CATEGORY_COUNT ? CATEGORY_NAMES[category] : "unknown";
+}
+
+bool ParseLogLevel(const std::string &name, LogLevel &level)
+{
+	for (int i = LOG_LEVEL_TRACE; i <= LOG_LEVEL_OFF; i++)
+	{
+		if (name == LEVEL_NAMES[i])
+		{
+			level = (LogLevel)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ParseLogCategory(const std::string &name, LogCategory &category)
+{
+	for (int i = 0; i < LOG_CATEGORY_COUNT; i++)
+	{
+		if (name == CATEGORY_NAMES[i])
+		{
+			category = (LogCategory)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+LogRecord *Log::BeginRecord(LogLevel level)
+{
+	ThreadLog *log = threadLog;
+	if (!log)
+	{
+		log = RegisterThread();
+		if (!log)
+			return nullptr;
+	}
+	LogRecord *record = log->ring.BeginPush();
+	if (record)
+		return record;
+
+	// Full ring. Chatty levels are shed; anything a user is meant to read
+	// waits for the writer.
+	LogState &state = State();
+	if (level < LOG_LEVEL_INFO)
+	{
+		state.dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	RequestWake(state);
+	while (!(record = log->ring.BeginPush()))
+	{
+		if (state.closed.load(std::memory_order_relaxed))
+			return nullptr;
+		std::this_thread::yield();
+	}
+	return record;
+}
+
+void Log::EndRecord()
+{
+	threadLog->ring.EndPush();
+}
+
+void Log::WriteLines(LogLevel level, LogCategory category, const std::string &text)
+{
+	if (!IsEnabled(level, category))
+		return;
+	size_t start = 0;
+	while (start < text.size())
+	{
+		size_t end = text.find('\n', start);
+		if (end == std::string::npos)
+			end = text.size();
+		Write(level, category, "%s", text.substr(start, end - start));
+		start = end + 1;
+	}
+}
+
+void Log::SetLevel(LogLevel level)
+{
+	for (std::atomic<int> &threshold : levels.thresholds)
+		threshold.store(level, std::memory_order_relaxed);
+}
+
+void Log::SetCategoryLevel(LogCategory category, LogLevel level)
+{
+	levels.thresholds[category].store(level, std::memory_order_relaxed);
+}
+
+bool Log::SetOutputFile(const std::string &path)
+{
+	FILE *file = path.empty() ? stdout : fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+	Flush();
+	LogState &state = State();
+	std::lock_guard<std::mutex> lock(state.outputMutex);
+	if (state.output != stdout)
+		fclose(state.output);
+	state.output = file;
+	return true;
+}
+
+void Log::Flush()
+{
+	LogState &state = State();
+	std::unique_lock<std::mutex> lock(state.mutex);
+	if (!state.writerStarted || state.stopping)
+		return;
+	uint64_t target = ++state.flushRequested;
+	state.wake.notify_one();
+	state.flushed.wait(lock, [&] { return state.flushCompleted >= target || state.stopping; });
+}
+
+void Log::Shutdown()
+{
+	State().Close();
+}
+
+uint64_t Log::GetWrittenCount()
+{
+	return State().written.load(std::memory_order_relaxed);
+}
+
+uint64_t Log::GetDroppedCount()
+{
+	return State().dropped.load(std::memory_order_relaxed);
+}
+
+void Log::FormatMessage(const LogRecord &record, std::string &out)
+{
+	std::string spec;
+	int argIndex = 0;
+	for (const char *c = record.format; *c; c++)
+	{
+		if (*c != '%')
+		{
+			out += *c;
+			continue;
+		}
+		if (c[1] == '%')
+		{
+			out += '%';
+			c++;
+			continue;
+		}
+
+		// Flags, width and precision are kept; length modifiers are dropped
+		// because the record already knows each argument's width.
+		spec.assign(1, '%');
+		c++;
+		while (*c && strchr("-+ #0123456789.", *c))
+			spec += *c++;
+		while (*c && strchr("hlLqjzt", *c))
+			c++;
+		if (!*c)
+			break;
+		if (!strchr("diouxXcfFeEgGaAsp", *c))
+		{
+			out += spec;
+			out += *c;
+			continue;
+		}
+		AppendArg(out, spec, *c, record, argIndex++);
+	}
+	if (record.truncated)
+		out += " [truncated]";
+}
+
+bool LogRateLimiter::Allow(uint32_t &suppressedBefore)
+{
+	static const uint64_t ticksPerSecond = TicksPerSecond();
+	uint64_t now = ProfilerTicks();
+	uint64_t start = windowStart.load(std::memory_order_relaxed);
+	if (now - start >= ticksPerSecond && windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed))
+		count.store(0, std::memory_order_relaxed);
+	if (count.load(std::memory_order_relaxed) < perSecond && count.fetch_add(1, std::memory_order_relaxed) < perSecond)
+	{
+		suppressedBefore = suppressed.exchange(0, std::memory_order_relaxed);
+		return true;
+	}
+	suppressed.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
@@ -0,0 +1,240 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include "profiler.h"
+
+enum LogLevel
+{
+	LOG_LEVEL_TRACE,
+	LOG_LEVEL_DEBUG,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_WARNING,
+	LOG_LEVEL_ERROR,
+	LOG_LEVEL_OFF,
+};
+
+enum LogCategory
+{
+	LOG_CATEGORY_GENERAL,
+	LOG_CATEGORY_VULKAN,
+	LOG_CATEGORY_PIPELINES,
+	LOG_CATEGORY_FRAME,
+	LOG_CATEGORY_CAPTURE,
+	LOG_CATEGORY_PROFILER,
+	LOG_CATEGORY_MEMORY,
+	LOG_CATEGORY_ASSETS,
+	LOG_CATEGORY_COUNT
+};
+
+const char *GetLogLevelName(LogLevel level);
+const char *GetLogCategoryName(LogCategory category);
+bool ParseLogLevel(const std::string &name, LogLevel &level);
+bool ParseLogCategory(const std::string &name, LogCategory &category);
+
+// One log call as captured on the calling thread: the format pointer, the raw
+// argument values and copies of any string arguments. Nothing is formatted
+// until the writer thread picks the record up.
+struct LogRecord
+{
+	static const int MAX_ARGS = 8;
+	static const int TEXT_CAPACITY = 288;
+
+	enum ArgType : uint8_t
+	{
+		ARG_INT,
+		ARG_UINT,
+		ARG_DOUBLE,
+		ARG_STRING,	// offset into text
+		ARG_POINTER,
+	};
+
+	uint64_t ticks;
+	const char *format;	// must outlive the record; use literals
+	uint8_t level;
+	uint8_t category;
+	uint8_t argCount;
+	uint8_t truncated;
+	uint16_t textUsed;
+	uint8_t argTypes[MAX_ARGS];
+	union
+	{
+		int64_t i;
+		uint64_t u;
+		double d;
+		const void *p;
+	} args[MAX_ARGS];
+	char text[TEXT_CAPACITY];
+
+	void AddArg(ArgType type, uint64_t bits)
+	{
+		if (argCount == MAX_ARGS)
+		{
+			truncated = 1;
+			return;
+		}
+		argTypes[argCount] = type;
+		args[argCount++].u = bits;
+	}
+
+	void AddString(const char *string, size_t length)
+	{
+		size_t space = TEXT_CAPACITY - textUsed;
+		if (argCount == MAX_ARGS || space == 0)
+		{
+			truncated = 1;
+			return;
+		}
+		if (length >= space)
+		{
+			length = space - 1;
+			truncated = 1;
+		}
+		memcpy(text + textUsed, string, length);
+		text[textUsed + length] = 0;
+		AddArg(ARG_STRING, textUsed);
+		textUsed = (uint16_t)(textUsed + length + 1);
+	}
+};
+
+// printf-style conversions are applied on the writer thread. Integers may be
+// passed to any integer conversion regardless of their size (%d, %u and %x
+// all work for uint64_t), and string arguments are copied, so temporaries are
+// safe.
+inline void EncodeLogArg(LogRecord &record, const char *value) { record.AddString(value ? value : "(null)", value ? strlen(value) : 6); }
+inline void EncodeLogArg(LogRecord &record, char *value) { EncodeLogArg(record, (const char *)value); }
+inline void EncodeLogArg(LogRecord &record, const std::string &value) { record.AddString(value.data(), value.size()); }
+inline void EncodeLogArg(LogRecord &record, const void *value) { record.AddArg(LogRecord::ARG_POINTER, (uint64_t)(uintptr_t)value); }
+
+inline void EncodeLogArg(LogRecord &record, double value)
+{
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	record.AddArg(LogRecord::ARG_DOUBLE, bits);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type EncodeLogArg(LogRecord &record, T value)
+{
+	if (std::is_signed<T>::value || std::is_enum<T>::value)
+		record.AddArg(LogRecord::ARG_INT, (uint64_t)(int64_t)value);
+	else
+		record.AddArg(LogRecord::ARG_UINT, (uint64_t)value);
+}
+
+inline void EncodeLogArg(LogRecord &record, float value) { EncodeLogArg(record, (double)value); }
+
+// Asynchronous logger. Each thread writes records into its own ring, which a
+// background thread drains, orders by timestamp, formats and writes out. A
+// call costs a level check, a timestamp and a few stores; it never locks,
+// allocates or formats. When a ring is full, records below INFO are dropped
+// and counted, while INFO and above wait for the writer, so reports are never
+// lost.
+class Log
+{
+public:
+	static bool IsEnabled(LogLevel level, LogCategory category)
+	{
+		return (int)level >= levels.thresholds[category].load(std::memory_order_relaxed);
+	}
+
+	template <typename... Args>
+	static void Write(LogLevel level, LogCategory category, const char *format, const Args &...args)
+	{
+		LogRecord *record = BeginRecord(level);
+		if (!record)
+			return;
+		record->ticks = ProfilerTicks();
+		record->format = format;
+		record->level = (uint8_t)level;
+		record->category = (uint8_t)category;
+		record->argCount = 0;
+		record->truncated = 0;
+		record->textUsed = 0;
+		(EncodeLogArg(*record, args), ...);
+		EndRecord();
+	}
+
+	// Cold path for text that is already formatted, such as multi-line
+	// summaries built with a stream: one record per line.
+	static void WriteLines(LogLevel level, LogCategory category, const std::string &text);
+
+	static void SetLevel(LogLevel level);
+	static void SetCategoryLevel(LogCategory category, LogLevel level);
+
+	// Defaults to stdout; an empty path goes back to it. Returns false if the
+	// file cannot be opened.
+	static bool SetOutputFile(const std::string &path);
+
+	// Blocks until every record logged before the call has been written.
+	static void Flush();
+
+	// Flushes and stops the writer thread; logging after this is dropped.
+	static void Shutdown();
+
+	static uint64_t GetWrittenCount();
+	static uint64_t GetDroppedCount();
+
+	// Formats a record the way the writer does, without the prefix.
+	static void FormatMessage(const LogRecord &record, std::string &out);
+
+private:
+	struct LevelTable
+	{
+		LevelTable();
+		std::atomic<int> thresholds[LOG_CATEGORY_COUNT];
+	};
+
+	static LogRecord *BeginRecord(LogLevel level);
+	static void EndRecord();
+
+	static LevelTable levels;
+};
+
+// Allows up to perSecond messages per one-second window from one call site
+// and counts the rest.
+class LogRateLimiter
+{
+public:
+	explicit LogRateLimiter(uint32_t perSecond) : perSecond(perSecond), windowStart(0), count(0), suppressed(0) {}
+
+	// suppressedBefore receives how many messages were dropped since the
+	// last one allowed.
+	bool Allow(uint32_t &suppressedBefore);
+
+private:
+	uint32_t perSecond;
+	std::atomic<uint64_t> windowStart;
+	std::atomic<uint32_t> count;
+	std::atomic<uint32_t> suppressed;
+};
+
+#define LOG(level, category, ...) \
+	do \
+	{ \
+		if (Log::IsEnabled(level, category)) \
+			Log::Write(level, category, __VA_ARGS__); \
+	} while (0)
+
+#define LOG_ERROR(category, ...) LOG(LOG_LEVEL_ERROR, category, __VA_ARGS__)
+#define LOG_WARNING(category, ...) LOG(LOG_LEVEL_WARNING, category, __VA_ARGS__)
+#define LOG_INFO(category, ...) LOG(LOG_LEVEL_INFO, category, __VA_ARGS__)
+#define LOG_DEBUG(category, ...) LOG(LOG_LEVEL_DEBUG, category, __VA_ARGS__)
+#define LOG_TRACE(category, ...) LOG(LOG_LEVEL_TRACE, category, __VA_ARGS__)
+
+// For messages that can fire every frame or every draw.
+#define LOG_RATE_LIMITED(level, category, perSecond, ...) \
+	do \
+	{ \
+		static LogRateLimiter logRateLimiter_(perSecond); \
+		uint32_t logSuppressed_; \
+		if (Log::IsEnabled(level, category) && logRateLimiter_.Allow(logSuppressed_)) \
+		{ \
+			if (logSuppressed_) \
+				Log::Write(level, category, "(%u similar messages suppressed)", logSuppressed_); \
+			Log::Write(level, category, __VA_ARGS__); \
+		} \
+	} while (0)
@@ -0,0 +1,114 @@
+#pragma once
+#include <math.h>
+
+struct Vec3
+{
+	float x, y, z;
+
+	Vec3() : x(0.0f), y(0.0f), z(0.0f) {}
+	Vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+	Vec3 operator+(const Vec3 &o) const { return Vec3(x + o.x, y + o.y, z + o.z); }
+	Vec3 operator-(const Vec3 &o) const { return Vec3(x - o.x, y - o.y, z - o.z); }
+	Vec3 operator*(float s) const { return Vec3(x * s, y * s, z * s); }
+	Vec3 operator-() const { return Vec3(-x, -y, -z); }
+	Vec3 &operator+=(const Vec3 &o) { x += o.x; y += o.y; z += o.z; return *this; }
+	float operator[](int i) const { return i == 0 ? x : i == 1 ? y : z; }
+};
+
+inline float Dot(const Vec3 &a, const Vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 Cross(const Vec3 &a, const Vec3 &b) { return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+inline float Length(const Vec3 &v) { return sqrtf(Dot(v, v)); }
+inline Vec3 Min(const Vec3 &a, const Vec3 &b) { return Vec3(fminf(a.x, b.x), fminf(a.y, b.y), fminf(a.z, b.z)); }
+inline Vec3 Max(const Vec3 &a, const Vec3 &b) { return Vec3(fmaxf(a.x, b.x), fmaxf(a.y, b.y), fmaxf(a.z, b.z)); }
+
+inline Vec3 Normalize(const Vec3 &v)
+{
+	float length = Length(v);
+	return length > 0.0f ? v * (1.0f / length) : Vec3(0.0f, 0.0f, 1.0f);
+}
+
+struct Vec4
+{
+	float x, y, z, w;
+
+	Vec4() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
+	Vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+	Vec4(const Vec3 &v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+};
+
+// Column-major 4x4 matrix matching GLSL layout, so it can be copied straight
+// into push constants and uniform buffers. Projections use Vulkan clip space
+// (depth 0..1, y down).
+struct Mat4
+{
+	float m[16];
+
+	static Mat4 Identity()
+	{
+		Mat4 r = {};
+		r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0f;
+		return r;
+	}
+
+	static Mat4 Perspective(float fovY, float aspect, float nearZ, float farZ)
+	{
+		float f = 1.0f / tanf(fovY * 0.5f);
+		Mat4 r = {};
+		r.m[0] = f / aspect;
+		r.m[5] = -f;
+		r.m[10] = farZ / (nearZ - farZ);
+		r.m[11] = -1.0f;
+		r.m[14] = nearZ * farZ / (nearZ - farZ);
+		return r;
+	}
+
+	static Mat4 LookAt(const Vec3 &eye, const Vec3 &target, const Vec3 &up)
+	{
+		Vec3 f = Normalize(target - eye);
+		Vec3 s = Normalize(Cross(f, up));
+		Vec3 u = Cross(s, f);
+		Mat4 r = Identity();
+		r.m[0] = s.x; r.m[4] = s.y; r.m[8] = s.z;
+		r.m[1] = u.x; r.m[5] = u.y; r.m[9] = u.z;
+		r.m[2] = -f.x; r.m[6] = -f.y; r.m[10] = -f.z;
+		r.m[12] = -Dot(s, eye);
+		r.m[13] = -Dot(u, eye);
+		r.m[14] = Dot(f, eye);
+		return r;
+	}
+
+	static Mat4 Translation(const Vec3 &t)
+	{
+		Mat4 r = Identity();
+		r.m[12] = t.x;
+		r.m[13] = t.y;
+		r.m[14] = t.z;
+		return r;
+	}
+
+	Mat4 operator*(const Mat4 &o) const
+	{
+		Mat4 r;
+		for (int c = 0; c < 4; c++)
+		{
+			for (int row = 0; row < 4; row++)
+			{
+				r.m[c * 4 + row] = m[0 * 4 + row] * o.m[c * 4 + 0] + m[1 * 4 + row] * o.m[c * 4 + 1] +
+					m[2 * 4 + row] * o.m[c * 4 + 2] + m[3 * 4 + row] * o.m[c * 4 + 3];
+			}
+		}
+		return r;
+	}
+
+	Vec4 operator*(const Vec4 &v) const
+	{
+		return Vec4(
+			m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12] * v.w,
+			m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13] * v.w,
+			m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14] * v.w,
+			m[3] * v.x + m[7] * v.y + m[11] * v.z + m[15] * v.w);
+	}
+
+	float Row(int row, int column) const { return m[column * 4 + row]; }
+};
@@ -0,0 +1,76 @@
+// Global allocation hooks feeding MemoryTracker. Only linked into Vulkan01, so
+// other executables keep the default allocator.
+#include <new>
+#include <stdlib.h>
+#include "memtrack.h"
+
+namespace
+{
+	// Every block is prefixed with its size and tag so delete can account for
+	// it without a lookup. The header is 16 bytes to keep malloc's alignment.
+	struct AllocationHeader
+	{
+		uint64_t size;
+		uint32_t tag;
+		uint32_t offset;
+	};
+	static_assert(sizeof(AllocationHeader) == 16, "allocation header must preserve 16-byte alignment");
+
+	void *TrackedAlloc(size_t size, size_t alignment)
+	{
+		if (alignment < sizeof(AllocationHeader))
+			alignment = sizeof(AllocationHeader);
+
+		size_t padding = alignment - 1 + sizeof(AllocationHeader);
+		uint8_t *raw = (uint8_t *)malloc(size + padding);
+		if (!raw)
+			return nullptr;
+
+		uintptr_t user = ((uintptr_t)raw + sizeof(AllocationHeader) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		AllocationHeader *header = (AllocationHeader *)user - 1;
+		header->size = size;
+		header->tag = MemoryTracker::GetThreadTag();
+		header->offset = (uint32_t)(user - (uintptr_t)raw);
+		MemoryTracker::OnHostAlloc((MemoryTag)header->tag, size);
+		return (void *)user;
+	}
+
+	void TrackedFree(void *pointer)
+	{
+		if (!pointer)
+			return;
+		AllocationHeader *header = (AllocationHeader *)pointer - 1;
+		MemoryTracker::OnHostFree((MemoryTag)header->tag, (size_t)header->size);
+		free((uint8_t *)pointer - header->offset);
+	}
+
+	void *TrackedAllocOrThrow(size_t size, size_t alignment)
+	{
+		void *pointer = TrackedAlloc(size ? size : 1, alignment);
+		if (!pointer)
+			throw std::bad_alloc();
+		return pointer;
+	}
+}
+
+void *operator new(size_t size) { return TrackedAllocOrThrow(size, 16); }
+void *operator new[](size_t size) { return TrackedAllocOrThrow(size, 16); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return TrackedAlloc(size ? size : 1, 16); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return TrackedAlloc(size ? size : 1, 16); }
+void *operator new(size_t size, std::align_val_t alignment) { return TrackedAllocOrThrow(size, (size_t)alignment); }
+void *operator new[](size_t size, std::align_val_t alignment) { return TrackedAllocOrThrow(size, (size_t)alignment); }
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept { return TrackedAlloc(size ? size : 1, (size_t)alignment); }
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept { return TrackedAlloc(size ? size : 1, (size_t)alignment); }
+
+void operator delete(void *pointer) noexcept { TrackedFree(pointer); }
+void operator delete[](void *pointer) noexcept { TrackedFree(pointer); }
+void operator delete(void *pointer, const std::nothrow_t &) noexcept { TrackedFree(pointer); }
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept { TrackedFree(pointer); }
+void operator delete(void *pointer, size_t) noexcept { TrackedFree(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { TrackedFree(pointer); }
+void operator delete(void *pointer, std::align_val_t) noexcept { TrackedFree(pointer); }
+void operator delete[](void *pointer, std::align_val_t) noexcept { TrackedFree(pointer); }
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept { TrackedFree(pointer); }
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept { TrackedFree(pointer); }
+void operator delete(void *pointer, std::align_val_t, const std::nothrow_t &) noexcept { TrackedFree(pointer); }
+void operator delete[](void *pointer, std::align_val_t, const std::nothrow_t &) noexcept { TrackedFree(pointer); }
@@ -0,0 +1,282 @@
+#include "memtrack.h"
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#include "log.h"
+
+namespace
+{
+	// Plain atomics only: the hooks run during static initialization, before
+	// any object with a constructor can be relied on.
+	struct TagCounters
+	{
+		std::atomic<int64_t> current;
+		std::atomic<int64_t> peak;
+		std::atomic<uint64_t> allocations;
+		int64_t frameStart;
+		int64_t frameDelta;
+	};
+
+	TagCounters hostCounters[MEMTAG_COUNT];
+	TagCounters deviceCounters[MEMTAG_COUNT];
+	std::atomic<int64_t> hostTotal;
+	std::atomic<int64_t> hostPeak;
+
+	thread_local MemoryTag threadTag = MEMTAG_UNTAGGED;
+
+	void RaisePeak(std::atomic<int64_t> &peak, int64_t value)
+	{
+		int64_t previous = peak.load(std::memory_order_relaxed);
+		while (value > previous && !peak.compare_exchange_weak(previous, value, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	void Add(TagCounters &counters, int64_t size)
+	{
+		int64_t current = counters.current.fetch_add(size, std::memory_order_relaxed) + size;
+		counters.allocations.fetch_add(1, std::memory_order_relaxed);
+		RaisePeak(counters.peak, current);
+	}
+
+	MemoryTagStats ToStats(const TagCounters &counters)
+	{
+		MemoryTagStats stats;
+		stats.currentBytes = counters.current.load(std::memory_order_relaxed);
+		stats.peakBytes = counters.peak.load(std::memory_order_relaxed);
+		stats.frameDeltaBytes = counters.frameDelta;
+		stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	struct DeviceAllocation
+	{
+		VkDeviceSize size;
+		MemoryTag tag;
+	};
+
+	struct DeviceState
+	{
+		std::mutex mutex;
+		std::unordered_map<VkDeviceMemory, DeviceAllocation> allocations;
+		std::vector<DeviceHeapBudget> heaps;
+	};
+
+	DeviceState &Device()
+	{
+		static DeviceState state;
+		return state;
+	}
+
+	std::string FormatBytes(int64_t bytes)
+	{
+		std::ostringstream out;
+		double value = (double)bytes;
+		const char *units[] = { "B", "KB", "MB", "GB" };
+		int unit = 0;
+		while ((value >= 1024.0 || value <= -1024.0) && unit < 3)
+		{
+			value /= 1024.0;
+			unit++;
+		}
+		out << std::fixed << std::setprecision(unit ? 1 : 0) << value << " " << units[unit];
+		return out.str();
+	}
+}
+
+const char *MemoryTracker::GetTagName(MemoryTag tag)
+{
+	static const char *names[MEMTAG_COUNT] = {
+		"untagged", "vulkan", "pipelines", "profiler", "renderer", "assets", "streaming", "capture", "logging"
+	};
+	return tag < MEMTAG_COUNT ? names[tag] : "invalid";
+}
+
+MemoryTag MemoryTracker::GetThreadTag()
+{
+	return threadTag;
+}
+
+void MemoryTracker::SetThreadTag(MemoryTag tag)
+{
+	threadTag = tag;
+}
+
+void MemoryTracker::OnHostAlloc(MemoryTag tag, size_t size)
+{
+	Add(hostCounters[tag], (int64_t)size);
+	int64_t total = hostTotal.fetch_add((int64_t)size, std::memory_order_relaxed) + (int64_t)size;
+	RaisePeak(hostPeak, total);
+}
+
+void MemoryTracker::OnHostFree(MemoryTag tag, size_t size)
+{
+	hostCounters[tag].current.fetch_sub((int64_t)size, std::memory_order_relaxed);
+	hostTotal.fetch_sub((int64_t)size, std::memory_order_relaxed);
+}
+
+VkResult MemoryTracker::AllocateDeviceMemory(VkDevice device, const VkMemoryAllocateInfo &info, MemoryTag tag, VkDeviceMemory *memory)
+{
+	VkResult result = vkAllocateMemory(device, &info, nullptr, memory);
+	if (result != VK_SUCCESS)
+		return result;
+
+	Add(deviceCounters[tag], (int64_t)info.allocationSize);
+	DeviceState &state = Device();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	state.allocations[*memory] = { info.allocationSize, tag };
+	return result;
+}
+
+void MemoryTracker::FreeDeviceMemory(VkDevice device, VkDeviceMemory memory)
+{
+	if (memory == VK_NULL_HANDLE)
+		return;
+
+	{
+		DeviceState &state = Device();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		auto it = state.allocations.find(memory);
+		if (it != state.allocations.end())
+		{
+			deviceCounters[it->second.tag].current.fetch_sub((int64_t)it->second.size, std::memory_order_relaxed);
+			state.allocations.erase(it);
+		}
+	}
+	vkFreeMemory(device, memory, nullptr);
+}
+
+void MemoryTracker::QueryDeviceBudget(VkPhysicalDevice physicalDevice, bool memoryBudgetEnabled)
+{
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+	budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+	VkPhysicalDeviceMemoryProperties2 props = {};
+	props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	props.pNext = memoryBudgetEnabled ? &budget : nullptr;
+	vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &props);
+
+	std::vector<DeviceHeapBudget> heaps;
+	for (uint32_t i = 0; i < props.memoryProperties.memoryHeapCount; i++)
+	{
+		DeviceHeapBudget heap;
+		heap.size = props.memoryProperties.memoryHeaps[i].size;
+		heap.budget = memoryBudgetEnabled ? budget.heapBudget[i] : heap.size;
+		heap.usage = memoryBudgetEnabled ? budget.heapUsage[i] : 0;
+		heap.deviceLocal = (props.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+		heaps.push_back(heap);
+	}
+
+	DeviceState &state = Device();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	state.heaps.swap(heaps);
+}
+
+void MemoryTracker::EndFrame()
+{
+	for (int i = 0; i < MEMTAG_COUNT; i++)
+	{
+		for (TagCounters *counters : { &hostCounters[i], &deviceCounters[i] })
+		{
+			int64_t current = counters->current.load(std::memory_order_relaxed);
+			counters->frameDelta = current - counters->frameStart;
+			counters->frameStart = current;
+		}
+	}
+}
+
+MemoryTagStats MemoryTracker::GetHostStats(MemoryTag tag)
+{
+	return ToStats(hostCounters[tag]);
+}
+
+MemoryTagStats MemoryTracker::GetDeviceStats(MemoryTag tag)
+{
+	return ToStats(deviceCounters[tag]);
+}
+
+int64_t MemoryTracker::GetHostTotal()
+{
+	return hostTotal.load(std::memory_order_relaxed);
+}
+
+int64_t MemoryTracker::GetHostPeak()
+{
+	return hostPeak.load(std::memory_order_relaxed);
+}
+
+void MemoryTracker::LogSummary()
+{
+	std::ostringstream out;
+	out << "Memory: host " << FormatBytes(GetHostTotal()) << " (peak " << FormatBytes(GetHostPeak()) << ")" << std::endl;
+	out << std::left << "  " << std::setw(10) << "tag" << std::setw(12) << "host" << std::setw(12) << "host peak"
+		<< std::setw(12) << "frame delta" << std::setw(12) << "device" << std::setw(12) << "device peak" << std::endl;
+	for (int i = 0; i < MEMTAG_COUNT; i++)
+	{
+		MemoryTagStats host = GetHostStats((MemoryTag)i);
+		MemoryTagStats device = GetDeviceStats((MemoryTag)i);
+		if (host.peakBytes == 0 && device.peakBytes == 0)
+			continue;
+		out << "  " << std::setw(10) << GetTagName((MemoryTag)i) << std::setw(12) << FormatBytes(host.currentBytes)
+			<< std::setw(12) << FormatBytes(host.peakBytes) << std::setw(12) << FormatBytes(host.frameDeltaBytes + device.frameDeltaBytes)
+			<< std::setw(12) << FormatBytes(device.currentBytes) << std::setw(12) << FormatBytes(device.peakBytes) << std::endl;
+	}
+
+	DeviceState &state = Device();
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		for (size_t i = 0; i < state.heaps.size(); i++)
+		{
+			const DeviceHeapBudget &heap = state.heaps[i];
+			out << "  heap " << i << (heap.deviceLocal ? " (device local)" : "") << ": usage " << FormatBytes((int64_t)heap.usage)
+				<< " of budget " << FormatBytes((int64_t)heap.budget) << ", size " << FormatBytes((int64_t)heap.size) << std::endl;
+		}
+	}
+	Log::WriteLines(LOG_LEVEL_INFO, LOG_CATEGORY_MEMORY, out.str());
+}
+
+std::string MemoryTracker::ExportJson()
+{
+	std::ostringstream out;
+	out << "{\"host\":{\"currentBytes\":" << GetHostTotal() << ",\"peakBytes\":" << GetHostPeak() << ",\"tags\":{";
+	for (int i = 0; i < MEMTAG_COUNT; i++)
+	{
+		MemoryTagStats stats = GetHostStats((MemoryTag)i);
+		out << (i ? "," : "") << "\"" << GetTagName((MemoryTag)i) << "\":{\"currentBytes\":" << stats.currentBytes
+			<< ",\"peakBytes\":" << stats.peakBytes << ",\"frameDeltaBytes\":" << stats.frameDeltaBytes
+			<< ",\"allocations\":" << stats.allocations << "}";
+	}
+	out << "}},\"device\":{\"tags\":{";
+	for (int i = 0; i < MEMTAG_COUNT; i++)
+	{
+		MemoryTagStats stats = GetDeviceStats((MemoryTag)i);
+		out << (i ? "," : "") << "\"" << GetTagName((MemoryTag)i) << "\":{\"currentBytes\":" << stats.currentBytes
+			<< ",\"peakBytes\":" << stats.peakBytes << ",\"frameDeltaBytes\":" << stats.frameDeltaBytes
+			<< ",\"allocations\":" << stats.allocations << "}";
+	}
+	out << "},\"heaps\":[";
+	DeviceState &state = Device();
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		for (size_t i = 0; i < state.heaps.size(); i++)
+		{
+			const DeviceHeapBudget &heap = state.heaps[i];
+			out << (i ? "," : "") << "{\"size\":" << heap.size << ",\"budget\":" << heap.budget << ",\"usage\":" << heap.usage
+				<< ",\"deviceLocal\":" << (heap.deviceLocal ? "true" : "false") << "}";
+		}
+	}
+	out << "]}}";
+	return out.str();
+}
+
+bool MemoryTracker::WriteJson(const std::string &path)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	file << ExportJson();
+	return (bool)file;
+}
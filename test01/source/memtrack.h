@@ -0,0 +1,85 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vulkan/vulkan.h>
+
+enum MemoryTag
+{
+	MEMTAG_UNTAGGED,
+	MEMTAG_VULKAN,
+	MEMTAG_PIPELINES,
+	MEMTAG_PROFILER,
+	MEMTAG_RENDERER,
+	MEMTAG_ASSETS,
+	MEMTAG_STREAMING,
+	MEMTAG_CAPTURE,
+	MEMTAG_LOGGING,
+	MEMTAG_COUNT
+};
+
+struct MemoryTagStats
+{
+	int64_t currentBytes;
+	int64_t peakBytes;
+	int64_t frameDeltaBytes;
+	uint64_t allocations;
+};
+
+struct DeviceHeapBudget
+{
+	uint64_t size;
+	uint64_t budget;
+	uint64_t usage;
+	bool deviceLocal;
+};
+
+// Host and device memory accounting broken down by MemoryTag. Host numbers come
+// from the global operator new/delete hooks in memhooks.cpp, which are only
+// linked into Vulkan01; without them host counters stay at zero. Device
+// numbers come from allocations made through AllocateDeviceMemory.
+class MemoryTracker
+{
+public:
+	static const char *GetTagName(MemoryTag tag);
+
+	static MemoryTag GetThreadTag();
+	static void SetThreadTag(MemoryTag tag);
+
+	// Called by the allocation hooks.
+	static void OnHostAlloc(MemoryTag tag, size_t size);
+	static void OnHostFree(MemoryTag tag, size_t size);
+
+	static VkResult AllocateDeviceMemory(VkDevice device, const VkMemoryAllocateInfo &info, MemoryTag tag, VkDeviceMemory *memory);
+	static void FreeDeviceMemory(VkDevice device, VkDeviceMemory memory);
+
+	// Heap budgets and usage from VK_EXT_memory_budget, or heap sizes only
+	// when the extension is not enabled.
+	static void QueryDeviceBudget(VkPhysicalDevice physicalDevice, bool memoryBudgetEnabled);
+
+	// Snapshots the counters so the next summary reports per-frame deltas.
+	static void EndFrame();
+
+	static MemoryTagStats GetHostStats(MemoryTag tag);
+	static MemoryTagStats GetDeviceStats(MemoryTag tag);
+	static int64_t GetHostTotal();
+	static int64_t GetHostPeak();
+
+	static void LogSummary();
+	static std::string ExportJson();
+	static bool WriteJson(const std::string &path);
+};
+
+class MemoryTagScope
+{
+public:
+	explicit MemoryTagScope(MemoryTag tag) : previous(MemoryTracker::GetThreadTag()) { MemoryTracker::SetThreadTag(tag); }
+	~MemoryTagScope() { MemoryTracker::SetThreadTag(previous); }
+
+private:
+	MemoryTag previous;
+};
+
+#define MEMORY_TAG_CONCAT_INNER(a, b) a##b
+#define MEMORY_TAG_CONCAT(a, b) MEMORY_TAG_CONCAT_INNER(a, b)
+#define MEMORY_TAG(tag) MemoryTagScope MEMORY_TAG_CONCAT(memoryTag, __LINE__)(tag)
@@ -0,0 +1,280 @@
+#include "mesh.h"
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <unordered_map>
+#include "meshoptimize.h"
+
+void Mesh::ComputeBounds(Vec3 &minimum, Vec3 &maximum) const
+{
+	minimum = Vec3(1e30f, 1e30f, 1e30f);
+	maximum = Vec3(-1e30f, -1e30f, -1e30f);
+	for (const Vertex &vertex : vertices)
+	{
+		Vec3 p(vertex.position[0], vertex.position[1], vertex.position[2]);
+		minimum = Min(minimum, p);
+		maximum = Max(maximum, p);
+	}
+}
+
+namespace
+{
+	struct ObjParser
+	{
+		const char *cursor;
+		const char *end;
+
+		bool AtLineEnd() const { return cursor >= end || *cursor == '\n' || *cursor == '\r' || *cursor == '#'; }
+
+		void SkipSpaces()
+		{
+			while (cursor < end && (*cursor == ' ' || *cursor == '\t'))
+				cursor++;
+		}
+
+		void SkipLine()
+		{
+			while (cursor < end && *cursor != '\n')
+				cursor++;
+			if (cursor < end)
+				cursor++;
+		}
+
+		float ReadFloat()
+		{
+			SkipSpaces();
+			char *next = nullptr;
+			float value = strtof(cursor, &next);
+			cursor = next > cursor ? next : cursor;
+			return value;
+		}
+
+		// Reads an OBJ index (1-based, negative meaning relative to the end)
+		// and converts it to 0-based; -1 when absent.
+		int ReadIndex(size_t count)
+		{
+			if (cursor >= end || !(*cursor == '-' || (*cursor >= '0' && *cursor <= '9')))
+				return -1;
+			char *next = nullptr;
+			long value = strtol(cursor, &next, 10);
+			cursor = next;
+			return value < 0 ? (int)count + (int)value : (int)value - 1;
+		}
+	};
+
+	struct VertexKey
+	{
+		int position, uv, normal;
+		bool operator==(const VertexKey &o) const { return position == o.position && uv == o.uv && normal == o.normal; }
+	};
+
+	struct VertexKeyHash
+	{
+		size_t operator()(const VertexKey &key) const
+		{
+			return (size_t)key.position * 73856093u ^ (size_t)key.uv * 19349663u ^ (size_t)key.normal * 83492791u;
+		}
+	};
+}
+
+bool ParseObj(const char *text, size_t length, Mesh &mesh)
+{
+	std::vector<Vec3> positions, normals;
+	std::vector<float> uvs;
+	std::unordered_map<VertexKey, uint32_t, VertexKeyHash> vertexMap;
+	std::vector<uint32_t> face;
+
+	mesh.vertices.clear();
+	mesh.indices.clear();
+
+	ObjParser parser = { text, text + length };
+	while (parser.cursor < parser.end)
+	{
+		parser.SkipSpaces();
+		const char *line = parser.cursor;
+		if (parser.end - line >= 2 && line[0] == 'v' && line[1] == ' ')
+		{
+			parser.cursor += 2;
+			float x = parser.ReadFloat(), y = parser.ReadFloat(), z = parser.ReadFloat();
+			positions.push_back(Vec3(x, y, z));
+		}
+		else if (parser.end - line >= 3 && line[0] == 'v' && line[1] == 'n' && line[2] == ' ')
+		{
+			parser.cursor += 3;
+			float x = parser.ReadFloat(), y = parser.ReadFloat(), z = parser.ReadFloat();
+			normals.push_back(Vec3(x, y, z));
+		}
+		else if (parser.end - line >= 3 && line[0] == 'v' && line[1] == 't' && line[2] == ' ')
+		{
+			parser.cursor += 3;
+			uvs.push_back(parser.ReadFloat());
+			uvs.push_back(parser.ReadFloat());
+		}
+		else if (parser.end - line >= 2 && line[0] == 'f' && line[1] == ' ')
+		{
+			parser.cursor += 2;
+			face.clear();
+			for (;;)
+			{
+				parser.SkipSpaces();
+				if (parser.AtLineEnd())
+					break;
+
+				VertexKey key;
+				key.position = parser.ReadIndex(positions.size());
+				key.uv = -1;
+				key.normal = -1;
+				if (parser.cursor < parser.end && *parser.cursor == '/')
+				{
+					parser.cursor++;
+					key.uv = parser.ReadIndex(uvs.size() / 2);
+					if (parser.cursor < parser.end && *parser.cursor == '/')
+					{
+						parser.cursor++;
+						key.normal = parser.ReadIndex(normals.size());
+					}
+				}
+				if (key.position < 0 || key.position >= (int)positions.size() ||
+					key.uv >= (int)(uvs.size() / 2) || key.normal >= (int)normals.size())
+					return false;
+
+				auto it = vertexMap.find(key);
+				if (it == vertexMap.end())
+				{
+					Vertex vertex = {};
+					const Vec3 &p = positions[key.position];
+					vertex.position[0] = p.x;
+					vertex.position[1] = p.y;
+					vertex.position[2] = p.z;
+					if (key.normal >= 0)
+					{
+						vertex.normal[0] = normals[key.normal].x;
+						vertex.normal[1] = normals[key.normal].y;
+						vertex.normal[2] = normals[key.normal].z;
+					}
+					if (key.uv >= 0)
+					{
+						vertex.uv[0] = uvs[key.uv * 2];
+						vertex.uv[1] = uvs[key.uv * 2 + 1];
+					}
+					it = vertexMap.emplace(key, (uint32_t)mesh.vertices.size()).first;
+					mesh.vertices.push_back(vertex);
+				}
+				face.push_back(it->second);
+
+				while (parser.cursor < parser.end && !parser.AtLineEnd() && *parser.cursor != ' ' && *parser.cursor != '\t')
+					parser.cursor++;
+			}
+			for (size_t i = 2; i < face.size(); i++)
+			{
+				mesh.indices.push_back(face[0]);
+				mesh.indices.push_back(face[i - 1]);
+				mesh.indices.push_back(face[i]);
+			}
+		}
+		parser.SkipLine();
+	}
+	return !mesh.indices.empty();
+}
+
+bool LoadObj(const std::string &path, Mesh &mesh)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	std::string text = buffer.str();
+	if (!ParseObj(text.data(), text.size(), mesh))
+		return false;
+	OptimizeMesh(mesh);
+	return true;
+}
+
+std::string WriteObj(const Mesh &mesh)
+{
+	std::ostringstream out;
+	out.precision(6);
+	for (const Vertex &v : mesh.vertices)
+		out << "v " << v.position[0] << " " << v.position[1] << " " << v.position[2] << "\n";
+	for (const Vertex &v : mesh.vertices)
+		out << "vt " << v.uv[0] << " " << v.uv[1] << "\n";
+	for (const Vertex &v : mesh.vertices)
+		out << "vn " << v.normal[0] << " " << v.normal[1] << " " << v.normal[2] << "\n";
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		out << "f";
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t index = mesh.indices[i + k] + 1;
+			out << " " << index << "/" << index << "/" << index;
+		}
+		out << "\n";
+	}
+	return out.str();
+}
+
+Mesh GenerateSphere(uint32_t rings, uint32_t segments, float radius)
+{
+	const float pi = 3.14159265358979f;
+	Mesh mesh;
+	for (uint32_t ring = 0; ring <= rings; ring++)
+	{
+		float v = (float)ring / rings;
+		float phi = v * pi;
+		for (uint32_t segment = 0; segment <= segments; segment++)
+		{
+			float u = (float)segment / segments;
+			float theta = u * 2.0f * pi;
+			Vec3 n(sinf(phi) * cosf(theta), cosf(phi), sinf(phi) * sinf(theta));
+			Vertex vertex;
+			vertex.position[0] = n.x * radius;
+			vertex.position[1] = n.y * radius;
+			vertex.position[2] = n.z * radius;
+			vertex.normal[0] = n.x;
+			vertex.normal[1] = n.y;
+			vertex.normal[2] = n.z;
+			vertex.uv[0] = u;
+			vertex.uv[1] = v;
+			mesh.vertices.push_back(vertex);
+		}
+	}
+	for (uint32_t ring = 0; ring < rings; ring++)
+	{
+		for (uint32_t segment = 0; segment < segments; segment++)
+		{
+			uint32_t a = ring * (segments + 1) + segment;
+			uint32_t b = a + segments + 1;
+			mesh.indices.insert(mesh.indices.end(), { a, a + 1, b, a + 1, b + 1, b });
+		}
+	}
+	return mesh;
+}
+
+Mesh GenerateGrid(uint32_t columns, uint32_t rows, float size)
+{
+	Mesh mesh;
+	for (uint32_t y = 0; y <= rows; y++)
+	{
+		for (uint32_t x = 0; x <= columns; x++)
+		{
+			Vertex vertex = {};
+			vertex.uv[0] = (float)x / columns;
+			vertex.uv[1] = (float)y / rows;
+			vertex.position[0] = (vertex.uv[0] - 0.5f) * size;
+			vertex.position[2] = (vertex.uv[1] - 0.5f) * size;
+			vertex.normal[1] = 1.0f;
+			mesh.vertices.push_back(vertex);
+		}
+	}
+	for (uint32_t y = 0; y < rows; y++)
+	{
+		for (uint32_t x = 0; x < columns; x++)
+		{
+			uint32_t a = y * (columns + 1) + x;
+			uint32_t b = a + columns + 1;
+			mesh.indices.insert(mesh.indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+		}
+	}
+	return mesh;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "mathutil.h"
+
+struct Vertex
+{
+	float position[3];
+	float normal[3];
+	float uv[2];
+};
+
+struct Mesh
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+
+	size_t GetTriangleCount() const { return indices.size() / 3; }
+	void ComputeBounds(Vec3 &minimum, Vec3 &maximum) const;
+};
+
+// Wavefront OBJ subset: v, vn, vt and polygonal f records (triangulated as
+// fans). Identical position/uv/normal tuples are merged into one vertex.
+bool ParseObj(const char *text, size_t length, Mesh &mesh);
+// Import path: parses, then reorders for the vertex cache, overdraw and
+// vertex fetch (OptimizeMesh).
+bool LoadObj(const std::string &path, Mesh &mesh);
+std::string WriteObj(const Mesh &mesh);
+
+Mesh GenerateSphere(uint32_t rings, uint32_t segments, float radius);
+Mesh GenerateGrid(uint32_t columns, uint32_t rows, float size);
@@ -0,0 +1,599 @@
+#include "meshcodec.h"
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include "profiler.h"
+#include "threadpool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_CODEC_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MESH_CODEC_NEON 1
+#include <arm_neon.h>
+#endif
+
+static const uint32_t STREAM_MAGIC = 0x3143534d;	// "MSC1"
+static const size_t BLOCK_BYTES = 64 * 1024;
+static const uint32_t BLOCK_STORED = 0x80000000u;
+static const size_t LZ_MIN_MATCH = 4;
+static const uint32_t LZ_HASH_BITS = 14;
+// Widest element the SIMD unfilter keeps running sums for, in 16-byte chunks.
+static const size_t SIMD_MAX_CHUNKS = 16;
+
+namespace
+{
+	// Little endian on every target we build for, so it is copied as is.
+	struct StreamHeader
+	{
+		uint32_t magic;
+		uint32_t count;
+		uint16_t stride;
+		uint8_t laneSize;
+		uint8_t reserved;
+		uint32_t blockElements;
+	};
+
+	static_assert(sizeof(StreamHeader) == 16, "stream header is 16 bytes");
+
+	struct BlockRef
+	{
+		size_t offset;
+		uint32_t sizeWord;
+	};
+
+	template <typename T>
+	T LoadLane(const uint8_t *p)
+	{
+		T value;
+		memcpy(&value, p, sizeof(T));
+		return value;
+	}
+
+	template <typename T>
+	void StoreLane(uint8_t *p, T value)
+	{
+		memcpy(p, &value, sizeof(T));
+	}
+
+	template <typename T>
+	void FilterBlock(const uint8_t *elements, size_t count, size_t stride, uint8_t *planes)
+	{
+		const uint32_t bits = sizeof(T) * 8;
+		size_t lanes = stride / sizeof(T);
+		size_t laneCount = count * lanes;
+		for (size_t e = 0; e < count; e++)
+		{
+			for (size_t l = 0; l < lanes; l++)
+			{
+				const uint8_t *p = elements + e * stride + l * sizeof(T);
+				T previous = e ? LoadLane<T>(p - stride) : 0;
+				T delta = (T)(LoadLane<T>(p) - previous);
+				T zigzag = (T)((T)(delta << 1) ^ (T)(0 - (T)(delta >> (bits - 1))));
+				size_t lane = e * lanes + l;
+				for (size_t b = 0; b < sizeof(T); b++)
+					planes[b * laneCount + lane] = (uint8_t)(zigzag >> (8 * b));
+			}
+		}
+	}
+
+	// Elements from firstElement on, each summed onto the one before it in
+	// elements.
+	template <typename T>
+	void UnfilterScalar(const uint8_t *planes, size_t count, size_t stride, size_t firstElement, uint8_t *elements)
+	{
+		size_t lanes = stride / sizeof(T);
+		size_t laneCount = count * lanes;
+		for (size_t e = firstElement; e < count; e++)
+		{
+			for (size_t l = 0; l < lanes; l++)
+			{
+				size_t lane = e * lanes + l;
+				T zigzag = 0;
+				for (size_t b = 0; b < sizeof(T); b++)
+					zigzag |= (T)(planes[b * laneCount + lane] << (8 * b));
+				T delta = (T)((T)(zigzag >> 1) ^ (T)(0 - (T)(zigzag & 1)));
+				uint8_t *p = elements + e * stride + l * sizeof(T);
+				T previous = e ? LoadLane<T>(p - stride) : 0;
+				StoreLane<T>(p, (T)(previous + delta));
+			}
+		}
+	}
+
+	size_t GreatestCommonDivisor(size_t a, size_t b)
+	{
+		while (b)
+		{
+			size_t t = a % b;
+			a = b;
+			b = t;
+		}
+		return a;
+	}
+
+#if MESH_CODEC_SSE2
+	inline __m128i ZigzagDecode32(__m128i z)
+	{
+		return _mm_xor_si128(_mm_srli_epi32(z, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(z, _mm_set1_epi32(1))));
+	}
+
+	inline __m128i ZigzagDecode16(__m128i z)
+	{
+		return _mm_xor_si128(_mm_srli_epi16(z, 1), _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(z, _mm_set1_epi16(1))));
+	}
+
+	// 16 lanes from the byte planes, back in lane order, as 16-byte chunks.
+	inline void LoadLanes32(const uint8_t *planes, size_t laneCount, size_t lane, __m128i *chunks)
+	{
+		__m128i p0 = _mm_loadu_si128((const __m128i *)(planes + lane));
+		__m128i p1 = _mm_loadu_si128((const __m128i *)(planes + laneCount + lane));
+		__m128i p2 = _mm_loadu_si128((const __m128i *)(planes + 2 * laneCount + lane));
+		__m128i p3 = _mm_loadu_si128((const __m128i *)(planes + 3 * laneCount + lane));
+		__m128i low01 = _mm_unpacklo_epi8(p0, p1), high01 = _mm_unpackhi_epi8(p0, p1);
+		__m128i low23 = _mm_unpacklo_epi8(p2, p3), high23 = _mm_unpackhi_epi8(p2, p3);
+		chunks[0] = ZigzagDecode32(_mm_unpacklo_epi16(low01, low23));
+		chunks[1] = ZigzagDecode32(_mm_unpackhi_epi16(low01, low23));
+		chunks[2] = ZigzagDecode32(_mm_unpacklo_epi16(high01, high23));
+		chunks[3] = ZigzagDecode32(_mm_unpackhi_epi16(high01, high23));
+	}
+
+	inline void LoadLanes16(const uint8_t *planes, size_t laneCount, size_t lane, __m128i *chunks)
+	{
+		__m128i p0 = _mm_loadu_si128((const __m128i *)(planes + lane));
+		__m128i p1 = _mm_loadu_si128((const __m128i *)(planes + laneCount + lane));
+		chunks[0] = ZigzagDecode16(_mm_unpacklo_epi8(p0, p1));
+		chunks[1] = ZigzagDecode16(_mm_unpackhi_epi8(p0, p1));
+	}
+
+	// Returns the first element left for the scalar loop.
+	size_t UnfilterSimd(const uint8_t *planes, size_t count, size_t stride, size_t laneSize, uint8_t *elements)
+	{
+		size_t laneCount = count * stride / laneSize;
+		if (laneSize == 4 && stride == 4)
+		{
+			// One lane per element: a running sum across the register.
+			__m128i carry = _mm_setzero_si128();
+			size_t lane = 0;
+			for (; lane + 16 <= laneCount; lane += 16)
+			{
+				__m128i chunks[4];
+				LoadLanes32(planes, laneCount, lane, chunks);
+				for (int k = 0; k < 4; k++)
+				{
+					__m128i sum = chunks[k];
+					sum = _mm_add_epi32(sum, _mm_slli_si128(sum, 4));
+					sum = _mm_add_epi32(sum, _mm_slli_si128(sum, 8));
+					sum = _mm_add_epi32(sum, carry);
+					_mm_storeu_si128((__m128i *)(elements + (lane + k * 4) * 4), sum);
+					carry = _mm_shuffle_epi32(sum, 0xff);
+				}
+			}
+			return lane;
+		}
+
+		// Whole chunks per element: one running sum per chunk position.
+		size_t chunkCount = stride / 16;
+		if (stride % 16 != 0 || chunkCount > SIMD_MAX_CHUNKS)
+			return 0;
+		size_t groupBytes = laneSize * 16;
+		size_t period = groupBytes / GreatestCommonDivisor(groupBytes, stride) * stride;
+		size_t simdBytes = count * stride / period * period;
+		__m128i sums[SIMD_MAX_CHUNKS];
+		for (size_t c = 0; c < chunkCount; c++)
+			sums[c] = _mm_setzero_si128();
+		size_t chunk = 0;
+		for (size_t offset = 0; offset < simdBytes; offset += groupBytes)
+		{
+			__m128i chunks[4];
+			int chunksPerGroup = laneSize == 4 ? 4 : 2;
+			if (laneSize == 4)
+				LoadLanes32(planes, laneCount, offset / 4, chunks);
+			else
+				LoadLanes16(planes, laneCount, offset / 2, chunks);
+			for (int k = 0; k < chunksPerGroup; k++)
+			{
+				sums[chunk] = laneSize == 4 ? _mm_add_epi32(sums[chunk], chunks[k]) : _mm_add_epi16(sums[chunk], chunks[k]);
+				_mm_storeu_si128((__m128i *)(elements + offset + k * 16), sums[chunk]);
+				if (++chunk == chunkCount)
+					chunk = 0;
+			}
+		}
+		return simdBytes / stride;
+	}
+#elif MESH_CODEC_NEON
+	inline uint32x4_t ZigzagDecode32(uint32x4_t z)
+	{
+		int32x4_t sign = vnegq_s32(vreinterpretq_s32_u32(vandq_u32(z, vdupq_n_u32(1))));
+		return veorq_u32(vshrq_n_u32(z, 1), vreinterpretq_u32_s32(sign));
+	}
+
+	inline uint16x8_t ZigzagDecode16(uint16x8_t z)
+	{
+		int16x8_t sign = vnegq_s16(vreinterpretq_s16_u16(vandq_u16(z, vdupq_n_u16(1))));
+		return veorq_u16(vshrq_n_u16(z, 1), vreinterpretq_u16_s16(sign));
+	}
+
+	inline void LoadLanes32(const uint8_t *planes, size_t laneCount, size_t lane, uint32x4_t *chunks)
+	{
+		uint8x16x2_t zip01 = vzipq_u8(vld1q_u8(planes + lane), vld1q_u8(planes + laneCount + lane));
+		uint8x16x2_t zip23 = vzipq_u8(vld1q_u8(planes + 2 * laneCount + lane), vld1q_u8(planes + 3 * laneCount + lane));
+		uint16x8x2_t low = vzipq_u16(vreinterpretq_u16_u8(zip01.val[0]), vreinterpretq_u16_u8(zip23.val[0]));
+		uint16x8x2_t high = vzipq_u16(vreinterpretq_u16_u8(zip01.val[1]), vreinterpretq_u16_u8(zip23.val[1]));
+		chunks[0] = ZigzagDecode32(vreinterpretq_u32_u16(low.val[0]));
+		chunks[1] = ZigzagDecode32(vreinterpretq_u32_u16(low.val[1]));
+		chunks[2] = ZigzagDecode32(vreinterpretq_u32_u16(high.val[0]));
+		chunks[3] = ZigzagDecode32(vreinterpretq_u32_u16(high.val[1]));
+	}
+
+	inline void LoadLanes16(const uint8_t *planes, size_t laneCount, size_t lane, uint16x8_t *chunks)
+	{
+		uint8x16x2_t zip = vzipq_u8(vld1q_u8(planes + lane), vld1q_u8(planes + laneCount + lane));
+		chunks[0] = ZigzagDecode16(vreinterpretq_u16_u8(zip.val[0]));
+		chunks[1] = ZigzagDecode16(vreinterpretq_u16_u8(zip.val[1]));
+	}
+
+	size_t UnfilterSimd(const uint8_t *planes, size_t count, size_t stride, size_t laneSize, uint8_t *elements)
+	{
+		size_t laneCount = count * stride / laneSize;
+		if (laneSize == 4 && stride == 4)
+		{
+			uint32x4_t zero = vdupq_n_u32(0);
+			uint32x4_t carry = zero;
+			size_t lane = 0;
+			for (; lane + 16 <= laneCount; lane += 16)
+			{
+				uint32x4_t chunks[4];
+				LoadLanes32(planes, laneCount, lane, chunks);
+				for (int k = 0; k < 4; k++)
+				{
+					uint32x4_t sum = chunks[k];
+					sum = vaddq_u32(sum, vextq_u32(zero, sum, 3));
+					sum = vaddq_u32(sum, vextq_u32(zero, sum, 2));
+					sum = vaddq_u32(sum, carry);
+					vst1q_u32((uint32_t *)(elements + (lane + k * 4) * 4), sum);
+					carry = vdupq_n_u32(vgetq_lane_u32(sum, 3));
+				}
+			}
+			return lane;
+		}
+
+		size_t chunkCount = stride / 16;
+		if (stride % 16 != 0 || chunkCount > SIMD_MAX_CHUNKS)
+			return 0;
+		size_t groupBytes = laneSize * 16;
+		size_t period = groupBytes / GreatestCommonDivisor(groupBytes, stride) * stride;
+		size_t simdBytes = count * stride / period * period;
+		uint8x16_t sums[SIMD_MAX_CHUNKS];
+		for (size_t c = 0; c < chunkCount; c++)
+			sums[c] = vdupq_n_u8(0);
+		size_t chunk = 0;
+		for (size_t offset = 0; offset < simdBytes; offset += groupBytes)
+		{
+			if (laneSize == 4)
+			{
+				uint32x4_t chunks[4];
+				LoadLanes32(planes, laneCount, offset / 4, chunks);
+				for (int k = 0; k < 4; k++)
+				{
+					sums[chunk] = vreinterpretq_u8_u32(vaddq_u32(vreinterpretq_u32_u8(sums[chunk]), chunks[k]));
+					vst1q_u8(elements + offset + k * 16, sums[chunk]);
+					if (++chunk == chunkCount)
+						chunk = 0;
+				}
+			}
+			else
+			{
+				uint16x8_t chunks[2];
+				LoadLanes16(planes, laneCount, offset / 2, chunks);
+				for (int k = 0; k < 2; k++)
+				{
+					sums[chunk] = vreinterpretq_u8_u16(vaddq_u16(vreinterpretq_u16_u8(sums[chunk]), chunks[k]));
+					vst1q_u8(elements + offset + k * 16, sums[chunk]);
+					if (++chunk == chunkCount)
+						chunk = 0;
+				}
+			}
+		}
+		return simdBytes / stride;
+	}
+#endif
+
+	bool ReadHeader(const uint8_t *data, size_t size, StreamHeader &header)
+	{
+		if (size < sizeof(StreamHeader))
+			return false;
+		memcpy(&header, data, sizeof(header));
+		return header.magic == STREAM_MAGIC && (header.laneSize == 2 || header.laneSize == 4) && header.stride > 0 &&
+			header.stride % header.laneSize == 0 && header.blockElements > 0;
+	}
+
+	bool DecodeBlock(const uint8_t *payload, uint32_t sizeWord, const StreamHeader &header, size_t count,
+		uint8_t *destination, std::vector<uint8_t> &scratch, bool simd)
+	{
+		size_t planeBytes = count * header.stride;
+		size_t payloadSize = sizeWord & ~BLOCK_STORED;
+		const uint8_t *planes = payload;
+		if (sizeWord & BLOCK_STORED)
+		{
+			if (payloadSize != planeBytes)
+				return false;
+		}
+		else
+		{
+			scratch.resize(planeBytes + LZ_DECOMPRESS_SLACK);
+			if (!LzDecompress(payload, payloadSize, scratch.data(), planeBytes))
+				return false;
+			planes = scratch.data();
+		}
+
+		size_t first = 0;
+#if MESH_CODEC_SSE2 || MESH_CODEC_NEON
+		if (simd)
+			first = UnfilterSimd(planes, count, header.stride, header.laneSize, destination);
+#else
+		(void)simd;
+#endif
+		if (header.laneSize == 4)
+			UnfilterScalar<uint32_t>(planes, count, header.stride, first, destination);
+		else
+			UnfilterScalar<uint16_t>(planes, count, header.stride, first, destination);
+		return true;
+	}
+
+	bool Decode(const uint8_t *data, size_t size, void *destination, size_t destinationSize, ThreadPool *pool, bool simd)
+	{
+		PROFILE_FUNCTION();
+		StreamHeader header;
+		if (!ReadHeader(data, size, header) || (size_t)header.count * header.stride != destinationSize)
+			return false;
+
+		std::vector<BlockRef> blocks;
+		size_t offset = sizeof(StreamHeader);
+		for (size_t element = 0; element < header.count; element += header.blockElements)
+		{
+			if (size - offset < sizeof(uint32_t))
+				return false;
+			BlockRef block;
+			memcpy(&block.sizeWord, data + offset, sizeof(uint32_t));
+			block.offset = offset + sizeof(uint32_t);
+			offset = block.offset + (block.sizeWord & ~BLOCK_STORED);
+			if (offset > size)
+				return false;
+			blocks.push_back(block);
+		}
+		if (offset != size)
+			return false;
+
+		uint8_t *output = (uint8_t *)destination;
+		size_t blockBytes = (size_t)header.blockElements * header.stride;
+		auto decodeBlock = [&](size_t b, std::vector<uint8_t> &scratch)
+		{
+			size_t first = b * header.blockElements;
+			size_t count = std::min<size_t>(header.blockElements, header.count - first);
+			return DecodeBlock(data + blocks[b].offset, blocks[b].sizeWord, header, count, output + b * blockBytes, scratch, simd);
+		};
+
+		if (!pool || pool->GetWorkerCount() == 0 || blocks.size() < 2)
+		{
+			std::vector<uint8_t> scratch;
+			for (size_t b = 0; b < blocks.size(); b++)
+			{
+				if (!decodeBlock(b, scratch))
+					return false;
+			}
+			return true;
+		}
+
+		// One task per worker, each taking every workerCount-th block.
+		size_t taskCount = std::min<size_t>(pool->GetWorkerCount(), blocks.size());
+		std::atomic<bool> ok(true);
+		pool->Run((unsigned)taskCount, [&](unsigned t)
+		{
+			std::vector<uint8_t> scratch;
+			for (size_t b = t; b < blocks.size(); b += taskCount)
+			{
+				if (!decodeBlock(b, scratch))
+				{
+					ok.store(false);
+					return;
+				}
+			}
+		});
+		return ok.load();
+	}
+}
+
+void EncodeMeshStream(const void *data, size_t count, size_t stride, size_t laneSize, std::vector<uint8_t> &out)
+{
+	PROFILE_FUNCTION();
+	StreamHeader header = {};
+	header.magic = STREAM_MAGIC;
+	header.count = (uint32_t)count;
+	header.stride = (uint16_t)stride;
+	header.laneSize = (uint8_t)laneSize;
+	header.blockElements = (uint32_t)std::max<size_t>(1, BLOCK_BYTES / stride);
+	const uint8_t *headerBytes = (const uint8_t *)&header;
+	out.insert(out.end(), headerBytes, headerBytes + sizeof(header));
+
+	const uint8_t *elements = (const uint8_t *)data;
+	std::vector<uint8_t> planes;
+	std::vector<uint8_t> compressed;
+	for (size_t first = 0; first < count; first += header.blockElements)
+	{
+		size_t blockCount = std::min<size_t>(header.blockElements, count - first);
+		planes.resize(blockCount * stride);
+		if (laneSize == 4)
+			FilterBlock<uint32_t>(elements + first * stride, blockCount, stride, planes.data());
+		else
+			FilterBlock<uint16_t>(elements + first * stride, blockCount, stride, planes.data());
+
+		compressed.clear();
+		LzCompress(planes.data(), planes.size(), compressed);
+		bool stored = compressed.size() >= planes.size();
+		const std::vector<uint8_t> &payload = stored ? planes : compressed;
+		uint32_t sizeWord = (uint32_t)payload.size() | (stored ? BLOCK_STORED : 0);
+		const uint8_t *sizeBytes = (const uint8_t *)&sizeWord;
+		out.insert(out.end(), sizeBytes, sizeBytes + sizeof(sizeWord));
+		out.insert(out.end(), payload.begin(), payload.end());
+	}
+}
+
+size_t GetMeshStreamSize(const uint8_t *data, size_t size)
+{
+	StreamHeader header;
+	return ReadHeader(data, size, header) ? (size_t)header.count * header.stride : 0;
+}
+
+bool DecodeMeshStream(const uint8_t *data, size_t size, void *destination, size_t destinationSize, ThreadPool *pool)
+{
+	return Decode(data, size, destination, destinationSize, pool, true);
+}
+
+bool DecodeMeshStreamReference(const uint8_t *data, size_t size, void *destination, size_t destinationSize)
+{
+	return Decode(data, size, destination, destinationSize, nullptr, false);
+}
+
+void LzCompress(const uint8_t *data, size_t size, std::vector<uint8_t> &out)
+{
+	std::vector<int32_t> table(1u << LZ_HASH_BITS, -1);
+	size_t anchor = 0;
+
+	auto writeLength = [&](size_t length)
+	{
+		for (; length >= 255; length -= 255)
+			out.push_back(255);
+		out.push_back((uint8_t)length);
+	};
+	// Literals from anchor to literalEnd, then a match unless matchLength is
+	// 0, which only the final sequence has.
+	auto writeSequence = [&](size_t literalEnd, size_t matchLength, size_t offset)
+	{
+		size_t literals = literalEnd - anchor;
+		size_t matchCode = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+		out.push_back((uint8_t)((std::min<size_t>(literals, 15) << 4) | std::min<size_t>(matchCode, 15)));
+		if (literals >= 15)
+			writeLength(literals - 15);
+		out.insert(out.end(), data + anchor, data + literalEnd);
+		if (!matchLength)
+			return;
+		out.push_back((uint8_t)offset);
+		out.push_back((uint8_t)(offset >> 8));
+		if (matchCode >= 15)
+			writeLength(matchCode - 15);
+	};
+
+	size_t position = 0;
+	uint32_t misses = 0;
+	while (position + LZ_MIN_MATCH <= size)
+	{
+		uint32_t sequence;
+		memcpy(&sequence, data + position, sizeof(sequence));
+		uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+		int32_t candidate = table[hash];
+		table[hash] = (int32_t)position;
+		if (candidate < 0 || position - candidate > 65535 || memcmp(data + candidate, data + position, LZ_MIN_MATCH) != 0)
+		{
+			// Skip faster through data that does not compress.
+			position += 1 + (misses++ >> 6);
+			continue;
+		}
+		misses = 0;
+		size_t length = LZ_MIN_MATCH;
+		while (position + length < size && data[candidate + length] == data[position + length])
+			length++;
+		writeSequence(position, length, position - candidate);
+		position += length;
+		anchor = position;
+		// Remember the end of the match too, or runs only ever find their start.
+		if (position + 2 <= size)
+		{
+			memcpy(&sequence, data + position - 2, sizeof(sequence));
+			table[(sequence * 2654435761u) >> (32 - LZ_HASH_BITS)] = (int32_t)(position - 2);
+		}
+	}
+	writeSequence(size, 0, 0);
+}
+
+bool LzDecompress(const uint8_t *data, size_t size, uint8_t *destination, size_t destinationSize)
+{
+	const uint8_t *input = data, *inputEnd = data + size;
+	uint8_t *output = destination, *outputEnd = destination + destinationSize;
+	auto readLength = [&](size_t &length)
+	{
+		uint8_t byte;
+		do
+		{
+			if (input >= inputEnd)
+				return false;
+			byte = *input++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	};
+
+	for (;;)
+	{
+		if (input >= inputEnd)
+			return false;
+		uint8_t token = *input++;
+		size_t literals = token >> 4;
+		if (literals == 15 && !readLength(literals))
+			return false;
+		if (literals > (size_t)(inputEnd - input) || literals > (size_t)(outputEnd - output))
+			return false;
+		// Short runs copy a fixed 16 bytes into the slack.
+		if (literals <= 16 && inputEnd - input >= 16)
+			memcpy(output, input, 16);
+		else
+			memcpy(output, input, literals);
+		input += literals;
+		output += literals;
+		if (input == inputEnd)
+			return output == outputEnd;
+
+		if (inputEnd - input < 2)
+			return false;
+		size_t offset = input[0] | (size_t)input[1] << 8;
+		input += 2;
+		size_t length = (token & 15) + LZ_MIN_MATCH;
+		if ((token & 15) == 15 && !readLength(length))
+			return false;
+		if (offset == 0 || offset > (size_t)(output - destination) || length > (size_t)(outputEnd - output))
+			return false;
+		const uint8_t *source = output - offset;
+		if (offset >= 16)
+		{
+			// Each 16-byte piece only reads bytes already written.
+			for (size_t i = 0; i < length; i += 16)
+				memcpy(output + i, source + i, 16);
+		}
+		else if (offset == 1)
+		{
+			// Runs of one byte, mostly the zero high-byte planes.
+			memset(output, source[0], length);
+		}
+		else if (offset >= 8)
+		{
+			for (size_t i = 0; i < length; i += 8)
+				memcpy(output + i, source + i, 8);
+		}
+		else
+		{
+			for (size_t i = 0; i < length; i++)
+				output[i] = source[i];
+		}
+		output += length;
+	}
+}
+
+const char *GetMeshCodecKernelName()
+{
+#if MESH_CODEC_SSE2
+	return "sse2";
+#elif MESH_CODEC_NEON
+	return "neon";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class ThreadPool;
+
+// Lossless compression for vertex and index buffers. Elements are split into
+// lanes of laneSize bytes (2 or 4); each lane is stored as the zigzagged
+// difference from the same lane of the previous element, and the bytes of
+// those differences are transposed into planes, so the mostly-zero high bytes
+// end up next to each other. An LZ4-style byte LZ then squeezes the planes.
+//
+// Streams are cut into independent blocks of about 64 KB of input, which
+// bounds the decoder's working set and lets blocks decode in parallel.
+// Layout (little endian):
+//   header: magic "MSC1", element count, stride (u16), lane size (u8), 0 (u8),
+//           elements per block
+//   blocks: u32 size, top bit set when the planes are stored uncompressed,
+//           then that many bytes
+//
+// stride must be a multiple of laneSize. Decoding uses SSE2 or NEON for the
+// unfiltering when stride is a multiple of 16 bytes, or a single 32-bit lane
+// such as an index buffer.
+void EncodeMeshStream(const void *data, size_t count, size_t stride, size_t laneSize, std::vector<uint8_t> &out);
+
+inline void EncodeIndexBuffer(const uint32_t *indices, size_t count, std::vector<uint8_t> &out)
+{
+	EncodeMeshStream(indices, count, sizeof(uint32_t), sizeof(uint32_t), out);
+}
+
+// Decoded size in bytes, or 0 if data does not start with a valid header.
+size_t GetMeshStreamSize(const uint8_t *data, size_t size);
+
+// Fails on any malformed or truncated input, and when destinationSize is not
+// the stream's decoded size. With a pool, blocks are spread across its workers
+// through ThreadPool::Run.
+bool DecodeMeshStream(const uint8_t *data, size_t size, void *destination, size_t destinationSize, ThreadPool *pool = nullptr);
+
+// Plain C++ version, for checking and measuring the SIMD path.
+bool DecodeMeshStreamReference(const uint8_t *data, size_t size, void *destination, size_t destinationSize);
+
+// The byte LZ on its own. LzDecompress needs destination to have
+// LZ_DECOMPRESS_SLACK writable bytes past destinationSize.
+static const size_t LZ_DECOMPRESS_SLACK = 32;
+void LzCompress(const uint8_t *data, size_t size, std::vector<uint8_t> &out);
+bool LzDecompress(const uint8_t *data, size_t size, uint8_t *destination, size_t destinationSize);
+
+// "sse2", "neon" or "scalar".
+const char *GetMeshCodecKernelName();
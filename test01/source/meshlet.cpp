@@ -0,0 +1,328 @@
+#include "meshlet.h"
+#include <algorithm>
+#include "perfcounters.h"
+
+static Vec3 GetPosition(const Mesh &mesh, uint32_t index)
+{
+	const float *p = mesh.vertices[index].position;
+	return Vec3(p[0], p[1], p[2]);
+}
+
+static int8_t QuantizeSnorm8(float value)
+{
+	float scaled = value * 127.0f;
+	return (int8_t)std::max(-127.0f, std::min(127.0f, scaled >= 0.0f ? scaled + 0.5f : scaled - 0.5f));
+}
+
+std::vector<uint32_t> MeshletMesh::BuildIndexBuffer() const
+{
+	std::vector<uint32_t> indices(triangles.size());
+	for (const Meshlet &meshlet : meshlets)
+	{
+		const uint8_t *local = &triangles[meshlet.triangleOffset * 3];
+		uint32_t *out = &indices[meshlet.triangleOffset * 3];
+		for (uint32_t i = 0; i < meshlet.triangleCount * 3u; i++)
+			out[i] = vertices[meshlet.vertexOffset + local[i]];
+	}
+	return indices;
+}
+
+namespace
+{
+	struct MeshletBuilder
+	{
+		const Mesh &mesh;
+		MeshletMesh &result;
+		uint32_t maxVertices;
+		uint32_t maxTriangles;
+
+		// Vertex to triangle adjacency in compressed rows, and how many of
+		// each vertex's triangles are still unassigned.
+		std::vector<uint32_t> adjacencyOffsets;
+		std::vector<uint32_t> adjacency;
+		std::vector<uint32_t> liveTriangles;
+		std::vector<uint8_t> emitted;
+		std::vector<Vec3> centroids;
+
+		// Current cluster. localIndex is 0xff for vertices not in it.
+		std::vector<uint8_t> localIndex;
+		std::vector<uint32_t> clusterVertices;
+		uint32_t clusterTriangles = 0;
+		Vec3 centroidSum;
+
+		MeshletBuilder(const Mesh &mesh, MeshletMesh &result, uint32_t maxVertices, uint32_t maxTriangles)
+			: mesh(mesh), result(result), maxVertices(maxVertices), maxTriangles(maxTriangles)
+		{
+			size_t vertexCount = mesh.vertices.size();
+			size_t triangleCount = mesh.GetTriangleCount();
+			adjacencyOffsets.assign(vertexCount + 1, 0);
+			for (uint32_t index : mesh.indices)
+				adjacencyOffsets[index + 1]++;
+			for (size_t i = 0; i < vertexCount; i++)
+				adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+			liveTriangles.resize(vertexCount);
+			for (size_t i = 0; i < vertexCount; i++)
+				liveTriangles[i] = adjacencyOffsets[i + 1] - adjacencyOffsets[i];
+
+			adjacency.resize(mesh.indices.size());
+			std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			centroids.resize(triangleCount);
+			for (uint32_t t = 0; t < triangleCount; t++)
+			{
+				const uint32_t *tri = &mesh.indices[t * 3];
+				for (int k = 0; k < 3; k++)
+					adjacency[cursor[tri[k]]++] = t;
+				centroids[t] = (GetPosition(mesh, tri[0]) + GetPosition(mesh, tri[1]) + GetPosition(mesh, tri[2])) * (1.0f / 3.0f);
+			}
+			emitted.assign(triangleCount, 0);
+			localIndex.assign(vertexCount, 0xff);
+		}
+
+		uint32_t CountNewVertices(uint32_t triangle) const
+		{
+			const uint32_t *tri = &mesh.indices[triangle * 3];
+			return (localIndex[tri[0]] == 0xff) + (localIndex[tri[1]] == 0xff) + (localIndex[tri[2]] == 0xff);
+		}
+
+		// Best unassigned triangle sharing a vertex with the cluster, or
+		// UINT32_MAX. Triangles that add no vertex come first; otherwise the
+		// closest to the cluster's centre wins, with distance scaled by how
+		// many unassigned triangles its vertices still have, so nearly
+		// enclosed triangles are mopped up rather than left as islands. Only
+		// border vertices still have live triangles, so this stays cheap as
+		// the cluster grows.
+		uint32_t FindCandidate() const
+		{
+			uint32_t best = UINT32_MAX;
+			bool bestFree = false;
+			float bestScore = 0.0f;
+			Vec3 center = centroidSum * (1.0f / (float)std::max(clusterTriangles, 1u));
+			for (uint32_t vertex : clusterVertices)
+			{
+				if (liveTriangles[vertex] == 0)
+					continue;
+				for (uint32_t i = adjacencyOffsets[vertex]; i < adjacencyOffsets[vertex + 1]; i++)
+				{
+					uint32_t triangle = adjacency[i];
+					if (emitted[triangle])
+						continue;
+					const uint32_t *tri = &mesh.indices[triangle * 3];
+					bool free = CountNewVertices(triangle) == 0;
+					uint32_t live = std::min(liveTriangles[tri[0]], std::min(liveTriangles[tri[1]], liveTriangles[tri[2]]));
+					Vec3 offset = centroids[triangle] - center;
+					float score = Dot(offset, offset) * (float)(live + 1);
+					if (best == UINT32_MAX || free > bestFree || (free == bestFree && score < bestScore))
+					{
+						best = triangle;
+						bestFree = free;
+						bestScore = score;
+					}
+				}
+			}
+			return best;
+		}
+
+		void Flush()
+		{
+			if (clusterTriangles == 0)
+				return;
+			Meshlet meshlet = {};
+			meshlet.vertexOffset = (uint32_t)result.vertices.size();
+			meshlet.triangleOffset = (uint32_t)(result.triangles.size() / 3) - clusterTriangles;
+			meshlet.vertexCount = (uint8_t)clusterVertices.size();
+			meshlet.triangleCount = (uint8_t)clusterTriangles;
+			result.meshlets.push_back(meshlet);
+			result.vertices.insert(result.vertices.end(), clusterVertices.begin(), clusterVertices.end());
+			for (uint32_t vertex : clusterVertices)
+				localIndex[vertex] = 0xff;
+			clusterVertices.clear();
+			clusterTriangles = 0;
+			centroidSum = Vec3();
+		}
+
+		void Add(uint32_t triangle)
+		{
+			if (clusterVertices.size() + CountNewVertices(triangle) > maxVertices || clusterTriangles + 1 > maxTriangles)
+				Flush();
+			const uint32_t *tri = &mesh.indices[triangle * 3];
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t vertex = tri[k];
+				if (localIndex[vertex] == 0xff)
+				{
+					localIndex[vertex] = (uint8_t)clusterVertices.size();
+					clusterVertices.push_back(vertex);
+				}
+				result.triangles.push_back(localIndex[vertex]);
+				liveTriangles[vertex]--;
+			}
+			emitted[triangle] = 1;
+			clusterTriangles++;
+			centroidSum += centroids[triangle];
+		}
+
+		void Run()
+		{
+			uint32_t triangleCount = (uint32_t)emitted.size();
+			uint32_t seed = 0;
+			for (;;)
+			{
+				uint32_t triangle = FindCandidate();
+				if (triangle == UINT32_MAX)
+				{
+					// Nothing connected is left: close the cluster and start the
+					// next one from the first unassigned triangle.
+					Flush();
+					while (seed < triangleCount && emitted[seed])
+						seed++;
+					if (seed == triangleCount)
+						break;
+					triangle = seed;
+				}
+				Add(triangle);
+			}
+		}
+	};
+}
+
+void BuildMeshlets(const Mesh &mesh, MeshletMesh &result, uint32_t maxVertices, uint32_t maxTriangles)
+{
+	maxVertices = std::max(3u, std::min(maxVertices, 255u));
+	maxTriangles = std::max(1u, std::min(maxTriangles, 255u));
+	result = MeshletMesh();
+	result.triangles.reserve(mesh.indices.size());
+
+	MeshletBuilder builder(mesh, result, maxVertices, maxTriangles);
+	builder.Run();
+
+	result.bounds.reserve(result.meshlets.size());
+	for (const Meshlet &meshlet : result.meshlets)
+		result.bounds.push_back(ComputeMeshletBounds(mesh, result, meshlet));
+}
+
+MeshletBounds ComputeMeshletBounds(const Mesh &mesh, const MeshletMesh &meshlets, const Meshlet &meshlet)
+{
+	MeshletBounds bounds = {};
+	const uint32_t *vertices = &meshlets.vertices[meshlet.vertexOffset];
+	const uint8_t *triangles = &meshlets.triangles[meshlet.triangleOffset * 3];
+
+	Vec3 minimum(1e30f, 1e30f, 1e30f);
+	Vec3 maximum(-1e30f, -1e30f, -1e30f);
+	for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+	{
+		Vec3 p = GetPosition(mesh, vertices[i]);
+		minimum = Min(minimum, p);
+		maximum = Max(maximum, p);
+	}
+	Vec3 center = (minimum + maximum) * 0.5f;
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+		radius = std::max(radius, Length(GetPosition(mesh, vertices[i]) - center));
+	bounds.center[0] = center.x;
+	bounds.center[1] = center.y;
+	bounds.center[2] = center.z;
+	bounds.radius = radius;
+
+	// Cone around the mean face normal, widened to the most divergent face.
+	// Normals follow the index winding (counter-clockwise front faces).
+	Vec3 normals[255];	// BuildMeshlets caps clusters at 255 triangles
+	uint32_t normalCount = 0;
+	Vec3 axisSum;
+	for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+	{
+		Vec3 a = GetPosition(mesh, vertices[triangles[t * 3 + 0]]);
+		Vec3 b = GetPosition(mesh, vertices[triangles[t * 3 + 1]]);
+		Vec3 c = GetPosition(mesh, vertices[triangles[t * 3 + 2]]);
+		Vec3 normal = Cross(b - a, c - a);
+		float length = Length(normal);
+		if (length <= 0.0f)
+			continue;
+		normals[normalCount] = normal * (1.0f / length);
+		axisSum += normals[normalCount++];
+	}
+
+	bounds.coneCutoff = 127;
+	if (normalCount == 0 || Length(axisSum) < 1e-6f)
+		return bounds;
+
+	// Quantize the axis first and measure the spread against what the test
+	// will actually use.
+	Vec3 axis = Normalize(axisSum);
+	bounds.coneAxis[0] = QuantizeSnorm8(axis.x);
+	bounds.coneAxis[1] = QuantizeSnorm8(axis.y);
+	bounds.coneAxis[2] = QuantizeSnorm8(axis.z);
+	Vec3 quantizedAxis = Normalize(Vec3(bounds.coneAxis[0] / 127.0f, bounds.coneAxis[1] / 127.0f, bounds.coneAxis[2] / 127.0f));
+	float minimumDot = 1.0f;
+	for (uint32_t i = 0; i < normalCount; i++)
+		minimumDot = std::min(minimumDot, Dot(quantizedAxis, normals[i]));
+	if (minimumDot <= 0.0f)
+		return bounds;
+
+	// The test compares against the sine of the cone's half angle. One extra
+	// step covers the axis being off unit length after quantization.
+	float cutoff = sqrtf(1.0f - minimumDot * minimumDot);
+	bounds.coneCutoff = (int8_t)std::min(127.0f, ceilf(cutoff * 127.0f) + 1.0f);
+	return bounds;
+}
+
+MeshletStats GetMeshletStats(const MeshletMesh &meshlets, size_t meshVertexCount)
+{
+	MeshletStats stats = {};
+	stats.meshletCount = meshlets.meshlets.size();
+	stats.triangleCount = meshlets.triangles.size() / 3;
+	stats.meshletVertexCount = meshlets.vertices.size();
+	if (stats.meshletCount)
+	{
+		stats.averageVertices = (double)stats.meshletVertexCount / stats.meshletCount;
+		stats.averageTriangles = (double)stats.triangleCount / stats.meshletCount;
+	}
+	if (stats.triangleCount)
+		stats.acmr = (double)stats.meshletVertexCount / stats.triangleCount;
+	if (meshVertexCount)
+		stats.atvr = (double)stats.meshletVertexCount / meshVertexCount;
+	return stats;
+}
+
+bool IsMeshletBackfacing(const MeshletBounds &bounds, const Vec3 &cameraPosition)
+{
+	// Sphere-centred form of the cone test, so no apex has to be stored: the
+	// cluster is hidden if the view direction to every point of the sphere is
+	// within the cone's back half-space.
+	if (bounds.coneCutoff >= 127)
+		return false;
+	Vec3 axis(bounds.coneAxis[0] / 127.0f, bounds.coneAxis[1] / 127.0f, bounds.coneAxis[2] / 127.0f);
+	Vec3 offset = Vec3(bounds.center[0], bounds.center[1], bounds.center[2]) - cameraPosition;
+	return Dot(offset, axis) >= bounds.coneCutoff / 127.0f * Length(offset) + bounds.radius;
+}
+
+size_t CullMeshlets(const Frustum &frustum, const Vec3 &cameraPosition, const MeshletBounds *bounds, size_t count,
+	uint32_t *visible, MeshletCullStats *stats)
+{
+	PROFILE_COUNTERS("Meshlet culling");
+	size_t visibleCount = 0;
+	uint64_t frustumCulled = 0;
+	uint64_t coneCulled = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		const MeshletBounds &cluster = bounds[i];
+		Vec3 center(cluster.center[0], cluster.center[1], cluster.center[2]);
+		if (!frustum.TestSphere(center, cluster.radius))
+		{
+			frustumCulled++;
+			continue;
+		}
+		if (IsMeshletBackfacing(cluster, cameraPosition))
+		{
+			coneCulled++;
+			continue;
+		}
+		visible[visibleCount++] = (uint32_t)i;
+	}
+	if (stats)
+	{
+		stats->tested += count;
+		stats->frustumCulled += frustumCulled;
+		stats->coneCulled += coneCulled;
+	}
+	return visibleCount;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "culling.h"
+#include "mesh.h"
+
+// Limits sized for mesh shading hardware (NVIDIA's recommended 64/124, which
+// also fit AMD's) and small enough that one cluster is a useful culling unit.
+static const uint32_t MESHLET_MAX_VERTICES = 64;
+static const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// A cluster of up to 64 vertices and 124 triangles. Triangles index the
+// cluster's own vertex list with bytes, so a cluster's topology costs three
+// bytes per triangle. 12 bytes, mirrored by shaders/meshletcull.comp.
+struct Meshlet
+{
+	uint32_t vertexOffset;	// into MeshletMesh::vertices
+	uint32_t triangleOffset;	// in triangles, into MeshletMesh::triangles
+	uint8_t vertexCount;
+	uint8_t triangleCount;
+	uint16_t reserved;
+};
+
+// Bounding sphere plus a normal cone, 20 bytes. The cone axis and cutoff are
+// snorm8 and rounded so the cone only ever grows; a cutoff of 127 disables
+// the backface test.
+struct MeshletBounds
+{
+	float center[3];
+	float radius;
+	int8_t coneAxis[3];
+	int8_t coneCutoff;
+};
+
+struct MeshletMesh
+{
+	std::vector<Meshlet> meshlets;
+	std::vector<MeshletBounds> bounds;
+	std::vector<uint32_t> vertices;	// cluster-local to mesh vertex index
+	std::vector<uint8_t> triangles;	// three cluster-local indices per triangle
+
+	// Plain index buffer in cluster order; cluster i occupies
+	// [triangleOffset * 3, (triangleOffset + triangleCount) * 3).
+	std::vector<uint32_t> BuildIndexBuffer() const;
+};
+
+// Greedy clustering: each cluster grows from a seed triangle, first taking
+// adjacent triangles that add no new vertices, then the one closest to the
+// cluster's centroid, weighted towards triangles whose vertices have few
+// unclustered neighbours left. Clusters stay spatially tight for culling
+// without stranding lone triangles along their borders.
+void BuildMeshlets(const Mesh &mesh, MeshletMesh &result,
+	uint32_t maxVertices = MESHLET_MAX_VERTICES, uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+MeshletBounds ComputeMeshletBounds(const Mesh &mesh, const MeshletMesh &meshlets, const Meshlet &meshlet);
+
+struct MeshletStats
+{
+	size_t meshletCount;
+	size_t triangleCount;
+	size_t meshletVertexCount;	// vertices summed over clusters, each transformed once per cluster
+	double averageVertices;
+	double averageTriangles;
+
+	// Vertex transforms per triangle (lower is better, 0.5 is the limit for a
+	// regular grid) and per unique mesh vertex (1.0 is ideal).
+	double acmr;
+	double atvr;
+};
+
+MeshletStats GetMeshletStats(const MeshletMesh &meshlets, size_t meshVertexCount);
+
+struct MeshletCullStats
+{
+	uint64_t tested;
+	uint64_t frustumCulled;
+	uint64_t coneCulled;
+};
+
+// True when every triangle in the cluster faces away from a camera at
+// cameraPosition.
+bool IsMeshletBackfacing(const MeshletBounds &bounds, const Vec3 &cameraPosition);
+
+// Frustum and normal-cone test per cluster. Writes the indices of the
+// visible clusters and returns how many there were; stats is optional and
+// accumulates.
+size_t CullMeshlets(const Frustum &frustum, const Vec3 &cameraPosition, const MeshletBounds *bounds, size_t count,
+	uint32_t *visible, MeshletCullStats *stats = nullptr);
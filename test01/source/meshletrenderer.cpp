@@ -0,0 +1,341 @@
+#include "meshletrenderer.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+#include "allocators.h"
+#include "common.h"
+#include "log.h"
+#include "profiler.h"
+#include "scenerenderer.h"
+#include "timer.h"
+
+static_assert(sizeof(Meshlet) == 12 && sizeof(MeshletBounds) == 20, "layouts are mirrored by meshletcull.comp");
+
+static const uint32_t CULL_GROUP_SIZE = 64;
+static const uint32_t COUNTERS_PER_SLOT = 4;
+
+struct MeshletCullPushConstants
+{
+	float planes[6][4];
+	float cameraPosition[3];
+	uint32_t meshletCount;
+	uint32_t counterOffset;
+};
+
+const char *GetMeshletCullingName(MeshletCulling culling)
+{
+	switch (culling)
+	{
+	case MESHLET_CULLING_NONE: return "none";
+	case MESHLET_CULLING_CPU: return "cpu";
+	case MESHLET_CULLING_GPU: return "gpu";
+	}
+	return "unknown";
+}
+
+bool ParseMeshletCulling(const std::string &name, MeshletCulling &culling)
+{
+	for (MeshletCulling candidate : { MESHLET_CULLING_NONE, MESHLET_CULLING_CPU, MESHLET_CULLING_GPU })
+	{
+		if (name == GetMeshletCullingName(candidate))
+		{
+			culling = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+MeshletRenderer::MeshletRenderer(Common &common, MeshletCulling culling)
+	: common(common), culling(culling), meshletStats(), indexCount(0), ranges(nullptr), rangeCount(0),
+	descriptorSetLayout(VK_NULL_HANDLE), descriptorPool(VK_NULL_HANDLE), descriptorSet(VK_NULL_HANDLE),
+	pipelineLayout(VK_NULL_HANDLE), cullPipeline(VK_NULL_HANDLE), counterPending(),
+	frames(0), drawnFrames(0), visibleTriangles(0), drawCalls(0), cullNs(0), cullStats()
+{
+	static_assert(COUNTER_SLOTS == Common::MAX_FRAMES_IN_FLIGHT, "one counter slot per frame in flight");
+}
+
+MeshletRenderer::~MeshletRenderer()
+{
+	if (common.device == VK_NULL_HANDLE)
+		return;
+	if (cullPipeline != VK_NULL_HANDLE)
+		vkDestroyPipeline(common.device, cullPipeline, nullptr);
+	if (pipelineLayout != VK_NULL_HANDLE)
+		vkDestroyPipelineLayout(common.device, pipelineLayout, nullptr);
+	if (descriptorPool != VK_NULL_HANDLE)
+		vkDestroyDescriptorPool(common.device, descriptorPool, nullptr);
+	if (descriptorSetLayout != VK_NULL_HANDLE)
+		vkDestroyDescriptorSetLayout(common.device, descriptorSetLayout, nullptr);
+	DestroyBuffer(common.device, counterBuffer);
+	DestroyBuffer(common.device, drawBuffer);
+	DestroyBuffer(common.device, boundsBuffer);
+	DestroyBuffer(common.device, meshletBuffer);
+	DestroyBuffer(common.device, indexBuffer);
+	DestroyBuffer(common.device, vertexBuffer);
+}
+
+bool MeshletRenderer::Init(const Mesh &mesh)
+{
+	PROFILE_FUNCTION();
+	uint64_t start = NowNs();
+	BuildMeshlets(mesh, meshlets);
+	meshletStats = GetMeshletStats(meshlets, mesh.vertices.size());
+	LOG_INFO(LOG_CATEGORY_FRAME, "Built %u meshlets from %u triangles in %.1f ms", meshletStats.meshletCount, meshletStats.triangleCount,
+		ElapsedMs(start, NowNs()));
+
+	std::vector<float> vertices = BuildBasicVertices(mesh);
+	std::vector<uint32_t> indices = meshlets.BuildIndexBuffer();
+	indexCount = (uint32_t)indices.size();
+	VkDevice device = common.device;
+	VkPhysicalDevice physicalDevice = common.physicalDevice;
+	if (!CreateFilledBuffer(device, physicalDevice, vertices.data(), vertices.size() * sizeof(float),
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MEMTAG_RENDERER, vertexBuffer) ||
+		!CreateFilledBuffer(device, physicalDevice, indices.data(), indices.size() * sizeof(uint32_t),
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT, MEMTAG_RENDERER, indexBuffer))
+		return false;
+	if (culling != MESHLET_CULLING_GPU)
+		return true;
+
+	size_t meshletCount = meshlets.meshlets.size();
+	if (!CreateFilledBuffer(device, physicalDevice, meshlets.meshlets.data(), meshletCount * sizeof(Meshlet),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEMTAG_RENDERER, meshletBuffer) ||
+		!CreateFilledBuffer(device, physicalDevice, meshlets.bounds.data(), meshletCount * sizeof(MeshletBounds),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEMTAG_RENDERER, boundsBuffer) ||
+		!CreateFilledBuffer(device, physicalDevice, nullptr, meshletCount * sizeof(VkDrawIndexedIndirectCommand),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MEMTAG_RENDERER, drawBuffer))
+		return false;
+
+	// Read back on the host, so no device-local preference.
+	if (!CreateBuffer(device, physicalDevice, COUNTER_SLOTS * COUNTERS_PER_SLOT * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		VK_MEMORY_PROPERTY_HOST_CACHED_BIT, MEMTAG_RENDERER, counterBuffer))
+		return false;
+	return CreateCullPipeline();
+}
+
+bool MeshletRenderer::CreateCullPipeline()
+{
+	std::vector<uint32_t> code;
+	if (!LoadSpirvFile(Common::GetShaderPath("meshletcull.comp.spv"), code))
+	{
+		LOG_ERROR(LOG_CATEGORY_PIPELINES, "Could not load %s", Common::GetShaderPath("meshletcull.comp.spv"));
+		return false;
+	}
+
+	VkDescriptorSetLayoutBinding bindings[4] = {};
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 4;
+	layoutInfo.pBindings = bindings;
+	if (vkCreateDescriptorSetLayout(common.device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+		return false;
+
+	VkPushConstantRange pushRange = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MeshletCullPushConstants) };
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+	if (vkCreatePipelineLayout(common.device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+		return false;
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = common.permutations->LoadModule(code);
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = pipelineLayout;
+	VkResult result = vkCreateComputePipelines(common.device, common.pipelineCache, 1, &pipelineInfo, nullptr, &cullPipeline);
+	if (result != VK_SUCCESS)
+	{
+		LOG_ERROR(LOG_CATEGORY_PIPELINES, "Meshlet cull pipeline creation failed: %s", VkResultToString(result));
+		return false;
+	}
+
+	VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 };
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	if (vkCreateDescriptorPool(common.device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+		return false;
+
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.descriptorPool = descriptorPool;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &descriptorSetLayout;
+	if (vkAllocateDescriptorSets(common.device, &allocateInfo, &descriptorSet) != VK_SUCCESS)
+		return false;
+
+	const BufferAllocation *buffers[4] = { &meshletBuffer, &boundsBuffer, &drawBuffer, &counterBuffer };
+	VkDescriptorBufferInfo bufferInfos[4];
+	VkWriteDescriptorSet writes[4] = {};
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		bufferInfos[i] = { buffers[i]->buffer, 0, VK_WHOLE_SIZE };
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = descriptorSet;
+		writes[i].dstBinding = i;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(common.device, 4, writes, 0, nullptr);
+	return true;
+}
+
+void MeshletRenderer::ReadGpuCounters(uint32_t slot)
+{
+	// The frame that last used this slot has finished: FrameLoop waited on
+	// its fence before handing the slot's frame index out again.
+	if (!counterPending[slot])
+		return;
+	InvalidateBuffer(common.device, counterBuffer);
+	const uint32_t *counters = (const uint32_t *)counterBuffer.mapped + slot * COUNTERS_PER_SLOT;
+	cullStats.tested += meshlets.meshlets.size();
+	cullStats.frustumCulled += counters[1];
+	cullStats.coneCulled += counters[2];
+	visibleTriangles += counters[3];
+	frames++;
+	counterPending[slot] = false;
+}
+
+void MeshletRenderer::Cull(VkCommandBuffer cmd, uint64_t frameIndex, const Mat4 &viewProjection, const Vec3 &cameraPosition, LinearArena &frameArena)
+{
+	PROFILE_FUNCTION();
+	uint32_t meshletCount = (uint32_t)meshlets.meshlets.size();
+	Frustum frustum = Frustum::FromMatrix(viewProjection);
+	if (culling == MESHLET_CULLING_NONE)
+	{
+		ranges = frameArena.New<DrawRange>();
+		ranges->firstIndex = 0;
+		ranges->indexCount = indexCount;
+		rangeCount = 1;
+		cullStats.tested += meshletCount;
+		visibleTriangles += meshletStats.triangleCount;
+		frames++;
+		return;
+	}
+
+	if (culling == MESHLET_CULLING_CPU)
+	{
+		uint64_t start = NowNs();
+		uint32_t *visible = frameArena.AllocateArray<uint32_t>(meshletCount);
+		size_t visibleCount = CullMeshlets(frustum, cameraPosition, meshlets.bounds.data(), meshletCount, visible, &cullStats);
+
+		// Clusters are contiguous in the index buffer, so consecutive visible
+		// clusters merge into one draw.
+		ranges = frameArena.AllocateArray<DrawRange>(visibleCount);
+		rangeCount = 0;
+		for (size_t i = 0; i < visibleCount; i++)
+		{
+			const Meshlet &meshlet = meshlets.meshlets[visible[i]];
+			uint32_t firstIndex = meshlet.triangleOffset * 3;
+			if (rangeCount && ranges[rangeCount - 1].firstIndex + ranges[rangeCount - 1].indexCount == firstIndex)
+				ranges[rangeCount - 1].indexCount += meshlet.triangleCount * 3;
+			else
+				ranges[rangeCount++] = { firstIndex, meshlet.triangleCount * 3u };
+			visibleTriangles += meshlet.triangleCount;
+		}
+		cullNs += NowNs() - start;
+		frames++;
+		return;
+	}
+
+	uint32_t slot = (uint32_t)(frameIndex % COUNTER_SLOTS);
+	ReadGpuCounters(slot);
+
+	// The previous frame's indirect reads must finish before the commands
+	// are rewritten.
+	CmdBufferBarrier(cmd, drawBuffer.buffer, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, 0, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, 0);
+	vkCmdFillBuffer(cmd, counterBuffer.buffer, slot * COUNTERS_PER_SLOT * sizeof(uint32_t), COUNTERS_PER_SLOT * sizeof(uint32_t), 0);
+	CmdBufferBarrier(cmd, counterBuffer.buffer, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+	MeshletCullPushConstants constants = {};
+	for (int i = 0; i < 6; i++)
+	{
+		constants.planes[i][0] = frustum.planes[i].normal.x;
+		constants.planes[i][1] = frustum.planes[i].normal.y;
+		constants.planes[i][2] = frustum.planes[i].normal.z;
+		constants.planes[i][3] = frustum.planes[i].d;
+	}
+	constants.cameraPosition[0] = cameraPosition.x;
+	constants.cameraPosition[1] = cameraPosition.y;
+	constants.cameraPosition[2] = cameraPosition.z;
+	constants.meshletCount = meshletCount;
+	constants.counterOffset = slot * COUNTERS_PER_SLOT;
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+	vkCmdPushConstants(cmd, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(cmd, (meshletCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	CmdBufferBarrier(cmd, drawBuffer.buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+	CmdBufferBarrier(cmd, counterBuffer.buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+	counterPending[slot] = true;
+}
+
+void MeshletRenderer::Draw(VkCommandBuffer cmd)
+{
+	drawnFrames++;
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer.buffer, &offset);
+	vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	if (culling != MESHLET_CULLING_GPU)
+	{
+		for (uint32_t i = 0; i < rangeCount; i++)
+			vkCmdDrawIndexed(cmd, ranges[i].indexCount, 1, ranges[i].firstIndex, 0, 0);
+		drawCalls += rangeCount;
+		return;
+	}
+
+	uint32_t meshletCount = (uint32_t)meshlets.meshlets.size();
+	uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	if (common.enabledFeatures.multiDrawIndirect)
+	{
+		vkCmdDrawIndexedIndirect(cmd, drawBuffer.buffer, 0, meshletCount, stride);
+		drawCalls++;
+		return;
+	}
+	for (uint32_t i = 0; i < meshletCount; i++)
+		vkCmdDrawIndexedIndirect(cmd, drawBuffer.buffer, (VkDeviceSize)i * stride, 1, stride);
+	drawCalls += meshletCount;
+}
+
+void MeshletRenderer::LogSummary() const
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(1);
+	out << "Meshlets: " << meshletStats.meshletCount << " clusters, " << meshletStats.averageVertices << " vertices and "
+		<< meshletStats.averageTriangles << " triangles on average, " << std::setprecision(3) << meshletStats.acmr
+		<< " vertices per triangle (ACMR), " << meshletStats.atvr << " per mesh vertex (ATVR)" << std::endl;
+	if (frames)
+	{
+		double tested = (double)std::max<uint64_t>(cullStats.tested, 1);
+		out << std::setprecision(1) << "  culling " << GetMeshletCullingName(culling) << ": "
+			<< 100.0 * cullStats.frustumCulled / tested << "% frustum culled, " << 100.0 * cullStats.coneCulled / tested
+			<< "% cone culled, " << (double)visibleTriangles / frames / 1000.0 << "k of "
+			<< meshletStats.triangleCount / 1000.0 << "k triangles drawn per frame, "
+			<< (double)drawCalls / std::max<uint64_t>(drawnFrames, 1) << " draw calls per frame";
+		if (culling == MESHLET_CULLING_CPU)
+			out << std::setprecision(3) << ", " << (double)cullNs / frames / 1000000.0 << " ms culling per frame";
+		out << std::endl;
+	}
+	Log::WriteLines(LOG_LEVEL_INFO, LOG_CATEGORY_FRAME, out.str());
+}
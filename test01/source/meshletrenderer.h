@@ -0,0 +1,89 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "mathutil.h"
+#include "meshlet.h"
+#include "vulkanhelpers.h"
+
+class Common;
+class LinearArena;
+
+enum MeshletCulling
+{
+	MESHLET_CULLING_NONE,	// one draw for the whole mesh, the baseline
+	MESHLET_CULLING_CPU,
+	MESHLET_CULLING_GPU,
+};
+
+const char *GetMeshletCullingName(MeshletCulling culling);
+bool ParseMeshletCulling(const std::string &name, MeshletCulling &culling);
+
+// Draws one mesh split into meshlets with the basic program's vertex layout.
+// Clusters are culled against the frustum and their normal cones either on
+// the CPU, which issues one draw per run of consecutive visible clusters, or
+// by a compute pass writing one indexed indirect draw per cluster.
+class MeshletRenderer
+{
+public:
+	MeshletRenderer(Common &common, MeshletCulling culling);
+	~MeshletRenderer();
+
+	bool Init(const Mesh &mesh);
+
+	// Outside of rendering. Culls for this frame; the draw list lives in
+	// frameArena until Draw.
+	void Cull(VkCommandBuffer cmd, uint64_t frameIndex, const Mat4 &viewProjection, const Vec3 &cameraPosition, LinearArena &frameArena);
+
+	// Inside rendering, with a basic pipeline and its push constants bound.
+	void Draw(VkCommandBuffer cmd);
+
+	void LogSummary() const;
+
+private:
+	// One set of GPU counters per frame in flight (Common::MAX_FRAMES_IN_FLIGHT),
+	// read back when the slot comes round again.
+	static const uint32_t COUNTER_SLOTS = 3;
+
+	struct DrawRange
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+	};
+
+	bool CreateCullPipeline();
+	void ReadGpuCounters(uint32_t slot);
+
+	Common &common;
+	MeshletCulling culling;
+	MeshletMesh meshlets;
+	MeshletStats meshletStats;
+	uint32_t indexCount;
+
+	BufferAllocation vertexBuffer;
+	BufferAllocation indexBuffer;
+
+	// CPU path: visible ranges for the frame being recorded.
+	DrawRange *ranges;
+	uint32_t rangeCount;
+
+	// GPU path.
+	BufferAllocation meshletBuffer;
+	BufferAllocation boundsBuffer;
+	BufferAllocation drawBuffer;
+	BufferAllocation counterBuffer;
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSet descriptorSet;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline cullPipeline;
+	bool counterPending[COUNTER_SLOTS];
+
+	uint64_t frames;	// with cull results; GPU results arrive a few frames late
+	uint64_t drawnFrames;
+	uint64_t visibleTriangles;
+	uint64_t drawCalls;
+	uint64_t cullNs;
+	MeshletCullStats cullStats;
+};
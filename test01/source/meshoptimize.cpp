@@ -0,0 +1,308 @@
+#include "meshoptimize.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "profiler.h"
+
+namespace
+{
+	// FIFO cache by timestamps: a vertex is resident while fewer than
+	// cacheSize misses have happened since its own. Advancing the clock by
+	// cacheSize + 1 flushes everything.
+	struct FifoCache
+	{
+		std::vector<uint32_t> time;
+		uint32_t clock;
+		uint32_t size;
+
+		FifoCache(size_t vertexCount, uint32_t size) : time(vertexCount, 0), clock(size + 1), size(size) {}
+
+		bool Contains(uint32_t vertex) const { return clock - time[vertex] <= size; }
+
+		// Returns true on a miss.
+		bool Access(uint32_t vertex)
+		{
+			if (Contains(vertex))
+				return false;
+			time[vertex] = clock++;
+			return true;
+		}
+
+		void Flush() { clock += size + 1; }
+	};
+
+	uint32_t CountMisses(FifoCache &cache, const uint32_t *triangle)
+	{
+		return (uint32_t)cache.Access(triangle[0]) + cache.Access(triangle[1]) + cache.Access(triangle[2]);
+	}
+}
+
+void OptimizeVertexCache(uint32_t *destination, const uint32_t *indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	PROFILE_FUNCTION();
+	size_t triangleCount = indexCount / 3;
+
+	// Triangles around each vertex, CSR style. live counts the ones not yet
+	// emitted.
+	std::vector<uint32_t> live(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		live[indices[i]]++;
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + live[v];
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnds;
+	deadEnds.reserve(triangleCount * 3);
+	std::vector<uint32_t> candidates;
+	FifoCache cache(vertexCount, cacheSize);
+	size_t output = 0;
+	uint32_t cursor = 0;
+
+	auto nextUnfinished = [&]() -> uint32_t
+	{
+		// Most recently used vertices first, then input order.
+		while (!deadEnds.empty())
+		{
+			uint32_t vertex = deadEnds.back();
+			deadEnds.pop_back();
+			if (live[vertex] > 0)
+				return vertex;
+		}
+		while (cursor < vertexCount)
+		{
+			if (live[cursor] > 0)
+				return cursor;
+			cursor++;
+		}
+		return UINT32_MAX;
+	};
+
+	uint32_t fan = nextUnfinished();
+	while (fan != UINT32_MAX)
+	{
+		candidates.clear();
+		for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; a++)
+		{
+			uint32_t triangle = adjacency[a];
+			if (emitted[triangle])
+				continue;
+			emitted[triangle] = 1;
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t vertex = indices[triangle * 3 + k];
+				destination[output++] = vertex;
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				live[vertex]--;
+				cache.Access(vertex);
+			}
+		}
+
+		// The candidate that will still be cached after its remaining
+		// triangles are emitted, preferring the one that entered earliest.
+		uint32_t best = UINT32_MAX;
+		int64_t bestPriority = -1;
+		for (uint32_t vertex : candidates)
+		{
+			if (live[vertex] == 0)
+				continue;
+			int64_t age = cache.clock - cache.time[vertex];
+			int64_t priority = age + 2 * live[vertex] <= cacheSize ? age : 0;
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				best = vertex;
+			}
+		}
+		fan = best != UINT32_MAX ? best : nextUnfinished();
+	}
+}
+
+void OptimizeOverdraw(uint32_t *destination, const uint32_t *indices, size_t indexCount,
+	const float *positions, size_t strideBytes, size_t vertexCount, float threshold, uint32_t cacheSize)
+{
+	PROFILE_FUNCTION();
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+	auto position = [&](uint32_t vertex)
+	{
+		const float *p = (const float *)((const uint8_t *)positions + vertex * strideBytes);
+		return Vec3(p[0], p[1], p[2]);
+	};
+
+	// Hard boundaries: triangles that miss on all three vertices, where the
+	// cache optimizer started over.
+	std::vector<uint32_t> hardStarts;
+	FifoCache cache(vertexCount, cacheSize);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (CountMisses(cache, indices + t * 3) == 3)
+			hardStarts.push_back((uint32_t)t);
+	}
+	if (hardStarts.empty() || hardStarts[0] != 0)
+		hardStarts.insert(hardStarts.begin(), 0);
+	hardStarts.push_back((uint32_t)triangleCount);
+
+	// Soft boundaries: split a cluster wherever the ACMR since its last split
+	// is already close to the whole cluster's, so a split costs little.
+	std::vector<uint32_t> clusterStarts;
+	for (size_t h = 0; h + 1 < hardStarts.size(); h++)
+	{
+		uint32_t start = hardStarts[h];
+		uint32_t end = hardStarts[h + 1];
+		cache.Flush();
+		uint32_t clusterMisses = 0;
+		for (uint32_t t = start; t < end; t++)
+			clusterMisses += CountMisses(cache, indices + t * 3);
+		float limit = threshold * clusterMisses / (end - start);
+
+		cache.Flush();
+		clusterStarts.push_back(start);
+		uint32_t splitStart = start;
+		uint32_t misses = 0;
+		for (uint32_t t = start; t < end; t++)
+		{
+			misses += CountMisses(cache, indices + t * 3);
+			if (t + 1 < end && (float)misses / (t + 1 - splitStart) <= limit)
+			{
+				clusterStarts.push_back(t + 1);
+				splitStart = t + 1;
+				misses = 0;
+				cache.Flush();
+			}
+		}
+	}
+	clusterStarts.push_back((uint32_t)triangleCount);
+	size_t clusterCount = clusterStarts.size() - 1;
+
+	Vec3 meshCenter(0.0f, 0.0f, 0.0f);
+	for (size_t v = 0; v < vertexCount; v++)
+		meshCenter = meshCenter + position((uint32_t)v);
+	meshCenter = meshCenter * (1.0f / std::max<size_t>(vertexCount, 1));
+
+	// Area-weighted centroid and normal per cluster; clusters whose normal
+	// points away from the mesh centre are the likely occluders.
+	std::vector<float> keys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		Vec3 centroid(0.0f, 0.0f, 0.0f);
+		Vec3 normal(0.0f, 0.0f, 0.0f);
+		float area = 0.0f;
+		for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+		{
+			Vec3 a = position(indices[t * 3 + 0]);
+			Vec3 b = position(indices[t * 3 + 1]);
+			Vec3 d = position(indices[t * 3 + 2]);
+			// Front faces wind counter-clockwise, as in BuildMeshlets' cones.
+			Vec3 n = Cross(b - a, d - a);
+			float triangleArea = Length(n);
+			centroid = centroid + (a + b + d) * (triangleArea / 3.0f);
+			normal = normal + n;
+			area += triangleArea;
+		}
+		float normalLength = Length(normal);
+		if (area <= 0.0f || normalLength <= 0.0f)
+		{
+			keys[c] = -1e30f;
+			continue;
+		}
+		centroid = centroid * (1.0f / area);
+		keys[c] = Dot(centroid - meshCenter, normal * (1.0f / normalLength));
+	}
+
+	std::vector<uint32_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+		order[c] = (uint32_t)c;
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+	size_t output = 0;
+	for (uint32_t c : order)
+	{
+		size_t count = (clusterStarts[c + 1] - clusterStarts[c]) * 3;
+		memcpy(destination + output, indices + clusterStarts[c] * 3, count * sizeof(uint32_t));
+		output += count;
+	}
+}
+
+size_t OptimizeVertexFetch(Mesh &mesh)
+{
+	PROFILE_FUNCTION();
+	std::vector<uint32_t> remap(mesh.vertices.size(), UINT32_MAX);
+	std::vector<Vertex> vertices;
+	vertices.reserve(mesh.vertices.size());
+	for (uint32_t &index : mesh.indices)
+	{
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = (uint32_t)vertices.size();
+			vertices.push_back(mesh.vertices[index]);
+		}
+		index = remap[index];
+	}
+	mesh.vertices.swap(vertices);
+	return mesh.vertices.size();
+}
+
+void OptimizeMesh(Mesh &mesh)
+{
+	PROFILE_FUNCTION();
+	std::vector<uint32_t> cacheOrder(mesh.indices.size());
+	OptimizeVertexCache(cacheOrder.data(), mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+	if (!mesh.vertices.empty())
+		OptimizeOverdraw(mesh.indices.data(), cacheOrder.data(), cacheOrder.size(), mesh.vertices[0].position, sizeof(Vertex),
+			mesh.vertices.size());
+	OptimizeVertexFetch(mesh);
+}
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	VertexCacheStats stats = {};
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<uint8_t> referenced(vertexCount, 0);
+	size_t referencedCount = 0;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		stats.vertexTransforms += cache.Access(indices[i]);
+		if (!referenced[indices[i]])
+		{
+			referenced[indices[i]] = 1;
+			referencedCount++;
+		}
+	}
+	size_t triangleCount = indexCount / 3;
+	stats.acmr = triangleCount ? (double)stats.vertexTransforms / triangleCount : 0.0;
+	stats.atvr = referencedCount ? (double)stats.vertexTransforms / referencedCount : 0.0;
+	return stats;
+}
+
+VertexFetchStats AnalyzeVertexFetch(const uint32_t *indices, size_t indexCount, size_t vertexCount, size_t vertexSize)
+{
+	// 64 lines of 64 bytes, FIFO, behind the post-transform cache.
+	const uint32_t LINE_SIZE = 64;
+	const uint32_t LINE_COUNT = 64;
+	VertexFetchStats stats = {};
+	FifoCache vertexCache(vertexCount, VERTEX_CACHE_FIFO_SIZE);
+	size_t lineTotal = (vertexCount * vertexSize + LINE_SIZE - 1) / LINE_SIZE;
+	FifoCache lineCache(lineTotal, LINE_COUNT);
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		if (!vertexCache.Access(indices[i]))
+			continue;
+		size_t first = indices[i] * vertexSize / LINE_SIZE;
+		size_t last = (indices[i] * vertexSize + vertexSize - 1) / LINE_SIZE;
+		for (size_t line = first; line <= last; line++)
+		{
+			if (lineCache.Access((uint32_t)line))
+				stats.bytesFetched += LINE_SIZE;
+		}
+	}
+	stats.overfetch = vertexCount ? (double)stats.bytesFetched / (vertexCount * vertexSize) : 0.0;
+	return stats;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "mesh.h"
+
+// Post-transform cache size the optimizers and the analysis assume; matches
+// DepthRasterizer and is a safe guess for GPUs, whose caches are larger but
+// not FIFO.
+static const uint32_t VERTEX_CACHE_FIFO_SIZE = 16;
+
+// Tipsify (Sander, Nehab and Barczak 2007): emits triangles by fanning around
+// one vertex at a time and picks the next fan vertex among those still in
+// the cache, jumping to recently used vertices at dead ends. Linear time.
+// destination must not alias indices.
+void OptimizeVertexCache(uint32_t *destination, const uint32_t *indices, size_t indexCount, size_t vertexCount,
+	uint32_t cacheSize = VERTEX_CACHE_FIFO_SIZE);
+
+// Reorders clusters of a cache-optimized index buffer so that triangles
+// facing outwards from the mesh centre come first, which is front-to-back
+// for most views and lowers overdraw. Clusters break wherever the cache
+// restarts and wherever the running ACMR is within threshold of the
+// cluster's, so cache efficiency drops by at most that factor.
+void OptimizeOverdraw(uint32_t *destination, const uint32_t *indices, size_t indexCount,
+	const float *positions, size_t strideBytes, size_t vertexCount, float threshold = 1.05f,
+	uint32_t cacheSize = VERTEX_CACHE_FIFO_SIZE);
+
+// Renumbers vertices in order of first use so fetches walk the vertex buffer
+// forwards, and drops vertices no triangle uses. Returns the new count.
+size_t OptimizeVertexFetch(Mesh &mesh);
+
+// All three passes, in the order that keeps each one's gains: cache, then
+// overdraw, then fetch (which does not change triangle order).
+void OptimizeMesh(Mesh &mesh);
+
+struct VertexCacheStats
+{
+	size_t vertexTransforms;	// cache misses
+	double acmr;	// transforms per triangle; 3 is worst, about 0.5 the limit for grids
+	double atvr;	// transforms per referenced vertex; 1 is ideal
+};
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount,
+	uint32_t cacheSize = VERTEX_CACHE_FIFO_SIZE);
+
+struct VertexFetchStats
+{
+	size_t bytesFetched;
+	double overfetch;	// bytes fetched per byte of vertex data; 1 is ideal
+};
+
+// Fetches on each transform, through a small cache of 64-byte lines.
+VertexFetchStats AnalyzeVertexFetch(const uint32_t *indices, size_t indexCount, size_t vertexCount, size_t vertexSize);
@@ -0,0 +1,87 @@
+#include "objectfield.h"
+#include <math.h>
+#include <random>
+#include "profiler.h"
+
+void GenerateObjectField(ObjectField &field, uint32_t objectCount, bool buildLods)
+{
+	PROFILE_FUNCTION();
+	field = ObjectField();
+
+	// Spheres of increasing density; dense enough that distant copies are
+	// mostly wasted triangles without LODs.
+	static const uint32_t meshDetail[][2] = { { 16, 32 }, { 24, 48 }, { 32, 64 } };
+	for (const uint32_t *detail : meshDetail)
+	{
+		Mesh sphere = GenerateSphere(detail[0], detail[1], 1.0f);
+		LodChain chain;
+		if (buildLods)
+			BuildLodChain(sphere, chain);
+		else
+			chain.lods.push_back({ 0, (uint32_t)sphere.indices.size(), 0.0f });
+		const std::vector<uint32_t> &indices = buildLods ? chain.indices : sphere.indices;
+
+		FieldMesh mesh = {};
+		mesh.firstLod = (uint32_t)field.lods.size();
+		mesh.lodCount = (uint32_t)chain.lods.size();
+		mesh.radius = 1.0f;
+		mesh.quantization = ComputeQuantizationBox(sphere.vertices.data(), sphere.vertices.size());
+		field.meshes.push_back(mesh);
+
+		uint32_t baseVertex = (uint32_t)field.geometry.vertices.size();
+		uint32_t baseIndex = (uint32_t)field.geometry.indices.size();
+		for (MeshLod lod : chain.lods)
+		{
+			lod.firstIndex += baseIndex;
+			field.lods.push_back(lod);
+		}
+		field.geometry.vertices.insert(field.geometry.vertices.end(), sphere.vertices.begin(), sphere.vertices.end());
+		field.packedVertices.resize(field.geometry.vertices.size());
+		PackVertices(&field.packedVertices[baseVertex], sphere.vertices.data(), sphere.vertices.size(), mesh.quantization);
+		for (uint32_t index : indices)
+			field.geometry.indices.push_back(baseVertex + index);
+	}
+
+	std::mt19937 rng(1234);
+	float extent = sqrtf((float)objectCount) * 0.5f;
+	std::uniform_real_distribution<float> horizontal(-extent, extent);
+	std::uniform_real_distribution<float> vertical(-3.0f, 3.0f);
+	std::uniform_real_distribution<float> scale(0.15f, 0.4f);
+	std::uniform_real_distribution<float> color(0.3f, 1.0f);
+	field.objects.resize(objectCount);
+	field.bounds.resize(objectCount);
+	for (uint32_t i = 0; i < objectCount; i++)
+	{
+		FieldObject &object = field.objects[i];
+		object = {};
+		object.positionScale[0] = horizontal(rng);
+		object.positionScale[1] = vertical(rng);
+		object.positionScale[2] = horizontal(rng);
+		object.positionScale[3] = scale(rng);
+		for (int c = 0; c < 3; c++)
+			object.color[c] = color(rng);
+		object.color[3] = 1.0f;
+		object.mesh = rng() % (uint32_t)field.meshes.size();
+
+		field.bounds[i].center = Vec3(object.positionScale[0], object.positionScale[1], object.positionScale[2]);
+		field.bounds[i].radius = field.meshes[object.mesh].radius * object.positionScale[3];
+	}
+}
+
+uint64_t SelectObjectLods(const ObjectField &field, const uint32_t *visible, size_t visibleCount, const Vec3 &eye,
+	float projectionScale, float pixelError, uint32_t *lods)
+{
+	uint64_t triangles = 0;
+	for (size_t i = 0; i < visibleCount; i++)
+	{
+		const FieldObject &object = field.objects[visible[i]];
+		const FieldMesh &mesh = field.meshes[object.mesh];
+		const BoundingSphere &bounds = field.bounds[visible[i]];
+		float distance = Length(bounds.center - eye) - bounds.radius;
+		uint32_t lod = mesh.firstLod + SelectLod(&field.lods[mesh.firstLod], mesh.lodCount, object.positionScale[3], distance,
+			projectionScale, pixelError);
+		lods[i] = lod;
+		triangles += field.lods[lod].indexCount / 3;
+	}
+	return triangles;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "culling.h"
+#include "mesh.h"
+#include "simplify.h"
+#include "vertexformat.h"
+
+// Mirrored by shaders/instanced.vert and shaders/instancecull.comp, as are
+// FieldMesh and MeshLod.
+struct FieldObject
+{
+	float positionScale[4];
+	float color[4];
+	uint32_t mesh;
+	uint32_t pad[3];
+};
+
+// A mesh's levels are lods[firstLod, firstLod + lodCount). Its vertices in
+// ObjectField::packedVertices decode through quantization.
+struct FieldMesh
+{
+	uint32_t firstLod;
+	uint32_t lodCount;
+	float radius;
+	uint32_t pad;
+	QuantizationBox quantization;
+};
+
+static_assert(sizeof(FieldObject) == 48 && sizeof(FieldMesh) == 32 && sizeof(MeshLod) == 12,
+	"layouts are mirrored by the instance shaders");
+
+// A large field of small objects, each a placement of one of a few shared
+// meshes. geometry holds every mesh's vertices and every level's indices;
+// indices are absolute, so draws use a vertex offset of 0. packedVertices
+// are the same vertices quantized per mesh, encoded once at generation.
+struct ObjectField
+{
+	Mesh geometry;
+	std::vector<PackedVertex> packedVertices;
+	std::vector<FieldMesh> meshes;
+	std::vector<MeshLod> lods;
+	std::vector<FieldObject> objects;
+	std::vector<BoundingSphere> bounds;
+};
+
+// Constant density, so the visible count grows with objectCount only through
+// the far plane. Without buildLods each mesh has just its full detail level.
+void GenerateObjectField(ObjectField &field, uint32_t objectCount, bool buildLods);
+
+// For each visible object, the level (an index into field.lods) whose error
+// projects within pixelError at the distance of its bounding sphere from eye.
+// Returns the triangles the selection draws.
+uint64_t SelectObjectLods(const ObjectField &field, const uint32_t *visible, size_t visibleCount, const Vec3 &eye,
+	float projectionScale, float pixelError, uint32_t *lods);
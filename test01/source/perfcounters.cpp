@@ -0,0 +1,297 @@
+#include "perfcounters.h"
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string.h>
+#include <vector>
+#include "log.h"
+
+#ifdef LINUX
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	struct SubsystemTotals
+	{
+		const char *name;
+		uint64_t calls;
+		PerfCounterValues counters;
+	};
+
+	struct SubsystemState
+	{
+		std::mutex mutex;
+		std::vector<SubsystemTotals> subsystems;
+		std::string unavailableReason;
+		bool anyAvailable = false;
+	};
+
+	SubsystemState &State()
+	{
+		static SubsystemState state;
+		return state;
+	}
+
+	thread_local std::unique_ptr<PerfCounterGroup> threadGroup;
+	thread_local bool threadGroupOpened = false;
+
+	double Ratio(const PerfCounterValues &values, PerfCounterId numerator, PerfCounterId denominator, double scale = 1.0)
+	{
+		if (!values.IsValid(numerator) || !values.IsValid(denominator) || values.values[denominator] == 0)
+			return -1.0;
+		return scale * values.values[numerator] / values.values[denominator];
+	}
+
+#ifdef LINUX
+	struct EventConfig
+	{
+		PerfCounterId id;
+		uint64_t config;
+	};
+
+	const EventConfig EVENTS[PERF_COUNTER_COUNT] = {
+		{ PERF_CYCLES, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_INSTRUCTIONS, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_REFERENCES },
+		{ PERF_CACHE_MISSES, PERF_COUNT_HW_CACHE_MISSES },
+		{ PERF_BRANCHES, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+		{ PERF_BRANCH_MISSES, PERF_COUNT_HW_BRANCH_MISSES },
+	};
+
+	int OpenEvent(uint64_t config, int groupFd)
+	{
+		perf_event_attr attr = {};
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = config;
+		attr.disabled = groupFd < 0 ? 1 : 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		return (int)syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+	}
+#endif
+}
+
+double PerfCounterValues::GetIpc() const
+{
+	return Ratio(*this, PERF_INSTRUCTIONS, PERF_CYCLES);
+}
+
+double PerfCounterValues::GetCacheMissRate() const
+{
+	return Ratio(*this, PERF_CACHE_MISSES, PERF_CACHE_REFERENCES);
+}
+
+double PerfCounterValues::GetBranchMissRate() const
+{
+	return Ratio(*this, PERF_BRANCH_MISSES, PERF_BRANCHES);
+}
+
+double PerfCounterValues::GetCacheMpki() const
+{
+	return Ratio(*this, PERF_CACHE_MISSES, PERF_INSTRUCTIONS, 1000.0);
+}
+
+PerfCounterValues PerfCounterValues::operator-(const PerfCounterValues &other) const
+{
+	PerfCounterValues result;
+	result.validMask = validMask & other.validMask;
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+		result.values[i] = values[i] >= other.values[i] ? values[i] - other.values[i] : 0;
+	return result;
+}
+
+PerfCounterValues &PerfCounterValues::operator+=(const PerfCounterValues &other)
+{
+	validMask = validMask ? validMask & other.validMask : other.validMask;
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+		values[i] += other.values[i];
+	return *this;
+}
+
+PerfCounterGroup::PerfCounterGroup() : leader(-1), openCount(0)
+{
+#ifdef LINUX
+	for (const EventConfig &event : EVENTS)
+	{
+		int fd = OpenEvent(event.config, leader);
+		if (fd < 0)
+		{
+			if (leader < 0)
+			{
+				error = errno == EACCES || errno == EPERM ? "perf_event_open not permitted (check /proc/sys/kernel/perf_event_paranoid)"
+					: errno == ENOENT || errno == EOPNOTSUPP ? "no hardware PMU available"
+					: std::string("perf_event_open failed: ") + strerror(errno);
+				return;
+			}
+			continue;
+		}
+		if (leader < 0)
+			leader = fd;
+		fds[openCount] = fd;
+		order[openCount] = event.id;
+		openCount++;
+	}
+	ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+	error = "hardware counters are only supported on Linux";
+#endif
+}
+
+PerfCounterGroup::~PerfCounterGroup()
+{
+#ifdef LINUX
+	for (uint32_t i = 0; i < openCount; i++)
+		close(fds[i]);
+#endif
+}
+
+bool PerfCounterGroup::Read(PerfCounterValues &values) const
+{
+#ifdef LINUX
+	if (leader < 0)
+		return false;
+
+	uint64_t buffer[3 + PERF_COUNTER_COUNT];
+	ssize_t expected = (ssize_t)((3 + openCount) * sizeof(uint64_t));
+	if (read(leader, buffer, sizeof(buffer)) != expected || buffer[0] != openCount)
+		return false;
+
+	uint64_t enabled = buffer[1];
+	uint64_t running = buffer[2];
+	double scale = running > 0 && running < enabled ? (double)enabled / running : 1.0;
+	values = PerfCounterValues();
+	for (uint32_t i = 0; i < openCount; i++)
+	{
+		values.values[order[i]] = scale == 1.0 ? buffer[3 + i] : (uint64_t)(buffer[3 + i] * scale);
+		values.validMask |= 1u << order[i];
+	}
+	return true;
+#else
+	(void)values;
+	return false;
+#endif
+}
+
+PerfCounterGroup *PerfCounters::ThreadGroup()
+{
+	if (!threadGroupOpened)
+	{
+		threadGroupOpened = true;
+		threadGroup.reset(new PerfCounterGroup());
+
+		SubsystemState &state = State();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (threadGroup->IsAvailable())
+			state.anyAvailable = true;
+		else if (state.unavailableReason.empty())
+			state.unavailableReason = threadGroup->GetError();
+	}
+	return threadGroup->IsAvailable() ? threadGroup.get() : nullptr;
+}
+
+bool PerfCounters::IsAvailable()
+{
+	return ThreadGroup() != nullptr;
+}
+
+void PerfCounters::Accumulate(const char *subsystem, const PerfCounterValues &delta)
+{
+	SubsystemState &state = State();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	for (SubsystemTotals &totals : state.subsystems)
+	{
+		if (totals.name == subsystem || strcmp(totals.name, subsystem) == 0)
+		{
+			totals.calls++;
+			totals.counters += delta;
+			return;
+		}
+	}
+	state.subsystems.push_back({ subsystem, 1, delta });
+}
+
+void PerfCounters::Reset()
+{
+	SubsystemState &state = State();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	state.subsystems.clear();
+}
+
+static void AppendRatio(std::ostringstream &out, double value, int width, bool percent)
+{
+	std::ostringstream cell;
+	if (value < 0.0)
+		cell << "-";
+	else if (percent)
+		cell << std::fixed << std::setprecision(2) << value * 100.0 << "%";
+	else
+		cell << std::fixed << std::setprecision(2) << value;
+	out << std::setw(width) << cell.str();
+}
+
+void PerfCounters::LogSummary()
+{
+	SubsystemState &state = State();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	if (!state.anyAvailable)
+	{
+		if (!state.unavailableReason.empty())
+			LOG_INFO(LOG_CATEGORY_PROFILER, "Hardware counters unavailable: %s", state.unavailableReason);
+		return;
+	}
+
+	std::ostringstream out;
+	out << "Hardware counters:" << std::endl;
+	out << std::left << "  " << std::setw(20) << "subsystem" << std::setw(8) << "calls" << std::setw(16) << "cycles"
+		<< std::setw(8) << "IPC" << std::setw(12) << "cache miss" << std::setw(8) << "MPKI" << std::setw(12) << "branch miss" << std::endl;
+	for (const SubsystemTotals &totals : state.subsystems)
+	{
+		out << "  " << std::setw(20) << totals.name << std::setw(8) << totals.calls << std::setw(16) << totals.counters.values[PERF_CYCLES];
+		AppendRatio(out, totals.counters.GetIpc(), 8, false);
+		AppendRatio(out, totals.counters.GetCacheMissRate(), 12, true);
+		AppendRatio(out, totals.counters.GetCacheMpki(), 8, false);
+		AppendRatio(out, totals.counters.GetBranchMissRate(), 12, true);
+		out << std::endl;
+	}
+	Log::WriteLines(LOG_LEVEL_INFO, LOG_CATEGORY_PROFILER, out.str());
+}
+
+std::string PerfCounters::ExportJson()
+{
+	SubsystemState &state = State();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	std::ostringstream out;
+	out << "{\"available\":" << (state.anyAvailable ? "true" : "false") << ",\"subsystems\":{";
+	for (size_t i = 0; i < state.subsystems.size(); i++)
+	{
+		const SubsystemTotals &totals = state.subsystems[i];
+		const PerfCounterValues &c = totals.counters;
+		out << (i ? "," : "") << "\"" << totals.name << "\":{\"calls\":" << totals.calls
+			<< ",\"cycles\":" << c.values[PERF_CYCLES] << ",\"instructions\":" << c.values[PERF_INSTRUCTIONS]
+			<< ",\"cacheReferences\":" << c.values[PERF_CACHE_REFERENCES] << ",\"cacheMisses\":" << c.values[PERF_CACHE_MISSES]
+			<< ",\"branches\":" << c.values[PERF_BRANCHES] << ",\"branchMisses\":" << c.values[PERF_BRANCH_MISSES]
+			<< ",\"ipc\":" << c.GetIpc() << ",\"cacheMissRate\":" << c.GetCacheMissRate()
+			<< ",\"branchMissRate\":" << c.GetBranchMissRate() << "}";
+	}
+	out << "}}";
+	return out.str();
+}
+
+bool PerfCounters::WriteJson(const std::string &path)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	file << ExportJson();
+	return (bool)file;
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include "profiler.h"
+
+#if !defined(PERF_COUNTERS_ENABLED)
+#if defined(LINUX)
+#define PERF_COUNTERS_ENABLED 1
+#else
+#define PERF_COUNTERS_ENABLED 0
+#endif
+#endif
+
+enum PerfCounterId
+{
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_REFERENCES,
+	PERF_CACHE_MISSES,
+	PERF_BRANCHES,
+	PERF_BRANCH_MISSES,
+	PERF_COUNTER_COUNT
+};
+
+struct PerfCounterValues
+{
+	uint64_t values[PERF_COUNTER_COUNT] = {};
+
+	// Bit per PerfCounterId that the PMU actually provided. Derived ratios are
+	// negative when an input is missing.
+	uint32_t validMask = 0;
+
+	bool IsValid(PerfCounterId id) const { return (validMask >> id) & 1; }
+	double GetIpc() const;
+	double GetCacheMissRate() const;
+	double GetBranchMissRate() const;
+
+	// Last-level cache misses per thousand instructions.
+	double GetCacheMpki() const;
+
+	PerfCounterValues operator-(const PerfCounterValues &other) const;
+	PerfCounterValues &operator+=(const PerfCounterValues &other);
+};
+
+// A perf_event_open group counting the calling thread in user mode. Events the
+// PMU does not provide are dropped individually; when even the cycle counter
+// cannot be opened (no PMU in the VM, perf_event_paranoid, non-Linux) the
+// group reports itself unavailable and reads return nothing.
+class PerfCounterGroup
+{
+public:
+	PerfCounterGroup();
+	~PerfCounterGroup();
+
+	PerfCounterGroup(const PerfCounterGroup &) = delete;
+	PerfCounterGroup &operator=(const PerfCounterGroup &) = delete;
+
+	bool IsAvailable() const { return leader >= 0; }
+	const std::string &GetError() const { return error; }
+
+	// Counts since the group was opened, scaled up when the kernel had to
+	// multiplex the PMU between groups. One syscall.
+	bool Read(PerfCounterValues &values) const;
+
+private:
+	int leader;
+	int fds[PERF_COUNTER_COUNT];
+	PerfCounterId order[PERF_COUNTER_COUNT];
+	uint32_t openCount;
+	std::string error;
+};
+
+// Per-subsystem totals collected by PerfCounterScope. Each thread lazily opens
+// its own group; reading it costs a syscall per scope edge, so counters belong
+// on coarse scopes such as a whole culling pass or mesh draw, not inner loops.
+class PerfCounters
+{
+public:
+	// Group for the calling thread, or null when counters are unavailable.
+	static PerfCounterGroup *ThreadGroup();
+
+	static bool IsAvailable();
+
+	static void Accumulate(const char *subsystem, const PerfCounterValues &delta);
+	static void Reset();
+
+	// IPC, cache and branch miss rates per subsystem, or a single line saying
+	// why there is nothing to report.
+	static void LogSummary();
+	static std::string ExportJson();
+	static bool WriteJson(const std::string &path);
+};
+
+class PerfCounterScope
+{
+public:
+	explicit PerfCounterScope(const char *subsystem) : subsystem(subsystem), group(PerfCounters::ThreadGroup())
+	{
+		if (group && !group->Read(start))
+			group = nullptr;
+	}
+
+	~PerfCounterScope()
+	{
+		PerfCounterValues end;
+		if (group && group->Read(end))
+			PerfCounters::Accumulate(subsystem, end - start);
+	}
+
+private:
+	const char *subsystem;
+	PerfCounterGroup *group;
+	PerfCounterValues start;
+};
+
+// Profiler scope that also attributes hardware counters to the subsystem.
+#if PERF_COUNTERS_ENABLED
+#define PROFILE_COUNTERS(subsystem) \
+	PROFILE_SCOPE(subsystem); \
+	PerfCounterScope PROFILE_CONCAT(perfCounterScope, __LINE__)(subsystem)
+#else
+#define PROFILE_COUNTERS(subsystem) PROFILE_SCOPE(subsystem)
+#endif
@@ -0,0 +1,90 @@
+#include "pipelinecompiler.h"
+#include "memtrack.h"
+#include "pipelinestatecache.h"
+#include "profiler.h"
+#include "timer.h"
+
+double PipelineJob::GetLatencyMs() const
+{
+	return IsReady() ? ElapsedMs(submitNs, readyNs) : 0.0;
+}
+
+double PipelineJob::GetCreateMs() const
+{
+	return IsReady() ? ElapsedMs(startNs, readyNs) : 0.0;
+}
+
+double PipelineJob::GetQueueMs() const
+{
+	return IsReady() ? ElapsedMs(submitNs, startNs) : 0.0;
+}
+
+PipelineCompiler::PipelineCompiler(PipelineStateCache &states, unsigned workerCount)
+	: states(states), pool(workerCount), compiled(0), failed(0),
+	frames(0), fallbackDraws(0), hitchFrames(0), frameHitched(false)
+{
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+		latencyHistogram[i] = 0;
+}
+
+PipelineCompiler::~PipelineCompiler()
+{
+	pool.WaitIdle();
+}
+
+std::shared_ptr<PipelineJob> PipelineCompiler::Submit(const GraphicsPipelineState &state)
+{
+	std::shared_ptr<PipelineJob> job = std::make_shared<PipelineJob>();
+	job->state = state;
+	job->submitNs = NowNs();
+	pool.Submit([this, job] { Compile(*job); });
+	return job;
+}
+
+void PipelineCompiler::Compile(PipelineJob &job)
+{
+	PROFILE_SCOPE("PipelineCompiler::Compile");
+	MEMORY_TAG(MEMTAG_PIPELINES);
+	job.startNs = NowNs();
+	job.pipeline = states.GetPipeline(job.state, &job.result);
+	job.readyNs = NowNs();
+
+	double latency = ElapsedMs(job.submitNs, job.readyNs);
+	int bucket = 0;
+	while (bucket < LATENCY_BUCKETS - 1 && latency >= (double)(1 << bucket))
+		bucket++;
+	latencyHistogram[bucket]++;
+	if (job.result == VK_SUCCESS)
+		compiled++;
+	else
+		failed++;
+
+	job.ready.store(true, std::memory_order_release);
+}
+
+void PipelineCompiler::WaitIdle()
+{
+	pool.WaitIdle();
+}
+
+void PipelineCompiler::BeginFrame()
+{
+	if (frameHitched)
+		hitchFrames++;
+	frameHitched = false;
+	frames++;
+}
+
+void PipelineCompiler::RecordFallbackDraw()
+{
+	fallbackDraws++;
+	frameHitched = true;
+}
+
+const char *PipelineCompiler::GetLatencyBucketLabel(int bucket)
+{
+	static const char *labels[LATENCY_BUCKETS] = {
+		"<1ms", "<2ms", "<4ms", "<8ms", "<16ms", "<32ms", "<64ms", "<128ms", "<256ms", "<512ms", "<1024ms", ">=1024ms"
+	};
+	return labels[bucket];
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "pipelinestate.h"
+#include "threadpool.h"
+
+class PipelineStateCache;
+
+// One pipeline being built in the background. The worker fills in pipeline and
+// result before publishing ready, so once IsReady() returns true both can be
+// read without further synchronization.
+class PipelineJob
+{
+public:
+	bool IsReady() const { return ready.load(std::memory_order_acquire); }
+	VkPipeline GetPipeline() const { return IsReady() ? pipeline : VK_NULL_HANDLE; }
+	VkResult GetResult() const { return result; }
+
+	// Submission to ready, including the time spent queued behind other jobs.
+	double GetLatencyMs() const;
+	// The creation call alone, and the time before a worker picked the job up.
+	double GetCreateMs() const;
+	double GetQueueMs() const;
+
+private:
+	friend class PipelineCompiler;
+
+	GraphicsPipelineState state;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult result = VK_NOT_READY;
+	uint64_t submitNs = 0;
+	uint64_t startNs = 0;
+	uint64_t readyNs = 0;
+	std::atomic<bool> ready{ false };
+};
+
+// Creates VkPipelines on worker threads. Callers keep drawing with a fallback
+// pipeline until the job reports ready; every such draw is counted as an avoided
+// hitch so the cost of on-demand compilation stays visible. Pipelines are
+// created through, and owned by, the shared PipelineStateCache.
+class PipelineCompiler
+{
+public:
+	// Readiness latency buckets are powers of two in milliseconds:
+	// <1, <2, <4 ... with the last bucket catching everything slower.
+	static const int LATENCY_BUCKETS = 12;
+
+	explicit PipelineCompiler(PipelineStateCache &states, unsigned workerCount = 0);
+	~PipelineCompiler();
+
+	std::shared_ptr<PipelineJob> Submit(const GraphicsPipelineState &state);
+
+	void WaitIdle();
+
+	void BeginFrame();
+	void RecordFallbackDraw();
+
+	uint64_t GetFallbackDraws() const { return fallbackDraws; }
+	// Counts the current frame too once it has drawn with a fallback.
+	uint64_t GetHitchFrames() const { return hitchFrames + (frameHitched ? 1 : 0); }
+	uint64_t GetFrameCount() const { return frames; }
+	uint64_t GetCompiledCount() const { return compiled.load(); }
+	uint64_t GetFailedCount() const { return failed.load(); }
+	uint64_t GetLatencyBucket(int bucket) const { return latencyHistogram[bucket].load(); }
+	unsigned GetWorkerCount() const { return pool.GetWorkerCount(); }
+
+	static const char *GetLatencyBucketLabel(int bucket);
+
+private:
+	void Compile(PipelineJob &job);
+
+	PipelineStateCache &states;
+	ThreadPool pool;
+
+	std::atomic<uint64_t> compiled;
+	std::atomic<uint64_t> failed;
+	std::atomic<uint64_t> latencyHistogram[LATENCY_BUCKETS];
+
+	// Only touched from the render thread.
+	uint64_t frames;
+	uint64_t fallbackDraws;
+	uint64_t hitchFrames;
+	bool frameHitched;
+};
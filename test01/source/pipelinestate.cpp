@@ -0,0 +1,235 @@
+#include "pipelinestate.h"
+#include "hash.h"
+
+VkPipelineColorBlendAttachmentState OpaqueBlendAttachment()
+{
+	VkPipelineColorBlendAttachmentState attachment = {};
+	attachment.blendEnable = VK_FALSE;
+	attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	return attachment;
+}
+
+VkPipelineColorBlendAttachmentState AlphaBlendAttachment()
+{
+	VkPipelineColorBlendAttachmentState attachment = OpaqueBlendAttachment();
+	attachment.blendEnable = VK_TRUE;
+	attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	attachment.colorBlendOp = VK_BLEND_OP_ADD;
+	attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	return attachment;
+}
+
+template <typename T>
+static uint64_t HashValue(uint64_t hash, const T &value)
+{
+	return HashCombine(hash, (uint64_t)value);
+}
+
+uint64_t HashPipelineState(const GraphicsPipelineState &state)
+{
+	// Field by field rather than hashing raw structs, so padding bytes never
+	// leak into the key.
+	uint64_t hash = state.stages.size();
+	for (const ShaderStageState &stage : state.stages)
+	{
+		hash = HashValue(hash, stage.stage);
+		hash = HashValue(hash, stage.module);
+		hash = HashCombine(hash, HashBytes(stage.entryPoint.data(), stage.entryPoint.size()));
+		for (const VkSpecializationMapEntry &entry : stage.specializationEntries)
+		{
+			hash = HashValue(hash, entry.constantID);
+			hash = HashValue(hash, entry.offset);
+			hash = HashValue(hash, entry.size);
+		}
+		hash = HashCombine(hash, HashBytes(stage.specializationData.data(), stage.specializationData.size()));
+	}
+
+	hash = HashValue(hash, state.vertexBindings.size());
+	for (const VkVertexInputBindingDescription &binding : state.vertexBindings)
+	{
+		hash = HashValue(hash, binding.binding);
+		hash = HashValue(hash, binding.stride);
+		hash = HashValue(hash, binding.inputRate);
+	}
+	hash = HashValue(hash, state.vertexAttributes.size());
+	for (const VkVertexInputAttributeDescription &attribute : state.vertexAttributes)
+	{
+		hash = HashValue(hash, attribute.location);
+		hash = HashValue(hash, attribute.binding);
+		hash = HashValue(hash, attribute.format);
+		hash = HashValue(hash, attribute.offset);
+	}
+
+	hash = HashValue(hash, state.topology);
+	hash = HashValue(hash, state.polygonMode);
+	hash = HashValue(hash, state.cullMode);
+	hash = HashValue(hash, state.frontFace);
+	hash = HashValue(hash, state.depthTest);
+	hash = HashValue(hash, state.depthWrite);
+	hash = HashValue(hash, state.depthCompareOp);
+	hash = HashValue(hash, state.samples);
+
+	hash = HashValue(hash, state.blendAttachments.size());
+	for (const VkPipelineColorBlendAttachmentState &blend : state.blendAttachments)
+	{
+		hash = HashValue(hash, blend.blendEnable);
+		hash = HashValue(hash, blend.srcColorBlendFactor);
+		hash = HashValue(hash, blend.dstColorBlendFactor);
+		hash = HashValue(hash, blend.colorBlendOp);
+		hash = HashValue(hash, blend.srcAlphaBlendFactor);
+		hash = HashValue(hash, blend.dstAlphaBlendFactor);
+		hash = HashValue(hash, blend.alphaBlendOp);
+		hash = HashValue(hash, blend.colorWriteMask);
+	}
+
+	hash = HashValue(hash, state.layout);
+	hash = HashValue(hash, state.renderPass);
+	hash = HashValue(hash, state.subpass);
+	hash = HashValue(hash, state.colorFormats.size());
+	for (VkFormat format : state.colorFormats)
+		hash = HashValue(hash, format);
+	hash = HashValue(hash, state.depthFormat);
+	return hash;
+}
+
+bool operator==(const ShaderStageState &a, const ShaderStageState &b)
+{
+	if (a.stage != b.stage || a.module != b.module || a.entryPoint != b.entryPoint ||
+		a.specializationData != b.specializationData || a.specializationEntries.size() != b.specializationEntries.size())
+		return false;
+	for (size_t i = 0; i < a.specializationEntries.size(); i++)
+	{
+		const VkSpecializationMapEntry &x = a.specializationEntries[i];
+		const VkSpecializationMapEntry &y = b.specializationEntries[i];
+		if (x.constantID != y.constantID || x.offset != y.offset || x.size != y.size)
+			return false;
+	}
+	return true;
+}
+
+static bool operator==(const VkVertexInputBindingDescription &a, const VkVertexInputBindingDescription &b)
+{
+	return a.binding == b.binding && a.stride == b.stride && a.inputRate == b.inputRate;
+}
+
+static bool operator==(const VkVertexInputAttributeDescription &a, const VkVertexInputAttributeDescription &b)
+{
+	return a.location == b.location && a.binding == b.binding && a.format == b.format && a.offset == b.offset;
+}
+
+static bool operator==(const VkPipelineColorBlendAttachmentState &a, const VkPipelineColorBlendAttachmentState &b)
+{
+	return a.blendEnable == b.blendEnable &&
+		a.srcColorBlendFactor == b.srcColorBlendFactor && a.dstColorBlendFactor == b.dstColorBlendFactor && a.colorBlendOp == b.colorBlendOp &&
+		a.srcAlphaBlendFactor == b.srcAlphaBlendFactor && a.dstAlphaBlendFactor == b.dstAlphaBlendFactor && a.alphaBlendOp == b.alphaBlendOp &&
+		a.colorWriteMask == b.colorWriteMask;
+}
+
+bool operator==(const GraphicsPipelineState &a, const GraphicsPipelineState &b)
+{
+	// Cheap scalar fields first so most mismatches exit early.
+	return a.topology == b.topology && a.polygonMode == b.polygonMode && a.cullMode == b.cullMode &&
+		a.frontFace == b.frontFace && a.depthTest == b.depthTest && a.depthWrite == b.depthWrite &&
+		a.depthCompareOp == b.depthCompareOp && a.samples == b.samples && a.layout == b.layout &&
+		a.renderPass == b.renderPass && a.subpass == b.subpass && a.depthFormat == b.depthFormat &&
+		a.colorFormats == b.colorFormats && a.blendAttachments == b.blendAttachments &&
+		a.vertexBindings == b.vertexBindings && a.vertexAttributes == b.vertexAttributes &&
+		a.stages == b.stages;
+}
+
+VkResult CreateGraphicsPipeline(VkDevice device, VkPipelineCache cache, const GraphicsPipelineState &state, VkPipeline *pipeline)
+{
+	std::vector<VkSpecializationInfo> specializations(state.stages.size());
+	std::vector<VkPipelineShaderStageCreateInfo> stages(state.stages.size());
+	for (size_t i = 0; i < state.stages.size(); i++)
+	{
+		const ShaderStageState &src = state.stages[i];
+		VkSpecializationInfo &spec = specializations[i];
+		spec = {};
+		spec.mapEntryCount = (uint32_t)src.specializationEntries.size();
+		spec.pMapEntries = src.specializationEntries.data();
+		spec.dataSize = src.specializationData.size();
+		spec.pData = src.specializationData.data();
+
+		VkPipelineShaderStageCreateInfo &stage = stages[i];
+		stage = {};
+		stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stage.stage = src.stage;
+		stage.module = src.module;
+		stage.pName = src.entryPoint.c_str();
+		stage.pSpecializationInfo = src.specializationEntries.empty() ? nullptr : &spec;
+	}
+
+	VkPipelineVertexInputStateCreateInfo vertexInput = {};
+	vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInput.vertexBindingDescriptionCount = (uint32_t)state.vertexBindings.size();
+	vertexInput.pVertexBindingDescriptions = state.vertexBindings.data();
+	vertexInput.vertexAttributeDescriptionCount = (uint32_t)state.vertexAttributes.size();
+	vertexInput.pVertexAttributeDescriptions = state.vertexAttributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = state.topology;
+
+	VkPipelineViewportStateCreateInfo viewport = {};
+	viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewport.viewportCount = 1;
+	viewport.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo raster = {};
+	raster.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	raster.polygonMode = state.polygonMode;
+	raster.cullMode = state.cullMode;
+	raster.frontFace = state.frontFace;
+	raster.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisample = {};
+	multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisample.rasterizationSamples = state.samples;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = state.depthTest;
+	depthStencil.depthWriteEnable = state.depthWrite;
+	depthStencil.depthCompareOp = state.depthCompareOp;
+
+	VkPipelineColorBlendStateCreateInfo blend = {};
+	blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	blend.attachmentCount = (uint32_t)state.blendAttachments.size();
+	blend.pAttachments = state.blendAttachments.data();
+
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamic = {};
+	dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic.dynamicStateCount = 2;
+	dynamic.pDynamicStates = dynamicStates;
+
+	VkPipelineRenderingCreateInfo rendering = {};
+	rendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	rendering.colorAttachmentCount = (uint32_t)state.colorFormats.size();
+	rendering.pColorAttachmentFormats = state.colorFormats.data();
+	rendering.depthAttachmentFormat = state.depthFormat;
+
+	VkGraphicsPipelineCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	info.pNext = state.renderPass == VK_NULL_HANDLE ? &rendering : nullptr;
+	info.stageCount = (uint32_t)stages.size();
+	info.pStages = stages.data();
+	info.pVertexInputState = &vertexInput;
+	info.pInputAssemblyState = &inputAssembly;
+	info.pViewportState = &viewport;
+	info.pRasterizationState = &raster;
+	info.pMultisampleState = &multisample;
+	info.pDepthStencilState = &depthStencil;
+	info.pColorBlendState = &blend;
+	info.pDynamicState = &dynamic;
+	info.layout = state.layout;
+	info.renderPass = state.renderPass;
+	info.subpass = state.subpass;
+	info.basePipelineIndex = -1;
+
+	return vkCreateGraphicsPipelines(device, cache, 1, &info, nullptr, pipeline);
+}
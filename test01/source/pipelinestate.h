@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+struct ShaderStageState
+{
+	VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+	VkShaderModule module = VK_NULL_HANDLE;
+	std::string entryPoint = "main";
+	std::vector<VkSpecializationMapEntry> specializationEntries;
+	std::vector<uint8_t> specializationData;
+};
+
+// Complete description of a graphics pipeline. Everything is held by value so a
+// state can be copied around freely; the Vulkan create-info structs are only
+// assembled inside CreateGraphicsPipeline. Viewport and scissor are always dynamic.
+struct GraphicsPipelineState
+{
+	std::vector<ShaderStageState> stages;
+	std::vector<VkVertexInputBindingDescription> vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	VkBool32 depthTest = VK_FALSE;
+	VkBool32 depthWrite = VK_FALSE;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+
+	// With renderPass left null the pipeline targets dynamic rendering and the
+	// attachment formats below are used instead.
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+	std::vector<VkFormat> colorFormats;
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+};
+
+VkPipelineColorBlendAttachmentState OpaqueBlendAttachment();
+VkPipelineColorBlendAttachmentState AlphaBlendAttachment();
+
+// Hashes and compares every field, including specialization data. Handles are
+// compared by value, so states referring to different modules or layouts are
+// never considered equal.
+uint64_t HashPipelineState(const GraphicsPipelineState &state);
+bool operator==(const ShaderStageState &a, const ShaderStageState &b);
+bool operator==(const GraphicsPipelineState &a, const GraphicsPipelineState &b);
+inline bool operator!=(const GraphicsPipelineState &a, const GraphicsPipelineState &b) { return !(a == b); }
+
+VkResult CreateGraphicsPipeline(VkDevice device, VkPipelineCache cache, const GraphicsPipelineState &state, VkPipeline *pipeline);
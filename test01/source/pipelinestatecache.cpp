@@ -0,0 +1,132 @@
+#include "pipelinestatecache.h"
+#include "log.h"
+#include "profiler.h"
+#include "vulkanhelpers.h"
+
+PipelineStateCache::PipelineStateCache(VkDevice device, VkPipelineCache pipelineCache)
+	: pipelineCount(0), lookups(0), hits(0), collisions(0)
+{
+	create = [device, pipelineCache](const GraphicsPipelineState &state, VkPipeline *pipeline)
+	{
+		return CreateGraphicsPipeline(device, pipelineCache, state, pipeline);
+	};
+	destroy = [device](VkPipeline pipeline)
+	{
+		vkDestroyPipeline(device, pipeline, nullptr);
+	};
+}
+
+PipelineStateCache::PipelineStateCache(CreateFunction create, DestroyFunction destroy)
+	: create(create), destroy(destroy), pipelineCount(0), lookups(0), hits(0), collisions(0)
+{
+}
+
+PipelineStateCache::~PipelineStateCache()
+{
+	Clear();
+}
+
+VkPipeline PipelineStateCache::GetPipeline(const GraphicsPipelineState &state, VkResult *result)
+{
+	uint64_t hash = HashPipelineState(state);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		lookups++;
+		VkPipeline pipeline = FindLocked(hash, state);
+		if (pipeline != VK_NULL_HANDLE)
+		{
+			hits++;
+			if (result)
+				*result = VK_SUCCESS;
+			return pipeline;
+		}
+	}
+
+	PROFILE_SCOPE("PipelineStateCache::Create");
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult createResult = create(state, &pipeline);
+	if (result)
+		*result = createResult;
+	if (createResult != VK_SUCCESS)
+	{
+		LOG_ERROR(LOG_CATEGORY_PIPELINES, "Pipeline creation failed: %s", VkResultToString(createResult));
+		return VK_NULL_HANDLE;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	VkPipeline existing = FindLocked(hash, state);
+	if (existing != VK_NULL_HANDLE)
+	{
+		// Another thread built the same state meanwhile.
+		destroy(pipeline);
+		hits++;
+		return existing;
+	}
+
+	std::vector<Entry> &bucket = entries[hash];
+	if (!bucket.empty())
+		collisions++;
+
+	Entry entry;
+	entry.state = state;
+	entry.pipeline = pipeline;
+	bucket.push_back(std::move(entry));
+	pipelineCount++;
+	return pipeline;
+}
+
+VkPipeline PipelineStateCache::Find(const GraphicsPipelineState &state) const
+{
+	uint64_t hash = HashPipelineState(state);
+	std::lock_guard<std::mutex> lock(mutex);
+	return FindLocked(hash, state);
+}
+
+VkPipeline PipelineStateCache::FindLocked(uint64_t hash, const GraphicsPipelineState &state) const
+{
+	auto it = entries.find(hash);
+	if (it == entries.end())
+		return VK_NULL_HANDLE;
+	for (const Entry &entry : it->second)
+	{
+		if (entry.state == state)
+			return entry.pipeline;
+	}
+	return VK_NULL_HANDLE;
+}
+
+void PipelineStateCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto &it : entries)
+	{
+		for (Entry &entry : it.second)
+			destroy(entry.pipeline);
+	}
+	entries.clear();
+	pipelineCount = 0;
+}
+
+size_t PipelineStateCache::GetPipelineCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pipelineCount;
+}
+
+uint64_t PipelineStateCache::GetLookupCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return lookups;
+}
+
+uint64_t PipelineStateCache::GetHitCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return hits;
+}
+
+uint64_t PipelineStateCache::GetCollisionCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return collisions;
+}
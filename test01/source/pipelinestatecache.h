@@ -0,0 +1,59 @@
+#pragma once
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "pipelinestate.h"
+
+// Deduplicates graphics pipelines by their complete state. Lookups hash the
+// state once and then compare full states within the hash bucket, so a 64-bit
+// collision costs an extra comparison but can never return the wrong pipeline.
+//
+// Safe to call from several threads: the async compiler's workers and the
+// render thread share one cache. Creation runs outside the lock, so two
+// threads asking for the same new state may both build it; the loser's
+// pipeline is destroyed and both get the one that was stored first.
+class PipelineStateCache
+{
+public:
+	typedef std::function<VkResult(const GraphicsPipelineState &state, VkPipeline *pipeline)> CreateFunction;
+	typedef std::function<void(VkPipeline pipeline)> DestroyFunction;
+
+	PipelineStateCache(VkDevice device, VkPipelineCache pipelineCache);
+
+	// For tests and benchmarks: pipelines come from the given functions instead
+	// of the driver.
+	PipelineStateCache(CreateFunction create, DestroyFunction destroy);
+	~PipelineStateCache();
+
+	// VK_NULL_HANDLE on failure, with the driver's error in result if given.
+	// Failures are not cached.
+	VkPipeline GetPipeline(const GraphicsPipelineState &state, VkResult *result = nullptr);
+	VkPipeline Find(const GraphicsPipelineState &state) const;
+	void Clear();
+
+	size_t GetPipelineCount() const;
+	uint64_t GetLookupCount() const;
+	uint64_t GetHitCount() const;
+	uint64_t GetCollisionCount() const;
+
+private:
+	struct Entry
+	{
+		GraphicsPipelineState state;
+		VkPipeline pipeline;
+	};
+
+	VkPipeline FindLocked(uint64_t hash, const GraphicsPipelineState &state) const;
+
+	CreateFunction create;
+	DestroyFunction destroy;
+	mutable std::mutex mutex;
+	std::unordered_map<uint64_t, std::vector<Entry>> entries;
+	size_t pipelineCount;
+	uint64_t lookups;
+	uint64_t hits;
+	uint64_t collisions;
+};
@@ -0,0 +1,213 @@
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include "memtrack.h"
+#include "timer.h"
+
+namespace
+{
+	struct ProfilerRegistry
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ProfileThreadBuffer>> buffers;
+		std::vector<ProfileThreadBuffer *> freeBuffers;	// released by exited threads
+		uint32_t threadCount = 0;
+
+		// Reference point pairing a tick value with steady_clock time.
+		uint64_t baseTicks = ProfilerTicks();
+		uint64_t baseNs = NowNs();
+	};
+
+	ProfilerRegistry &Registry()
+	{
+		static ProfilerRegistry registry;
+		return registry;
+	}
+
+	// Ticks per nanosecond, measured against steady_clock between the profiler's
+	// first use and now. Accuracy improves the longer the process has run.
+	double TicksPerNs()
+	{
+		ProfilerRegistry &registry = Registry();
+		uint64_t ticks = ProfilerTicks();
+		uint64_t ns = NowNs();
+		if (ns - registry.baseNs < 10000000)
+		{
+			// Too short for a stable ratio; spin for 10 ms to calibrate.
+			while (NowNs() - registry.baseNs < 10000000)
+			{
+			}
+			ticks = ProfilerTicks();
+			ns = NowNs();
+		}
+		return (double)(ticks - registry.baseTicks) / (double)(ns - registry.baseNs);
+	}
+
+	void AppendJsonString(std::ostringstream &out, const std::string &text)
+	{
+		out << '"';
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				out << '\\' << c;
+			else if ((unsigned char)c < 0x20)
+				out << ' ';
+			else
+				out << c;
+		}
+		out << '"';
+	}
+}
+
+// Returns the thread's buffer to the registry when the thread exits.
+struct ProfileThreadRelease
+{
+	ProfileThreadBuffer *buffer = nullptr;
+
+	~ProfileThreadRelease()
+	{
+		threadExited = true;
+		if (!buffer)
+			return;
+		ProfilerRegistry &registry = Registry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.freeBuffers.push_back(buffer);
+		Profiler::threadBuffer = nullptr;
+	}
+
+	// Set once the release has run; scopes in later thread-exit destructors
+	// get a buffer of their own that is never recycled.
+	static thread_local bool threadExited;
+};
+
+thread_local bool ProfileThreadRelease::threadExited = false;
+static thread_local ProfileThreadRelease threadRelease;
+
+ProfileThreadBuffer *Profiler::RegisterThread()
+{
+	MEMORY_TAG(MEMTAG_PROFILER);
+	ProfilerRegistry &registry = Registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	registry.threadCount++;
+	std::string name = registry.threadCount == 1 ? "main" : "thread " + std::to_string(registry.threadCount);
+	bool exited = ProfileThreadRelease::threadExited;
+	if (!exited && !registry.freeBuffers.empty())
+	{
+		threadBuffer = registry.freeBuffers.back();
+		registry.freeBuffers.pop_back();
+	}
+	else
+	{
+		registry.buffers.emplace_back(new ProfileThreadBuffer());
+		threadBuffer = registry.buffers.back().get();
+		threadBuffer->threadId = (uint32_t)registry.buffers.size();
+	}
+	threadBuffer->depth = 0;
+	threadBuffer->threadName = name;
+	if (!exited)
+		threadRelease.buffer = threadBuffer;
+	return threadBuffer;
+}
+
+ProfileThreadBuffer *Profiler::CreateTrack(const char *name)
+{
+	MEMORY_TAG(MEMTAG_PROFILER);
+	ProfilerRegistry &registry = Registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	registry.buffers.emplace_back(new ProfileThreadBuffer());
+	ProfileThreadBuffer *track = registry.buffers.back().get();
+	track->threadId = (uint32_t)registry.buffers.size();
+	track->threadName = name;
+	track->timestampsInNs = true;
+	return track;
+}
+
+void Profiler::SetThreadName(const char *name)
+{
+	ProfileThreadBuffer *buffer = ThreadBuffer();
+	std::lock_guard<std::mutex> lock(Registry().mutex);
+	buffer->threadName = name;
+}
+
+uint64_t Profiler::TicksToNs(uint64_t ticks)
+{
+#if defined(PROFILER_TICKS_TSC) || defined(__aarch64__)
+	static const double ticksPerNs = TicksPerNs();
+	ProfilerRegistry &registry = Registry();
+	double offset = ((double)ticks - (double)registry.baseTicks) / ticksPerNs;
+	return registry.baseNs + (int64_t)offset;
+#else
+	return ticks;
+#endif
+}
+
+uint64_t Profiler::GetEventCount()
+{
+	ProfilerRegistry &registry = Registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	uint64_t count = 0;
+	for (auto &buffer : registry.buffers)
+		count += buffer->head.load(std::memory_order_acquire);
+	return count;
+}
+
+std::string Profiler::ExportChromeTrace()
+{
+	MEMORY_TAG(MEMTAG_PROFILER);
+	ProfilerRegistry &registry = Registry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	std::ostringstream out;
+	out.precision(3);
+	out << std::fixed << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first = true;
+	for (auto &buffer : registry.buffers)
+	{
+		if (!first)
+			out << ",";
+		first = false;
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"args\":{\"name\":";
+		AppendJsonString(out, buffer->threadName);
+		out << "}}";
+
+		// The owner keeps writing while we copy, so once the copy is done
+		// re-read head and drop every slot it may have reached since.
+		uint64_t head = buffer->head.load(std::memory_order_acquire);
+		uint64_t begin = head > ProfileThreadBuffer::CAPACITY ? head - ProfileThreadBuffer::CAPACITY : 0;
+		std::vector<ProfileEvent> events;
+		events.reserve((size_t)(head - begin));
+		for (uint64_t i = begin; i < head; i++)
+			events.push_back(buffer->events[i & (ProfileThreadBuffer::CAPACITY - 1)]);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = buffer->head.load(std::memory_order_relaxed);
+		uint64_t valid = after + 1 > ProfileThreadBuffer::CAPACITY ? after + 1 - ProfileThreadBuffer::CAPACITY : 0;
+		for (uint64_t i = std::max(begin, valid); i < head; i++)
+		{
+			const ProfileEvent &event = events[(size_t)(i - begin)];
+			uint64_t start = buffer->timestampsInNs ? event.start : TicksToNs(event.start);
+			uint64_t end = buffer->timestampsInNs ? event.end : TicksToNs(event.end);
+			out << ",{\"name\":";
+			AppendJsonString(out, event.name);
+			out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+				<< ",\"ts\":" << (double)(int64_t)(start - registry.baseNs) / 1000.0
+				<< ",\"dur\":" << (double)(end - start) / 1000.0
+				<< ",\"args\":{\"depth\":" << event.depth << "}}";
+		}
+	}
+	out << "]}";
+	return out.str();
+}
+
+bool Profiler::WriteChromeTrace(const std::string &path)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	file << ExportChromeTrace();
+	return (bool)file;
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <string>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PROFILER_TICKS_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILER_TICKS_TSC
+#endif
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+// Raw timestamp used on the hot path. Converted to nanoseconds only when a
+// trace is exported, so a scope costs two counter reads and one store.
+inline uint64_t ProfilerTicks()
+{
+#if defined(PROFILER_TICKS_TSC)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t ticks;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+	return ticks;
+#else
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct ProfileEvent
+{
+	const char *name;
+	uint64_t start;
+	uint64_t end;
+	uint32_t depth;
+};
+
+// Single-producer ring owned by one thread. The owner publishes each event by
+// advancing head with release ordering; exporters read head with acquire and
+// copy the newest events. When the ring wraps, the oldest events are lost.
+//
+// When its thread exits the buffer is handed to the next thread that
+// registers, events and all, so short-lived pools do not each leave 2 MB
+// behind. The track then shows its holders one after another under the
+// latest one's name.
+struct ProfileThreadBuffer
+{
+	static const uint32_t CAPACITY = 1 << 16;
+
+	ProfileEvent events[CAPACITY];
+	std::atomic<uint64_t> head{ 0 };
+	uint32_t depth = 0;
+	uint32_t threadId = 0;
+	std::string threadName;
+
+	// Tracks fed from other clocks (GPU timestamps) store nanoseconds instead
+	// of raw ticks.
+	bool timestampsInNs = false;
+};
+
+class Profiler
+{
+public:
+	static ProfileThreadBuffer *ThreadBuffer()
+	{
+		ProfileThreadBuffer *buffer = threadBuffer;
+		return buffer ? buffer : RegisterThread();
+	}
+
+	static void Record(ProfileThreadBuffer *buffer, const char *name, uint64_t start, uint64_t end, uint32_t depth)
+	{
+		uint64_t index = buffer->head.load(std::memory_order_relaxed);
+		ProfileEvent &event = buffer->events[index & (ProfileThreadBuffer::CAPACITY - 1)];
+		event.name = name;
+		event.start = start;
+		event.end = end;
+		event.depth = depth;
+		buffer->head.store(index + 1, std::memory_order_release);
+	}
+
+	static void SetThreadName(const char *name);
+
+	// Adds a named timeline that is not tied to a CPU thread. Events are
+	// recorded with Record() in NowNs() nanoseconds, from one thread at a time.
+	static ProfileThreadBuffer *CreateTrack(const char *name);
+
+	// Converts raw ticks to nanoseconds on the steady_clock timeline, so
+	// profiler events can be merged with other NowNs() timestamps.
+	static uint64_t TicksToNs(uint64_t ticks);
+
+	// Chrome trace event format, loadable in chrome://tracing and Perfetto.
+	static std::string ExportChromeTrace();
+	static bool WriteChromeTrace(const std::string &path);
+
+	static uint64_t GetEventCount();
+
+private:
+	friend struct ProfileThreadRelease;
+
+	static ProfileThreadBuffer *RegisterThread();
+
+	// Constant-initialized in the header so other translation units access it
+	// directly instead of through a TLS wrapper call.
+	static inline thread_local ProfileThreadBuffer *threadBuffer = nullptr;
+};
+
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char *name)
+		: buffer(Profiler::ThreadBuffer()), name(name)
+	{
+		depth = buffer->depth++;
+		start = ProfilerTicks();
+	}
+
+	~ProfileScope()
+	{
+		uint64_t end = ProfilerTicks();
+		buffer->depth--;
+		Profiler::Record(buffer, name, start, end, depth);
+	}
+
+private:
+	ProfileThreadBuffer *buffer;
+	const char *name;
+	uint64_t start;
+	uint32_t depth;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// Names must be string literals or otherwise outlive the profiler.
+#if PROFILER_ENABLED
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#define PROFILE_THREAD_NAME(name) Profiler::SetThreadName(name)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_THREAD_NAME(name)
+#endif
@@ -0,0 +1,317 @@
+#include "scenerenderer.h"
+#include <algorithm>
+#include <string.h>
+#include <vector>
+#include "allocators.h"
+#include "common.h"
+#include "log.h"
+#include "mathutil.h"
+#include "mesh.h"
+#include "profiler.h"
+#include "simplify.h"
+
+static const int GRID_SIZE = 6;
+
+// Spheres in the meshlet scene, about 1.3M triangles for the whole grid.
+static const uint32_t DENSE_RINGS = 96;
+static const uint32_t DENSE_SEGMENTS = 192;
+
+static const float SCENE_FOV = 1.0f;
+static const float SCENE_NEAR = 0.1f;
+static const float SCENE_FAR = 100.0f;
+
+std::vector<float> BuildBasicVertices(const Mesh &mesh)
+{
+	std::vector<float> vertices;
+	vertices.reserve(mesh.vertices.size() * 6);
+	for (const Vertex &vertex : mesh.vertices)
+	{
+		for (int i = 0; i < 3; i++)
+			vertices.push_back(vertex.position[i]);
+		for (int i = 0; i < 3; i++)
+			vertices.push_back(vertex.normal[i] * 0.5f + 0.5f);
+	}
+	return vertices;
+}
+
+static Vec3 GetGridOffset(int x, int y)
+{
+	return Vec3((x - GRID_SIZE / 2 + 0.5f) * 2.0f, (y - GRID_SIZE / 2 + 0.5f) * 2.0f, 0.0f);
+}
+
+SceneRenderer::SceneRenderer(Common &common, uint32_t width, uint32_t height)
+	: common(common), width(width), height(height), indexCount(0)
+{
+}
+
+SceneRenderer::~SceneRenderer()
+{
+	if (common.device == VK_NULL_HANDLE)
+		return;
+	DestroyBuffer(common.device, indexBuffer);
+	DestroyBuffer(common.device, vertexBuffer);
+	DestroyImage(common.device, colorTarget);
+}
+
+bool SceneRenderer::Init()
+{
+	PROFILE_FUNCTION();
+	if (!CreateImage2D(common.device, common.physicalDevice, width, height, COLOR_FORMAT,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT, MEMTAG_RENDERER, colorTarget))
+	{
+		LOG_ERROR(LOG_CATEGORY_VULKAN, "Could not create %ux%u color target", width, height);
+		return false;
+	}
+	if (lightPass)
+	{
+		if (!lightPass->Init(SCENE_FOV, width, height, SCENE_NEAR, SCENE_FAR))
+			return false;
+		instanceRenderer->SetLights(lightPass.get());
+	}
+	if (instanceRenderer)
+		return instanceRenderer->Init() && (!lightPass || CreateLights());
+	return meshletRenderer ? CreateMeshletScene() : CreateMesh();
+}
+
+void SceneRenderer::EnableMeshlets(MeshletCulling culling)
+{
+	meshletRenderer.reset(new MeshletRenderer(common, culling));
+}
+
+void SceneRenderer::EnableObjects(uint32_t objectCount, InstanceSubmission submission, VertexFormat vertexFormat)
+{
+	instanceRenderer.reset(new InstanceRenderer(common, submission, objectCount, vertexFormat));
+}
+
+void SceneRenderer::EnableLights(uint32_t lightCount, LightBinning binning)
+{
+	if (!instanceRenderer)
+	{
+		LOG_WARNING(LOG_CATEGORY_GENERAL, "Lights only shade the object field, ignoring them");
+		return;
+	}
+	lightPass.reset(new LightClusterPass(common, lightCount, binning));
+}
+
+// Scattered through the field's box, a little above and below it so the
+// outer objects are lit from both sides.
+bool SceneRenderer::CreateLights()
+{
+	const ObjectField &field = instanceRenderer->GetField();
+	Vec3 minimum(0, 0, 0), maximum(0, 0, 0);
+	for (const BoundingSphere &bounds : field.bounds)
+	{
+		minimum = Vec3(std::min(minimum.x, bounds.center.x), std::min(minimum.y, bounds.center.y), std::min(minimum.z, bounds.center.z));
+		maximum = Vec3(std::max(maximum.x, bounds.center.x), std::max(maximum.y, bounds.center.y), std::max(maximum.z, bounds.center.z));
+	}
+	minimum.y -= 0.5f;
+	maximum.y += 1.0f;
+	std::vector<PointLight> lights;
+	GenerateLights(lights, lightPass->GetLightCount(), minimum, maximum, 1.0f, 3.0f, 50);
+	lightPass->SetLights(lights.data(), (uint32_t)lights.size());
+	return true;
+}
+
+bool SceneRenderer::CreateMeshletScene()
+{
+	Mesh sphere = GenerateSphere(DENSE_RINGS, DENSE_SEGMENTS, 0.8f);
+	Mesh grid;
+	grid.vertices.reserve(sphere.vertices.size() * GRID_SIZE * GRID_SIZE);
+	grid.indices.reserve(sphere.indices.size() * GRID_SIZE * GRID_SIZE);
+	for (int y = 0; y < GRID_SIZE; y++)
+	{
+		for (int x = 0; x < GRID_SIZE; x++)
+		{
+			uint32_t base = (uint32_t)grid.vertices.size();
+			Vec3 offset = GetGridOffset(x, y);
+			for (Vertex vertex : sphere.vertices)
+			{
+				vertex.position[0] += offset.x;
+				vertex.position[1] += offset.y;
+				vertex.position[2] += offset.z;
+				grid.vertices.push_back(vertex);
+			}
+			for (uint32_t index : sphere.indices)
+				grid.indices.push_back(base + index);
+		}
+	}
+	return meshletRenderer->Init(grid);
+}
+
+void SceneRenderer::LogSummary() const
+{
+	if (meshletRenderer)
+		meshletRenderer->LogSummary();
+	if (instanceRenderer)
+		instanceRenderer->LogSummary();
+	if (lightPass)
+		lightPass->LogSummary();
+}
+
+bool SceneRenderer::CreateMesh()
+{
+	Mesh sphere = GenerateSphere(24, 48, 0.8f);
+	std::vector<float> vertices = BuildBasicVertices(sphere);
+	indexCount = (uint32_t)sphere.indices.size();
+
+	return CreateFilledBuffer(common.device, common.physicalDevice, vertices.data(), vertices.size() * sizeof(float),
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MEMTAG_RENDERER, vertexBuffer) &&
+		CreateFilledBuffer(common.device, common.physicalDevice, sphere.indices.data(), sphere.indices.size() * sizeof(uint32_t),
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT, MEMTAG_RENDERER, indexBuffer);
+}
+
+static void TransitionColorTarget(VkCommandBuffer cmd, VkImage image, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+	VkImageLayout oldLayout, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess, VkImageLayout newLayout)
+{
+	VkImageMemoryBarrier2 barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	barrier.srcStageMask = srcStage;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstStageMask = dstStage;
+	barrier.dstAccessMask = dstAccess;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+	VkDependencyInfo dependency = {};
+	dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency.imageMemoryBarrierCount = 1;
+	dependency.pImageMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(cmd, &dependency);
+}
+
+SceneCamera SceneRenderer::GetCamera(uint64_t frameIndex) const
+{
+	float angle = frameIndex * 0.02f;
+	SceneCamera camera;
+	camera.eye = Vec3(sinf(angle) * 10.0f, 3.0f, cosf(angle) * 10.0f);
+	camera.view = Mat4::LookAt(camera.eye, Vec3(0, 0, 0), Vec3(0, 1, 0));
+	camera.viewProjection = Mat4::Perspective(SCENE_FOV, (float)width / height, SCENE_NEAR, SCENE_FAR) * camera.view;
+	camera.projectionScale = GetLodProjectionScale(SCENE_FOV, height);
+	return camera;
+}
+
+void SceneRenderer::Record(VkCommandBuffer cmd, uint64_t frameIndex, LinearArena &frameArena)
+{
+	PROFILE_FUNCTION();
+	GPU_PROFILE_ZONE(common.gpuProfiler.get(), cmd, "Scene");
+
+	SceneCamera camera = GetCamera(frameIndex);
+	const Mat4 &viewProjection = camera.viewProjection;
+
+	// Culling may dispatch compute, which has to happen outside rendering.
+	if (meshletRenderer)
+		meshletRenderer->Cull(cmd, frameIndex, viewProjection, camera.eye, frameArena);
+	if (instanceRenderer)
+		instanceRenderer->Cull(cmd, frameIndex, viewProjection, camera.eye, camera.projectionScale, frameArena);
+	if (lightPass)
+		lightPass->Update(cmd, frameIndex, camera.view);
+
+	// The previous frame's copy out of the target must finish before it is
+	// overwritten; its contents are not needed.
+	TransitionColorTarget(cmd, colorTarget.image, VK_PIPELINE_STAGE_2_COPY_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED,
+		VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+	VkRenderingAttachmentInfo colorAttachment = {};
+	colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	colorAttachment.imageView = colorTarget.view;
+	colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.clearValue.color = { { 0.1f, 0.1f, 0.12f, 1.0f } };
+
+	VkRenderingInfo renderingInfo = {};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	renderingInfo.renderArea = { { 0, 0 }, { width, height } };
+	renderingInfo.layerCount = 1;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachments = &colorAttachment;
+	vkCmdBeginRendering(cmd, &renderingInfo);
+
+	VkViewport viewport = { 0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f };
+	VkRect2D scissor = { { 0, 0 }, { width, height } };
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+	if (instanceRenderer)
+		instanceRenderer->Draw(cmd, viewProjection);
+	else if (meshletRenderer)
+		RecordMeshlets(cmd, viewProjection);
+	else
+		RecordGrid(cmd, viewProjection, frameArena);
+	vkCmdEndRendering(cmd);
+
+	TransitionColorTarget(cmd, colorTarget.image, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+}
+
+void SceneRenderer::RecordGrid(VkCommandBuffer cmd, const Mat4 &viewProjection, LinearArena &frameArena)
+{
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer.buffer, &offset);
+	vkCmdBindIndexBuffer(cmd, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+	// Draw packets are built in the frame arena, then recorded in one tight
+	// loop. There is no depth buffer, so submission order stays row order.
+	struct DrawPacket
+	{
+		VkPipeline pipeline;
+		BasicPushConstants constants;
+	};
+	ArenaVector<DrawPacket> draws{ ArenaAllocator<DrawPacket>(frameArena) };
+	draws.reserve(GRID_SIZE * GRID_SIZE);
+
+	static const uint32_t rowFeatures[] = { 0, BASIC_VERTEX_COLOR, BASIC_VERTEX_COLOR | BASIC_FOG, BASIC_VERTEX_COLOR | BASIC_GAMMA };
+	for (int y = 0; y < GRID_SIZE; y++)
+	{
+		uint32_t features = rowFeatures[y % 4];
+		VkPipeline pipeline = common.GetBasicPipeline(features);
+		if (pipeline == VK_NULL_HANDLE)
+			continue;
+
+		for (int x = 0; x < GRID_SIZE; x++)
+		{
+			DrawPacket draw = {};
+			draw.pipeline = pipeline;
+			Mat4 mvp = viewProjection * Mat4::Translation(GetGridOffset(x, y));
+			memcpy(draw.constants.mvp, mvp.m, sizeof(draw.constants.mvp));
+			draw.constants.fogColor[0] = 0.1f;
+			draw.constants.fogColor[1] = 0.1f;
+			draw.constants.fogColor[2] = 0.12f;
+			draw.constants.fogColor[3] = 0.05f;
+			draw.constants.features = features;
+			draws.push_back(draw);
+		}
+	}
+
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	for (const DrawPacket &draw : draws)
+	{
+		if (draw.pipeline != boundPipeline)
+		{
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.pipeline);
+			boundPipeline = draw.pipeline;
+		}
+		vkCmdPushConstants(cmd, common.GetBasicPipelineLayout(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			0, sizeof(draw.constants), &draw.constants);
+		vkCmdDrawIndexed(cmd, indexCount, 1, 0, 0, 0);
+	}
+}
+
+void SceneRenderer::RecordMeshlets(VkCommandBuffer cmd, const Mat4 &viewProjection)
+{
+	VkPipeline pipeline = common.GetBasicPipeline(BASIC_VERTEX_COLOR);
+	if (pipeline == VK_NULL_HANDLE)
+		return;
+
+	BasicPushConstants constants = {};
+	memcpy(constants.mvp, viewProjection.m, sizeof(constants.mvp));
+	constants.features = BASIC_VERTEX_COLOR;
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdPushConstants(cmd, common.GetBasicPipelineLayout(), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+		0, sizeof(constants), &constants);
+	meshletRenderer->Draw(cmd);
+}
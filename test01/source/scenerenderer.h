@@ -0,0 +1,79 @@
+#pragma once
+#include <memory>
+#include <stdint.h>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "instancerenderer.h"
+#include "lightclusterpass.h"
+#include "meshletrenderer.h"
+#include "vulkanhelpers.h"
+
+class Common;
+class LinearArena;
+struct Mesh;
+
+// Interleaved position and color (from the normal), the basic program's input.
+std::vector<float> BuildBasicVertices(const Mesh &mesh);
+
+struct SceneCamera
+{
+	Vec3 eye;
+	Mat4 view;
+	Mat4 viewProjection;
+	float projectionScale;	// GetLodProjectionScale for the viewport
+};
+
+// Draws a grid of spheres with the basic program into an offscreen color
+// target. Each row uses a different feature mask, so the permutation and
+// fallback paths are exercised every frame. With meshlets enabled the grid is
+// instead one dense mesh drawn through MeshletRenderer; with objects enabled
+// it is replaced by an InstanceRenderer field, optionally lit by clustered
+// point lights.
+class SceneRenderer
+{
+public:
+	SceneRenderer(Common &common, uint32_t width, uint32_t height);
+	~SceneRenderer();
+
+	// Call one of these before Init.
+	void EnableMeshlets(MeshletCulling culling);
+	void EnableObjects(uint32_t objectCount, InstanceSubmission submission, VertexFormat vertexFormat);
+
+	// After EnableObjects; only the object field is lit.
+	void EnableLights(uint32_t lightCount, LightBinning binning);
+
+	bool Init();
+
+	// Leaves the color target in TRANSFER_SRC_OPTIMAL so it can be copied out
+	// after the pass. Per-frame draw data is built in frameArena.
+	void Record(VkCommandBuffer cmd, uint64_t frameIndex, LinearArena &frameArena);
+
+	// The camera Record uses for a frame, for systems that follow it.
+	SceneCamera GetCamera(uint64_t frameIndex) const;
+
+	const ImageAllocation &GetColorTarget() const { return colorTarget; }
+	uint32_t GetWidth() const { return width; }
+	uint32_t GetHeight() const { return height; }
+
+	void LogSummary() const;
+
+	static const VkFormat COLOR_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+private:
+	bool CreateMesh();
+	bool CreateMeshletScene();
+	bool CreateLights();
+	void RecordGrid(VkCommandBuffer cmd, const Mat4 &viewProjection, LinearArena &frameArena);
+	void RecordMeshlets(VkCommandBuffer cmd, const Mat4 &viewProjection);
+
+	Common &common;
+	uint32_t width;
+	uint32_t height;
+	ImageAllocation colorTarget;
+	BufferAllocation vertexBuffer;
+	BufferAllocation indexBuffer;
+	uint32_t indexCount;
+	std::unique_ptr<MeshletRenderer> meshletRenderer;
+	std::unique_ptr<InstanceRenderer> instanceRenderer;
+	std::unique_ptr<LightClusterPass> lightPass;
+};
@@ -0,0 +1,246 @@
+#include "shaderpermutation.h"
+#include <string.h>
+#include "hash.h"
+#include "log.h"
+#include "memtrack.h"
+#include "pipelinestatecache.h"
+#include "profiler.h"
+#include "timer.h"
+#include "vulkanhelpers.h"
+
+ShaderPermutationManager::ShaderPermutationManager(VkDevice device, PipelineStateCache &states)
+	: device(device), states(states), compiler(nullptr), moduleRequests(0)
+{
+}
+
+ShaderPermutationManager::~ShaderPermutationManager()
+{
+	// Pending jobs still reference the modules. Their pipelines, like the
+	// finished ones, are destroyed with the state cache.
+	if (compiler)
+		compiler->WaitIdle();
+	for (auto &it : modules)
+		vkDestroyShaderModule(device, it.second.module, nullptr);
+}
+
+VkShaderModule ShaderPermutationManager::LoadModule(const std::vector<uint32_t> &spirv)
+{
+	PROFILE_FUNCTION();
+	MEMORY_TAG(MEMTAG_PIPELINES);
+	moduleRequests++;
+
+	// Hash collisions are resolved by comparing the full word stream, so two
+	// different shaders can never end up sharing a module.
+	uint64_t hash = HashBytes(spirv.data(), spirv.size() * sizeof(uint32_t));
+	auto range = modules.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second.code == spirv)
+			return it->second.module;
+	}
+
+	VkShaderModuleCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	info.codeSize = spirv.size() * sizeof(uint32_t);
+	info.pCode = spirv.data();
+
+	VkShaderModule module = VK_NULL_HANDLE;
+	VkResult result = vkCreateShaderModule(device, &info, nullptr, &module);
+	if (result != VK_SUCCESS)
+	{
+		LOG_ERROR(LOG_CATEGORY_PIPELINES, "vkCreateShaderModule failed: %s", VkResultToString(result));
+		return VK_NULL_HANDLE;
+	}
+
+	ModuleEntry entry;
+	entry.code = spirv;
+	entry.module = module;
+	modules.emplace(hash, std::move(entry));
+	return module;
+}
+
+size_t ShaderPermutationManager::GetUniqueModuleCount() const
+{
+	return modules.size();
+}
+
+size_t ShaderPermutationManager::GetPipelineCount() const
+{
+	size_t count = 0;
+	for (const Program &program : programs)
+	{
+		for (const auto &entry : program.pipelines)
+			count += entry.second != VK_NULL_HANDLE;
+	}
+	return count;
+}
+
+uint32_t ShaderPermutationManager::RegisterProgram(const std::string &name, const GraphicsPipelineState &baseState, const std::vector<ShaderFeature> &features)
+{
+	Program program;
+	program.name = name;
+	program.baseState = baseState;
+	program.features = features;
+	program.hasFallback = false;
+	program.fallbackMask = 0;
+	programs.push_back(std::move(program));
+	return (uint32_t)programs.size() - 1;
+}
+
+uint64_t ShaderPermutationManager::ValidMask(const Program &program, uint64_t featureMask) const
+{
+	if (program.features.size() >= 64)
+		return featureMask;
+	return featureMask & ((1ull << program.features.size()) - 1);
+}
+
+GraphicsPipelineState ShaderPermutationManager::SpecializeState(const Program &program, uint64_t featureMask) const
+{
+	std::vector<VkSpecializationMapEntry> entries(program.features.size());
+	std::vector<uint8_t> data(program.features.size() * sizeof(VkBool32));
+	for (size_t i = 0; i < program.features.size(); i++)
+	{
+		VkBool32 enabled = (featureMask >> i) & 1 ? VK_TRUE : VK_FALSE;
+		entries[i].constantID = program.features[i].constantId;
+		entries[i].offset = (uint32_t)(i * sizeof(VkBool32));
+		entries[i].size = sizeof(VkBool32);
+		memcpy(&data[i * sizeof(VkBool32)], &enabled, sizeof(VkBool32));
+	}
+
+	// Every stage gets the full set; entries for constants a stage does not
+	// declare are ignored by the driver.
+	GraphicsPipelineState state = program.baseState;
+	for (ShaderStageState &stage : state.stages)
+	{
+		stage.specializationEntries = entries;
+		stage.specializationData = data;
+	}
+	return state;
+}
+
+void ShaderPermutationManager::SetAsyncCompiler(PipelineCompiler *asyncCompiler)
+{
+	compiler = asyncCompiler;
+}
+
+bool ShaderPermutationManager::SetFallbackPermutation(uint32_t programId, uint64_t featureMask)
+{
+	if (programId >= programs.size())
+		return false;
+
+	Program &program = programs[programId];
+	featureMask = ValidMask(program, featureMask);
+	auto it = program.pipelines.find(featureMask);
+	VkPipeline pipeline = it != program.pipelines.end() ? it->second : CreateNow(programId, featureMask);
+	if (pipeline == VK_NULL_HANDLE)
+		return false;
+
+	program.hasFallback = true;
+	program.fallbackMask = featureMask;
+	return true;
+}
+
+VkPipeline ShaderPermutationManager::GetPipeline(uint32_t programId, uint64_t featureMask)
+{
+	MEMORY_TAG(MEMTAG_PIPELINES);
+	if (programId >= programs.size())
+		return VK_NULL_HANDLE;
+
+	Program &program = programs[programId];
+	featureMask = ValidMask(program, featureMask);
+
+	auto it = program.pipelines.find(featureMask);
+	if (it != program.pipelines.end())
+	{
+		if (it->second == VK_NULL_HANDLE && program.hasFallback)
+			return program.pipelines[program.fallbackMask];
+		return it->second;
+	}
+
+	if (compiler && program.hasFallback)
+		return GetAsync(programId, featureMask);
+	return CreateNow(programId, featureMask);
+}
+
+VkPipeline ShaderPermutationManager::CreateNow(uint32_t programId, uint64_t featureMask)
+{
+	PROFILE_FUNCTION();
+	Program &program = programs[programId];
+	GraphicsPipelineState state = SpecializeState(program, featureMask);
+
+	uint64_t start = NowNs();
+	VkResult result = VK_SUCCESS;
+	VkPipeline pipeline = states.GetPipeline(state, &result);
+	uint64_t end = NowNs();
+	if (result != VK_SUCCESS)
+	{
+		// Remembered so that later lookups do not retry on the draw path.
+		LOG_ERROR(LOG_CATEGORY_PIPELINES, "Pipeline creation failed for %s [%s]: %s", program.name, DescribeFeatures(programId, featureMask), VkResultToString(result));
+		program.pipelines[featureMask] = VK_NULL_HANDLE;
+		return VK_NULL_HANDLE;
+	}
+
+	program.pipelines[featureMask] = pipeline;
+	RecordStats(programId, featureMask, ElapsedMs(start, end), 0.0);
+	return pipeline;
+}
+
+VkPipeline ShaderPermutationManager::GetAsync(uint32_t programId, uint64_t featureMask)
+{
+	Program &program = programs[programId];
+	VkPipeline fallback = program.pipelines[program.fallbackMask];
+
+	auto it = program.pending.find(featureMask);
+	if (it == program.pending.end())
+	{
+		program.pending[featureMask] = compiler->Submit(SpecializeState(program, featureMask));
+		compiler->RecordFallbackDraw();
+		return fallback;
+	}
+
+	std::shared_ptr<PipelineJob> job = it->second;
+	if (!job->IsReady())
+	{
+		compiler->RecordFallbackDraw();
+		return fallback;
+	}
+
+	program.pending.erase(it);
+	if (job->GetResult() != VK_SUCCESS)
+	{
+		// Keep drawing with the fallback rather than retrying every frame.
+		LOG_ERROR(LOG_CATEGORY_PIPELINES, "Pipeline creation failed for %s [%s]: %s", program.name, DescribeFeatures(programId, featureMask), VkResultToString(job->GetResult()));
+		program.pipelines[featureMask] = VK_NULL_HANDLE;
+		return fallback;
+	}
+
+	program.pipelines[featureMask] = job->GetPipeline();
+	RecordStats(programId, featureMask, job->GetCreateMs(), job->GetQueueMs());
+	return job->GetPipeline();
+}
+
+void ShaderPermutationManager::RecordStats(uint32_t programId, uint64_t featureMask, double createMs, double queueMs)
+{
+	PermutationStats stats;
+	stats.program = programs[programId].name;
+	stats.features = DescribeFeatures(programId, featureMask);
+	stats.featureMask = featureMask;
+	stats.createMs = createMs;
+	stats.queueMs = queueMs;
+	permutationStats.push_back(stats);
+}
+
+std::string ShaderPermutationManager::DescribeFeatures(uint32_t programId, uint64_t featureMask) const
+{
+	const Program &program = programs[programId];
+	std::string names;
+	for (size_t i = 0; i < program.features.size(); i++)
+	{
+		if (!((featureMask >> i) & 1))
+			continue;
+		if (!names.empty())
+			names += "|";
+		names += program.features[i].name;
+	}
+	return names.empty() ? "none" : names;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "pipelinecompiler.h"
+#include "pipelinestate.h"
+
+class PipelineStateCache;
+
+// A feature toggle of a shader program. The shaders declare it as
+//     layout(constant_id = N) const bool NAME = false;
+// so every permutation shares the same SPIR-V and only the specialization data differs.
+struct ShaderFeature
+{
+	std::string name;
+	uint32_t constantId;
+};
+
+struct PermutationStats
+{
+	std::string program;
+	std::string features;
+	uint64_t featureMask;
+	double createMs;
+	double queueMs;	// waiting for a compiler worker; zero when built synchronously
+};
+
+// Owns shader modules and the pipelines of every requested permutation.
+// Modules are deduplicated on their SPIR-V contents, and pipelines are only
+// created the first time a permutation is asked for. With a PipelineCompiler
+// attached, missing permutations are built in the background and the program's
+// fallback permutation is returned until they are ready. Pipelines themselves
+// belong to the PipelineStateCache, so identical states are shared with every
+// other user of the cache.
+class ShaderPermutationManager
+{
+public:
+	ShaderPermutationManager(VkDevice device, PipelineStateCache &states);
+	~ShaderPermutationManager();
+
+	VkShaderModule LoadModule(const std::vector<uint32_t> &spirv);
+
+	// baseState must reference modules obtained from LoadModule; its
+	// specialization data is replaced per permutation. Returns the program id.
+	uint32_t RegisterProgram(const std::string &name, const GraphicsPipelineState &baseState, const std::vector<ShaderFeature> &features);
+
+	VkPipeline GetPipeline(uint32_t program, uint64_t featureMask);
+
+	void SetAsyncCompiler(PipelineCompiler *compiler);
+
+	// Builds the fallback permutation synchronously. It is typically an uber
+	// variant that evaluates the features at run time.
+	bool SetFallbackPermutation(uint32_t program, uint64_t featureMask);
+
+	std::string DescribeFeatures(uint32_t program, uint64_t featureMask) const;
+
+	size_t GetModuleRequestCount() const { return moduleRequests; }
+	size_t GetUniqueModuleCount() const;
+	// Live pipelines; failed permutations are left out.
+	size_t GetPipelineCount() const;
+	const std::vector<PermutationStats> &GetPermutationStats() const { return permutationStats; }
+
+private:
+	struct ModuleEntry
+	{
+		std::vector<uint32_t> code;
+		VkShaderModule module;
+	};
+
+	struct Program
+	{
+		std::string name;
+		GraphicsPipelineState baseState;
+		std::vector<ShaderFeature> features;
+		// VK_NULL_HANDLE marks a permutation that failed to build; it is not
+		// retried, and the fallback is drawn in its place.
+		std::unordered_map<uint64_t, VkPipeline> pipelines;
+		std::unordered_map<uint64_t, std::shared_ptr<PipelineJob>> pending;
+		bool hasFallback;
+		uint64_t fallbackMask;
+	};
+
+	uint64_t ValidMask(const Program &program, uint64_t featureMask) const;
+	GraphicsPipelineState SpecializeState(const Program &program, uint64_t featureMask) const;
+	VkPipeline CreateNow(uint32_t programId, uint64_t featureMask);
+	VkPipeline GetAsync(uint32_t programId, uint64_t featureMask);
+	void RecordStats(uint32_t programId, uint64_t featureMask, double createMs, double queueMs);
+
+	VkDevice device;
+	PipelineStateCache &states;
+	PipelineCompiler *compiler;
+	std::unordered_multimap<uint64_t, ModuleEntry> modules;
+	size_t moduleRequests;
+	std::vector<Program> programs;
+	std::vector<PermutationStats> permutationStats;
+};
@@ -0,0 +1,40 @@
+#version 450
+
+// Feature toggles, set per pipeline through specialization constants.
+layout(constant_id = 0) const bool USE_VERTEX_COLOR = false;
+layout(constant_id = 1) const bool USE_FOG = false;
+layout(constant_id = 2) const bool USE_GAMMA = false;
+
+// Uber variant: ignores the constants above and reads the same toggles from
+// pc.features, so one pipeline can stand in for any permutation while the
+// specialized one is still compiling.
+layout(constant_id = 3) const bool UBER = false;
+
+layout(push_constant) uniform PushConstants
+{
+	mat4 mvp;
+	vec4 fogColor;
+	uint features;
+} pc;
+
+layout(location = 0) in vec3 inColor;
+layout(location = 1) in float inDepth;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+	bool useVertexColor = UBER ? (pc.features & 1u) != 0u : USE_VERTEX_COLOR;
+	bool useFog = UBER ? (pc.features & 2u) != 0u : USE_FOG;
+	bool useGamma = UBER ? (pc.features & 4u) != 0u : USE_GAMMA;
+
+	vec3 color = useVertexColor ? inColor : vec3(1.0);
+	if (useFog)
+	{
+		float fog = clamp(inDepth * pc.fogColor.a, 0.0, 1.0);
+		color = mix(color, pc.fogColor.rgb, fog);
+	}
+	if (useGamma)
+		color = pow(color, vec3(1.0 / 2.2));
+	outColor = vec4(color, 1.0);
+}
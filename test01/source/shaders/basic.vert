@@ -0,0 +1,21 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+
+layout(push_constant) uniform PushConstants
+{
+	mat4 mvp;
+	vec4 fogColor;
+	uint features;
+} pc;
+
+layout(location = 0) out vec3 outColor;
+layout(location = 1) out float outDepth;
+
+void main()
+{
+	gl_Position = pc.mvp * vec4(inPosition, 1.0);
+	outColor = inColor;
+	outDepth = gl_Position.w;
+}
@@ -0,0 +1,72 @@
+#version 450
+
+// The instanced program's fragment stage with lights: the fragment's cluster
+// comes from its pixel and view depth, and only that cluster's lights are
+// shaded, as ShadeLights does in lightclusters.cpp. The lists are written by
+// lightcull.comp or uploaded from LightClusters.
+
+layout(location = 0) in vec3 inColor;
+layout(location = 1) in float inDepth;
+layout(location = 2) in vec3 inPosition;
+layout(location = 3) in vec3 inNormal;
+
+layout(location = 0) out vec4 outColor;
+
+struct Light
+{
+	vec4 positionRadius;
+	vec4 colorIntensity;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer Lights
+{
+	Light lights[];
+};
+
+layout(std430, set = 1, binding = 1) readonly buffer ClusterGrid
+{
+	uint tilesX;
+	uint tilesY;
+	uint slices;
+	uint maxLightsPerCluster;
+	float tileWidth;
+	float tileHeight;
+	float nearPlane;
+	float sliceScale;
+} grid;
+
+layout(std430, set = 1, binding = 2) readonly buffer Ranges
+{
+	uvec2 ranges[];
+};
+
+layout(std430, set = 1, binding = 3) readonly buffer LightIndices
+{
+	uint lightIndices[];
+};
+
+// Lights alone leave most of the field black.
+const float AMBIENT = 0.15;
+
+void main()
+{
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / vec2(grid.tileWidth, grid.tileHeight)), uvec2(grid.tilesX - 1, grid.tilesY - 1));
+	float slice = clamp(floor(log(inDepth / grid.nearPlane) * grid.sliceScale), 0.0, float(grid.slices - 1));
+	uvec2 range = ranges[(uint(slice) * grid.tilesY + tile.y) * grid.tilesX + tile.x];
+
+	vec3 normal = normalize(inNormal);
+	vec3 lighting = vec3(AMBIENT);
+	for (uint i = 0; i < range.y; i++)
+	{
+		Light light = lights[lightIndices[range.x + i]];
+		vec3 toLight = light.positionRadius.xyz - inPosition;
+		float distanceSquared = dot(toLight, toLight);
+		float radiusSquared = light.positionRadius.w * light.positionRadius.w;
+		if (distanceSquared >= radiusSquared)
+			continue;
+		float falloff = 1.0 - distanceSquared / radiusSquared;
+		float cosine = max(dot(normal, toLight) * inversesqrt(max(distanceSquared, 1e-8)), 0.0);
+		lighting += light.colorIntensity.rgb * (light.colorIntensity.w * falloff * falloff * cosine);
+	}
+	outColor = vec4(inColor * lighting, 1.0);
+}
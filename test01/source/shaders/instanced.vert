@@ -0,0 +1,87 @@
+#version 450
+
+// Mesh vertices placed and tinted per object, coloured by their normal.
+// gl_InstanceIndex is the object index: every draw passes it as
+// firstInstance, whether recorded on the CPU or written by instancecull.comp.
+//
+// With PACKED_VERTICES the inputs are a PackedVertex (vertexformat.h): snorm16
+// positions inside the mesh's quantization box and an octahedral normal,
+// both already normalized by the vertex fetch. Otherwise they are the float
+// Vertex fields.
+
+layout(constant_id = 0) const bool PACKED_VERTICES = true;
+
+layout(location = 0) in vec4 inPosition;
+layout(location = 1) in vec3 inNormal;
+
+struct Object
+{
+	vec4 positionScale;
+	vec4 color;
+	uint mesh;
+	uint pad0;
+	uint pad1;
+	uint pad2;
+};
+
+struct MeshInfo
+{
+	uint firstLod;
+	uint lodCount;
+	float radius;
+	uint pad;
+	vec4 quantization;	// offset, scale
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Objects
+{
+	Object objects[];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Meshes
+{
+	MeshInfo meshes[];
+};
+
+// Shared with basic.frag; mvp holds the view-projection matrix.
+layout(push_constant) uniform PushConstants
+{
+	mat4 mvp;
+	vec4 fogColor;
+	uint features;
+} pc;
+
+layout(location = 0) out vec3 outColor;
+layout(location = 1) out float outDepth;
+
+// World space, for clustered.frag; basic.frag leaves them unread.
+layout(location = 2) out vec3 outPosition;
+layout(location = 3) out vec3 outNormal;
+
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-v.z, 0.0);
+	v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+	return normalize(v);
+}
+
+void main()
+{
+	Object object = objects[gl_InstanceIndex];
+	vec3 localPosition = inPosition.xyz;
+	vec3 normal = inNormal;
+	if (PACKED_VERTICES)
+	{
+		vec4 quantization = meshes[object.mesh].quantization;
+		localPosition = quantization.xyz + inPosition.xyz * quantization.w;
+		normal = DecodeOctahedral(inNormal.xy);
+	}
+
+	vec3 position = localPosition * object.positionScale.w + object.positionScale.xyz;
+	gl_Position = pc.mvp * vec4(position, 1.0);
+	outColor = (normal * 0.5 + 0.5) * object.color.rgb;
+	outDepth = gl_Position.w;
+	outPosition = position;
+	outNormal = normal;
+}
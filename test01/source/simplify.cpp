@@ -0,0 +1,412 @@
+#include "simplify.h"
+#include <algorithm>
+#include <float.h>
+#include <string.h>
+#include "meshoptimize.h"
+#include "profiler.h"
+
+namespace
+{
+	// Symmetric 4x4 quadric: sum of squared distances to a set of planes,
+	// each weighted by the area it came from.
+	struct Quadric
+	{
+		double a00, a11, a22, a01, a02, a12;
+		double b0, b1, b2;
+		double c;
+		double weight;
+	};
+
+	void AddPlane(Quadric &q, const Vec3 &normal, float distance, double weight)
+	{
+		double x = normal.x, y = normal.y, z = normal.z, d = distance;
+		q.a00 += weight * x * x;
+		q.a11 += weight * y * y;
+		q.a22 += weight * z * z;
+		q.a01 += weight * x * y;
+		q.a02 += weight * x * z;
+		q.a12 += weight * y * z;
+		q.b0 += weight * x * d;
+		q.b1 += weight * y * d;
+		q.b2 += weight * z * d;
+		q.c += weight * d * d;
+		q.weight += weight;
+	}
+
+	void AddQuadric(Quadric &q, const Quadric &other)
+	{
+		q.a00 += other.a00;
+		q.a11 += other.a11;
+		q.a22 += other.a22;
+		q.a01 += other.a01;
+		q.a02 += other.a02;
+		q.a12 += other.a12;
+		q.b0 += other.b0;
+		q.b1 += other.b1;
+		q.b2 += other.b2;
+		q.c += other.c;
+		q.weight += other.weight;
+	}
+
+	// Mean squared distance from p to the quadric's planes.
+	double Evaluate(const Quadric &q, const Vec3 &p)
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double r = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+			+ 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+			+ 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+		return q.weight > 0.0 ? std::max(r, 0.0) / q.weight : 0.0;
+	}
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		float cost;	// squared relative error
+	};
+
+	const uint8_t VERTEX_MANIFOLD = 0;
+	const uint8_t VERTEX_BORDER = 1;	// on an open edge
+	const uint8_t VERTEX_SEAM = 2;	// shares its position with other vertices
+
+	// Triangles around each vertex, CSR style.
+	struct Adjacency
+	{
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> triangles;
+
+		void Build(const uint32_t *indices, size_t indexCount, size_t vertexCount)
+		{
+			offsets.assign(vertexCount + 1, 0);
+			for (size_t i = 0; i < indexCount; i++)
+				offsets[indices[i] + 1]++;
+			for (size_t v = 0; v < vertexCount; v++)
+				offsets[v + 1] += offsets[v];
+			triangles.resize(indexCount);
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indexCount; i++)
+				triangles[fill[indices[i]]++] = (uint32_t)(i / 3);
+		}
+	};
+
+	bool HasEdge(const uint32_t *triangle, uint32_t a, uint32_t b)
+	{
+		return (triangle[0] == a && triangle[1] == b) || (triangle[1] == a && triangle[2] == b) || (triangle[2] == a && triangle[0] == b);
+	}
+}
+
+float GetMeshExtent(const Mesh &mesh)
+{
+	if (mesh.vertices.empty())
+		return 0.0f;
+	Vec3 minimum, maximum;
+	mesh.ComputeBounds(minimum, maximum);
+	Vec3 size = maximum - minimum;
+	return std::max(size.x, std::max(size.y, size.z));
+}
+
+size_t SimplifyMesh(uint32_t *destination, const Mesh &mesh, size_t targetIndexCount, float targetError,
+	float *resultError, const SimplifyOptions &options)
+{
+	PROFILE_FUNCTION();
+	size_t vertexCount = mesh.vertices.size();
+	float maxError = 0.0f;
+	if (resultError)
+		*resultError = 0.0f;
+	if (vertexCount == 0)
+		return 0;
+
+	// Positions scaled to a unit extent, so errors are relative.
+	Vec3 minimum, maximum;
+	mesh.ComputeBounds(minimum, maximum);
+	float extent = GetMeshExtent(mesh);
+	float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+	std::vector<Vec3> positions(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		const float *p = mesh.vertices[v].position;
+		positions[v] = (Vec3(p[0], p[1], p[2]) - minimum) * scale;
+	}
+
+	// One representative per distinct position; seam vertices share it.
+	std::vector<uint32_t> canonical(vertexCount);
+	{
+		std::vector<uint32_t> order(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+			order[v] = (uint32_t)v;
+		auto less = [&](uint32_t a, uint32_t b)
+		{
+			return memcmp(mesh.vertices[a].position, mesh.vertices[b].position, sizeof(float) * 3) < 0;
+		};
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return less(a, b) || (!less(b, a) && a < b); });
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			bool same = i > 0 && memcmp(mesh.vertices[order[i]].position, mesh.vertices[order[i - 1]].position, sizeof(float) * 3) == 0;
+			canonical[order[i]] = same ? canonical[order[i - 1]] : order[i];
+		}
+	}
+
+	// Triangles that have collapsed to a line or point draw nothing; drop
+	// them up front.
+	size_t indexCount = 0;
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		uint32_t a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+		if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[c] == canonical[a])
+			continue;
+		destination[indexCount++] = a;
+		destination[indexCount++] = b;
+		destination[indexCount++] = c;
+	}
+
+	// Classify on positions: an edge is open when no triangle runs it the
+	// other way.
+	std::vector<uint8_t> kind(vertexCount, VERTEX_MANIFOLD);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		if (canonical[v] != v)
+		{
+			kind[v] = VERTEX_SEAM;
+			kind[canonical[v]] = VERTEX_SEAM;
+		}
+	}
+	std::vector<uint32_t> positionIndices(indexCount);
+	for (size_t i = 0; i < indexCount; i++)
+		positionIndices[i] = canonical[destination[i]];
+	Adjacency positionAdjacency;
+	positionAdjacency.Build(positionIndices.data(), indexCount, vertexCount);
+	auto isOpen = [&](const uint32_t *indices, uint32_t a, uint32_t b)
+	{
+		for (uint32_t k = positionAdjacency.offsets[b]; k < positionAdjacency.offsets[b + 1]; k++)
+		{
+			if (HasEdge(indices + positionAdjacency.triangles[k] * 3, b, a))
+				return false;
+		}
+		return true;
+	};
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t a = positionIndices[i];
+		uint32_t b = positionIndices[i - i % 3 + (i + 1) % 3];
+		if (isOpen(positionIndices.data(), a, b))
+		{
+			kind[a] |= VERTEX_BORDER;
+			kind[b] |= VERTEX_BORDER;
+		}
+	}
+
+	// Plane quadrics per position, plus planes through open edges at right
+	// angles to the face so that border vertices that may move stay on the
+	// outline.
+	std::vector<Quadric> quadrics(vertexCount, Quadric());
+	for (size_t i = 0; i < indexCount; i += 3)
+	{
+		uint32_t a = positionIndices[i], b = positionIndices[i + 1], c = positionIndices[i + 2];
+		Vec3 normal = Cross(positions[c] - positions[a], positions[b] - positions[a]);
+		float area = Length(normal);
+		if (area <= 0.0f)
+			continue;
+		normal = normal * (1.0f / area);
+		float distance = -Dot(normal, positions[a]);
+		AddPlane(quadrics[a], normal, distance, area);
+		AddPlane(quadrics[b], normal, distance, area);
+		AddPlane(quadrics[c], normal, distance, area);
+
+		if (options.lockBorders)
+			continue;
+		uint32_t corners[3] = { a, b, c };
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t from = corners[k], to = corners[(k + 1) % 3];
+			if (!isOpen(positionIndices.data(), from, to))
+				continue;
+			Vec3 edge = positions[to] - positions[from];
+			float length = Length(edge);
+			if (length <= 0.0f)
+				continue;
+			Vec3 side = Normalize(Cross(edge, normal));
+			float sideDistance = -Dot(side, positions[from]);
+			AddPlane(quadrics[from], side, sideDistance, length * length * 10.0f);
+			AddPlane(quadrics[to], side, sideDistance, length * length * 10.0f);
+		}
+	}
+
+	auto attributeCost = [&](uint32_t from, uint32_t to)
+	{
+		const Vertex &a = mesh.vertices[from];
+		const Vertex &b = mesh.vertices[to];
+		float dn = 0.0f;
+		for (int k = 0; k < 3; k++)
+			dn += (a.normal[k] - b.normal[k]) * (a.normal[k] - b.normal[k]);
+		float duv = (a.uv[0] - b.uv[0]) * (a.uv[0] - b.uv[0]) + (a.uv[1] - b.uv[1]) * (a.uv[1] - b.uv[1]);
+		return options.normalWeight * options.normalWeight * dn + options.uvWeight * options.uvWeight * duv;
+	};
+
+	float errorLimit = targetError * targetError;
+	std::vector<Collapse> collapses;
+	std::vector<Collapse> best(vertexCount);
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<uint8_t> touched(vertexCount);
+	Adjacency adjacency;
+	targetIndexCount -= targetIndexCount % 3;
+
+	// Passes of independent collapses, cheapest first, each vertex involved
+	// in at most one per pass so costs stay valid; then the index buffer is
+	// rebuilt and costs recomputed.
+	while (indexCount > targetIndexCount)
+	{
+		adjacency.Build(destination, indexCount, vertexCount);
+
+		// The cheapest collapse out of each vertex.
+		for (size_t v = 0; v < vertexCount; v++)
+			best[v] = { (uint32_t)v, (uint32_t)v, FLT_MAX };
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			uint32_t a = destination[i];
+			uint32_t b = destination[i - i % 3 + (i + 1) % 3];
+			for (int direction = 0; direction < 2; direction++)
+			{
+				uint32_t from = direction ? b : a, to = direction ? a : b;
+				if (kind[from] & VERTEX_SEAM)
+					continue;
+				if (kind[from] & VERTEX_BORDER)
+				{
+					// Only along the outline, onto another outline vertex.
+					if (options.lockBorders || !(kind[canonical[to]] & VERTEX_BORDER) ||
+						(!isOpen(positionIndices.data(), canonical[from], canonical[to]) && !isOpen(positionIndices.data(), canonical[to], canonical[from])))
+						continue;
+				}
+				float cost = (float)Evaluate(quadrics[from], positions[to]) + attributeCost(from, to);
+				if (cost < best[from].cost)
+					best[from] = { from, to, cost };
+			}
+		}
+		collapses.clear();
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			if (best[v].cost <= errorLimit)
+				collapses.push_back(best[v]);
+		}
+		if (collapses.empty())
+			break;
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) { return x.cost < y.cost; });
+
+		for (size_t v = 0; v < vertexCount; v++)
+			remap[v] = (uint32_t)v;
+		memset(touched.data(), 0, vertexCount);
+		size_t remaining = indexCount / 3;
+		size_t performed = 0;
+		for (const Collapse &collapse : collapses)
+		{
+			if (remaining * 3 <= targetIndexCount)
+				break;
+			uint32_t from = collapse.from, to = collapse.to;
+			if (touched[from] || touched[canonical[to]])
+				continue;
+
+			// Reject collapses that would turn a surviving triangle over.
+			bool flips = false;
+			uint32_t removed = 0;
+			for (uint32_t k = adjacency.offsets[from]; k < adjacency.offsets[from + 1] && !flips; k++)
+			{
+				const uint32_t *triangle = destination + adjacency.triangles[k] * 3;
+				uint32_t corner[3];
+				bool hasTarget = false;
+				for (int j = 0; j < 3; j++)
+				{
+					corner[j] = canonical[remap[triangle[j]]];
+					hasTarget |= corner[j] == canonical[to];
+				}
+				if (hasTarget)
+				{
+					removed++;
+					continue;
+				}
+				Vec3 before = Cross(positions[corner[2]] - positions[corner[0]], positions[corner[1]] - positions[corner[0]]);
+				for (int j = 0; j < 3; j++)
+				{
+					if (triangle[j] == from)
+						corner[j] = canonical[to];
+				}
+				Vec3 after = Cross(positions[corner[2]] - positions[corner[0]], positions[corner[1]] - positions[corner[0]]);
+				flips = Dot(before, after) <= 0.0f;
+			}
+			if (flips)
+				continue;
+
+			remap[from] = to;
+			touched[from] = 1;
+			touched[canonical[to]] = 1;
+			AddQuadric(quadrics[canonical[to]], quadrics[from]);
+			maxError = std::max(maxError, collapse.cost);
+			remaining -= std::min<size_t>(removed, remaining);
+			performed++;
+		}
+		if (performed == 0)
+			break;
+
+		size_t written = 0;
+		for (size_t i = 0; i < indexCount; i += 3)
+		{
+			uint32_t a = remap[destination[i]], b = remap[destination[i + 1]], c = remap[destination[i + 2]];
+			if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[c] == canonical[a])
+				continue;
+			destination[written++] = a;
+			destination[written++] = b;
+			destination[written++] = c;
+		}
+		indexCount = written;
+		for (size_t i = 0; i < indexCount; i++)
+			positionIndices[i] = canonical[destination[i]];
+		positionIndices.resize(indexCount);
+		positionAdjacency.Build(positionIndices.data(), indexCount, vertexCount);
+	}
+
+	if (resultError)
+		*resultError = sqrtf(maxError);
+	return indexCount;
+}
+
+void BuildLodChain(const Mesh &mesh, LodChain &chain, uint32_t maxLods, float reduction, float maxError)
+{
+	PROFILE_FUNCTION();
+	chain.indices.assign(mesh.indices.begin(), mesh.indices.end());
+	chain.lods.clear();
+	chain.lods.push_back({ 0, (uint32_t)mesh.indices.size(), 0.0f });
+
+	float extent = GetMeshExtent(mesh);
+	std::vector<uint32_t> simplified(mesh.indices.size());
+	std::vector<uint32_t> ordered(mesh.indices.size());
+	while (chain.lods.size() < maxLods)
+	{
+		const MeshLod &previous = chain.lods.back();
+		size_t target = (size_t)(previous.indexCount / 3 * reduction) * 3;
+		float error = 0.0f;
+		size_t count = SimplifyMesh(simplified.data(), mesh, target, maxError, &error);
+		if (count == 0 || count > previous.indexCount * 9 / 10)
+			break;
+
+		OptimizeVertexCache(ordered.data(), simplified.data(), count, mesh.vertices.size());
+		MeshLod lod;
+		lod.firstIndex = (uint32_t)chain.indices.size();
+		lod.indexCount = (uint32_t)count;
+		lod.error = std::max(previous.error, error * extent);
+		chain.indices.insert(chain.indices.end(), ordered.begin(), ordered.begin() + count);
+		chain.lods.push_back(lod);
+	}
+}
+
+uint32_t SelectLod(const MeshLod *lods, uint32_t lodCount, float errorScale, float distance, float projectionScale, float pixelError)
+{
+	if (pixelError <= 0.0f)
+		return 0;
+	float pixelsPerUnit = errorScale * projectionScale / std::max(distance, 1e-4f);
+	uint32_t selected = 0;
+	for (uint32_t lod = 1; lod < lodCount; lod++)
+	{
+		if (lods[lod].error * pixelsPerUnit > pixelError)
+			break;
+		selected = lod;
+	}
+	return selected;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "mesh.h"
+
+struct SimplifyOptions
+{
+	// Attribute differences count as this much distance, relative to the
+	// mesh extent, per unit of difference.
+	float normalWeight = 0.02f;
+	float uvWeight = 0.02f;
+
+	// Vertices on open edges never move, so separate parts keep their
+	// outlines and tiled meshes keep matching edges.
+	bool lockBorders = true;
+};
+
+// Quadric error metric simplification (Garland and Heckbert) by half-edge
+// collapse: vertices only ever move onto a neighbour, so the vertex buffer is
+// shared by every result and attributes never need interpolating. Vertices
+// split along attribute seams stay where they are.
+//
+// Writes at most mesh.indices.size() indices to destination and returns how
+// many; stops at targetIndexCount or before a collapse whose error, relative
+// to the mesh extent, would exceed targetError. resultError receives the
+// largest error reached, also relative.
+size_t SimplifyMesh(uint32_t *destination, const Mesh &mesh, size_t targetIndexCount, float targetError,
+	float *resultError = nullptr, const SimplifyOptions &options = SimplifyOptions());
+
+// Largest dimension of the mesh bounds, to turn relative errors into
+// object-space ones.
+float GetMeshExtent(const Mesh &mesh);
+
+struct MeshLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error;	// object space
+};
+
+// LOD 0 is the mesh itself; each following level targets reduction times the
+// previous triangle count. All levels index mesh.vertices.
+struct LodChain
+{
+	std::vector<uint32_t> indices;
+	std::vector<MeshLod> lods;
+};
+
+// Stops early once a level saves less than a tenth of the previous one's
+// triangles or its error passes maxError (relative).
+void BuildLodChain(const Mesh &mesh, LodChain &chain, uint32_t maxLods = 6, float reduction = 0.5f, float maxError = 0.1f);
+
+// Pixels per object-space unit at distance 1 for a perspective projection.
+inline float GetLodProjectionScale(float fovY, uint32_t viewportHeight)
+{
+	return viewportHeight / (2.0f * tanf(fovY * 0.5f));
+}
+
+// The coarsest level whose error, scaled by errorScale (the object's scale)
+// and projected at distance, stays within pixelError. pixelError <= 0 always
+// picks LOD 0.
+uint32_t SelectLod(const MeshLod *lods, uint32_t lodCount, float errorScale, float distance, float projectionScale, float pixelError);
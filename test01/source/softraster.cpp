@@ -0,0 +1,157 @@
+#include "softraster.h"
+#include <algorithm>
+#include <string.h>
+#include "perfcounters.h"
+
+DepthRasterizer::DepthRasterizer(uint32_t width, uint32_t height)
+	: width(width), height(height), depth((size_t)width * height, 1.0f)
+{
+	ResetStats();
+}
+
+void DepthRasterizer::Clear(float value)
+{
+	std::fill(depth.begin(), depth.end(), value);
+}
+
+void DepthRasterizer::ResetStats()
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+void DepthRasterizer::DrawIndexed(const float *positions, size_t strideBytes, const uint32_t *indices, size_t indexCount, const Mat4 &mvp)
+{
+	DrawIndexedWith([=](uint32_t index)
+	{
+		const float *p = (const float *)((const uint8_t *)positions + index * strideBytes);
+		return Vec4(p[0], p[1], p[2], 1.0f);
+	}, indices, indexCount, mvp);
+}
+
+void DepthRasterizer::DrawIndexedQuantized(const int16_t *positions, size_t strideBytes, const uint32_t *indices, size_t indexCount,
+	const QuantizationBox &box, const Mat4 &mvp)
+{
+	// The encoder never writes -32768, so the snorm clamp is not needed.
+	Mat4 decode = Mat4::Translation(Vec3(box.offset[0], box.offset[1], box.offset[2]));
+	decode.m[0] = decode.m[5] = decode.m[10] = box.scale / 32767.0f;
+	DrawIndexedWith([=](uint32_t index)
+	{
+		const int16_t *p = (const int16_t *)((const uint8_t *)positions + index * strideBytes);
+		return Vec4(p[0], p[1], p[2], 1.0f);
+	}, indices, indexCount, mvp * decode);
+}
+
+template <typename Fetch>
+void DepthRasterizer::DrawIndexedWith(Fetch fetch, const uint32_t *indices, size_t indexCount, const Mat4 &mvp)
+{
+	PROFILE_COUNTERS("Rasterizer");
+	uint32_t cacheTags[VERTEX_CACHE_SIZE];
+	ScreenVertex cacheValues[VERTEX_CACHE_SIZE];
+	for (int i = 0; i < VERTEX_CACHE_SIZE; i++)
+		cacheTags[i] = UINT32_MAX;
+	int cacheNext = 0;
+
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		ScreenVertex corners[3];
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t index = indices[i + k];
+			int slot = -1;
+			for (int c = 0; c < VERTEX_CACHE_SIZE; c++)
+			{
+				if (cacheTags[c] == index)
+				{
+					slot = c;
+					break;
+				}
+			}
+			if (slot >= 0)
+			{
+				stats.vertexCacheHits++;
+				corners[k] = cacheValues[slot];
+				continue;
+			}
+
+			Vec4 clip = mvp * fetch(index);
+			ScreenVertex v;
+			v.clipped = clip.w <= 1e-5f;
+			float invW = v.clipped ? 0.0f : 1.0f / clip.w;
+			v.x = (clip.x * invW * 0.5f + 0.5f) * width;
+			v.y = (clip.y * invW * 0.5f + 0.5f) * height;
+			v.z = clip.z * invW;
+			stats.vertexTransforms++;
+
+			cacheTags[cacheNext] = index;
+			cacheValues[cacheNext] = v;
+			cacheNext = (cacheNext + 1) % VERTEX_CACHE_SIZE;
+			corners[k] = v;
+		}
+
+		stats.triangles++;
+		if (corners[0].clipped || corners[1].clipped || corners[2].clipped)
+		{
+			stats.trianglesCulled++;
+			continue;
+		}
+		// Vulkan's front faces (counter-clockwise by its area formula, with y
+		// down) have a negative cross product; swapping two corners flips it.
+		RasterizeTriangle(corners[0], corners[2], corners[1]);
+	}
+}
+
+void DepthRasterizer::RasterizeTriangle(const ScreenVertex &a, const ScreenVertex &b, const ScreenVertex &c)
+{
+	// Positive for front faces, given the swap in DrawIndexedWith.
+	float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	if (area <= 0.0f)
+	{
+		stats.trianglesCulled++;
+		return;
+	}
+
+	int minX = std::max(0, (int)floorf(std::min(a.x, std::min(b.x, c.x))));
+	int maxX = std::min((int)width - 1, (int)ceilf(std::max(a.x, std::max(b.x, c.x))));
+	int minY = std::max(0, (int)floorf(std::min(a.y, std::min(b.y, c.y))));
+	int maxY = std::min((int)height - 1, (int)ceilf(std::max(a.y, std::max(b.y, c.y))));
+	if (minX > maxX || minY > maxY)
+	{
+		stats.trianglesCulled++;
+		return;
+	}
+
+	// Edge functions evaluated at pixel centers and stepped incrementally.
+	float invArea = 1.0f / area;
+	float e0dx = b.y - c.y, e0dy = c.x - b.x;
+	float e1dx = c.y - a.y, e1dy = a.x - c.x;
+	float e2dx = a.y - b.y, e2dy = b.x - a.x;
+	float px = minX + 0.5f, py = minY + 0.5f;
+	float w0Row = (b.x - px) * (c.y - py) - (b.y - py) * (c.x - px);
+	float w1Row = (c.x - px) * (a.y - py) - (c.y - py) * (a.x - px);
+	float w2Row = (a.x - px) * (b.y - py) - (a.y - py) * (b.x - px);
+
+	for (int y = minY; y <= maxY; y++)
+	{
+		float w0 = w0Row, w1 = w1Row, w2 = w2Row;
+		float *row = &depth[(size_t)y * width];
+		for (int x = minX; x <= maxX; x++)
+		{
+			stats.pixelsTested++;
+			if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f)
+			{
+				float z = (w0 * a.z + w1 * b.z + w2 * c.z) * invArea;
+				if (z >= 0.0f && z < row[x])
+				{
+					row[x] = z;
+					stats.pixelsWritten++;
+				}
+			}
+			w0 += e0dx;
+			w1 += e1dx;
+			w2 += e2dx;
+		}
+		w0Row += e0dy;
+		w1Row += e1dy;
+		w2Row += e2dy;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "mathutil.h"
+#include "vertexformat.h"
+
+struct SoftRasterStats
+{
+	uint64_t triangles;
+	uint64_t trianglesCulled;
+	uint64_t pixelsTested;
+	uint64_t pixelsWritten;
+	uint64_t vertexTransforms;
+	uint64_t vertexCacheHits;
+};
+
+// Depth-only scanline-free rasterizer (half-space edge functions over each
+// triangle's bounding box). Used for CPU occlusion tests and as a benchmark
+// workload. Transformed vertices go through a small FIFO post-transform cache
+// like a GPU's, so index order affects its cost the same way.
+class DepthRasterizer
+{
+public:
+	static const int VERTEX_CACHE_SIZE = 16;
+
+	DepthRasterizer(uint32_t width, uint32_t height);
+
+	void Clear(float depth = 1.0f);
+
+	// positions are strideBytes apart; triangles behind the near plane or
+	// back-facing are skipped. Facing follows the pipeline's default
+	// (frontFace = COUNTER_CLOCKWISE in Vulkan's y-down framebuffer), so the
+	// repo's outward-wound meshes keep their outside.
+	void DrawIndexed(const float *positions, size_t strideBytes, const uint32_t *indices, size_t indexCount, const Mat4 &mvp);
+
+	// The same for snorm16 positions (PackedVertex::position); the box is
+	// folded into mvp, so each vertex costs three int-to-float conversions
+	// more and half the fetch.
+	void DrawIndexedQuantized(const int16_t *positions, size_t strideBytes, const uint32_t *indices, size_t indexCount,
+		const QuantizationBox &box, const Mat4 &mvp);
+
+	const float *GetDepth() const { return depth.data(); }
+	uint32_t GetWidth() const { return width; }
+	uint32_t GetHeight() const { return height; }
+	const SoftRasterStats &GetStats() const { return stats; }
+	void ResetStats();
+
+private:
+	struct ScreenVertex
+	{
+		float x, y, z;
+		bool clipped;
+	};
+
+	template <typename Fetch>
+	void DrawIndexedWith(Fetch fetch, const uint32_t *indices, size_t indexCount, const Mat4 &mvp);
+	void RasterizeTriangle(const ScreenVertex &a, const ScreenVertex &b, const ScreenVertex &c);
+
+	uint32_t width;
+	uint32_t height;
+	std::vector<float> depth;
+	SoftRasterStats stats;
+};
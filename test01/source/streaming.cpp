@@ -0,0 +1,412 @@
+#include "streaming.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <queue>
+#include <random>
+#include "assetpack.h"
+#include "fileio.h"
+#include "log.h"
+#include "memtrack.h"
+#include "mesh.h"
+#include "profiler.h"
+
+namespace
+{
+	struct Candidate
+	{
+		float priority;
+		uint32_t resource;
+	};
+
+	struct Victim
+	{
+		float priority;
+		uint32_t resource;
+		uint32_t level;	// the resident level when queued, to spot stale entries
+	};
+
+	// Lowest priority on top; ties go to the lower index so runs repeat.
+	struct VictimOrder
+	{
+		bool operator()(const Victim &a, const Victim &b) const
+		{
+			return a.priority != b.priority ? a.priority > b.priority : a.resource > b.resource;
+		}
+	};
+}
+
+// Passed by reference to the log formatter, so it needs storage.
+const uint32_t StreamingManager::THRASH_UPDATES;
+
+StreamingManager::StreamingManager(const StreamingConfig &config)
+	: config(config), pack(nullptr), io(nullptr), loadsInFlight(0)
+{
+}
+
+StreamingManager::~StreamingManager()
+{
+	Flush();
+}
+
+void StreamingManager::SetSource(const AssetPack *pack, IoQueue *io)
+{
+	this->pack = pack;
+	this->io = io;
+}
+
+uint32_t StreamingManager::AddResource(const BoundingSphere &bounds, const StreamingLevel *levels, uint32_t levelCount)
+{
+	Resource resource = {};
+	resource.bounds = bounds;
+	resource.firstLevel = (uint32_t)this->levels.size();
+	resource.levelCount = levelCount;
+	resource.residentLevel = levelCount;
+	resource.loadingLevel = NO_LEVEL;
+	resource.wantedLevel = levelCount - 1;
+	this->levels.insert(this->levels.end(), levels, levels + levelCount);
+	levelData.resize(this->levels.size());
+	resources.push_back(resource);
+	return (uint32_t)resources.size() - 1;
+}
+
+const std::vector<uint8_t> &StreamingManager::GetLevelData(uint32_t resource, uint32_t level) const
+{
+	return levelData[resources[resource].firstLevel + level];
+}
+
+// The error on screen now, which the next finer level would take away. Nothing
+// resident at all beats everything.
+float StreamingManager::GetLoadPriority(const Resource &resource) const
+{
+	if (resource.residentLevel == resource.levelCount)
+		return FLT_MAX;
+	return levels[resource.firstLevel + resource.residentLevel].error * resource.pixelsPerUnit;
+}
+
+// The error that would show if the finest resident level went.
+float StreamingManager::GetEvictPriority(const Resource &resource) const
+{
+	return levels[resource.firstLevel + resource.residentLevel + 1].error * resource.pixelsPerUnit;
+}
+
+void StreamingManager::Update(const Vec3 &eye, const Frustum &frustum, float projectionScale)
+{
+	PROFILE_FUNCTION();
+	stats.updates++;
+
+	std::vector<Completion> completions;
+	PollLoads(completions, false);
+	for (Completion &completion : completions)
+	{
+		Resource &resource = resources[completion.resource];
+		uint32_t level = resource.loadingLevel;
+		uint32_t size = levels[resource.firstLevel + level].size;
+		resource.loadingLevel = NO_LEVEL;
+		stats.inFlightBytes -= size;
+		loadsInFlight--;
+		if (!completion.ok)
+		{
+			stats.loadsFailed++;
+			continue;
+		}
+		levelData[resource.firstLevel + level] = std::move(completion.data);
+		resource.residentLevel = level;
+		resource.arrivedAt = stats.updates;
+		stats.residentBytes += size;
+		stats.loadsCompleted++;
+		stats.bytesLoaded += size;
+	}
+
+	std::vector<Candidate> candidates;
+	std::priority_queue<Victim, std::vector<Victim>, VictimOrder> victims;
+	for (uint32_t i = 0; i < (uint32_t)resources.size(); i++)
+	{
+		Resource &resource = resources[i];
+		float distance = std::max(Length(resource.bounds.center - eye) - resource.bounds.radius, 1e-3f);
+		bool inFrustum = frustum.TestSphere(resource.bounds.center, resource.bounds.radius);
+		resource.pixelsPerUnit = projectionScale / distance * (inFrustum ? 1.0f : config.offscreenScale);
+
+		const StreamingLevel *resourceLevels = &levels[resource.firstLevel];
+		resource.wantedLevel = 0;
+		for (uint32_t level = 1; level < resource.levelCount && config.pixelError > 0.0f; level++)
+		{
+			if (resourceLevels[level].error * resource.pixelsPerUnit > config.pixelError)
+				break;
+			resource.wantedLevel = level;
+		}
+
+		if (inFrustum)
+		{
+			stats.visibleResources++;
+			if (resource.residentLevel <= resource.wantedLevel)
+				stats.satisfiedResources++;
+			else
+				stats.missingLevels += resource.residentLevel - resource.wantedLevel;
+		}
+
+		if (resource.loadingLevel != NO_LEVEL)
+			continue;
+		if (resource.residentLevel > resource.wantedLevel)
+			candidates.push_back(Candidate{ GetLoadPriority(resource), i });
+		if (resource.residentLevel + 1 < resource.levelCount)
+			victims.push(Victim{ GetEvictPriority(resource), i, resource.residentLevel });
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b)
+	{
+		return a.priority != b.priority ? a.priority > b.priority : a.resource < b.resource;
+	});
+
+	for (const Candidate &candidate : candidates)
+	{
+		if (loadsInFlight >= config.maxLoadsInFlight)
+			break;
+		const Resource &resource = resources[candidate.resource];
+		bool pinned = resource.residentLevel == resource.levelCount;
+		uint32_t level = pinned ? resource.levelCount - 1 : resource.residentLevel - 1;
+		uint64_t size = levels[resource.firstLevel + level].size;
+
+		// Make room from the least important levels, but only those clearly
+		// less important than this one. Coarsest levels go in regardless.
+		bool fits = true;
+		while (stats.residentBytes + stats.inFlightBytes + size > config.memoryBudget)
+		{
+			while (!victims.empty() && (resources[victims.top().resource].residentLevel != victims.top().level ||
+				resources[victims.top().resource].loadingLevel != NO_LEVEL))
+				victims.pop();
+			if (victims.empty() || (!pinned && victims.top().priority * config.hysteresis >= candidate.priority))
+			{
+				fits = pinned;
+				break;
+			}
+			uint32_t victim = victims.top().resource;
+			victims.pop();
+			Evict(victim);
+			if (resources[victim].residentLevel + 1 < resources[victim].levelCount)
+				victims.push(Victim{ GetEvictPriority(resources[victim]), victim, resources[victim].residentLevel });
+		}
+		if (fits && !BeginLoad(candidate.resource))
+			break;
+	}
+
+	stats.peakResidentBytes = std::max(stats.peakResidentBytes, stats.residentBytes);
+	if (stats.residentBytes > config.memoryBudget)
+		stats.overBudgetUpdates++;
+}
+
+bool StreamingManager::BeginLoad(uint32_t index)
+{
+	Resource &resource = resources[index];
+	uint32_t level = resource.residentLevel == resource.levelCount ? resource.levelCount - 1 : resource.residentLevel - 1;
+	const StreamingLevel &streamingLevel = levels[resource.firstLevel + level];
+	if (pack && io)
+	{
+		const AssetPackEntry &entry = pack->GetEntry(streamingLevel.asset);
+		std::vector<uint8_t> &buffer = readBuffers[index];
+		buffer.resize((size_t)entry.storedSize);
+		if (!io->Read(pack->GetFile(), entry.offset, (uint32_t)entry.storedSize, buffer.data(), index))
+		{
+			readBuffers.erase(index);
+			return false;
+		}
+	}
+	else
+	{
+		simulated.push_back(SimulatedLoad{ index, stats.updates + config.simulatedLatency });
+	}
+	resource.loadingLevel = level;
+	stats.inFlightBytes += streamingLevel.size;
+	stats.loadsIssued++;
+	loadsInFlight++;
+	return true;
+}
+
+void StreamingManager::Evict(uint32_t index)
+{
+	Resource &resource = resources[index];
+	uint32_t level = resource.firstLevel + resource.residentLevel;
+	std::vector<uint8_t>().swap(levelData[level]);
+	stats.residentBytes -= levels[level].size;
+	stats.bytesEvicted += levels[level].size;
+	stats.evictions++;
+	if (resource.arrivedAt && stats.updates - resource.arrivedAt < THRASH_UPDATES)
+		stats.thrashEvictions++;
+	resource.residentLevel++;
+	resource.arrivedAt = 0;
+}
+
+void StreamingManager::PollLoads(std::vector<Completion> &completions, bool wait)
+{
+	if (pack && io)
+	{
+		io->Submit();
+		std::vector<IoCompletion> finished(std::max(loadsInFlight, 1u));
+		size_t count = io->Reap(finished.data(), finished.size(), wait ? loadsInFlight : 0);
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t index = (uint32_t)finished[i].userData;
+			const Resource &resource = resources[index];
+			const StreamingLevel &level = levels[resource.firstLevel + resource.loadingLevel];
+			const AssetPackEntry &entry = pack->GetEntry(level.asset);
+			Completion completion;
+			completion.resource = index;
+			completion.ok = finished[i].result == (int64_t)entry.storedSize;
+			if (completion.ok)
+			{
+				MEMORY_TAG(MEMTAG_STREAMING);
+				completion.ok = AssetPack::DecodeAsset(entry, readBuffers[index].data(), completion.data) &&
+					completion.data.size() == level.size;
+			}
+			readBuffers.erase(index);
+			completions.push_back(std::move(completion));
+		}
+		return;
+	}
+
+	if (wait)
+	{
+		// Nothing real is in flight; dropping the loads is enough.
+		for (const SimulatedLoad &load : simulated)
+			completions.push_back(Completion{ load.resource, false, std::vector<uint8_t>() });
+		simulated.clear();
+		return;
+	}
+	// Oldest first, and never more than the bandwidth allows, though one
+	// load larger than a whole update's worth still gets through.
+	int64_t bandwidth = (int64_t)config.simulatedBandwidth;
+	size_t done = 0;
+	for (; done < simulated.size() && simulated[done].readyAt <= stats.updates && bandwidth > 0; done++)
+	{
+		const Resource &resource = resources[simulated[done].resource];
+		bandwidth -= levels[resource.firstLevel + resource.loadingLevel].size;
+		completions.push_back(Completion{ simulated[done].resource, true, std::vector<uint8_t>() });
+	}
+	simulated.erase(simulated.begin(), simulated.begin() + done);
+}
+
+void StreamingManager::Flush()
+{
+	while (loadsInFlight > 0)
+	{
+		std::vector<Completion> completions;
+		PollLoads(completions, true);
+		if (completions.empty())
+			break;
+		for (const Completion &completion : completions)
+		{
+			Resource &resource = resources[completion.resource];
+			stats.inFlightBytes -= levels[resource.firstLevel + resource.loadingLevel].size;
+			resource.loadingLevel = NO_LEVEL;
+			loadsInFlight--;
+		}
+	}
+}
+
+void StreamingManager::LogSummary() const
+{
+	LOG_INFO(LOG_CATEGORY_ASSETS, "Streaming: %u resources, %.1f MB resident (peak %.1f MB) of a %.1f MB budget",
+		(uint32_t)resources.size(), stats.residentBytes / 1048576.0, stats.peakResidentBytes / 1048576.0, config.memoryBudget / 1048576.0);
+	LOG_INFO(LOG_CATEGORY_ASSETS, "Streaming: %llu loads (%llu failed, %.1f MB), %llu evictions (%llu within %u updates of loading)",
+		stats.loadsCompleted, stats.loadsFailed, stats.bytesLoaded / 1048576.0, stats.evictions, stats.thrashEvictions, THRASH_UPDATES);
+	LOG_INFO(LOG_CATEGORY_ASSETS, "Streaming: wanted level resident for %.1f%% of visible resources, %llu levels short over %llu updates",
+		stats.GetHitRate() * 100.0, stats.missingLevels, stats.updates);
+}
+
+void GenerateStreamingWorld(StreamingWorld &world, uint32_t resourceCount, float extent, uint32_t detail, uint32_t seed)
+{
+	world = StreamingWorld();
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> position(-0.5f * extent, 0.5f * extent);
+	std::uniform_real_distribution<float> radius(0.5f, 2.5f);
+	detail = std::max(detail, 1u);
+	for (uint32_t i = 0; i < resourceCount; i++)
+	{
+		BoundingSphere bounds;
+		bounds.radius = radius(rng);
+		bounds.center = Vec3(position(rng), bounds.radius, position(rng));
+		world.bounds.push_back(bounds);
+		world.firstLevel.push_back((uint32_t)world.levels.size());
+
+		// Even resources are meshes, halving rings per level; odd ones are
+		// RGBA8 textures, halving width per mip.
+		bool mesh = i % 2 == 0;
+		uint32_t shape = mesh ? 16 * detail : 64 * detail;
+		for (; shape >= (mesh ? 4u : 8u); shape /= 2)
+		{
+			StreamingLevel level;
+			level.asset = 0;
+			if (mesh)
+			{
+				level.size = (shape + 1) * (2 * shape + 1) * (uint32_t)sizeof(Vertex);
+				level.error = bounds.radius * (1.0f - cosf(3.14159265f / shape));
+			}
+			else
+			{
+				level.size = shape * shape * 4;
+				level.error = 2.0f * bounds.radius / shape;
+			}
+			world.levels.push_back(level);
+			world.shapes.push_back(shape);
+			world.totalBytes += level.size;
+		}
+		world.levelCount.push_back((uint32_t)world.levels.size() - world.firstLevel.back());
+	}
+}
+
+bool WriteStreamingWorldPack(StreamingWorld &world, const std::string &path)
+{
+	PROFILE_FUNCTION();
+	AssetPackWriter writer;
+	if (!writer.Open(path))
+		return false;
+	std::mt19937 rng(97);
+	std::vector<uint8_t> texels;
+	for (size_t i = 0; i < world.bounds.size(); i++)
+	{
+		for (uint32_t l = 0; l < world.levelCount[i]; l++)
+		{
+			uint32_t level = world.firstLevel[i] + l;
+			uint32_t shape = world.shapes[level];
+			std::string name = "world/" + std::to_string(i) + "/" + std::to_string(l);
+			bool added;
+			if (i % 2 == 0)
+			{
+				Mesh mesh = GenerateSphere(shape, shape * 2, world.bounds[i].radius);
+				added = writer.AddMeshStream(name, mesh.vertices.data(), mesh.vertices.size(), sizeof(Vertex), 4);
+			}
+			else
+			{
+				texels.resize(world.levels[level].size);
+				for (uint32_t t = 0; t < shape * shape; t++)
+				{
+					uint32_t x = t % shape, y = t / shape;
+					texels[t * 4 + 0] = (uint8_t)(x * 255 / shape);
+					texels[t * 4 + 1] = (uint8_t)(y * 255 / shape);
+					texels[t * 4 + 2] = (uint8_t)(rng() & 15);
+					texels[t * 4 + 3] = 255;
+				}
+				added = writer.Add(name, texels.data(), texels.size(), ASSET_COMPRESSION_LZ);
+			}
+			if (!added)
+				return false;
+		}
+	}
+	if (!writer.Finish())
+		return false;
+
+	AssetPack pack;
+	if (!pack.Open(path))
+		return false;
+	for (size_t i = 0; i < world.bounds.size(); i++)
+	{
+		for (uint32_t l = 0; l < world.levelCount[i]; l++)
+		{
+			uint32_t asset = pack.Find("world/" + std::to_string(i) + "/" + std::to_string(l));
+			if (asset == AssetPack::INVALID_ASSET || pack.GetEntry(asset).size != world.levels[world.firstLevel[i] + l].size)
+				return false;
+			world.levels[world.firstLevel[i] + l].asset = asset;
+		}
+	}
+	return true;
+}
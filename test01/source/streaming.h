@@ -0,0 +1,192 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "culling.h"
+
+class AssetPack;
+class IoQueue;
+
+// One level of a streamed resource: a mesh LOD or a texture mip. Levels are
+// listed finest first and error grows with the level, as in MeshLod.
+struct StreamingLevel
+{
+	uint32_t asset;	// index in the source pack
+	uint32_t size;	// bytes resident once loaded
+	float error;	// object space: simplification error, or texel size for mips
+};
+
+struct StreamingConfig
+{
+	uint64_t memoryBudget = 64ull << 20;
+
+	// Screen-space error, in pixels, that makes a finer level wanted.
+	float pixelError = 1.0f;
+
+	// Priority scale for resources outside the frustum, so the camera can
+	// turn without everything behind it having been dropped.
+	float offscreenScale = 0.25f;
+
+	// A load only evicts levels whose priority is this many times lower, so
+	// two resources of similar priority do not keep displacing each other.
+	float hysteresis = 2.0f;
+
+	uint32_t maxLoadsInFlight = 32;
+
+	// Simulated loads, used when no pack is attached: each takes this many
+	// updates and at most this many bytes complete per update.
+	uint32_t simulatedLatency = 2;
+	uint64_t simulatedBandwidth = 8ull << 20;
+};
+
+struct StreamingStats
+{
+	uint64_t updates = 0;
+	uint64_t residentBytes = 0;
+	uint64_t peakResidentBytes = 0;
+	uint64_t inFlightBytes = 0;
+	uint64_t loadsIssued = 0;
+	uint64_t loadsCompleted = 0;
+	uint64_t loadsFailed = 0;
+	uint64_t bytesLoaded = 0;
+	uint64_t evictions = 0;
+	uint64_t bytesEvicted = 0;
+
+	// Evictions of a level within THRASH_UPDATES updates of it arriving.
+	uint64_t thrashEvictions = 0;
+
+	// Summed over updates and resources in the frustum: how many had their
+	// wanted level resident, and how many levels short the rest were.
+	uint64_t visibleResources = 0;
+	uint64_t satisfiedResources = 0;
+	uint64_t missingLevels = 0;
+
+	// Updates that ended over budget, which only the coarsest levels can
+	// cause: those are always loaded and never evicted.
+	uint64_t overBudgetUpdates = 0;
+
+	double GetHitRate() const { return visibleResources ? (double)satisfiedResources / visibleResources : 1.0; }
+};
+
+// Keeps each resource's levels resident from its coarsest up to the finest
+// one worth the memory. Every update projects each resource's level errors
+// from the eye: the coarsest level within pixelError is wanted, and the
+// projected error of what is shown now is the priority of loading the next
+// finer level. Under the budget, loads evict the finest level of the least
+// important resources, so residency always stays a contiguous chain ending at
+// the coarsest level, which is pinned.
+//
+// Loads are asynchronous. With a pack and an IoQueue attached they are reads
+// of the pack, decoded when they complete; otherwise they are simulated with
+// a fixed latency and bandwidth, which makes a run with a scripted camera
+// fully deterministic. Update() is the only place state changes, so the
+// manager belongs to one thread.
+class StreamingManager
+{
+public:
+	static const uint32_t THRASH_UPDATES = 8;
+
+	explicit StreamingManager(const StreamingConfig &config = StreamingConfig());
+	~StreamingManager();
+
+	StreamingManager(const StreamingManager &) = delete;
+	StreamingManager &operator=(const StreamingManager &) = delete;
+
+	// Both must outlive the manager. Call before adding resources.
+	void SetSource(const AssetPack *pack, IoQueue *io);
+
+	uint32_t AddResource(const BoundingSphere &bounds, const StreamingLevel *levels, uint32_t levelCount);
+
+	void Update(const Vec3 &eye, const Frustum &frustum, float projectionScale);
+
+	// Waits for loads in flight; in simulation they are dropped.
+	void Flush();
+
+	uint32_t GetResourceCount() const { return (uint32_t)resources.size(); }
+	uint32_t GetLevelCount(uint32_t resource) const { return resources[resource].levelCount; }
+
+	// The finest resident level; GetLevelCount() while nothing is resident.
+	uint32_t GetResidentLevel(uint32_t resource) const { return resources[resource].residentLevel; }
+	uint32_t GetWantedLevel(uint32_t resource) const { return resources[resource].wantedLevel; }
+
+	// Decoded contents of a resident level; empty in simulation.
+	const std::vector<uint8_t> &GetLevelData(uint32_t resource, uint32_t level) const;
+
+	const StreamingConfig &GetConfig() const { return config; }
+	const StreamingStats &GetStats() const { return stats; }
+	void LogSummary() const;
+
+private:
+	static const uint32_t NO_LEVEL = ~0u;
+
+	struct Resource
+	{
+		BoundingSphere bounds;
+		uint32_t firstLevel;
+		uint32_t levelCount;
+		uint32_t residentLevel;
+		uint32_t loadingLevel;	// NO_LEVEL when idle
+		uint32_t wantedLevel;
+		float pixelsPerUnit;	// this update, offscreen scale included
+		uint64_t arrivedAt;	// update the resident level arrived in
+	};
+
+	struct SimulatedLoad
+	{
+		uint32_t resource;
+		uint64_t readyAt;
+	};
+
+	struct Completion
+	{
+		uint32_t resource;
+		bool ok;
+		std::vector<uint8_t> data;
+	};
+
+	float GetLoadPriority(const Resource &resource) const;
+	float GetEvictPriority(const Resource &resource) const;
+	bool BeginLoad(uint32_t index);
+	void Evict(uint32_t index);
+	void PollLoads(std::vector<Completion> &completions, bool wait);
+
+	StreamingConfig config;
+	StreamingStats stats;
+	std::vector<Resource> resources;
+	std::vector<StreamingLevel> levels;
+	std::vector<std::vector<uint8_t>> levelData;
+
+	const AssetPack *pack;
+	IoQueue *io;
+	std::unordered_map<uint32_t, std::vector<uint8_t>> readBuffers;	// by resource
+	std::vector<SimulatedLoad> simulated;
+	uint32_t loadsInFlight;
+};
+
+// A synthetic open world for exercising the manager: resources scattered over
+// a square of side extent around the origin, alternating between a sphere
+// mesh with a LOD chain and a texture with a mip chain.
+struct StreamingWorld
+{
+	std::vector<BoundingSphere> bounds;
+	std::vector<uint32_t> firstLevel;
+	std::vector<uint32_t> levelCount;
+	std::vector<StreamingLevel> levels;
+	std::vector<uint32_t> shapes;	// per level: sphere rings, or texture width
+	uint64_t totalBytes = 0;
+};
+
+// Level sizes match what WriteStreamingWorldPack stores, so a simulation sees
+// the same sizes as a run reading the pack. detail scales every level's size.
+void GenerateStreamingWorld(StreamingWorld &world, uint32_t resourceCount, float extent, uint32_t detail, uint32_t seed);
+
+// Writes each level as an asset and points the levels at them.
+bool WriteStreamingWorldPack(StreamingWorld &world, const std::string &path);
+
+inline void AddStreamingWorld(StreamingManager &manager, const StreamingWorld &world)
+{
+	for (size_t i = 0; i < world.bounds.size(); i++)
+		manager.AddResource(world.bounds[i], &world.levels[world.firstLevel[i]], world.levelCount[i]);
+}
@@ -0,0 +1,97 @@
+#include "threadpool.h"
+#include "profiler.h"
+
+ThreadPool::ThreadPool(unsigned workerCount, size_t queueCapacity)
+	: jobs(queueCapacity), pending(0), sleepers(0), stopping(false)
+{
+	if (workerCount == 0)
+		workerCount = DefaultWorkerCount();
+	for (unsigned i = 0; i < workerCount; i++)
+		workers.emplace_back(&ThreadPool::WorkerMain, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping.store(true);
+	}
+	jobAvailable.notify_all();
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+unsigned ThreadPool::DefaultWorkerCount()
+{
+	unsigned cores = std::thread::hardware_concurrency();
+	return cores > 1 ? cores - 1 : 1;
+}
+
+void ThreadPool::Submit(std::function<void()> job)
+{
+	pending.fetch_add(1);
+	while (!jobs.TryPush(std::move(job)))
+		std::this_thread::yield();
+
+	// Pairs with the fence in WorkerMain: either this load sees the sleeper,
+	// or the sleeper's recheck sees the job.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleepers.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobAvailable.notify_one();
+	}
+}
+
+void ThreadPool::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [this] { return pending.load() == 0; });
+}
+
+void ThreadPool::Run(unsigned taskCount, const std::function<void(unsigned)> &task)
+{
+	std::mutex doneMutex;
+	std::condition_variable done;
+	unsigned remaining = taskCount;
+	for (unsigned i = 0; i < taskCount; i++)
+	{
+		Submit([&, i]
+		{
+			task(i);
+			std::lock_guard<std::mutex> lock(doneMutex);
+			if (--remaining == 0)
+				done.notify_one();
+		});
+	}
+	std::unique_lock<std::mutex> lock(doneMutex);
+	done.wait(lock, [&] { return remaining == 0; });
+}
+
+void ThreadPool::WorkerMain()
+{
+	PROFILE_THREAD_NAME("pool worker");
+	std::function<void()> job;
+	for (;;)
+	{
+		if (jobs.TryPop(job))
+		{
+			job();
+			job = nullptr;
+			if (pending.fetch_sub(1) == 1)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				idle.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		sleepers.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		jobAvailable.wait(lock, [this] { return stopping.load() || !jobs.IsEmpty(); });
+		sleepers.fetch_sub(1, std::memory_order_relaxed);
+		if (stopping.load() && jobs.IsEmpty())
+			return;
+	}
+}
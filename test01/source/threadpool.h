@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "concurrentqueue.h"
+
+// Fixed set of worker threads consuming a FIFO of jobs. Jobs travel through a
+// lock-free MPMC ring; the mutex is only taken to put idle workers to sleep
+// and wake them, so busy producers and workers never contend on it.
+class ThreadPool
+{
+public:
+	// workerCount of 0 picks hardware_concurrency() - 1, but at least one worker.
+	explicit ThreadPool(unsigned workerCount = 0, size_t queueCapacity = 1024);
+	~ThreadPool();
+
+	// Yields while the queue is full.
+	void Submit(std::function<void()> job);
+
+	// Blocks until the queue is empty and no job is running.
+	void WaitIdle();
+
+	// Runs task(0) .. task(taskCount - 1) on the workers and blocks until all
+	// of them have returned. Only these jobs are waited on, so other threads
+	// can keep submitting to the same pool. The caller must not be one of the
+	// workers: once every worker is blocked in Run nothing is left to run the
+	// tasks.
+	void Run(unsigned taskCount, const std::function<void(unsigned)> &task);
+
+	unsigned GetWorkerCount() const { return (unsigned)workers.size(); }
+
+	static unsigned DefaultWorkerCount();
+
+private:
+	void WorkerMain();
+
+	std::vector<std::thread> workers;
+	MpmcQueue<std::function<void()>> jobs;
+	std::atomic<unsigned> pending;	// submitted and not yet finished
+	std::atomic<unsigned> sleepers;
+	std::atomic<bool> stopping;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable idle;
+};
@@ -0,0 +1,14 @@
+#pragma once
+#include <chrono>
+#include <stdint.h>
+
+inline uint64_t NowNs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline double ElapsedMs(uint64_t startNs, uint64_t endNs)
+{
+	return (double)(endNs - startNs) / 1000000.0;
+}
@@ -0,0 +1,134 @@
+#include "vertexformat.h"
+#include <algorithm>
+#include <math.h>
+#include "imageencode.h"
+#include "profiler.h"
+
+const char *GetVertexFormatName(VertexFormat format)
+{
+	switch (format)
+	{
+	case VERTEX_FORMAT_FLOAT: return "float";
+	case VERTEX_FORMAT_PACKED: return "packed";
+	}
+	return "unknown";
+}
+
+bool ParseVertexFormat(const std::string &name, VertexFormat &format)
+{
+	for (VertexFormat candidate : { VERTEX_FORMAT_FLOAT, VERTEX_FORMAT_PACKED })
+	{
+		if (name == GetVertexFormatName(candidate))
+		{
+			format = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t GetVertexFormatSize(VertexFormat format)
+{
+	return format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+QuantizationBox ComputeQuantizationBox(const Vertex *vertices, size_t count)
+{
+	QuantizationBox box = {};
+	box.scale = 1.0f;
+	if (count == 0)
+		return box;
+	Vec3 minimum(vertices[0].position[0], vertices[0].position[1], vertices[0].position[2]);
+	Vec3 maximum = minimum;
+	for (size_t v = 1; v < count; v++)
+	{
+		Vec3 p(vertices[v].position[0], vertices[v].position[1], vertices[v].position[2]);
+		minimum = Min(minimum, p);
+		maximum = Max(maximum, p);
+	}
+	Vec3 center = (minimum + maximum) * 0.5f;
+	Vec3 half = (maximum - minimum) * 0.5f;
+	box.offset[0] = center.x;
+	box.offset[1] = center.y;
+	box.offset[2] = center.z;
+	float scale = std::max(half.x, std::max(half.y, half.z));
+	box.scale = scale > 0.0f ? scale : 1.0f;
+	return box;
+}
+
+void PackVertices(PackedVertex *destination, const Vertex *vertices, size_t count, const QuantizationBox &box)
+{
+	PROFILE_FUNCTION();
+	float inverseScale = 1.0f / box.scale;
+	for (size_t v = 0; v < count; v++)
+	{
+		const Vertex &vertex = vertices[v];
+		PackedVertex &packed = destination[v];
+		for (int k = 0; k < 3; k++)
+			packed.position[k] = EncodeSnorm16((vertex.position[k] - box.offset[k]) * inverseScale);
+		packed.position[3] = 0;
+		EncodeOctahedral(vertex.normal, packed.normal);
+		packed.uv[0] = FloatToHalf(vertex.uv[0]);
+		packed.uv[1] = FloatToHalf(vertex.uv[1]);
+	}
+}
+
+void UnpackVertices(Vertex *destination, const PackedVertex *vertices, size_t count, const QuantizationBox &box)
+{
+	for (size_t v = 0; v < count; v++)
+	{
+		const PackedVertex &packed = vertices[v];
+		Vertex &vertex = destination[v];
+		for (int k = 0; k < 3; k++)
+			vertex.position[k] = box.offset[k] + DecodeSnorm16(packed.position[k]) * box.scale;
+		DecodeOctahedral(packed.normal, vertex.normal);
+		vertex.uv[0] = HalfToFloat(packed.uv[0]);
+		vertex.uv[1] = HalfToFloat(packed.uv[1]);
+	}
+}
+
+int16_t EncodeSnorm16(float value)
+{
+	value = std::min(std::max(value, -1.0f), 1.0f);
+	return (int16_t)lrintf(value * 32767.0f);
+}
+
+float DecodeSnorm16(int16_t value)
+{
+	return std::max(value / 32767.0f, -1.0f);
+}
+
+void EncodeOctahedral(const float *vector, int16_t *encoded)
+{
+	float sum = fabsf(vector[0]) + fabsf(vector[1]) + fabsf(vector[2]);
+	if (sum <= 0.0f)
+	{
+		encoded[0] = encoded[1] = 0;
+		return;
+	}
+	float x = vector[0] / sum, y = vector[1] / sum;
+	if (vector[2] < 0.0f)
+	{
+		// Fold the lower hemisphere over the diagonals.
+		float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	encoded[0] = EncodeSnorm16(x);
+	encoded[1] = EncodeSnorm16(y);
+}
+
+void DecodeOctahedral(const int16_t *encoded, float *vector)
+{
+	float x = DecodeSnorm16(encoded[0]), y = DecodeSnorm16(encoded[1]);
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	// Unfolds the lower hemisphere without a branch.
+	float t = std::max(-z, 0.0f);
+	x += x >= 0.0f ? -t : t;
+	y += y >= 0.0f ? -t : t;
+	float length = sqrtf(x * x + y * y + z * z);
+	vector[0] = x / length;
+	vector[1] = y / length;
+	vector[2] = z / length;
+}
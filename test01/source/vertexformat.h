@@ -0,0 +1,53 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "mesh.h"
+
+// Maps snorm16 positions back to object space: p = offset + q * scale. The
+// scale is the same on every axis so that distances, and with them bounds
+// and simplification errors, survive quantization unchanged in shape.
+struct QuantizationBox
+{
+	float offset[3];
+	float scale;
+};
+
+// 16 bytes against Vertex's 32. Every field decodes through a fixed-function
+// vertex format (R16G16B16A16_SNORM, R16G16_SNORM, R16G16_SFLOAT); shaders
+// then apply the QuantizationBox and unfold the octahedral normal.
+struct PackedVertex
+{
+	int16_t position[4];	// w unused
+	int16_t normal[2];	// octahedral
+	uint16_t uv[2];	// half floats (FloatToHalf)
+};
+
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex is mirrored by vertex input state");
+
+enum VertexFormat
+{
+	VERTEX_FORMAT_FLOAT,	// Vertex
+	VERTEX_FORMAT_PACKED,	// PackedVertex
+};
+
+const char *GetVertexFormatName(VertexFormat format);
+bool ParseVertexFormat(const std::string &name, VertexFormat &format);
+size_t GetVertexFormatSize(VertexFormat format);
+
+// The smallest box, centred on the mesh bounds, that holds every position.
+QuantizationBox ComputeQuantizationBox(const Vertex *vertices, size_t count);
+
+void PackVertices(PackedVertex *destination, const Vertex *vertices, size_t count, const QuantizationBox &box);
+void UnpackVertices(Vertex *destination, const PackedVertex *vertices, size_t count, const QuantizationBox &box);
+
+// Round to nearest; decoding matches VK_FORMAT_*_SNORM, including the clamp
+// of -32768 to -1.
+int16_t EncodeSnorm16(float value);
+float DecodeSnorm16(int16_t value);
+
+// Octahedral mapping (Meyer et al. 2010): a unit vector projected onto the
+// octahedron and unfolded into [-1, 1]^2. Two snorm16s keep normals and
+// tangents within 0.04 degrees.
+void EncodeOctahedral(const float *vector, int16_t *encoded);
+void DecodeOctahedral(const int16_t *encoded, float *vector);
@@ -0,0 +1,181 @@
+#include "videostream.h"
+#include <algorithm>
+#include <stdio.h>
+#include "log.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+const char *GetVideoStreamFormatName(VideoStreamFormat format)
+{
+	return format == VIDEO_STREAM_RAW ? "yuv" : "y4m";
+}
+
+bool ParseVideoStreamFormat(const std::string &name, VideoStreamFormat &format)
+{
+	if (name == "y4m")
+		format = VIDEO_STREAM_Y4M;
+	else if (name == "yuv" || name == "raw")
+		format = VIDEO_STREAM_RAW;
+	else
+		return false;
+	return true;
+}
+
+VideoStream::VideoStream()
+	: format(VIDEO_STREAM_Y4M), fd(-1), nextSequence(0), broken(false), framesWritten(0), bytesWritten(0)
+{
+}
+
+VideoStream::~VideoStream()
+{
+	Close();
+}
+
+bool VideoStream::Open(const std::string &path, VideoStreamFormat format, uint32_t width, uint32_t height, uint32_t frameRate)
+{
+	Close();
+	this->path = path;
+	this->format = format;
+	nextSequence = 0;
+	broken = false;
+	framesWritten = 0;
+	bytesWritten = 0;
+
+	Log::Flush();
+	fflush(stdout);
+#ifdef _WIN32
+	if (path == "-")
+	{
+		fd = _dup(_fileno(stdout));
+		_dup2(_fileno(stderr), _fileno(stdout));
+	}
+	else
+	{
+		fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+	}
+	if (fd >= 0)
+		_setmode(fd, _O_BINARY);
+#else
+	// A reader that exits early should end the stream, not the process.
+	signal(SIGPIPE, SIG_IGN);
+	if (path == "-")
+	{
+		fd = dup(STDOUT_FILENO);
+		dup2(STDERR_FILENO, STDOUT_FILENO);
+	}
+	else
+	{
+		fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+#endif
+	if (fd < 0)
+	{
+		LOG_ERROR(LOG_CATEGORY_CAPTURE, "Could not open video stream %s", path);
+		return false;
+	}
+
+	if (format == VIDEO_STREAM_Y4M)
+	{
+		// C420jpeg is centred chroma, which is what the 2x2 average produces.
+		char header[128];
+		int length = snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+			width, height, frameRate);
+		if (!WriteAll(header, (size_t)length))
+		{
+			LOG_ERROR(LOG_CATEGORY_CAPTURE, "Could not write to video stream %s", path);
+			Close();
+			return false;
+		}
+	}
+	return true;
+}
+
+void VideoStream::Close()
+{
+	if (fd < 0)
+		return;
+#ifdef _WIN32
+	_close(fd);
+#else
+	close(fd);
+#endif
+	fd = -1;
+}
+
+bool VideoStream::WriteAll(const void *data, size_t size)
+{
+	const char *bytes = (const char *)data;
+	while (size > 0)
+	{
+#ifdef _WIN32
+		int written = _write(fd, bytes, (unsigned)std::min<size_t>(size, 1u << 30));
+		if (written <= 0)
+			return false;
+#else
+		ssize_t written = write(fd, bytes, size);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+#endif
+		bytes += written;
+		size -= (size_t)written;
+	}
+	return true;
+}
+
+bool VideoStream::WriteFrame(uint64_t sequence, const uint8_t *yuv, size_t size)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	turn.wait(lock, [&] { return sequence == nextSequence; });
+	bool ok = !broken && fd >= 0;
+
+	// Only the thread holding the turn writes, so the lock can be dropped
+	// while the reader drains the pipe.
+	if (ok)
+	{
+		lock.unlock();
+		static const char marker[] = "FRAME\n";
+		ok = (format != VIDEO_STREAM_Y4M || WriteAll(marker, sizeof(marker) - 1)) && WriteAll(yuv, size);
+		lock.lock();
+		if (ok)
+		{
+			framesWritten++;
+			bytesWritten += size;
+		}
+		else
+		{
+			broken = true;
+			LOG_WARNING(LOG_CATEGORY_CAPTURE, "Video stream %s closed by the reader after %u frames", path, framesWritten);
+		}
+	}
+	nextSequence++;
+	turn.notify_all();
+	return ok;
+}
+
+bool VideoStream::IsBroken() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return broken;
+}
+
+uint64_t VideoStream::GetFramesWritten() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return framesWritten;
+}
+
+uint64_t VideoStream::GetBytesWritten() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return bytesWritten;
+}
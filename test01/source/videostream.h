@@ -0,0 +1,61 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+enum VideoStreamFormat
+{
+	VIDEO_STREAM_Y4M,	// YUV4MPEG2 header and per-frame markers
+	VIDEO_STREAM_RAW,	// bare I420 planes; the consumer is told size and rate
+};
+
+const char *GetVideoStreamFormatName(VideoStreamFormat format);
+bool ParseVideoStreamFormat(const std::string &name, VideoStreamFormat &format);
+
+// Sends YUV 4:2:0 frames to an external encoder through stdout or a named
+// pipe, so nothing touches the disk:
+//   Vulkan01 --stream - | ffmpeg -i - out.mp4
+//   mkfifo /tmp/video && ffmpeg -i /tmp/video out.mkv & Vulkan01 --stream /tmp/video
+// Frames may be handed over from several threads in any order and are written
+// strictly by sequence number.
+class VideoStream
+{
+public:
+	VideoStream();
+	~VideoStream();
+
+	// "-" is stdout; console output is moved to stderr so it cannot corrupt
+	// the stream. Any other path is opened for writing (created if missing);
+	// opening a named pipe blocks until the reader connects.
+	bool Open(const std::string &path, VideoStreamFormat format, uint32_t width, uint32_t height, uint32_t frameRate);
+	void Close();
+
+	// Blocks until every lower sequence number has been written, so callers
+	// must queue frames to their writers in sequence order: with a single
+	// writer thread, a frame queued behind this one would never arrive.
+	// Returns false once the reader has gone away; later frames are then
+	// dropped.
+	bool WriteFrame(uint64_t sequence, const uint8_t *yuv, size_t size);
+
+	const std::string &GetPath() const { return path; }
+	VideoStreamFormat GetFormat() const { return format; }
+	bool IsBroken() const;
+	uint64_t GetFramesWritten() const;
+	uint64_t GetBytesWritten() const;
+
+private:
+	bool WriteAll(const void *data, size_t size);
+
+	std::string path;
+	VideoStreamFormat format;
+	int fd;
+
+	mutable std::mutex mutex;
+	std::condition_variable turn;
+	uint64_t nextSequence;
+	bool broken;
+	uint64_t framesWritten;
+	uint64_t bytesWritten;
+};
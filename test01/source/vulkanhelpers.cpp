@@ -0,0 +1,248 @@
+#include "vulkanhelpers.h"
+#include <fstream>
+#include <string.h>
+
+const char *VkResultToString(VkResult result)
+{
+	switch (result)
+	{
+	case VK_SUCCESS: return "VK_SUCCESS";
+	case VK_NOT_READY: return "VK_NOT_READY";
+	case VK_TIMEOUT: return "VK_TIMEOUT";
+	case VK_INCOMPLETE: return "VK_INCOMPLETE";
+	case VK_ERROR_OUT_OF_HOST_MEMORY: return "VK_ERROR_OUT_OF_HOST_MEMORY";
+	case VK_ERROR_OUT_OF_DEVICE_MEMORY: return "VK_ERROR_OUT_OF_DEVICE_MEMORY";
+	case VK_ERROR_INITIALIZATION_FAILED: return "VK_ERROR_INITIALIZATION_FAILED";
+	case VK_ERROR_DEVICE_LOST: return "VK_ERROR_DEVICE_LOST";
+	case VK_ERROR_FEATURE_NOT_PRESENT: return "VK_ERROR_FEATURE_NOT_PRESENT";
+	default: return "VK_ERROR_UNKNOWN";
+	}
+}
+
+bool LoadSpirvFile(const std::string &path, std::vector<uint32_t> &code)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+
+	std::streamsize size = file.tellg();
+	if (size <= 0 || size % 4 != 0)
+		return false;
+
+	code.resize((size_t)size / 4);
+	file.seekg(0);
+	file.read((char *)code.data(), size);
+	return (bool)file;
+}
+
+uint32_t FindMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeBits, VkMemoryPropertyFlags required,
+	VkMemoryPropertyFlags preferred)
+{
+	VkPhysicalDeviceMemoryProperties properties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &properties);
+
+	uint32_t fallback = UINT32_MAX;
+	for (uint32_t i = 0; i < properties.memoryTypeCount; i++)
+	{
+		VkMemoryPropertyFlags flags = properties.memoryTypes[i].propertyFlags;
+		if (!(typeBits & (1u << i)) || (flags & required) != required)
+			continue;
+		if ((flags & preferred) == preferred)
+			return i;
+		if (fallback == UINT32_MAX)
+			fallback = i;
+	}
+	return fallback;
+}
+
+bool CreateBuffer(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize size, VkBufferUsageFlags usage,
+	VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, MemoryTag tag, BufferAllocation &allocation)
+{
+	VkBufferCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	info.size = size;
+	info.usage = usage;
+	info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (vkCreateBuffer(device, &info, nullptr, &allocation.buffer) != VK_SUCCESS)
+		return false;
+
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(device, allocation.buffer, &requirements);
+	VkMemoryAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.allocationSize = requirements.size;
+	allocateInfo.memoryTypeIndex = FindMemoryType(physicalDevice, requirements.memoryTypeBits, required, preferred);
+	if (allocateInfo.memoryTypeIndex == UINT32_MAX ||
+		MemoryTracker::AllocateDeviceMemory(device, allocateInfo, tag, &allocation.memory) != VK_SUCCESS ||
+		vkBindBufferMemory(device, allocation.buffer, allocation.memory, 0) != VK_SUCCESS)
+	{
+		DestroyBuffer(device, allocation);
+		return false;
+	}
+	allocation.size = size;
+
+	VkPhysicalDeviceMemoryProperties properties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &properties);
+	VkMemoryPropertyFlags flags = properties.memoryTypes[allocateInfo.memoryTypeIndex].propertyFlags;
+	allocation.coherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+	if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+		vkMapMemory(device, allocation.memory, 0, VK_WHOLE_SIZE, 0, &allocation.mapped) != VK_SUCCESS)
+	{
+		DestroyBuffer(device, allocation);
+		return false;
+	}
+	return true;
+}
+
+void DestroyBuffer(VkDevice device, BufferAllocation &allocation)
+{
+	if (allocation.buffer != VK_NULL_HANDLE)
+		vkDestroyBuffer(device, allocation.buffer, nullptr);
+	MemoryTracker::FreeDeviceMemory(device, allocation.memory);
+	allocation = BufferAllocation();
+}
+
+bool CreateFilledBuffer(VkDevice device, VkPhysicalDevice physicalDevice, const void *data, VkDeviceSize size,
+	VkBufferUsageFlags usage, MemoryTag tag, BufferAllocation &allocation)
+{
+	VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	if (!CreateBuffer(device, physicalDevice, size, usage, hostVisible, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tag, allocation))
+		return false;
+	if (data)
+		memcpy(allocation.mapped, data, (size_t)size);
+	return true;
+}
+
+void CmdBufferBarrier(VkCommandBuffer cmd, VkBuffer buffer, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+	VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+{
+	VkBufferMemoryBarrier2 barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+	barrier.srcStageMask = srcStage;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstStageMask = dstStage;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = buffer;
+	barrier.size = VK_WHOLE_SIZE;
+
+	VkDependencyInfo dependency = {};
+	dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency.bufferMemoryBarrierCount = 1;
+	dependency.pBufferMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(cmd, &dependency);
+}
+
+void InvalidateBuffer(VkDevice device, const BufferAllocation &allocation)
+{
+	if (allocation.coherent || !allocation.mapped)
+		return;
+
+	VkMappedMemoryRange range = {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = allocation.memory;
+	range.size = VK_WHOLE_SIZE;
+	vkInvalidateMappedMemoryRanges(device, 1, &range);
+}
+
+bool CreateStorageSet(VkDevice device, VkDescriptorPool pool, VkShaderStageFlags stages,
+	const BufferAllocation *const *buffers, uint32_t count, VkDescriptorSetLayout &layout, VkDescriptorSet &set)
+{
+	VkDescriptorSetLayoutBinding bindings[MAX_STORAGE_SET_BINDINGS] = {};
+	for (uint32_t i = 0; i < count; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = stages;
+	}
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = count;
+	layoutInfo.pBindings = bindings;
+	if (layout == VK_NULL_HANDLE && vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+		return false;
+
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.descriptorPool = pool;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &layout;
+	if (vkAllocateDescriptorSets(device, &allocateInfo, &set) != VK_SUCCESS)
+		return false;
+
+	VkDescriptorBufferInfo bufferInfos[MAX_STORAGE_SET_BINDINGS];
+	VkWriteDescriptorSet writes[MAX_STORAGE_SET_BINDINGS] = {};
+	for (uint32_t i = 0; i < count; i++)
+	{
+		bufferInfos[i] = { buffers[i]->buffer, 0, VK_WHOLE_SIZE };
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = set;
+		writes[i].dstBinding = i;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(device, count, writes, 0, nullptr);
+	return true;
+}
+
+bool CreateImage2D(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t width, uint32_t height, VkFormat format,
+	VkImageUsageFlags usage, VkImageAspectFlags aspect, MemoryTag tag, ImageAllocation &allocation)
+{
+	VkImageCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	info.imageType = VK_IMAGE_TYPE_2D;
+	info.format = format;
+	info.extent = { width, height, 1 };
+	info.mipLevels = 1;
+	info.arrayLayers = 1;
+	info.samples = VK_SAMPLE_COUNT_1_BIT;
+	info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	info.usage = usage;
+	info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	if (vkCreateImage(device, &info, nullptr, &allocation.image) != VK_SUCCESS)
+		return false;
+
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(device, allocation.image, &requirements);
+	VkMemoryAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.allocationSize = requirements.size;
+	allocateInfo.memoryTypeIndex = FindMemoryType(physicalDevice, requirements.memoryTypeBits, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (allocateInfo.memoryTypeIndex == UINT32_MAX ||
+		MemoryTracker::AllocateDeviceMemory(device, allocateInfo, tag, &allocation.memory) != VK_SUCCESS ||
+		vkBindImageMemory(device, allocation.image, allocation.memory, 0) != VK_SUCCESS)
+	{
+		DestroyImage(device, allocation);
+		return false;
+	}
+
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = allocation.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	viewInfo.subresourceRange = { aspect, 0, 1, 0, 1 };
+	if (vkCreateImageView(device, &viewInfo, nullptr, &allocation.view) != VK_SUCCESS)
+	{
+		DestroyImage(device, allocation);
+		return false;
+	}
+	allocation.format = format;
+	allocation.width = width;
+	allocation.height = height;
+	return true;
+}
+
+void DestroyImage(VkDevice device, ImageAllocation &allocation)
+{
+	if (allocation.view != VK_NULL_HANDLE)
+		vkDestroyImageView(device, allocation.view, nullptr);
+	if (allocation.image != VK_NULL_HANDLE)
+		vkDestroyImage(device, allocation.image, nullptr);
+	MemoryTracker::FreeDeviceMemory(device, allocation.memory);
+	allocation = ImageAllocation();
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+#include "memtrack.h"
+
+const char *VkResultToString(VkResult result);
+
+// Reads a SPIR-V binary from disk. Returns false if the file is missing or is
+// not a whole number of 32-bit words.
+bool LoadSpirvFile(const std::string &path, std::vector<uint32_t> &code);
+
+// Index of a memory type allowed by typeBits that has all required flags,
+// preferring one that also has the preferred flags. UINT32_MAX if none.
+uint32_t FindMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeBits, VkMemoryPropertyFlags required,
+	VkMemoryPropertyFlags preferred = 0);
+
+struct BufferAllocation
+{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+
+	// Persistently mapped when the memory is host visible.
+	void *mapped = nullptr;
+	bool coherent = false;
+};
+
+bool CreateBuffer(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize size, VkBufferUsageFlags usage,
+	VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, MemoryTag tag, BufferAllocation &allocation);
+void DestroyBuffer(VkDevice device, BufferAllocation &allocation);
+
+// Host visible and coherent, device local when the device has such memory
+// (integrated GPUs, resizable BAR). Filled with data unless it is null.
+bool CreateFilledBuffer(VkDevice device, VkPhysicalDevice physicalDevice, const void *data, VkDeviceSize size,
+	VkBufferUsageFlags usage, MemoryTag tag, BufferAllocation &allocation);
+
+// Whole-buffer barrier on a single queue.
+void CmdBufferBarrier(VkCommandBuffer cmd, VkBuffer buffer, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+	VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess);
+
+// Makes device writes visible to the host; a no-op for coherent memory.
+void InvalidateBuffer(VkDevice device, const BufferAllocation &allocation);
+
+// A set with buffers[i] as storage buffer binding i, allocated from pool. The
+// layout is created unless it already exists, so several sets can share one.
+static const uint32_t MAX_STORAGE_SET_BINDINGS = 8;
+bool CreateStorageSet(VkDevice device, VkDescriptorPool pool, VkShaderStageFlags stages,
+	const BufferAllocation *const *buffers, uint32_t count, VkDescriptorSetLayout &layout, VkDescriptorSet &set);
+
+struct ImageAllocation
+{
+	VkImage image = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t width = 0;
+	uint32_t height = 0;
+};
+
+// Single-sampled 2D image in device-local memory with a view over the whole
+// image.
+bool CreateImage2D(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t width, uint32_t height, VkFormat format,
+	VkImageUsageFlags usage, VkImageAspectFlags aspect, MemoryTag tag, ImageAllocation &allocation);
+void DestroyImage(VkDevice device, ImageAllocation &allocation);
@@ -0,0 +1,247 @@
+#include "yuvconvert.h"
+#include <algorithm>
+#include "threadpool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define YUV_CONVERT_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define YUV_CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+// BT.709 limited range in 8.8 fixed point. The luma weights are scaled by
+// 219/255 and the chroma weights by 224/255; each chroma row sums to zero so
+// grey maps exactly to 128.
+//   Y  = (( 47 R + 157 G +  16 B + 128) >> 8) + 16
+//   Cb = ((-26 R -  87 G + 113 B + 128) >> 8) + 128
+//   Cr = ((112 R - 102 G -  10 B + 128) >> 8) + 128
+// Every intermediate fits in 16 bits, which the SIMD kernels rely on.
+static const int LUMA_R = 47, LUMA_G = 157, LUMA_B = 16;
+static const int CB_R = -26, CB_G = -87, CB_B = 113;
+static const int CR_R = 112, CR_G = -102, CR_B = -10;
+
+Yuv420Layout GetYuv420Layout(uint32_t width, uint32_t height)
+{
+	Yuv420Layout layout;
+	layout.width = width;
+	layout.height = height;
+	layout.chromaWidth = (width + 1) / 2;
+	layout.chromaHeight = (height + 1) / 2;
+	layout.lumaSize = (size_t)width * height;
+	layout.chromaSize = (size_t)layout.chromaWidth * layout.chromaHeight;
+	return layout;
+}
+
+static inline uint8_t Luma(const uint8_t *pixel)
+{
+	return (uint8_t)(((LUMA_R * pixel[0] + LUMA_G * pixel[1] + LUMA_B * pixel[2] + 128) >> 8) + 16);
+}
+
+// Right shifts of negative values are arithmetic on every target we build for,
+// matching the SIMD kernels.
+static inline uint8_t Chroma(int r, int g, int b, int kr, int kg, int kb)
+{
+	return (uint8_t)(((kr * r + kg * g + kb * b + 128) >> 8) + 128);
+}
+
+// Converts pixels from xBegin (even) to the end of a pair of rows. row1 equals
+// row0 and y1 is null for the last row of an odd height image; the last column
+// of an odd width image is likewise paired with itself.
+static void ConvertRowPairScalar(const uint8_t *row0, const uint8_t *row1, uint32_t width, uint32_t xBegin,
+	uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+	for (uint32_t x = xBegin; x < width; x += 2)
+	{
+		uint32_t x1 = std::min(x + 1, width - 1);
+		const uint8_t *a = row0 + x * 4, *b = row0 + x1 * 4;
+		const uint8_t *c = row1 + x * 4, *d = row1 + x1 * 4;
+		y0[x] = Luma(a);
+		y0[x1] = Luma(b);
+		if (y1)
+		{
+			y1[x] = Luma(c);
+			y1[x1] = Luma(d);
+		}
+		int r = (a[0] + b[0] + c[0] + d[0] + 2) >> 2;
+		int g = (a[1] + b[1] + c[1] + d[1] + 2) >> 2;
+		int bl = (a[2] + b[2] + c[2] + d[2] + 2) >> 2;
+		cb[x / 2] = Chroma(r, g, bl, CB_R, CB_G, CB_B);
+		cr[x / 2] = Chroma(r, g, bl, CR_R, CR_G, CR_B);
+	}
+}
+
+#if YUV_CONVERT_SSE2
+
+// Eight pixels to three vectors of 16-bit channel values.
+static inline void SplitRgb(const uint8_t *pixels, __m128i &r, __m128i &g, __m128i &b)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	__m128i lo = _mm_loadu_si128((const __m128i *)pixels);
+	__m128i hi = _mm_loadu_si128((const __m128i *)(pixels + 16));
+	r = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+	g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask), _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+	b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask), _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+}
+
+// The weighted sum peaks at 56228, so unsigned 16-bit lanes cannot wrap.
+static inline __m128i Luma8(__m128i r, __m128i g, __m128i b)
+{
+	__m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(LUMA_R)), _mm_mullo_epi16(g, _mm_set1_epi16(LUMA_G)));
+	sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(LUMA_B)), _mm_set1_epi16(128)));
+	return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+}
+
+// Averaged channels are 0-255, so the signed sums stay within +-28943.
+static inline __m128i Chroma8(__m128i r, __m128i g, __m128i b, int kr, int kg, int kb)
+{
+	__m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16((short)kr)), _mm_mullo_epi16(g, _mm_set1_epi16((short)kg)));
+	sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16((short)kb)), _mm_set1_epi16(128)));
+	return _mm_add_epi16(_mm_srai_epi16(sum, 8), _mm_set1_epi16(128));
+}
+
+// Sums horizontal pairs of two rows of eight values into four 32-bit lanes.
+static inline __m128i PairSum(__m128i row0, __m128i row1)
+{
+	return _mm_madd_epi16(_mm_add_epi16(row0, row1), _mm_set1_epi16(1));
+}
+
+// 16 pixels from each of two rows: 32 luma and 8 of each chroma samples.
+static inline void ConvertBlock16(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+	__m128i r0a, g0a, b0a, r0b, g0b, b0b, r1a, g1a, b1a, r1b, g1b, b1b;
+	SplitRgb(row0, r0a, g0a, b0a);
+	SplitRgb(row0 + 32, r0b, g0b, b0b);
+	SplitRgb(row1, r1a, g1a, b1a);
+	SplitRgb(row1 + 32, r1b, g1b, b1b);
+
+	_mm_storeu_si128((__m128i *)y0, _mm_packus_epi16(Luma8(r0a, g0a, b0a), Luma8(r0b, g0b, b0b)));
+	_mm_storeu_si128((__m128i *)y1, _mm_packus_epi16(Luma8(r1a, g1a, b1a), Luma8(r1b, g1b, b1b)));
+
+	const __m128i two = _mm_set1_epi16(2);
+	__m128i r = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(PairSum(r0a, r1a), PairSum(r0b, r1b)), two), 2);
+	__m128i g = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(PairSum(g0a, g1a), PairSum(g0b, g1b)), two), 2);
+	__m128i b = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(PairSum(b0a, b1a), PairSum(b0b, b1b)), two), 2);
+	_mm_storel_epi64((__m128i *)cb, _mm_packus_epi16(Chroma8(r, g, b, CB_R, CB_G, CB_B), _mm_setzero_si128()));
+	_mm_storel_epi64((__m128i *)cr, _mm_packus_epi16(Chroma8(r, g, b, CR_R, CR_G, CR_B), _mm_setzero_si128()));
+}
+
+#elif YUV_CONVERT_NEON
+
+static inline uint8x8_t Luma8(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+{
+	uint16x8_t sum = vmull_u8(r, vdup_n_u8(LUMA_R));
+	sum = vmlal_u8(sum, g, vdup_n_u8(LUMA_G));
+	sum = vmlal_u8(sum, b, vdup_n_u8(LUMA_B));
+	return vadd_u8(vrshrn_n_u16(sum, 8), vdup_n_u8(16));
+}
+
+static inline uint8x8_t Chroma8(int16x8_t r, int16x8_t g, int16x8_t b, int kr, int kg, int kb)
+{
+	int16x8_t sum = vmulq_n_s16(r, (int16_t)kr);
+	sum = vmlaq_n_s16(sum, g, (int16_t)kg);
+	sum = vmlaq_n_s16(sum, b, (int16_t)kb);
+	return vqmovun_s16(vaddq_s16(vrshrq_n_s16(sum, 8), vdupq_n_s16(128)));
+}
+
+// Rounded 2x2 average of one channel across two rows of 16 pixels.
+static inline int16x8_t Average2x2(uint8x16_t row0, uint8x16_t row1)
+{
+	return vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(row0), row1), 2));
+}
+
+static inline void ConvertBlock16(const uint8_t *row0, const uint8_t *row1, uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+	uint8x16x4_t p0 = vld4q_u8(row0);
+	uint8x16x4_t p1 = vld4q_u8(row1);
+
+	vst1q_u8(y0, vcombine_u8(Luma8(vget_low_u8(p0.val[0]), vget_low_u8(p0.val[1]), vget_low_u8(p0.val[2])),
+		Luma8(vget_high_u8(p0.val[0]), vget_high_u8(p0.val[1]), vget_high_u8(p0.val[2]))));
+	vst1q_u8(y1, vcombine_u8(Luma8(vget_low_u8(p1.val[0]), vget_low_u8(p1.val[1]), vget_low_u8(p1.val[2])),
+		Luma8(vget_high_u8(p1.val[0]), vget_high_u8(p1.val[1]), vget_high_u8(p1.val[2]))));
+
+	int16x8_t r = Average2x2(p0.val[0], p1.val[0]);
+	int16x8_t g = Average2x2(p0.val[1], p1.val[1]);
+	int16x8_t b = Average2x2(p0.val[2], p1.val[2]);
+	vst1_u8(cb, Chroma8(r, g, b, CB_R, CB_G, CB_B));
+	vst1_u8(cr, Chroma8(r, g, b, CR_R, CR_G, CR_B));
+}
+
+#endif
+
+static void ConvertRows(const uint8_t *rgba, uint32_t width, uint32_t height, uint8_t *yuv, uint32_t rowBegin,
+	uint32_t rowEnd, bool simd)
+{
+	Yuv420Layout layout = GetYuv420Layout(width, height);
+	uint8_t *lumaPlane = yuv;
+	uint8_t *cbPlane = yuv + layout.lumaSize;
+	uint8_t *crPlane = cbPlane + layout.chromaSize;
+	size_t stride = (size_t)width * 4;
+	rowEnd = std::min(rowEnd, height);
+
+	for (uint32_t y = rowBegin; y < rowEnd; y += 2)
+	{
+		bool pair = y + 1 < height;
+		const uint8_t *row0 = rgba + y * stride;
+		const uint8_t *row1 = pair ? row0 + stride : row0;
+		uint8_t *y0 = lumaPlane + (size_t)y * width;
+		uint8_t *y1 = pair ? y0 + width : nullptr;
+		uint8_t *cb = cbPlane + (size_t)(y / 2) * layout.chromaWidth;
+		uint8_t *cr = crPlane + (size_t)(y / 2) * layout.chromaWidth;
+
+		uint32_t x = 0;
+#if YUV_CONVERT_SSE2 || YUV_CONVERT_NEON
+		if (simd && pair)
+		{
+			for (; x + 16 <= width; x += 16)
+				ConvertBlock16(row0 + x * 4, row1 + x * 4, y0 + x, y1 + x, cb + x / 2, cr + x / 2);
+		}
+#else
+		(void)simd;
+#endif
+		ConvertRowPairScalar(row0, row1, width, x, y0, y1, cb, cr);
+	}
+}
+
+void ConvertRgbaToYuv420Rows(const uint8_t *rgba, uint32_t width, uint32_t height, uint8_t *yuv,
+	uint32_t rowBegin, uint32_t rowEnd)
+{
+	ConvertRows(rgba, width, height, yuv, rowBegin, rowEnd, true);
+}
+
+void ConvertRgbaToYuv420Reference(const uint8_t *rgba, uint32_t width, uint32_t height, uint8_t *yuv)
+{
+	ConvertRows(rgba, width, height, yuv, 0, height, false);
+}
+
+void ConvertRgbaToYuv420(const uint8_t *rgba, uint32_t width, uint32_t height, uint8_t *yuv, ThreadPool *pool,
+	uint32_t bandCount)
+{
+	if (!pool)
+	{
+		ConvertRows(rgba, width, height, yuv, 0, height, true);
+		return;
+	}
+
+	if (bandCount == 0)
+		bandCount = pool->GetWorkerCount();
+	uint32_t rowPairs = (height + 1) / 2;
+	bandCount = std::max(1u, std::min(bandCount, rowPairs));
+	uint32_t rowsPerBand = (rowPairs + bandCount - 1) / bandCount * 2;
+
+	pool->Run(bandCount, [&](unsigned i)
+	{
+		ConvertRows(rgba, width, height, yuv, i * rowsPerBand, (i + 1) * rowsPerBand, true);
+	});
+}
+
+const char *GetYuvConvertKernelName()
+{
+#if YUV_CONVERT_SSE2
+	return "sse2";
+#elif YUV_CONVERT_NEON
+	return "neon";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+class ThreadPool;
+
+// Planar 4:2:0 frame as Y4M and raw .yuv consumers expect it: the full
+// resolution Y plane, then the Cb and Cr planes at half width and height.
+struct Yuv420Layout
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t chromaWidth;
+	uint32_t chromaHeight;
+	size_t lumaSize;
+	size_t chromaSize;
+
+	size_t GetFrameSize() const { return lumaSize + 2 * chromaSize; }
+};
+
+Yuv420Layout GetYuv420Layout(uint32_t width, uint32_t height);
+
+// Converts tightly packed 8-bit RGBA to BT.709 limited range YUV 4:2:0. Each
+// chroma sample is the rounded average of its 2x2 block (centred siting);
+// alpha is ignored. Uses SSE2 or NEON where available, with results identical
+// to the reference version.
+//
+// The Rows variant converts [rowBegin, rowEnd) only; rowBegin must be even.
+void ConvertRgbaToYuv420Rows(const uint8_t *rgba, uint32_t width, uint32_t height, uint8_t *yuv,
+	uint32_t rowBegin, uint32_t rowEnd);
+
+// With a pool the image is split into bandCount bands converted on its workers
+// through ThreadPool::Run; bandCount 0 picks one per worker.
+void ConvertRgbaToYuv420(const uint8_t *rgba, uint32_t width, uint32_t height, uint8_t *yuv,
+	ThreadPool *pool = nullptr, uint32_t bandCount = 0);
+
+// Plain C++ version, for checking and measuring the SIMD path.
+void ConvertRgbaToYuv420Reference(const uint8_t *rgba, uint32_t width, uint32_t height, uint8_t *yuv);
+
+// "sse2", "neon" or "scalar".
+const char *GetYuvConvertKernelName();